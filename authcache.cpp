@@ -0,0 +1,131 @@
+#include "authcache.h"
+#include <QMessageAuthenticationCode>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+
+AuthCache::AuthCache(int maxEntries, int ttlMs, int negativeTtlMs, int maxFailures) :
+    m_maxEntries(maxEntries),
+    m_ttlMs(ttlMs),
+    m_negativeTtlMs(negativeTtlMs),
+    m_maxFailures(maxFailures),
+    m_generation(0),
+    m_hits(0),
+    m_misses(0),
+    m_throttled(0)
+{
+    // Секрет живет только в памяти процесса: по дампу ключей пароль не подобрать
+    m_secret.resize(32);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(m_secret.data()),
+                                          m_secret.size() / int(sizeof(quint32)));
+    m_clock.start();
+}
+
+QByteArray AuthCache::key(const QByteArray &authorization) const
+{
+    return QMessageAuthenticationCode::hash(authorization, m_secret, QCryptographicHash::Sha256);
+}
+
+QByteArray AuthCache::key(const QString &username, const QString &password) const
+{
+    return key("Basic " + (username + ":" + password).toUtf8().toBase64());
+}
+
+QByteArray AuthCache::userKey(const QString &username) const
+{
+    return QMessageAuthenticationCode::hash("user:" + username.toUtf8(), m_secret, QCryptographicHash::Sha256);
+}
+
+AuthCache::Result AuthCache::lookup(const QByteArray &key)
+{
+    if (!isEnabled()) return Result::Miss;
+
+    qint64 now = m_clock.elapsed();
+    QMutexLocker locker(&m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        if (it->expiresAt > now) {
+            m_lru.splice(m_lru.begin(), m_lru, it->lruPos);
+            ++m_hits;
+            return it->allowed ? Result::Allowed : Result::Denied;
+        }
+        removeLocked(key);
+    }
+
+    ++m_misses;
+    return Result::Miss;
+}
+
+bool AuthCache::isThrottled(const QString &username)
+{
+    if (!isEnabled() || m_maxFailures <= 0) return false;
+
+    qint64 now = m_clock.elapsed();
+    QMutexLocker locker(&m_mutex);
+    if (m_failures.isEmpty()) return false;
+
+    auto it = m_failures.find(userKey(username));
+    if (it == m_failures.end()) return false;
+    if (it->windowEnd <= now) {
+        m_failures.erase(it);
+        return false;
+    }
+    if (it->count < m_maxFailures) return false;
+
+    ++m_throttled;
+    return true;
+}
+
+void AuthCache::insert(const QByteArray &key, const QString &username, bool allowed, quint64 generation)
+{
+    if (!isEnabled()) return;
+
+    qint64 now = m_clock.elapsed();
+    QMutexLocker locker(&m_mutex);
+    if (generation != m_generation.load()) return;
+
+    removeLocked(key);
+    while (!m_lru.empty() && m_entries.size() >= m_maxEntries)
+        removeLocked(m_lru.back());
+
+    m_lru.push_front(key);
+    Slot slot;
+    slot.allowed = allowed;
+    slot.expiresAt = now + (allowed ? m_ttlMs : m_negativeTtlMs);
+    slot.lruPos = m_lru.begin();
+    m_entries.insert(key, slot);
+
+    if (m_maxFailures <= 0) return;
+    QByteArray user = userKey(username);
+    if (allowed) {
+        m_failures.remove(user);
+        return;
+    }
+
+    // Счетчики неудач тоже ограничены: при переполнении начинаем заново
+    if (m_failures.size() >= m_maxEntries && !m_failures.contains(user))
+        m_failures.clear();
+    Failures &failures = m_failures[user];
+    if (failures.windowEnd <= now) {
+        failures.count = 0;
+        failures.windowEnd = now + m_negativeTtlMs;
+    }
+    ++failures.count;
+}
+
+void AuthCache::invalidateAll()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_generation;
+    m_entries.clear();
+    m_lru.clear();
+    m_failures.clear();
+}
+
+void AuthCache::removeLocked(const QByteArray &key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) return;
+    m_lru.erase(it->lruPos);
+    m_entries.erase(it);
+}
@@ -0,0 +1,85 @@
+#ifndef AUTHCACHE_H
+#define AUTHCACHE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <list>
+
+// Кеш результатов проверки Basic-авторизации.
+// Ключ - HMAC-SHA256 значения Authorization с секретом процесса,
+// пароли и сами заголовки не хранятся. Помнит и успешные, и неудачные
+// проверки; после maxFailures неудач подряд на одно имя пользователя
+// новые пароли для него отклоняются без запроса в БД до конца окна.
+class AuthCache
+{
+public:
+    enum class Result {
+        Miss,       // надо идти в БД
+        Allowed,
+        Denied
+    };
+
+    AuthCache(int maxEntries, int ttlMs, int negativeTtlMs, int maxFailures);
+
+    // Ключ для значения заголовка Authorization
+    QByteArray key(const QByteArray &authorization) const;
+    // Ключ для пары логин/пароль - тот же, что у соответствующего Basic-заголовка
+    QByteArray key(const QString &username, const QString &password) const;
+
+    Result lookup(const QByteArray &key);
+    // Для имени слишком много неудач подряд - не проверять новые пароли
+    bool isThrottled(const QString &username);
+
+    // Поколение кеша: снять до запроса в БД и передать в insert,
+    // чтобы результат, полученный до invalidateAll, не попал в кеш
+    quint64 generation() const { return m_generation.load(); }
+    void insert(const QByteArray &key, const QString &username, bool allowed, quint64 generation);
+
+    // Таблица users изменилась
+    void invalidateAll();
+
+    bool isEnabled() const { return m_maxEntries > 0; }
+    quint64 hits() const { return m_hits.load(); }
+    quint64 misses() const { return m_misses.load(); }
+    quint64 throttled() const { return m_throttled.load(); }
+
+private:
+    QByteArray userKey(const QString &username) const;
+    void removeLocked(const QByteArray &key);
+
+    struct Slot
+    {
+        bool allowed;
+        qint64 expiresAt;
+        std::list<QByteArray>::iterator lruPos;
+    };
+
+    struct Failures
+    {
+        int count;
+        qint64 windowEnd;
+    };
+
+    int m_maxEntries;
+    int m_ttlMs;
+    int m_negativeTtlMs;
+    int m_maxFailures;
+    QByteArray m_secret;
+
+    QMutex m_mutex;
+    QHash<QByteArray, Slot> m_entries;
+    std::list<QByteArray> m_lru; // в начале - недавно использованные
+    QHash<QByteArray, Failures> m_failures; // по HMAC имени пользователя
+    QElapsedTimer m_clock;
+
+    std::atomic<quint64> m_generation;
+    std::atomic<quint64> m_hits;
+    std::atomic<quint64> m_misses;
+    std::atomic<quint64> m_throttled;
+};
+
+#endif // AUTHCACHE_H
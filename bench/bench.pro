@@ -0,0 +1,24 @@
+# Бенчмарки сервера: микробенчмарки горячих путей и генератор нагрузки.
+# Сборка: qmake bench/bench.pro && make (или "make bench" в корне после qmake)
+
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = server-bench
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# Код сервера без его main.cpp - бенчмарки могут поднять сервер в своем процессе
+include(../server.pri)
+
+SOURCES += \
+        loadgenerator.cpp \
+        main.cpp \
+        microbench.cpp
+
+HEADERS += \
+    loadgenerator.h \
+    microbench.h
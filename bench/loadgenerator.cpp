@@ -0,0 +1,380 @@
+#include "loadgenerator.h"
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace {
+
+// Сколько запросов держим в одном соединении при открытом цикле
+// (сервер разбирает не больше 16 конвейерных запросов)
+const size_t MaxInFlight = 16;
+// Сколько ждем ответы на уже отправленные запросы после окончания прогона
+const qint64 DrainTimeoutNs = 5LL * 1000 * 1000 * 1000;
+
+qint64 percentile(const std::vector<qint64> &sorted, double q)
+{
+    if (sorted.empty()) return 0;
+    size_t index = size_t(std::ceil(q * double(sorted.size())));
+    if (index > 0) --index;
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+}
+
+void LoadResult::merge(const LoadResult &other)
+{
+    requests += other.requests;
+    errors += other.errors;
+    bytes += other.bytes;
+    elapsedSec = std::max(elapsedSec, other.elapsedSec);
+    latenciesUs.insert(latenciesUs.end(), other.latenciesUs.begin(), other.latenciesUs.end());
+    for (auto it = other.statuses.begin(); it != other.statuses.end(); ++it)
+        statuses[it.key()] += it.value();
+}
+
+QJsonObject LoadResult::toJson(const LoadOptions &options) const
+{
+    std::vector<qint64> sorted = latenciesUs;
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean = 0;
+    for (qint64 latency : sorted) mean += double(latency);
+    if (!sorted.empty()) mean /= double(sorted.size());
+
+    QJsonObject latency;
+    latency["mean"] = mean;
+    latency["p50"] = double(percentile(sorted, 0.50));
+    latency["p90"] = double(percentile(sorted, 0.90));
+    latency["p99"] = double(percentile(sorted, 0.99));
+    latency["p999"] = double(percentile(sorted, 0.999));
+    latency["max"] = double(sorted.empty() ? 0 : sorted.back());
+
+    QJsonObject statusCounts;
+    for (auto it = statuses.begin(); it != statuses.end(); ++it)
+        statusCounts[QString::number(it.key())] = double(it.value());
+
+    QJsonObject json;
+    json["name"] = options.name;
+    json["method"] = QString::fromLatin1(options.method);
+    json["path"] = QString::fromUtf8(options.path);
+    json["mode"] = options.rate > 0 ? "open" : "closed";
+    json["target_rate"] = options.rate;
+    json["connections"] = options.connections;
+    json["threads"] = options.threads;
+    json["duration_sec"] = elapsedSec;
+    json["requests"] = double(requests);
+    json["errors"] = double(errors);
+    json["rps"] = elapsedSec > 0 ? double(requests) / elapsedSec : 0;
+    json["bytes"] = double(bytes);
+    json["latency_us"] = latency;
+    json["statuses"] = statusCounts;
+    return json;
+}
+
+LoadGenerator::LoadGenerator(const LoadOptions &options, QObject *parent) :
+    QObject(parent),
+    m_options(options),
+    m_ticker(new QTimer(this)),
+    m_loop(nullptr),
+    m_measureFrom(qint64(options.warmupSec) * 1000000000LL),
+    m_stopAt(qint64(options.warmupSec + options.durationSec) * 1000000000LL),
+    m_scheduled(0),
+    m_stopping(false)
+{
+    m_request = m_options.method + " " + m_options.path + " HTTP/1.1\r\n"
+        "Host: " + m_options.host.toLatin1() + ":" + QByteArray::number(m_options.port) + "\r\n"
+        "User-Agent: server-bench\r\n"
+        + m_options.extraHeaders;
+    if (!m_options.body.isEmpty())
+        m_request += "Content-Length: " + QByteArray::number(m_options.body.size()) + "\r\n";
+    m_request += "\r\n" + m_options.body;
+
+    m_ticker->setTimerType(Qt::PreciseTimer);
+    m_ticker->setInterval(1);
+    connect(m_ticker, &QTimer::timeout, this, &LoadGenerator::tick);
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    for (Client *client : m_clients)
+        delete client;
+}
+
+LoadResult LoadGenerator::run()
+{
+    QEventLoop loop;
+    m_loop = &loop;
+    m_clock.start();
+
+    for (int i = 0; i < std::max(1, m_options.connections); ++i) {
+        Client *client = new Client;
+        m_clients.push_back(client);
+        connectClient(client);
+    }
+    m_ticker->start();
+    loop.exec();
+
+    m_ticker->stop();
+    for (Client *client : m_clients) {
+        if (!client->socket) continue;
+        client->socket->disconnect(this);
+        client->socket->abort();
+    }
+    m_result.elapsedSec = m_options.durationSec;
+    m_loop = nullptr;
+    return m_result;
+}
+
+void LoadGenerator::connectClient(Client *client)
+{
+    client->buffer.clear();
+    client->connected = false;
+    QTcpSocket *socket = new QTcpSocket(this);
+    client->socket = socket;
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    connect(socket, &QTcpSocket::connected, this, [this, client]() {
+        client->connected = true;
+        if (m_stopping) return;
+        if (m_options.rate <= 0) {
+            send(client, m_clock.nsecsElapsed());
+        } else {
+            while (!m_backlog.empty() && client->inFlight.size() < MaxInFlight) {
+                send(client, m_backlog.front());
+                m_backlog.pop_front();
+            }
+        }
+    });
+    connect(socket, &QTcpSocket::readyRead, this, [this, client]() { onReadyRead(client); });
+    // Ошибка и disconnected могут прийти оба - обрабатываем первое для текущего сокета
+    connect(socket, &QTcpSocket::disconnected, this, [this, client, socket]() {
+        if (client->socket == socket) onDisconnected(client);
+    });
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this,
+            [this, client, socket](QAbstractSocket::SocketError error) {
+        if (client->socket == socket && error != QAbstractSocket::RemoteHostClosedError)
+            onDisconnected(client);
+    });
+    socket->connectToHost(m_options.host, m_options.port);
+}
+
+void LoadGenerator::send(Client *client, qint64 scheduledAt)
+{
+    client->inFlight.push_back(scheduledAt);
+    client->socket->write(m_request);
+}
+
+void LoadGenerator::onReadyRead(Client *client)
+{
+    client->buffer.append(client->socket->readAll());
+    for (;;) {
+        int status = 0;
+        bool closeDelimited = false;
+        int size = parseResponse(client->buffer, status, closeDelimited);
+        if (size == 0) return;
+        if (size < 0 || client->inFlight.empty()) {
+            // Битый ответ - дальше поток не разобрать, начинаем соединение заново
+            client->socket->abort();
+            return;
+        }
+        client->buffer.remove(0, size);
+        complete(client, status, size);
+    }
+}
+
+void LoadGenerator::onDisconnected(Client *client)
+{
+    bool wasConnected = client->connected;
+    client->connected = false;
+
+    // Ответ без длины заканчивается закрытием соединения
+    int status = 0;
+    bool closeDelimited = false;
+    if (parseResponse(client->buffer, status, closeDelimited) == 0 && closeDelimited && !client->inFlight.empty())
+        complete(client, status, client->buffer.size());
+    fail(client);
+
+    // Сервер закрыл keep-alive - переподключаемся сразу, не смогли подключиться - с паузой
+    client->socket->disconnect(this);
+    client->socket->deleteLater();
+    client->socket = nullptr;
+    if (!m_stopping) {
+        if (wasConnected) {
+            connectClient(client);
+        } else {
+            QTimer::singleShot(100, this, [this, client]() {
+                if (!m_stopping) connectClient(client);
+            });
+        }
+    }
+    finishIfDone();
+}
+
+void LoadGenerator::complete(Client *client, int status, qint64 size)
+{
+    qint64 now = m_clock.nsecsElapsed();
+    qint64 scheduledAt = client->inFlight.front();
+    client->inFlight.pop_front();
+
+    if (scheduledAt >= m_measureFrom && scheduledAt < m_stopAt) {
+        ++m_result.requests;
+        m_result.bytes += size;
+        ++m_result.statuses[status];
+        if (status >= 500) ++m_result.errors;
+        m_result.latenciesUs.push_back((now - scheduledAt) / 1000);
+    }
+
+    if (!m_stopping && client->connected) {
+        if (m_options.rate <= 0) {
+            send(client, now);
+        } else if (!m_backlog.empty()) {
+            send(client, m_backlog.front());
+            m_backlog.pop_front();
+        }
+    }
+    finishIfDone();
+}
+
+void LoadGenerator::fail(Client *client)
+{
+    for (qint64 scheduledAt : client->inFlight) {
+        if (scheduledAt >= m_measureFrom && scheduledAt < m_stopAt)
+            ++m_result.errors;
+    }
+    client->inFlight.clear();
+    client->buffer.clear();
+}
+
+void LoadGenerator::tick()
+{
+    qint64 now = m_clock.nsecsElapsed();
+    if (now >= m_stopAt) {
+        m_stopping = true;
+        // Не дождались - считаем оставшиеся ошибками
+        if (now >= m_stopAt + DrainTimeoutNs) {
+            for (Client *client : m_clients) fail(client);
+            m_backlog.clear();
+        }
+        finishIfDone();
+        return;
+    }
+
+    if (m_options.rate <= 0) return;
+
+    // Назначаем все запросы, чье время пришло, на самые свободные соединения
+    double intervalNs = 1e9 / m_options.rate;
+    while (qint64(double(m_scheduled) * intervalNs) <= now) {
+        qint64 scheduledAt = qint64(double(m_scheduled++) * intervalNs);
+        Client *best = nullptr;
+        for (Client *client : m_clients) {
+            if (!client->connected) continue;
+            if (client->inFlight.size() >= MaxInFlight) continue;
+            if (!best || client->inFlight.size() < best->inFlight.size())
+                best = client;
+        }
+        if (best)
+            send(best, scheduledAt);
+        else
+            m_backlog.push_back(scheduledAt);
+    }
+}
+
+void LoadGenerator::finishIfDone()
+{
+    if (!m_stopping || !m_loop) return;
+    if (!m_backlog.empty() && m_clock.nsecsElapsed() < m_stopAt + DrainTimeoutNs) return;
+    for (Client *client : m_clients) {
+        if (!client->inFlight.empty()) return;
+    }
+    // Назначенные, но не отправленные запросы - это тоже задержка, которую увидел бы клиент
+    for (qint64 scheduledAt : m_backlog) {
+        if (scheduledAt >= m_measureFrom && scheduledAt < m_stopAt)
+            ++m_result.errors;
+    }
+    m_backlog.clear();
+    m_loop->quit();
+}
+
+int LoadGenerator::parseResponse(const QByteArray &buffer, int &status, bool &closeDelimited)
+{
+    closeDelimited = false;
+    int headEnd = buffer.indexOf("\r\n\r\n");
+    if (headEnd == -1) return 0;
+    if (!buffer.startsWith("HTTP/1.")) return -1;
+
+    status = buffer.mid(9, 3).toInt();
+    int bodyStart = headEnd + 4;
+    if (status < 200 || status == 204 || status == 304)
+        return bodyStart;
+
+    QByteArray head = buffer.left(headEnd + 2).toLower();
+    int lengthPos = head.indexOf("\r\ncontent-length:");
+    if (lengthPos != -1) {
+        int lineEnd = head.indexOf("\r\n", lengthPos + 2);
+        bool ok = false;
+        qint64 length = head.mid(lengthPos + 17, lineEnd - lengthPos - 17).trimmed().toLongLong(&ok);
+        if (!ok) return -1;
+        return buffer.size() >= bodyStart + length ? int(bodyStart + length) : 0;
+    }
+
+    if (head.contains("\r\ntransfer-encoding: chunked")) {
+        int pos = bodyStart;
+        for (;;) {
+            int lineEnd = buffer.indexOf("\r\n", pos);
+            if (lineEnd == -1) return 0;
+            bool ok = false;
+            QByteArray sizeField = buffer.mid(pos, lineEnd - pos);
+            int semicolon = sizeField.indexOf(';');
+            if (semicolon != -1) sizeField.truncate(semicolon);
+            int size = sizeField.trimmed().toInt(&ok, 16);
+            if (!ok) return -1;
+            if (size == 0) {
+                // Трейлеры не ждем, сервер их не шлет
+                return buffer.size() >= lineEnd + 4 ? lineEnd + 4 : 0;
+            }
+            pos = lineEnd + 2 + size + 2;
+            if (buffer.size() < pos) return 0;
+        }
+    }
+
+    closeDelimited = true;
+    return 0;
+}
+
+LoadResult runLoad(const LoadOptions &options)
+{
+    int threads = std::max(1, std::min(options.threads, options.connections));
+    std::vector<LoadResult> results(size_t(threads), LoadResult());
+    std::vector<std::unique_ptr<QThread>> workers;
+
+    QEventLoop loop;
+    int running = threads;
+    for (int i = 0; i < threads; ++i) {
+        LoadOptions part = options;
+        part.connections = options.connections / threads + (i < options.connections % threads ? 1 : 0);
+        part.rate = options.rate / threads;
+
+        LoadResult *result = &results[size_t(i)];
+        workers.emplace_back(QThread::create([part, result]() {
+            LoadGenerator generator(part);
+            *result = generator.run();
+        }));
+        QObject::connect(workers.back().get(), &QThread::finished, &loop, [&]() {
+            if (--running == 0) loop.quit();
+        }, Qt::QueuedConnection);
+        workers.back()->start();
+    }
+    loop.exec();
+
+    LoadResult total;
+    for (const LoadResult &result : results)
+        total.merge(result);
+    for (auto &worker : workers)
+        worker->wait();
+    return total;
+}
@@ -0,0 +1,101 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <deque>
+#include <vector>
+
+class QEventLoop;
+class QTcpSocket;
+class QTimer;
+
+struct LoadOptions
+{
+    QString name;                  // имя сценария в отчете
+    QString host = "127.0.0.1";
+    quint16 port = 8080;
+    QByteArray method = "GET";
+    QByteArray path = "/";
+    QByteArray body;
+    QByteArray extraHeaders;       // готовые строки "Name: value\r\n"
+    int connections = 16;
+    int threads = 1;
+    int durationSec = 10;
+    int warmupSec = 2;             // результаты прогрева не учитываются
+    double rate = 0;               // 0 - закрытый цикл, иначе запросов/с (открытый)
+};
+
+// Итог прогона. Задержки хранятся целиком - для p999 нужны все замеры
+struct LoadResult
+{
+    qint64 requests = 0;
+    qint64 errors = 0;             // обрывы и ответы 5xx
+    qint64 bytes = 0;
+    double elapsedSec = 0;
+    std::vector<qint64> latenciesUs;
+    QMap<int, qint64> statuses;
+
+    void merge(const LoadResult &other);
+    QJsonObject toJson(const LoadOptions &options) const;
+};
+
+// Генератор нагрузки на одном потоке: connections keep-alive соединений.
+// Закрытый цикл - каждое соединение шлет следующий запрос после ответа.
+// Открытый цикл - запросы назначаются по расписанию с частотой rate,
+// задержка считается от назначенного времени, а не от фактической
+// отправки, чтобы перегруженный сервер не прятал очередь (coordinated omission)
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LoadGenerator(const LoadOptions &options, QObject *parent = nullptr);
+    ~LoadGenerator();
+
+    // Блокирует поток до конца прогона, крутя свой цикл событий
+    LoadResult run();
+
+private:
+    struct Client
+    {
+        QTcpSocket *socket = nullptr;
+        bool connected = false;
+        QByteArray buffer;
+        std::deque<qint64> inFlight;   // время (нс), от которого считать задержку
+    };
+
+    // Размер разобранного ответа, 0 - ответ еще не пришел, -1 - ошибка
+    static int parseResponse(const QByteArray &buffer, int &status, bool &closeDelimited);
+
+    void connectClient(Client *client);
+    void send(Client *client, qint64 scheduledAt);
+    void onReadyRead(Client *client);
+    void onDisconnected(Client *client);
+    void complete(Client *client, int status, qint64 size);
+    void fail(Client *client);
+    void tick();
+    void finishIfDone();
+
+    LoadOptions m_options;
+    QByteArray m_request;
+    std::vector<Client *> m_clients;
+    std::deque<qint64> m_backlog;      // открытый цикл: назначены, но некуда отправить
+    QElapsedTimer m_clock;
+    QTimer *m_ticker;
+    QEventLoop *m_loop;
+    qint64 m_measureFrom;
+    qint64 m_stopAt;
+    qint64 m_scheduled;
+    bool m_stopping;
+    LoadResult m_result;
+};
+
+// Прогон в options.threads потоках; вызывающий поток крутит цикл событий
+// (в нем может работать сервер, запущенный в том же процессе)
+LoadResult runLoad(const LoadOptions &options);
+
+#endif // LOADGENERATOR_H
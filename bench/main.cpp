@@ -0,0 +1,140 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include "httpserver.h"
+#include "loadgenerator.h"
+#include "microbench.h"
+#include <memory>
+#include <vector>
+
+// Сценарии нагрузки по умолчанию: пути из www и /api/db из init_db.sql
+static LoadOptions scenario(const QString &name, const LoadOptions &base)
+{
+    LoadOptions options = base;
+    options.name = name;
+    if (name == "static") options.path = "/index.html";
+    else if (name == "db") options.path = "/api/db/users?_limit=10";
+    else if (name == "php") options.path = "/api_example.php";
+    return options;
+}
+
+static void printLoad(const QJsonObject &result)
+{
+    QJsonObject latency = result["latency_us"].toObject();
+    QTextStream(stdout) << QString("%1 %2 rps  p50 %3 us  p99 %4 us  p999 %5 us  errors %6\n")
+        .arg(result["name"].toString(), -10)
+        .arg(result["rps"].toDouble(), 10, 'f', 0)
+        .arg(latency["p50"].toDouble(), 8, 'f', 0)
+        .arg(latency["p99"].toDouble(), 8, 'f', 0)
+        .arg(latency["p999"].toDouble(), 8, 'f', 0)
+        .arg(result["errors"].toDouble(), 0, 'f', 0);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("server-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Микробенчмарки и нагрузочные тесты simple-http-server");
+    parser.addHelpOption();
+    parser.addPositionalArgument("mode", "micro, load или all (по умолчанию all)");
+    parser.addOptions({
+        { "output", "Записать результаты в JSON-файл", "file" },
+        { "min-time-ms", "Время на один микробенчмарк", "ms", "500" },
+        { "filter", "Только микробенчмарки, чье имя содержит строку", "text" },
+        { "db", "Строка подключения к Postgres для замеров по pqxx::result", "conninfo" },
+        { "host", "Адрес сервера", "host", "127.0.0.1" },
+        { "port", "Порт сервера", "port", "8080" },
+        { "start-server", "Поднять сервер в этом же процессе (настройки из http_server.ini)" },
+        { "scenarios", "Сценарии через запятую: static, db, php", "list", "static,db,php" },
+        { "path", "Свой путь вместо сценариев (например /style.css)", "path" },
+        { "connections", "Число соединений", "n", "16" },
+        { "threads", "Потоков генератора нагрузки", "n", "1" },
+        { "duration", "Длительность замера, с", "sec", "10" },
+        { "warmup", "Прогрев перед замером, с", "sec", "2" },
+        { "rate", "Запросов в секунду (открытый цикл), 0 - закрытый цикл", "rps", "0" },
+        { "accept-encoding", "Значение Accept-Encoding в запросах", "value" },
+    });
+    parser.process(app);
+
+    QString mode = parser.positionalArguments().value(0, "all");
+    if (mode != "micro" && mode != "load" && mode != "all") {
+        QTextStream(stderr) << "Unknown mode: " << mode << "\n";
+        return 1;
+    }
+
+    QJsonObject report;
+    report["format"] = 1;
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["qt"] = qVersion();
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["cores"] = QThread::idealThreadCount();
+
+    if (mode == "micro" || mode == "all") {
+        QTextStream(stdout) << "== micro ==\n";
+        report["micro"] = runMicroBenchmarks(parser.value("min-time-ms").toInt(), parser.value("db"),
+                                             parser.value("filter"));
+    }
+
+    if (mode == "load" || mode == "all") {
+        LoadOptions base;
+        base.host = parser.value("host");
+        base.port = quint16(parser.value("port").toUInt());
+        base.connections = parser.value("connections").toInt();
+        base.threads = parser.value("threads").toInt();
+        base.durationSec = parser.value("duration").toInt();
+        base.warmupSec = parser.value("warmup").toInt();
+        base.rate = parser.value("rate").toDouble();
+        if (parser.isSet("accept-encoding"))
+            base.extraHeaders = "Accept-Encoding: " + parser.value("accept-encoding").toLatin1() + "\r\n";
+
+        // Сервер в том же процессе: его цикл событий крутит главный поток, пока идет нагрузка
+        std::unique_ptr<HttpServer> server;
+        if (parser.isSet("start-server")) {
+            server.reset(new HttpServer);
+            if (!server->startServer(base.port)) {
+                QTextStream(stderr) << "Failed to start server on port " << base.port << "\n";
+                return 1;
+            }
+        }
+
+        std::vector<LoadOptions> runs;
+        if (parser.isSet("path")) {
+            LoadOptions options = base;
+            options.name = "custom";
+            options.path = parser.value("path").toUtf8();
+            runs.push_back(options);
+        } else {
+            for (const QString &name : parser.value("scenarios").split(',', QString::SkipEmptyParts))
+                runs.push_back(scenario(name.trimmed(), base));
+        }
+
+        QTextStream(stdout) << "== load (" << (base.rate > 0 ? "open" : "closed") << " loop, "
+                            << base.connections << " connections) ==\n";
+        QJsonArray load;
+        for (const LoadOptions &options : runs) {
+            QJsonObject result = runLoad(options).toJson(options);
+            printLoad(result);
+            load.append(result);
+        }
+        report["load"] = load;
+    }
+
+    if (parser.isSet("output")) {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QTextStream(stderr) << "Cannot write " << file.fileName() << "\n";
+            return 1;
+        }
+        file.write(QJsonDocument(report).toJson());
+    }
+    return 0;
+}
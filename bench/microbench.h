@@ -0,0 +1,29 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <QJsonArray>
+#include <QString>
+#include <functional>
+
+// Простой замер нс/операцию: прогрев, подбор числа итераций,
+// несколько серий и медиана - одиночный выброс не портит результат
+class MicroBench
+{
+public:
+    explicit MicroBench(int minTimeMs = 500);
+
+    // bytesPerOp - объем данных за операцию, чтобы посчитать МБ/с
+    void run(const QString &name, const std::function<void()> &op, qint64 bytesPerOp = 0);
+
+    QJsonArray results() const { return m_results; }
+
+private:
+    int m_minTimeMs;
+    QJsonArray m_results;
+};
+
+// Все микробенчмарки сервера. dbConnectionString - для замеров по
+// настоящему pqxx::result; пустая строка - эти замеры пропускаются
+QJsonArray runMicroBenchmarks(int minTimeMs, const QString &dbConnectionString, const QString &filter);
+
+#endif // MICROBENCH_H
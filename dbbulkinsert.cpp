@@ -0,0 +1,309 @@
+#include "dbbulkinsert.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+typedef DbBulkInsert::Value Value;
+
+Value jsonToValue(const QJsonValue &value)
+{
+    switch (value.type()) {
+    case QJsonValue::Null:
+    case QJsonValue::Undefined:
+        return std::nullopt;
+    case QJsonValue::Bool:
+        return std::string(value.toBool() ? "true" : "false");
+    case QJsonValue::Double: {
+        // Целые - как целые: 42, а не 42.0 или 4.2e+01
+        double number = value.toDouble();
+        if (std::floor(number) == number && std::fabs(number) < 9007199254740992.0)
+            return QByteArray::number(qint64(number)).toStdString();
+        return QByteArray::number(number, 'g', 17).toStdString();
+    }
+    case QJsonValue::String:
+        return value.toString().toStdString();
+    case QJsonValue::Array:
+        return QJsonDocument(value.toArray()).toJson(QJsonDocument::Compact).toStdString();
+    case QJsonValue::Object:
+        return QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact).toStdString();
+    }
+    return std::nullopt;
+}
+
+// Колонки и значения объекта; служебные поля (_...) пропускаются, как в обычной вставке.
+// Ключи QJsonObject отсортированы, поэтому одинаковые наборы дают одинаковые колонки
+void objectToRow(const QJsonObject &object, std::vector<std::string> &columns, std::vector<Value> &row)
+{
+    for (auto it = object.begin(); it != object.end(); ++it) {
+        if (it.key().startsWith('_')) continue;
+        columns.push_back(it.key().toStdString());
+        row.push_back(jsonToValue(it.value()));
+    }
+}
+
+// Новая пачка начинается при смене набора колонок или когда текущая заполнена
+void appendRow(std::vector<DbBulkInsert::Batch> &batches, const std::vector<std::string> &columns,
+               std::vector<Value> &&row, int rowNumber, int batchRows)
+{
+    if (batches.empty() || int(batches.back().rows.size()) >= batchRows || batches.back().columns != columns) {
+        DbBulkInsert::Batch batch;
+        batch.columns = columns;
+        batch.firstRow = rowNumber;
+        batches.push_back(std::move(batch));
+    }
+    batches.back().rows.push_back(std::move(row));
+}
+
+bool appendObject(std::vector<DbBulkInsert::Batch> &batches, const QJsonValue &value, int rowNumber,
+                  int batchRows, QString &error)
+{
+    if (!value.isObject()) {
+        error = QString("Row %1 is not a JSON object").arg(rowNumber);
+        return false;
+    }
+    std::vector<std::string> columns;
+    std::vector<Value> row;
+    objectToRow(value.toObject(), columns, row);
+    if (columns.empty()) {
+        error = QString("Row %1 has no fields").arg(rowNumber);
+        return false;
+    }
+    appendRow(batches, columns, std::move(row), rowNumber, batchRows);
+    return true;
+}
+
+// Одна запись CSV (RFC 4180) с позиции pos. Пустое поле без кавычек - NULL,
+// "" - пустая строка, как в COPY ... CSV. false - незакрытая кавычка
+bool readCsvRecord(const QByteArray &data, int &pos, std::vector<Value> &fields)
+{
+    const char *bytes = data.constData();
+    const int size = data.size();
+    fields.clear();
+    while (true) {
+        std::string field;
+        bool quoted = pos < size && bytes[pos] == '"';
+        if (quoted) {
+            ++pos;
+            while (true) {
+                const char *quote = static_cast<const char *>(std::memchr(bytes + pos, '"', size - pos));
+                if (!quote) return false;
+                field.append(bytes + pos, quote - (bytes + pos));
+                pos = int(quote - bytes) + 1;
+                if (pos < size && bytes[pos] == '"') {
+                    field += '"';
+                    ++pos;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        int end = pos;
+        while (end < size && bytes[end] != ',' && bytes[end] != '\n' && bytes[end] != '\r')
+            ++end;
+        field.append(bytes + pos, end - pos);
+        pos = end;
+
+        if (quoted || !field.empty())
+            fields.push_back(std::move(field));
+        else
+            fields.push_back(std::nullopt);
+
+        if (pos < size && bytes[pos] == ',') {
+            ++pos;
+            continue;
+        }
+        if (pos < size && bytes[pos] == '\r') ++pos;
+        if (pos < size && bytes[pos] == '\n') ++pos;
+        return true;
+    }
+}
+
+bool parseCsv(const QByteArray &body, int batchRows, std::vector<DbBulkInsert::Batch> &batches, QString &error)
+{
+    int pos = 0;
+    std::vector<Value> header;
+    if (!readCsvRecord(body, pos, header)) {
+        error = "Unterminated quote in CSV header";
+        return false;
+    }
+    std::vector<std::string> columns;
+    for (const Value &name : header) {
+        if (!name || name->empty()) {
+            error = "Empty column name in CSV header";
+            return false;
+        }
+        columns.push_back(*name);
+    }
+
+    int rowNumber = 0;
+    std::vector<Value> fields;
+    while (pos < body.size()) {
+        int start = pos;
+        if (!readCsvRecord(body, pos, fields)) {
+            error = QString("Unterminated quote in CSV row %1").arg(rowNumber);
+            return false;
+        }
+        // Пустые строки (перевод строки в конце файла) пропускаем
+        if (fields.size() == 1 && !fields[0] && pos - start <= 2)
+            continue;
+        if (fields.size() != columns.size()) {
+            error = QString("CSV row %1 has %2 fields, expected %3")
+                .arg(rowNumber).arg(fields.size()).arg(columns.size());
+            return false;
+        }
+        appendRow(batches, columns, std::move(fields), rowNumber++, batchRows);
+        fields = std::vector<Value>();
+    }
+    return true;
+}
+
+std::string quotedColumns(pqxx::connection &conn, const std::vector<std::string> &columns)
+{
+    std::string joined;
+    for (const std::string &column : columns) {
+        if (!joined.empty()) joined += ", ";
+        joined += conn.quote_name(column);
+    }
+    return joined;
+}
+
+}
+
+DbBulkInsert::Format DbBulkInsert::detect(const QByteArray &contentType, const QByteArray &body)
+{
+    QByteArray type = contentType.toLower();
+    if (type.contains("ndjson") || type.contains("jsonlines"))
+        return Format::NdJson;
+    if (type.contains("text/csv"))
+        return Format::Csv;
+    if (type.contains("json")) {
+        // Объект - обычная вставка одной строки, массив - массовая
+        for (char c : body) {
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+            return c == '[' ? Format::JsonArray : Format::None;
+        }
+    }
+    return Format::None;
+}
+
+bool DbBulkInsert::parse(Format format, const QByteArray &body, int batchRows,
+                         std::vector<Batch> &batches, QString &error)
+{
+    batchRows = qMax(1, batchRows);
+    switch (format) {
+    case Format::None:
+        break;
+    case Format::JsonArray: {
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(body, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isArray()) {
+            error = "Invalid JSON: " + parseError.errorString();
+            return false;
+        }
+        const QJsonArray rows = doc.array();
+        for (int i = 0; i < rows.size(); ++i) {
+            if (!appendObject(batches, rows.at(i), i, batchRows, error))
+                return false;
+        }
+        return true;
+    }
+    case Format::NdJson: {
+        int rowNumber = 0;
+        int lineStart = 0;
+        while (lineStart < body.size()) {
+            int lineEnd = body.indexOf('\n', lineStart);
+            if (lineEnd == -1) lineEnd = body.size();
+            QByteArray line = body.mid(lineStart, lineEnd - lineStart).trimmed();
+            lineStart = lineEnd + 1;
+            if (line.isEmpty()) continue;
+
+            QJsonParseError parseError;
+            QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+            if (parseError.error != QJsonParseError::NoError) {
+                error = QString("Invalid JSON in row %1: %2").arg(rowNumber).arg(parseError.errorString());
+                return false;
+            }
+            QJsonValue row = doc.isObject() ? QJsonValue(doc.object()) : QJsonValue();
+            if (!appendObject(batches, row, rowNumber, batchRows, error))
+                return false;
+            ++rowNumber;
+        }
+        return true;
+    }
+    case Format::Csv:
+        return parseCsv(body, batchRows, batches, error);
+    }
+    error = "Unsupported bulk format";
+    return false;
+}
+
+void DbBulkInsert::copyBatch(pqxx::transaction_base &txn, const std::string &table, const Batch &batch,
+                             int serial, std::vector<long long> &ids)
+{
+    pqxx::connection &conn = txn.conn();
+    std::string target = conn.quote_name(table);
+    std::string columns = quotedColumns(conn, batch.columns);
+    std::string staging = "bulk_rows_" + std::to_string(serial);
+
+    // Типы колонок берем у целевой таблицы, но без ее ограничений (NOT NULL у id):
+    // умолчания подставит INSERT, который и вернет id
+    txn.exec("CREATE TEMP TABLE " + staging + " ON COMMIT DROP AS SELECT " + columns
+             + " FROM " + target + " WITH NO DATA");
+    {
+        pqxx::stream_to stream = pqxx::stream_to::raw_table(txn, staging, columns);
+        for (const std::vector<Value> &row : batch.rows)
+            stream.write_row(row);
+        stream.complete();
+    }
+
+    pqxx::result result = txn.exec("INSERT INTO " + target + " (" + columns + ") SELECT " + columns
+                                   + " FROM " + staging + " RETURNING id");
+    txn.exec("DROP TABLE " + staging);
+
+    ids.reserve(ids.size() + result.size());
+    for (const pqxx::row &row : result)
+        ids.push_back(row[0].as<long long>());
+}
+
+void DbBulkInsert::insertBatch(pqxx::transaction_base &txn, const std::string &table, const Batch &batch,
+                               std::vector<long long> &ids)
+{
+    pqxx::connection &conn = txn.conn();
+    const std::string prefix = "INSERT INTO " + conn.quote_name(table) + " ("
+        + quotedColumns(conn, batch.columns) + ") VALUES ";
+    const size_t width = batch.columns.size();
+
+    // В одном выражении не больше 65535 параметров (ограничение протокола)
+    const size_t rowsPerStatement = std::max<size_t>(1, 65535 / width);
+    for (size_t start = 0; start < batch.rows.size(); start += rowsPerStatement) {
+        size_t end = std::min(batch.rows.size(), start + rowsPerStatement);
+        std::string sql = prefix;
+        pqxx::params values;
+        int param = 0;
+        for (size_t r = start; r < end; ++r) {
+            sql += r == start ? "(" : ", (";
+            for (size_t c = 0; c < width; ++c) {
+                if (c > 0) sql += ", ";
+                sql += "$" + std::to_string(++param);
+                const Value &value = batch.rows[r][c];
+                if (value)
+                    values.append(*value);
+                else
+                    values.append();
+            }
+            sql += ")";
+        }
+        sql += " RETURNING id";
+
+        pqxx::result result = txn.exec_params(sql, values);
+        for (const pqxx::row &row : result)
+            ids.push_back(row[0].as<long long>());
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef DBBULKINSERT_H
+#define DBBULKINSERT_H
+
+#include <QByteArray>
+#include <QString>
+#include <optional>
+#include <pqxx/pqxx>
+#include <string>
+#include <vector>
+
+// Массовая вставка для POST /api/db/<table>: JSON-массив объектов,
+// NDJSON (объект на строку) или CSV с заголовком. Строки режутся на
+// пачки с одинаковым набором колонок, каждая пачка загружается одним
+// COPY (или многострочными INSERT, если COPY недоступен).
+class DbBulkInsert
+{
+public:
+    enum class Format { None, JsonArray, NdJson, Csv };
+
+    typedef std::optional<std::string> Value; // nullopt - NULL
+
+    struct Batch
+    {
+        std::vector<std::string> columns;
+        std::vector<std::vector<Value>> rows;
+        int firstRow = 0; // номер первой строки пачки в теле запроса
+    };
+
+    // None - тело не для массовой вставки (обычный объект или форма)
+    static Format detect(const QByteArray &contentType, const QByteArray &body);
+
+    // Пачки не больше batchRows строк. false - тело битое, причина в error
+    static bool parse(Format format, const QByteArray &body, int batchRows,
+                      std::vector<Batch> &batches, QString &error);
+
+    // Загрузить пачку в txn; ids - id вставленных строк в порядке строк.
+    // copyBatch грузит через COPY во временную таблицу (serial - ее уникальный
+    // номер в транзакции) и переносит строки INSERT ... SELECT ... RETURNING id
+    static void copyBatch(pqxx::transaction_base &txn, const std::string &table, const Batch &batch,
+                          int serial, std::vector<long long> &ids);
+    static void insertBatch(pqxx::transaction_base &txn, const std::string &table, const Batch &batch,
+                            std::vector<long long> &ids);
+};
+
+#endif // DBBULKINSERT_H
@@ -0,0 +1,70 @@
+#include "dbchangelistener.h"
+#include <QDebug>
+#include <pqxx/pqxx>
+
+namespace {
+
+class ChangeReceiver : public pqxx::notification_receiver
+{
+public:
+    ChangeReceiver(pqxx::connection &connection, const std::string &channel,
+                   const std::function<void(const QString &)> &onChange) :
+        pqxx::notification_receiver(connection, channel),
+        m_onChange(onChange)
+    {
+    }
+
+    void operator()(const std::string &payload, int) override
+    {
+        // Уведомление без имени таблицы - сбросить все
+        m_onChange(QString::fromStdString(payload).trimmed());
+    }
+
+private:
+    const std::function<void(const QString &)> &m_onChange;
+};
+
+}
+
+DbChangeListener::DbChangeListener(const QString &connectionString, const QString &channel,
+                                   std::function<void(const QString &)> onChange, QObject *parent) :
+    QThread(parent),
+    m_connectionString(connectionString),
+    m_channel(channel),
+    m_onChange(std::move(onChange)),
+    m_stopping(false)
+{
+}
+
+DbChangeListener::~DbChangeListener()
+{
+    stop();
+}
+
+void DbChangeListener::stop()
+{
+    m_stopping = true;
+    wait();
+}
+
+void DbChangeListener::run()
+{
+    while (!m_stopping.load()) {
+        try {
+            pqxx::connection connection(m_connectionString.toStdString());
+            ChangeReceiver receiver(connection, m_channel.toStdString(), m_onChange);
+
+            // Пока соединения не было, уведомления терялись
+            m_onChange(QString());
+            qInfo() << "Listening for table changes on channel" << m_channel;
+
+            // Ждем с таймаутом, чтобы заметить stop()
+            while (!m_stopping.load())
+                connection.await_notification(1, 0);
+        } catch (const std::exception &e) {
+            qWarning() << "Table change listener:" << e.what();
+            for (int i = 0; i < 50 && !m_stopping.load(); ++i)
+                msleep(100);
+        }
+    }
+}
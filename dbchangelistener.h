@@ -0,0 +1,34 @@
+#ifndef DBCHANGELISTENER_H
+#define DBCHANGELISTENER_H
+
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <functional>
+
+// LISTEN на отдельном соединении с PostgreSQL: узнаем об изменениях,
+// сделанных в обход сервера. Payload уведомления - имя таблицы
+// (триггер notify_table_changed из init_db.sql). После обрыва соединение
+// переоткрывается. Уведомления до подключения теряются, поэтому каждое
+// подключение считается изменением всех таблиц (onChange с пустым именем).
+class DbChangeListener : public QThread
+{
+    Q_OBJECT
+public:
+    DbChangeListener(const QString &connectionString, const QString &channel,
+                     std::function<void(const QString &table)> onChange, QObject *parent = nullptr);
+    ~DbChangeListener();
+
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    QString m_connectionString;
+    QString m_channel;
+    std::function<void(const QString &)> m_onChange;
+    std::atomic<bool> m_stopping;
+};
+
+#endif // DBCHANGELISTENER_H
@@ -0,0 +1,229 @@
+#include "dbconnectionpool.h"
+#include <QDebug>
+
+DbConnectionPool::Lease::Lease(Lease &&other) noexcept :
+    m_pool(other.m_pool),
+    m_entry(other.m_entry)
+{
+    other.m_pool = nullptr;
+    other.m_entry = nullptr;
+}
+
+DbConnectionPool::Lease &DbConnectionPool::Lease::operator=(Lease &&other) noexcept
+{
+    if (this != &other) {
+        reset();
+        m_pool = other.m_pool;
+        m_entry = other.m_entry;
+        other.m_pool = nullptr;
+        other.m_entry = nullptr;
+    }
+    return *this;
+}
+
+pqxx::connection &DbConnectionPool::Lease::operator*() const
+{
+    return *m_entry->connection;
+}
+
+pqxx::connection *DbConnectionPool::Lease::operator->() const
+{
+    return m_entry->connection.get();
+}
+
+PreparedStatementCache &DbConnectionPool::Lease::statements() const
+{
+    return m_entry->statements;
+}
+
+void DbConnectionPool::Lease::reset()
+{
+    if (m_entry) {
+        m_pool->release(m_entry);
+        m_entry = nullptr;
+        m_pool = nullptr;
+    }
+}
+
+DbConnectionPool::DbConnectionPool(const QString &connectionString, int minSize, int maxSize,
+                                   int acquireTimeoutMs, int healthCheckIntervalSec, int statementCacheSize) :
+    m_connectionString(connectionString),
+    m_minSize(qMax(0, minSize)),
+    m_maxSize(qMax(1, maxSize)),
+    m_acquireTimeoutMs(acquireTimeoutMs),
+    m_healthCheckIntervalMs(healthCheckIntervalSec * 1000),
+    m_statementCacheSize(statementCacheSize),
+    m_total(0),
+    m_inUse(0),
+    m_saturated(false),
+    m_acquires(0),
+    m_waits(0),
+    m_timeouts(0),
+    m_connectFailures(0),
+    m_totalWaitUs(0),
+    m_maxWaitUs(0)
+{
+    if (m_minSize > m_maxSize) m_minSize = m_maxSize;
+}
+
+DbConnectionPool::~DbConnectionPool()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_inUse > 0)
+        qWarning() << "Database pool destroyed with" << m_inUse << "connections in use";
+    qDeleteAll(m_idle);
+    m_idle.clear();
+}
+
+bool DbConnectionPool::warmUp()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_total < m_minSize) {
+        locker.unlock();
+        Entry *entry = createEntry();
+        locker.relock();
+        if (!entry) return false;
+        m_idle.append(entry);
+        ++m_total;
+    }
+    return true;
+}
+
+DbConnectionPool::Entry *DbConnectionPool::createEntry()
+{
+    try {
+        Entry *entry = new Entry(m_statementCacheSize);
+        std::unique_ptr<Entry> guard(entry);
+        entry->connection.reset(new pqxx::connection(m_connectionString.toStdString()));
+        entry->lastChecked.start();
+        return guard.release();
+    } catch (const std::exception &e) {
+        qWarning() << "Database connection error:" << e.what();
+        QMutexLocker locker(&m_mutex);
+        ++m_connectFailures;
+        return nullptr;
+    }
+}
+
+bool DbConnectionPool::isHealthy(Entry *entry)
+{
+    if (!entry->connection->is_open())
+        return false;
+
+    // Долго простаивавшее соединение могло умереть на стороне сервера
+    if (m_healthCheckIntervalMs > 0 && entry->lastChecked.hasExpired(m_healthCheckIntervalMs)) {
+        try {
+            pqxx::nontransaction ping(*entry->connection);
+            ping.exec("SELECT 1");
+        } catch (const std::exception &e) {
+            qWarning() << "Database pool health check failed:" << e.what();
+            return false;
+        }
+        entry->lastChecked.restart();
+    }
+    return true;
+}
+
+DbConnectionPool::Lease DbConnectionPool::acquire()
+{
+    QElapsedTimer waitTimer;
+    waitTimer.start();
+
+    QMutexLocker locker(&m_mutex);
+    ++m_acquires;
+    bool waited = false;
+
+    // Выдача соединения под m_mutex с учетом времени ожидания
+    auto lease = [&](Entry *entry) {
+        ++m_inUse;
+        if (waited) {
+            quint64 waitUs = quint64(waitTimer.nsecsElapsed() / 1000);
+            m_totalWaitUs += waitUs;
+            if (waitUs > m_maxWaitUs) m_maxWaitUs = waitUs;
+        }
+        return Lease(this, entry);
+    };
+
+    for (;;) {
+        // LIFO: последнее возвращенное соединение самое "теплое"
+        while (!m_idle.isEmpty()) {
+            Entry *entry = m_idle.takeLast();
+            locker.unlock();
+            bool healthy = isHealthy(entry);
+            locker.relock();
+            if (healthy)
+                return lease(entry);
+            delete entry;
+            --m_total;
+        }
+
+        // Есть место - открываем новое соединение вне блокировки
+        if (m_total < m_maxSize) {
+            ++m_total;
+            locker.unlock();
+            Entry *entry = createEntry();
+            locker.relock();
+            if (entry)
+                return lease(entry);
+            --m_total;
+            m_available.wakeOne();
+            return Lease();
+        }
+
+        // Пул исчерпан
+        if (!waited) {
+            waited = true;
+            ++m_waits;
+            if (!m_saturated) {
+                m_saturated = true;
+                qWarning() << "Database pool saturated:" << m_inUse << "of" << m_maxSize << "connections in use";
+            }
+        }
+
+        qint64 remaining = m_acquireTimeoutMs - waitTimer.elapsed();
+        if (remaining <= 0) {
+            ++m_timeouts;
+            qWarning() << "Database pool acquire timed out after" << waitTimer.elapsed() << "ms";
+            return Lease();
+        }
+        m_available.wait(&m_mutex, static_cast<unsigned long>(remaining));
+    }
+}
+
+void DbConnectionPool::release(Entry *entry)
+{
+    // Соединение, оборванное во время запроса, в пул не возвращаем
+    bool open = entry->connection->is_open();
+
+    QMutexLocker locker(&m_mutex);
+    --m_inUse;
+    if (open) {
+        m_idle.append(entry);
+    } else {
+        delete entry;
+        --m_total;
+    }
+
+    if (m_saturated && m_inUse < m_maxSize) {
+        m_saturated = false;
+        qInfo() << "Database pool recovered from saturation";
+    }
+    m_available.wakeOne();
+}
+
+DbConnectionPool::Stats DbConnectionPool::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats s;
+    s.size = m_total;
+    s.idle = m_idle.size();
+    s.inUse = m_inUse;
+    s.maxSize = m_maxSize;
+    s.acquires = m_acquires;
+    s.waits = m_waits;
+    s.timeouts = m_timeouts;
+    s.connectFailures = m_connectFailures;
+    s.totalWaitUs = m_totalWaitUs;
+    s.maxWaitUs = m_maxWaitUs;
+    return s;
+}
@@ -0,0 +1,113 @@
+#ifndef DBCONNECTIONPOOL_H
+#define DBCONNECTIONPOOL_H
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <memory>
+#include <pqxx/pqxx>
+#include "preparedstatementcache.h"
+
+// Ограниченный пул соединений с PostgreSQL.
+// Соединения создаются по требованию до maxSize, простаивающие
+// периодически проверяются, оборванные пересоздаются.
+class DbConnectionPool
+{
+    struct Entry;
+
+public:
+    struct Stats
+    {
+        int size;              // всего открытых соединений
+        int idle;
+        int inUse;
+        int maxSize;
+        quint64 acquires;
+        quint64 waits;         // сколько раз пришлось ждать свободное соединение
+        quint64 timeouts;      // не дождались за acquire_timeout
+        quint64 connectFailures;
+        quint64 totalWaitUs;
+        quint64 maxWaitUs;
+    };
+
+    // Соединение, взятое из пула. Возвращается в пул в деструкторе.
+    class Lease
+    {
+    public:
+        Lease() : m_pool(nullptr), m_entry(nullptr) {}
+        Lease(Lease &&other) noexcept;
+        Lease &operator=(Lease &&other) noexcept;
+        ~Lease() { reset(); }
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        explicit operator bool() const { return m_entry != nullptr; }
+        pqxx::connection &operator*() const;
+        pqxx::connection *operator->() const;
+
+        // Подготовленные выражения этого соединения
+        PreparedStatementCache &statements() const;
+
+        void reset();
+
+    private:
+        friend class DbConnectionPool;
+        Lease(DbConnectionPool *pool, Entry *entry) : m_pool(pool), m_entry(entry) {}
+
+        DbConnectionPool *m_pool;
+        Entry *m_entry;
+    };
+
+    DbConnectionPool(const QString &connectionString, int minSize, int maxSize,
+                     int acquireTimeoutMs, int healthCheckIntervalSec, int statementCacheSize = 64);
+    ~DbConnectionPool();
+
+    // Открыть minSize соединений заранее. false - БД недоступна
+    bool warmUp();
+
+    // Пустой Lease - БД недоступна или пул исчерпан дольше acquire_timeout
+    Lease acquire();
+
+    Stats stats() const;
+    int maxSize() const { return m_maxSize; }
+
+private:
+    struct Entry
+    {
+        explicit Entry(int statementCacheSize) : statements(statementCacheSize) {}
+
+        std::unique_ptr<pqxx::connection> connection;
+        PreparedStatementCache statements;
+        QElapsedTimer lastChecked;
+    };
+
+    Entry *createEntry();
+    bool isHealthy(Entry *entry);
+    void release(Entry *entry);
+
+    QString m_connectionString;
+    int m_minSize;
+    int m_maxSize;
+    int m_acquireTimeoutMs;
+    int m_healthCheckIntervalMs;
+    int m_statementCacheSize;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_available;
+    QList<Entry *> m_idle;
+    int m_total;
+    int m_inUse;
+    bool m_saturated;
+
+    quint64 m_acquires;
+    quint64 m_waits;
+    quint64 m_timeouts;
+    quint64 m_connectFailures;
+    quint64 m_totalWaitUs;
+    quint64 m_maxWaitUs;
+};
+
+#endif // DBCONNECTIONPOOL_H
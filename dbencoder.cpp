@@ -0,0 +1,573 @@
+#include "dbencoder.h"
+#include "dbjson.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// OID встроенных типов Postgres (pg_type.h)
+const pqxx::oid BoolOid = 16;
+const pqxx::oid Int8Oid = 20;
+const pqxx::oid Int2Oid = 21;
+const pqxx::oid Int4Oid = 23;
+const pqxx::oid OidOid = 26;
+const pqxx::oid Float4Oid = 700;
+const pqxx::oid Float8Oid = 701;
+
+bool formatForType(const QByteArray &type, DbEncoder::Format &format)
+{
+    if (type == "application/json") {
+        format = DbEncoder::Format::Json;
+    } else if (type == "application/x-ndjson" || type == "application/ndjson"
+               || type == "application/jsonlines" || type == "application/x-jsonlines") {
+        format = DbEncoder::Format::NdJson;
+    } else if (type == "text/csv") {
+        format = DbEncoder::Format::Csv;
+    } else if (type == "application/msgpack" || type == "application/x-msgpack"
+               || type == "application/vnd.msgpack") {
+        format = DbEncoder::Format::MsgPack;
+    } else if (type == "application/cbor") {
+        format = DbEncoder::Format::Cbor;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseInteger(const pqxx::field &field, qint64 &value)
+{
+    const char *text = field.c_str();
+    char *end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0')
+        return false;
+    value = parsed;
+    return true;
+}
+
+// NaN и Infinity Postgres пишет словами - strtod их понимает
+bool parseReal(const pqxx::field &field, double &value)
+{
+    const char *text = field.c_str();
+    char *end = nullptr;
+    double parsed = std::strtod(text, &end);
+    if (end == text || *end != '\0')
+        return false;
+    value = parsed;
+    return true;
+}
+
+// Целые в сетевом порядке байт - общее для MessagePack и CBOR
+void put16(QByteArray &out, quint16 value)
+{
+    out.append(char(value >> 8));
+    out.append(char(value));
+}
+
+void put32(QByteArray &out, quint32 value)
+{
+    put16(out, quint16(value >> 16));
+    put16(out, quint16(value));
+}
+
+void put64(QByteArray &out, quint64 value)
+{
+    put32(out, quint32(value >> 32));
+    put32(out, quint32(value));
+}
+
+void putDouble(QByteArray &out, double value)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put64(out, bits);
+}
+
+// MessagePack: самое короткое представление для каждого значения
+void packInt(QByteArray &out, qint64 value)
+{
+    if (value >= 0) {
+        if (value < 128) {
+            out.append(char(value));
+        } else if (value < 256) {
+            out.append(char(0xcc));
+            out.append(char(value));
+        } else if (value < 65536) {
+            out.append(char(0xcd));
+            put16(out, quint16(value));
+        } else if (value <= 0xffffffffLL) {
+            out.append(char(0xce));
+            put32(out, quint32(value));
+        } else {
+            out.append(char(0xcf));
+            put64(out, quint64(value));
+        }
+    } else if (value >= -32) {
+        out.append(char(value));
+    } else if (value >= -128) {
+        out.append(char(0xd0));
+        out.append(char(value));
+    } else if (value >= -32768) {
+        out.append(char(0xd1));
+        put16(out, quint16(value));
+    } else if (value >= -2147483648LL) {
+        out.append(char(0xd2));
+        put32(out, quint32(value));
+    } else {
+        out.append(char(0xd3));
+        put64(out, quint64(value));
+    }
+}
+
+void packString(QByteArray &out, const char *data, size_t size)
+{
+    if (size < 32) {
+        out.append(char(0xa0 | size));
+    } else if (size < 256) {
+        out.append(char(0xd9));
+        out.append(char(size));
+    } else if (size < 65536) {
+        out.append(char(0xda));
+        put16(out, quint16(size));
+    } else {
+        out.append(char(0xdb));
+        put32(out, quint32(size));
+    }
+    out.append(data, int(size));
+}
+
+void packContainer(QByteArray &out, quint32 size, int fixBase, int marker16)
+{
+    if (size < 16) {
+        out.append(char(fixBase | size));
+    } else if (size < 65536) {
+        out.append(char(marker16));
+        put16(out, quint16(size));
+    } else {
+        out.append(char(marker16 + 1));
+        put32(out, size);
+    }
+}
+
+void packArray(QByteArray &out, quint32 size) { packContainer(out, size, 0x90, 0xdc); }
+void packMap(QByteArray &out, quint32 size) { packContainer(out, size, 0x80, 0xde); }
+
+// CBOR (RFC 8949): старшие 3 бита - мажорный тип, остальное - длина или значение
+enum CborMajor { CborUnsigned = 0, CborNegative = 1, CborText = 3, CborArray = 4, CborMap = 5 };
+const char CborFalse = char(0xf4);
+const char CborTrue = char(0xf5);
+const char CborNull = char(0xf6);
+const char CborDouble = char(0xfb);
+const char CborIndefiniteArray = char(0x9f);
+const char CborBreak = char(0xff);
+
+void cborHead(QByteArray &out, int major, quint64 value)
+{
+    const int type = major << 5;
+    if (value < 24) {
+        out.append(char(type | int(value)));
+    } else if (value < 256) {
+        out.append(char(type | 24));
+        out.append(char(value));
+    } else if (value < 65536) {
+        out.append(char(type | 25));
+        put16(out, quint16(value));
+    } else if (value <= 0xffffffffULL) {
+        out.append(char(type | 26));
+        put32(out, quint32(value));
+    } else {
+        out.append(char(type | 27));
+        put64(out, value);
+    }
+}
+
+void cborInt(QByteArray &out, qint64 value)
+{
+    if (value >= 0)
+        cborHead(out, CborUnsigned, quint64(value));
+    else
+        cborHead(out, CborNegative, quint64(-1 - value));
+}
+
+void cborString(QByteArray &out, const char *data, size_t size)
+{
+    cborHead(out, CborText, size);
+    out.append(data, int(size));
+}
+
+// Поле CSV (RFC 4180): в кавычках, если есть разделители или кавычки.
+// Пустая строка - "", чтобы отличаться от NULL
+void appendCsvField(QByteArray &out, const char *data, size_t size)
+{
+    bool quote = size == 0;
+    for (size_t i = 0; i < size && !quote; ++i) {
+        char c = data[i];
+        quote = c == ',' || c == '"' || c == '\r' || c == '\n';
+    }
+    if (!quote) {
+        out.append(data, int(size));
+        return;
+    }
+    out.append('"');
+    const char *runStart = data;
+    for (const char *p = data; p != data + size; ++p) {
+        if (*p != '"') continue;
+        out.append(runStart, int(p + 1 - runStart));
+        out.append('"');
+        runStart = p + 1;
+    }
+    out.append(runStart, int(data + size - runStart));
+    out.append('"');
+}
+
+}
+
+DbEncoder::Format DbEncoder::negotiate(const QByteArray &accept)
+{
+    // Побеждает больший q, при равных - первый в списке. */* и
+    // неизвестные типы не учитываются: по умолчанию и так JSON
+    Format best = Format::Json;
+    double bestQ = 0;
+    for (const QByteArray &item : accept.split(',')) {
+        QList<QByteArray> parts = item.split(';');
+        Format format;
+        if (!formatForType(parts.value(0).trimmed().toLower(), format))
+            continue;
+        double q = 1.0;
+        for (int i = 1; i < parts.size(); ++i) {
+            QByteArray param = parts[i].trimmed();
+            if (param.startsWith("q=")) {
+                bool ok = false;
+                q = param.mid(2).toDouble(&ok);
+                if (!ok) q = 0;
+            }
+        }
+        if (q > bestQ) {
+            best = format;
+            bestQ = q;
+        }
+    }
+    return best;
+}
+
+bool DbEncoder::parseFormat(const QString &name, Format &format)
+{
+    QString lower = name.trimmed().toLower();
+    for (Format candidate : { Format::Json, Format::NdJson, Format::Csv, Format::MsgPack, Format::Cbor }) {
+        if (lower == QString::fromLatin1(token(candidate))) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+QByteArray DbEncoder::token(Format format)
+{
+    switch (format) {
+    case Format::Json: return "json";
+    case Format::NdJson: return "ndjson";
+    case Format::Csv: return "csv";
+    case Format::MsgPack: return "msgpack";
+    case Format::Cbor: return "cbor";
+    }
+    return "json";
+}
+
+QByteArray DbEncoder::contentType(Format format)
+{
+    switch (format) {
+    case Format::Json: return "application/json";
+    case Format::NdJson: return "application/x-ndjson";
+    case Format::Csv: return "text/csv; charset=utf-8";
+    case Format::MsgPack: return "application/msgpack";
+    case Format::Cbor: return "application/cbor";
+    }
+    return "application/json";
+}
+
+DbEncoder::DbEncoder(Format format, Layout layout) :
+    m_format(format),
+    // NDJSON и CSV построчные по определению
+    m_layout(hasEnvelope(format) ? layout : Layout::Rows),
+    m_paged(false),
+    m_rows(0)
+{
+}
+
+void DbEncoder::appendKey(QByteArray &out, const QByteArray &name) const
+{
+    switch (m_format) {
+    case Format::Json:
+    case Format::NdJson:
+        DbJson::appendString(out, name.constData(), size_t(name.size()));
+        out.append(':');
+        break;
+    case Format::MsgPack:
+        packString(out, name.constData(), size_t(name.size()));
+        break;
+    case Format::Cbor:
+        cborString(out, name.constData(), size_t(name.size()));
+        break;
+    case Format::Csv:
+        appendCsvField(out, name.constData(), size_t(name.size()));
+        break;
+    }
+}
+
+void DbEncoder::begin(const pqxx::result &result, qint64 rowCount, bool paged)
+{
+    m_paged = paged;
+    m_rows = 0;
+    const pqxx::row::size_type columns = result.columns();
+    for (pqxx::row::size_type i = 0; i < columns; ++i) {
+        QByteArray name(result.column_name(i));
+        QByteArray key;
+        appendKey(key, name);
+        m_keys.push_back(key);
+
+        switch (result.column_type(i)) {
+        case BoolOid: m_kinds.push_back(Kind::Bool); break;
+        case Int2Oid:
+        case Int4Oid:
+        case Int8Oid:
+        case OidOid: m_kinds.push_back(Kind::Integer); break;
+        case Float4Oid:
+        case Float8Oid: m_kinds.push_back(Kind::Real); break;
+        default: m_kinds.push_back(Kind::Text); break;
+        }
+    }
+    if (m_layout == Layout::Columns)
+        m_columns.assign(size_t(columns), QByteArray());
+
+    switch (m_format) {
+    case Format::Json:
+        m_out.append("{\"status\":\"success\",\"data\":");
+        m_out.append(m_layout == Layout::Columns ? '{' : '[');
+        break;
+    case Format::NdJson:
+        break;
+    case Format::Csv:
+        // Заголовок - имена колонок, уже экранированные в m_keys
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            if (i > 0) m_out.append(',');
+            m_out.append(m_keys[i]);
+        }
+        m_out.append("\r\n");
+        break;
+    case Format::MsgPack:
+        packMap(m_out, paged ? 3 : 2);
+        packString(m_out, "status", 6);
+        packString(m_out, "success", 7);
+        packString(m_out, "data", 4);
+        if (m_layout == Layout::Columns)
+            packMap(m_out, quint32(columns));
+        else
+            packArray(m_out, quint32(qMax<qint64>(0, rowCount)));
+        break;
+    case Format::Cbor:
+        cborHead(m_out, CborMap, paged ? 3 : 2);
+        cborString(m_out, "status", 6);
+        cborString(m_out, "success", 7);
+        cborString(m_out, "data", 4);
+        if (m_layout == Layout::Columns)
+            cborHead(m_out, CborMap, columns);
+        else
+            m_out.append(CborIndefiniteArray);
+        break;
+    }
+}
+
+void DbEncoder::appendValue(QByteArray &out, const pqxx::field &field, Kind kind) const
+{
+    const bool null = field.is_null();
+    qint64 integer = 0;
+    double real = 0;
+
+    switch (m_format) {
+    case Format::Json:
+        // Прежний вид ответа: все строками, NULL - ""
+        DbJson::appendString(out, field.c_str(), null ? 0 : field.size());
+        return;
+
+    case Format::Csv:
+        if (!null)
+            appendCsvField(out, field.c_str(), field.size());
+        return;
+
+    case Format::NdJson:
+        if (null) {
+            out.append("null");
+        } else if (kind == Kind::Bool) {
+            out.append(field.c_str()[0] == 't' ? "true" : "false");
+        } else if ((kind == Kind::Integer && parseInteger(field, integer))
+                   || (kind == Kind::Real && parseReal(field, real) && std::isfinite(real))) {
+            // Текст Postgres для целых и конечных чисел - уже корректное число JSON
+            out.append(field.c_str(), int(field.size()));
+        } else {
+            DbJson::appendString(out, field.c_str(), field.size());
+        }
+        return;
+
+    case Format::MsgPack:
+        if (null) {
+            out.append(char(0xc0));
+        } else if (kind == Kind::Bool) {
+            out.append(char(field.c_str()[0] == 't' ? 0xc3 : 0xc2));
+        } else if (kind == Kind::Integer && parseInteger(field, integer)) {
+            packInt(out, integer);
+        } else if (kind == Kind::Real && parseReal(field, real)) {
+            out.append(char(0xcb));
+            putDouble(out, real);
+        } else {
+            packString(out, field.c_str(), field.size());
+        }
+        return;
+
+    case Format::Cbor:
+        if (null) {
+            out.append(CborNull);
+        } else if (kind == Kind::Bool) {
+            out.append(field.c_str()[0] == 't' ? CborTrue : CborFalse);
+        } else if (kind == Kind::Integer && parseInteger(field, integer)) {
+            cborInt(out, integer);
+        } else if (kind == Kind::Real && parseReal(field, real)) {
+            out.append(CborDouble);
+            putDouble(out, real);
+        } else {
+            cborString(out, field.c_str(), field.size());
+        }
+        return;
+    }
+}
+
+void DbEncoder::appendRows(const pqxx::result &result, int count)
+{
+    const int rows = count < 0 ? int(result.size()) : qMin(count, int(result.size()));
+    const size_t columns = m_keys.size();
+
+    for (int r = 0; r < rows; ++r) {
+        const pqxx::row row = result[pqxx::result::size_type(r)];
+
+        if (m_layout == Layout::Columns) {
+            for (size_t i = 0; i < columns; ++i) {
+                QByteArray &column = m_columns[i];
+                if (m_format == Format::Json && m_rows > 0) column.append(',');
+                appendValue(column, row[pqxx::row::size_type(i)], m_kinds[i]);
+            }
+            ++m_rows;
+            continue;
+        }
+
+        switch (m_format) {
+        case Format::Json:
+        case Format::NdJson:
+            if (m_format == Format::Json && m_rows > 0) m_out.append(',');
+            m_out.append('{');
+            for (size_t i = 0; i < columns; ++i) {
+                if (i > 0) m_out.append(',');
+                m_out.append(m_keys[i]);
+                appendValue(m_out, row[pqxx::row::size_type(i)], m_kinds[i]);
+            }
+            m_out.append(m_format == Format::Json ? "}" : "}\n");
+            break;
+        case Format::Csv:
+            for (size_t i = 0; i < columns; ++i) {
+                if (i > 0) m_out.append(',');
+                appendValue(m_out, row[pqxx::row::size_type(i)], m_kinds[i]);
+            }
+            m_out.append("\r\n");
+            break;
+        case Format::MsgPack:
+        case Format::Cbor:
+            if (m_format == Format::MsgPack)
+                packMap(m_out, quint32(columns));
+            else
+                cborHead(m_out, CborMap, columns);
+            for (size_t i = 0; i < columns; ++i) {
+                m_out.append(m_keys[i]);
+                appendValue(m_out, row[pqxx::row::size_type(i)], m_kinds[i]);
+            }
+            break;
+        }
+        ++m_rows;
+    }
+}
+
+void DbEncoder::finish(const QByteArray &next)
+{
+    if (m_layout == Layout::Columns) {
+        for (size_t i = 0; i < m_columns.size(); ++i) {
+            switch (m_format) {
+            case Format::Json:
+                if (i > 0) m_out.append(',');
+                m_out.append(m_keys[i]);
+                m_out.append('[');
+                m_out.append(m_columns[i]);
+                m_out.append(']');
+                break;
+            case Format::MsgPack:
+                m_out.append(m_keys[i]);
+                packArray(m_out, quint32(m_rows));
+                m_out.append(m_columns[i]);
+                break;
+            case Format::Cbor:
+                m_out.append(m_keys[i]);
+                cborHead(m_out, CborArray, quint64(m_rows));
+                m_out.append(m_columns[i]);
+                break;
+            case Format::NdJson:
+            case Format::Csv:
+                break;
+            }
+        }
+        m_columns.clear();
+    }
+
+    switch (m_format) {
+    case Format::Json:
+        m_out.append(m_layout == Layout::Columns ? '}' : ']');
+        if (m_paged) {
+            m_out.append(",\"next\":");
+            if (next.isEmpty())
+                m_out.append("null");
+            else
+                DbJson::appendString(m_out, next.constData(), size_t(next.size()));
+        }
+        m_out.append('}');
+        break;
+    case Format::NdJson:
+    case Format::Csv:
+        break;
+    case Format::MsgPack:
+        if (m_paged) {
+            packString(m_out, "next", 4);
+            if (next.isEmpty())
+                m_out.append(char(0xc0));
+            else
+                packString(m_out, next.constData(), size_t(next.size()));
+        }
+        break;
+    case Format::Cbor:
+        if (m_layout == Layout::Rows)
+            m_out.append(CborBreak);
+        if (m_paged) {
+            cborString(m_out, "next", 4);
+            if (next.isEmpty())
+                m_out.append(CborNull);
+            else
+                cborString(m_out, next.constData(), size_t(next.size()));
+        }
+        break;
+    }
+}
+
+QByteArray DbEncoder::takeOutput()
+{
+    QByteArray out;
+    out.swap(m_out);
+    return out;
+}
@@ -0,0 +1,72 @@
+#ifndef DBENCODER_H
+#define DBENCODER_H
+
+#include <QByteArray>
+#include <QString>
+#include <pqxx/pqxx>
+#include <vector>
+
+// Тело ответа GET /api/db прямо из полей pqxx::result, без QJsonArray:
+// компактный JSON, NDJSON, CSV, MessagePack или CBOR.
+//
+// JSON сохраняет прежний вид (значения - строки, NULL - пустая строка).
+// NDJSON, MessagePack и CBOR типизированы по OID колонки: целые, числа
+// с плавающей точкой, bool и NULL пишутся своими типами, остальное
+// (numeric, даты, текст) - строками. CSV - текст Postgres как есть,
+// NULL - пустое поле без кавычек (как читает COPY и массовая вставка).
+//
+// JSON, MessagePack и CBOR отдаются в обертке {"status", "data", "next"};
+// Layout::Columns кладет в data по массиву на колонку вместо объекта на
+// строку - для больших выборок так меньше и повторяющихся ключей.
+class DbEncoder
+{
+public:
+    enum class Format { Json, NdJson, Csv, MsgPack, Cbor };
+    enum class Layout { Rows, Columns };
+
+    // Формат по Accept с учетом q; без подходящего типа - JSON
+    static Format negotiate(const QByteArray &accept);
+    // Имя для _format: json, ndjson, csv, msgpack, cbor
+    static bool parseFormat(const QString &name, Format &format);
+    static QByteArray token(Format format);
+    static QByteArray contentType(Format format);
+    static bool hasEnvelope(Format format) { return format != Format::NdJson && format != Format::Csv; }
+    // Поток по курсору: число строк заранее неизвестно, а массиву MessagePack
+    // оно нужно в заголовке; по колонкам нельзя писать, не дочитав все строки
+    static bool supportsStreaming(Format format, Layout layout)
+    {
+        return format != Format::MsgPack && (layout == Layout::Rows || !hasEnvelope(format));
+    }
+
+    explicit DbEncoder(Format format, Layout layout = Layout::Rows);
+
+    // Начать тело; колонки и их типы берутся из result. rowCount - сколько
+    // строк будет всего (-1 - неизвестно, только если supportsStreaming).
+    // paged - в обертке будет поле next
+    void begin(const pqxx::result &result, qint64 rowCount = -1, bool paged = false);
+    // Первые count строк result (-1 - все)
+    void appendRows(const pqxx::result &result, int count = -1);
+    // Закончить тело; next - токен следующей страницы, пустой - null
+    void finish(const QByteArray &next = QByteArray());
+
+    // Готовая часть тела; при потоковой отдаче забирается по кускам
+    QByteArray takeOutput();
+
+private:
+    enum class Kind { Text, Integer, Real, Bool };
+
+    void appendKey(QByteArray &out, const QByteArray &name) const;
+    void appendValue(QByteArray &out, const pqxx::field &field, Kind kind) const;
+
+    Format m_format;
+    Layout m_layout;
+    bool m_paged;
+    qint64 m_rows;
+    std::vector<QByteArray> m_names;   // имена колонок, UTF-8
+    std::vector<QByteArray> m_keys;    // имена колонок, уже закодированные ключами
+    std::vector<Kind> m_kinds;
+    std::vector<QByteArray> m_columns; // значения по колонкам для Layout::Columns
+    QByteArray m_out;
+};
+
+#endif // DBENCODER_H
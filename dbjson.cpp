@@ -0,0 +1,74 @@
+#include "dbjson.h"
+#include <QJsonObject>
+#include <QString>
+#include <cstring>
+
+QJsonArray DbJson::rowsToArray(const pqxx::result &result)
+{
+    QJsonArray items;
+    for (auto row : result) {
+        QJsonObject item;
+        for (auto field : row) {
+            item[QString::fromStdString(field.name())] = QString::fromStdString(field.c_str());
+        }
+        items.append(item);
+    }
+    return items;
+}
+
+std::vector<QByteArray> DbJson::columnKeys(const pqxx::result &result)
+{
+    std::vector<QByteArray> keys;
+    keys.reserve(size_t(result.columns()));
+    for (pqxx::row::size_type i = 0; i < result.columns(); ++i) {
+        QByteArray key;
+        appendString(key, result.column_name(i), std::strlen(result.column_name(i)));
+        keys.push_back(key + ":");
+    }
+    return keys;
+}
+
+void DbJson::appendRows(QByteArray &out, const pqxx::result &result,
+                        const std::vector<QByteArray> &keys, bool &firstRow)
+{
+    for (auto row : result) {
+        out.append(firstRow ? "{" : ",{");
+        firstRow = false;
+        for (pqxx::row::size_type i = 0; i < row.size(); ++i) {
+            if (i > 0) out.append(',');
+            out.append(keys[size_t(i)]);
+            pqxx::field field = row[i];
+            appendString(out, field.c_str(), field.is_null() ? 0 : field.size());
+        }
+        out.append('}');
+    }
+}
+
+void DbJson::appendString(QByteArray &out, const char *data, size_t size)
+{
+    // UTF-8 из libpq копируется как есть, экранируются только спецсимволы
+    static const char hex[] = "0123456789abcdef";
+    out.append('"');
+    const char *runStart = data;
+    for (const char *p = data; p != data + size; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(runStart, int(p - runStart));
+        runStart = p + 1;
+        switch (c) {
+        case '"': out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+            out.append("\\u00");
+            out.append(hex[c >> 4]);
+            out.append(hex[c & 0xf]);
+            break;
+        }
+    }
+    out.append(runStart, int(data + size - runStart));
+    out.append('"');
+}
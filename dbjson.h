@@ -0,0 +1,26 @@
+#ifndef DBJSON_H
+#define DBJSON_H
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <pqxx/pqxx>
+#include <vector>
+
+// Преобразование строк pqxx::result в JSON для /api/db.
+// Значения отдаются строками, NULL - пустой строкой.
+class DbJson
+{
+public:
+    // Массив объектов через QJsonObject (обычная выборка)
+    static QJsonArray rowsToArray(const pqxx::result &result);
+
+    // Потоковый вариант: имена колонок экранируются один раз,
+    // строки дописываются в out компактным JSON через запятую
+    static std::vector<QByteArray> columnKeys(const pqxx::result &result);
+    static void appendRows(QByteArray &out, const pqxx::result &result,
+                           const std::vector<QByteArray> &keys, bool &firstRow);
+
+    static void appendString(QByteArray &out, const char *data, size_t size);
+};
+
+#endif // DBJSON_H
@@ -0,0 +1,48 @@
+#include "dbpagetoken.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonValue>
+
+namespace {
+
+// Первый элемент массива - версия формата
+const int TokenVersion = 1;
+
+const QByteArray::Base64Options TokenEncoding =
+    QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals;
+
+}
+
+QByteArray DbPageToken::encode() const
+{
+    QJsonArray fields;
+    fields.append(TokenVersion);
+    fields.append(QString::fromStdString(column));
+    fields.append(desc);
+    fields.append(value ? QJsonValue(QString::fromStdString(*value)) : QJsonValue());
+    fields.append(QString::fromStdString(key));
+    return QJsonDocument(fields).toJson(QJsonDocument::Compact).toBase64(TokenEncoding);
+}
+
+bool DbPageToken::decode(const QByteArray &token, DbPageToken &result)
+{
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromBase64(token, TokenEncoding), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isArray())
+        return false;
+
+    const QJsonArray fields = doc.array();
+    if (fields.size() != 5 || fields.at(0).toInt() != TokenVersion
+        || !fields.at(1).isString() || !fields.at(2).isBool()
+        || !(fields.at(3).isString() || fields.at(3).isNull()) || !fields.at(4).isString())
+        return false;
+
+    result.column = fields.at(1).toString().toStdString();
+    result.desc = fields.at(2).toBool();
+    if (fields.at(3).isNull())
+        result.value.reset();
+    else
+        result.value = fields.at(3).toString().toStdString();
+    result.key = fields.at(4).toString().toStdString();
+    return result.isValid();
+}
@@ -0,0 +1,27 @@
+#ifndef DBPAGETOKEN_H
+#define DBPAGETOKEN_H
+
+#include <QByteArray>
+#include <optional>
+#include <string>
+
+// Продолжение постраничной выборки GET /api/db/<table>: порядок сортировки
+// и ключ последней отданной строки. Клиенту отдается непрозрачной строкой
+// (поле next ответа), обратно приходит параметром _after. Значения из
+// токена идут в запрос только параметрами, так что подделка токена дает
+// не больше, чем подделка _order и фильтров.
+struct DbPageToken
+{
+    std::string column;               // колонка _order; пустая - сортировка только по id
+    bool desc = false;
+    std::optional<std::string> value; // column в последней строке, nullopt - NULL
+    std::string key;                  // id последней строки
+
+    bool isValid() const { return !key.empty(); }
+
+    // base64url от компактного JSON, без '=' в конце - можно класть в URL как есть
+    QByteArray encode() const;
+    static bool decode(const QByteArray &token, DbPageToken &result);
+};
+
+#endif // DBPAGETOKEN_H
@@ -0,0 +1,170 @@
+#include "dbresponsecache.h"
+#include <QMutexLocker>
+
+DbResponseCache::DbResponseCache(qint64 maxBytes, qint64 maxEntryBytes, int defaultTtlMs) :
+    m_maxBytes(maxBytes),
+    m_maxEntryBytes(qMin(maxEntryBytes, maxBytes)),
+    m_defaultTtlMs(defaultTtlMs),
+    m_allGeneration(0),
+    m_bytes(0),
+    m_hits(0),
+    m_staleHits(0),
+    m_misses(0),
+    m_coalesced(0),
+    m_invalidations(0)
+{
+    m_clock.start();
+}
+
+void DbResponseCache::setTableTtl(const QString &table, int ttlMs)
+{
+    m_tableTtl.insert(table, ttlMs);
+}
+
+QByteArray DbResponseCache::key(const QString &table, const QMap<QString, QString> &params)
+{
+    // Разделители - управляющие символы, которых нет в именах таблиц и параметров
+    QByteArray key = table.toUtf8();
+    for (auto it = params.begin(); it != params.end(); ++it) {
+        if (it.key() == "_cache") continue;
+        key.append('\x1e');
+        key.append(it.key().toUtf8());
+        key.append('\x1f');
+        key.append(it.value().toUtf8());
+    }
+    return key;
+}
+
+DbResponseCache::Status DbResponseCache::lookup(const QString &table, const QByteArray &key,
+                                                const HttpResponderPtr &responder,
+                                                HttpResponse &response, quint64 &generation)
+{
+    qint64 now = m_clock.elapsed();
+    QMutexLocker locker(&m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end() && it->expiresAt > now) {
+        m_lru.splice(m_lru.begin(), m_lru, it->lruPos);
+        ++m_hits;
+        response = it->response;
+        return Status::Hit;
+    }
+
+    // Загрузка, начатая до изменения таблицы, свежим данным не считается:
+    // после записи запросы ждут новую загрузку, а не ту, что уже идет
+    generation = generationLocked(table);
+    QByteArray flight = loadingKey(key, generation);
+    auto loading = m_loading.find(flight);
+    if (loading != m_loading.end()) {
+        // Истекшую запись обновляет один запрос, остальные пока получают старую,
+        // но не дольше еще одного TTL
+        if (it != m_entries.end() && now - it->expiresAt < it->ttlMs) {
+            ++m_staleHits;
+            response = it->response;
+            return Status::Hit;
+        }
+        loading->append(responder);
+        ++m_coalesced;
+        return Status::Wait;
+    }
+
+    m_loading.insert(flight, QVector<HttpResponderPtr>());
+    ++m_misses;
+    return Status::Load;
+}
+
+void DbResponseCache::complete(const QString &table, const QByteArray &key, const HttpResponse &response,
+                               quint64 generation)
+{
+    QVector<HttpResponderPtr> waiting;
+    {
+        qint64 now = m_clock.elapsed();
+        QMutexLocker locker(&m_mutex);
+        waiting = m_loading.take(loadingKey(key, generation));
+
+        int ttlMs = ttl(table);
+        qint64 size = key.size() + response.size();
+        if (response.status() == 200 && ttlMs > 0 && size <= m_maxEntryBytes
+            && generation == generationLocked(table)) {
+            removeLocked(key);
+            while (!m_lru.empty() && m_bytes + size > m_maxBytes)
+                removeLocked(m_lru.back());
+
+            m_lru.push_front(key);
+            Entry entry;
+            entry.table = table;
+            entry.response = response;
+            entry.size = size;
+            entry.expiresAt = now + ttlMs;
+            entry.ttlMs = ttlMs;
+            entry.lruPos = m_lru.begin();
+            m_entries.insert(key, entry);
+            m_tableKeys[table].insert(key);
+            m_bytes += size;
+        }
+    }
+
+    // Отправка - вне блокировки: responder только ставит ответ в очередь соединения
+    for (const HttpResponderPtr &responder : waiting)
+        responder->send(response);
+}
+
+void DbResponseCache::invalidate(const QString &table)
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_invalidations;
+
+    // Загрузки, начатые до изменения, не должны положить в кеш старые данные
+    if (table.isEmpty()) {
+        ++m_allGeneration;
+        m_entries.clear();
+        m_lru.clear();
+        m_tableKeys.clear();
+        m_bytes = 0;
+        return;
+    }
+
+    ++m_tableGenerations[table];
+    const QSet<QByteArray> keys = m_tableKeys.take(table);
+    for (const QByteArray &key : keys)
+        removeLocked(key);
+}
+
+qint64 DbResponseCache::bytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytes;
+}
+
+int DbResponseCache::entries() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.size();
+}
+
+QByteArray DbResponseCache::loadingKey(const QByteArray &key, quint64 generation)
+{
+    return key + '\x1d' + QByteArray::number(generation);
+}
+
+quint64 DbResponseCache::generationLocked(const QString &table) const
+{
+    // Оба счетчика только растут, поэтому их сумма меняется при любом сбросе
+    return m_allGeneration + m_tableGenerations.value(table, 0);
+}
+
+void DbResponseCache::removeLocked(const QByteArray &key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) return;
+
+    auto keys = m_tableKeys.find(it->table);
+    if (keys != m_tableKeys.end()) {
+        keys->remove(key);
+        if (keys->isEmpty())
+            m_tableKeys.erase(keys);
+    }
+    m_bytes -= it->size;
+    m_lru.erase(it->lruPos);
+    m_entries.erase(it);
+}
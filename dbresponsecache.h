@@ -0,0 +1,101 @@
+#ifndef DBRESPONSECACHE_H
+#define DBRESPONSECACHE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <list>
+#include "httpresponder.h"
+#include "httpresponse.h"
+
+// Кеш готовых ответов GET /api/db/<table>. Ключ - таблица и параметры
+// запроса, значение - ответ целиком (заголовки и JSON-тело), который
+// отдается без запроса в БД и без сериализации.
+//
+// Записи таблицы сбрасываются, когда сервер в нее пишет или приходит
+// NOTIFY о ее изменении. Один и тот же промах загружается один раз:
+// остальные запросы ждут его результат (ответ приходит их responder'ам),
+// а пока истекшая запись обновляется, им отдается старая.
+class DbResponseCache
+{
+public:
+    enum class Status {
+        Hit,   // ответ в response
+        Load,  // загрузить самому и обязательно вызвать complete()
+        Wait   // этот ключ уже загружается - ответ придет responder'у из complete()
+    };
+
+    DbResponseCache(qint64 maxBytes, qint64 maxEntryBytes, int defaultTtlMs);
+
+    // До начала работы: TTL для отдельных таблиц, 0 - таблицу не кешировать
+    void setTableTtl(const QString &table, int ttlMs);
+    int ttl(const QString &table) const { return m_tableTtl.value(table, m_defaultTtlMs); }
+    bool isCacheable(const QString &table) const { return isEnabled() && ttl(table) > 0; }
+    bool isEnabled() const { return m_maxBytes > 0; }
+
+    // Таблица и параметры (QMap уже отсортирован по имени); _cache в ключ не входит
+    static QByteArray key(const QString &table, const QMap<QString, QString> &params);
+
+    // generation - снимок поколения таблицы для complete()
+    Status lookup(const QString &table, const QByteArray &key, const HttpResponderPtr &responder,
+                  HttpResponse &response, quint64 &generation);
+    // Результат загрузки после Load. Кладется в кеш, если это 200 и таблица
+    // не менялась с момента lookup, и в любом случае уходит ждавшим запросам
+    void complete(const QString &table, const QByteArray &key, const HttpResponse &response,
+                  quint64 generation);
+
+    // Таблица изменилась; пустое имя - все таблицы (например, после переподключения LISTEN)
+    void invalidate(const QString &table);
+
+    quint64 hits() const { return m_hits.load(); }
+    quint64 staleHits() const { return m_staleHits.load(); }
+    quint64 misses() const { return m_misses.load(); }
+    quint64 coalesced() const { return m_coalesced.load(); }
+    quint64 invalidations() const { return m_invalidations.load(); }
+    qint64 bytes() const;
+    int entries() const;
+
+private:
+    struct Entry
+    {
+        QString table;
+        HttpResponse response;
+        qint64 size;
+        qint64 expiresAt;
+        int ttlMs;
+        std::list<QByteArray>::iterator lruPos;
+    };
+
+    static QByteArray loadingKey(const QByteArray &key, quint64 generation);
+    quint64 generationLocked(const QString &table) const;
+    void removeLocked(const QByteArray &key);
+
+    qint64 m_maxBytes;
+    qint64 m_maxEntryBytes;
+    int m_defaultTtlMs;
+    QHash<QString, int> m_tableTtl; // меняется только до начала работы
+
+    mutable QMutex m_mutex;
+    QHash<QByteArray, Entry> m_entries;
+    std::list<QByteArray> m_lru; // в начале - недавно использованные
+    QHash<QString, QSet<QByteArray>> m_tableKeys;
+    QHash<QByteArray, QVector<HttpResponderPtr>> m_loading; // ключ и поколение загружаются: кто ждет ответ
+    QHash<QString, quint64> m_tableGenerations;
+    quint64 m_allGeneration;
+    qint64 m_bytes;
+    QElapsedTimer m_clock;
+
+    std::atomic<quint64> m_hits;
+    std::atomic<quint64> m_staleHits;
+    std::atomic<quint64> m_misses;
+    std::atomic<quint64> m_coalesced;
+    std::atomic<quint64> m_invalidations;
+};
+
+#endif // DBRESPONSECACHE_H
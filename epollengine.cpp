@@ -0,0 +1,365 @@
+#include "epollengine.h"
+
+#ifdef Q_OS_LINUX
+
+#include <QDebug>
+#include <QSocketNotifier>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+// Событий за один epoll_wait; остальные заберем на следующем пробуждении
+static const int MaxEvents = 256;
+// Общий буфер чтения воркера: запрос с заголовками обычно влезает целиком
+static const int ReadBufferSize = 64 * 1024;
+// Частей ответа в одном sendmsg
+static const int MaxIov = 64;
+
+static const uint32_t ListenEvents = EPOLLIN | EPOLLET;
+static const uint32_t SocketEvents = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+EpollEngine::EpollEngine(AcceptHandler onAccept, QObject *parent) :
+    QObject(parent),
+    m_onAccept(std::move(onAccept)),
+    m_epollFd(::epoll_create1(EPOLL_CLOEXEC)),
+    m_listenFd(-1),
+    m_notifier(nullptr),
+    m_readBuffer(ReadBufferSize),
+    m_inBatch(false)
+{
+    if (m_epollFd < 0) {
+        qWarning() << "epoll_create1 failed:" << strerror(errno);
+        return;
+    }
+    // Дескриптор epoll читаем, пока в нем есть готовые события
+    m_notifier = new QSocketNotifier(m_epollFd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, [this]() { processEvents(); });
+}
+
+EpollEngine::~EpollEngine()
+{
+    delete m_notifier;
+    if (m_listenFd >= 0)
+        ::close(m_listenFd);
+    if (m_epollFd >= 0)
+        ::close(m_epollFd);
+}
+
+bool EpollEngine::listen(quint16 port)
+{
+    if (!isValid()) return false;
+
+    // Сначала IPv6 с приемом IPv4 (как QHostAddress::Any), без IPv6 - только IPv4
+    int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bool ipv6 = fd >= 0;
+    if (!ipv6)
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        qWarning() << "socket() failed:" << strerror(errno);
+        return false;
+    }
+
+    int on = 1;
+    int off = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // Свой listener у каждого воркера на одном порту
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        qWarning() << "SO_REUSEPORT is not supported:" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    int result;
+    if (ipv6) {
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        sockaddr_in6 address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        result = ::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    } else {
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        result = ::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    }
+    if (result < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        qWarning() << "Failed to listen on port" << port << ":" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    // data.ptr == nullptr - это listener, у соединений там их транспорт
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = ListenEvents;
+    event.data.ptr = nullptr;
+    if (::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        qWarning() << "epoll_ctl(listener) failed:" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    m_listenFd = fd;
+    return true;
+}
+
+void EpollEngine::setAccepting(bool accepting)
+{
+    if (m_listenFd < 0) return;
+
+    // epoll_ctl потокобезопасен. После MOD ядро заново проверит готовность,
+    // так что ждущие в backlog подключения придут событием сразу
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = accepting ? ListenEvents : 0;
+    event.data.ptr = nullptr;
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_MOD, m_listenFd, &event);
+}
+
+void EpollEngine::processEvents()
+{
+    epoll_event events[MaxEvents];
+    int count;
+    do {
+        count = ::epoll_wait(m_epollFd, events, MaxEvents, 0);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) return;
+
+    m_inBatch = true;
+    for (int i = 0; i < count; ++i) {
+        EpollTransport *transport = static_cast<EpollTransport *>(events[i].data.ptr);
+        if (!transport) {
+            acceptPending();
+            continue;
+        }
+
+        // Закрытые раньше в этой же пачке живут до deleteLater соединения, но дескриптора у них нет
+        const uint32_t flags = events[i].events;
+        if (transport->m_fd >= 0 && (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            transport->readable(m_readBuffer.data(), int(m_readBuffer.size()));
+        if (transport->m_fd >= 0 && (flags & (EPOLLHUP | EPOLLERR)) && !(flags & EPOLLIN))
+            transport->closeSocket();
+        if (transport->m_fd >= 0 && (flags & EPOLLOUT) && transport->m_queued > 0)
+            markDirty(transport);
+    }
+    flushDirty();
+    m_inBatch = false;
+}
+
+void EpollEngine::acceptPending()
+{
+    // Edge-triggered: забираем все подключения до EAGAIN
+    while (true) {
+        sockaddr_storage address;
+        socklen_t length = sizeof(address);
+        int fd = ::accept4(m_listenFd, reinterpret_cast<sockaddr *>(&address), &length,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            // EMFILE/ENFILE: оставшиеся ждут в backlog до следующего подключения
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                qWarning() << "accept4 failed:" << strerror(errno);
+            return;
+        }
+
+        // Ответ уходит одним sendmsg целиком - Nagle только задержал бы его
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        m_onAccept(fd, QHostAddress(reinterpret_cast<sockaddr *>(&address)));
+    }
+}
+
+void EpollEngine::markDirty(EpollTransport *transport)
+{
+    if (transport->m_dirty) return;
+    transport->m_dirty = true;
+    m_dirty.push_back(transport);
+
+    // Ответ пришел не из пачки (пул БД, таймер) - отправляем на ближайшем проходе цикла
+    if (!m_inBatch && m_dirty.size() == 1)
+        QMetaObject::invokeMethod(this, [this]() {
+            m_inBatch = true;
+            flushDirty();
+            m_inBatch = false;
+        }, Qt::QueuedConnection);
+}
+
+void EpollEngine::forget(EpollTransport *transport)
+{
+    if (transport->m_dirty)
+        m_dirty.erase(std::remove(m_dirty.begin(), m_dirty.end(), transport), m_dirty.end());
+}
+
+void EpollEngine::flushDirty()
+{
+    // Обработчик bytesWritten может дописать еще - тогда соединение снова окажется в списке
+    while (!m_dirty.empty()) {
+        std::vector<EpollTransport *> dirty;
+        dirty.swap(m_dirty);
+        for (EpollTransport *transport : dirty) {
+            transport->m_dirty = false;
+            qint64 sent = transport->flush();
+            if (sent > 0 && transport->m_handler)
+                transport->m_handler->transportBytesWritten(sent);
+        }
+    }
+}
+
+EpollTransport::EpollTransport(EpollEngine *engine, int socketDescriptor, const QHostAddress &peer) :
+    m_engine(engine),
+    m_fd(socketDescriptor),
+    m_peer(peer),
+    m_queued(0),
+    m_dirty(false),
+    m_closeWhenFlushed(false)
+{
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = SocketEvents;
+    event.data.ptr = this;
+    if (::epoll_ctl(m_engine->m_epollFd, EPOLL_CTL_ADD, m_fd, &event) < 0) {
+        qWarning() << "epoll_ctl(socket) failed:" << strerror(errno);
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+EpollTransport::~EpollTransport()
+{
+    m_engine->forget(this);
+    // Закрытый дескриптор epoll убирает из набора сам
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+void EpollTransport::readable(char *buffer, int size)
+{
+    while (m_fd >= 0) {
+        ssize_t received = ::recv(m_fd, buffer, size_t(size), 0);
+        if (received > 0) {
+            // Единственная копия: из общего буфера сразу в данные, которые заберет парсер
+            m_unread.append(buffer, int(received));
+            if (m_handler)
+                m_handler->transportReadyRead();
+            // Прочитали меньше буфера - сокет пуст, новые данные придут новым событием
+            if (received < size)
+                return;
+            continue;
+        }
+        if (received == 0) {
+            // Клиент закрыл соединение
+            closeSocket();
+            return;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            closeSocket();
+        return;
+    }
+}
+
+QByteArray EpollTransport::readAll()
+{
+    QByteArray data;
+    data.swap(m_unread);
+    return data;
+}
+
+void EpollTransport::write(const HttpBody *parts, int count)
+{
+    if (m_fd < 0 || m_closeWhenFlushed) return;
+
+    for (int i = 0; i < count; ++i) {
+        if (parts[i].isEmpty()) continue;
+        m_queue.push_back(parts[i]);
+        m_queued += parts[i].size();
+    }
+    if (m_queued > 0)
+        m_engine->markDirty(this);
+}
+
+qint64 EpollTransport::flush()
+{
+    qint64 total = 0;
+    while (m_fd >= 0 && !m_queue.empty()) {
+        iovec iov[MaxIov];
+        int count = 0;
+        for (auto it = m_queue.begin(); it != m_queue.end() && count < MaxIov; ++it, ++count) {
+            iov[count].iov_base = const_cast<char *>(it->constData());
+            iov[count].iov_len = size_t(it->size());
+        }
+
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = size_t(count);
+        // MSG_NOSIGNAL: без QTcpSocket никто не выключил SIGPIPE
+        ssize_t sent = ::sendmsg(m_fd, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;   // допишем по EPOLLOUT
+            closeSocket();
+            return -1;
+        }
+
+        total += sent;
+        m_queued -= sent;
+        while (sent > 0) {
+            HttpBody &front = m_queue.front();
+            if (sent >= front.size()) {
+                sent -= front.size();
+                m_queue.pop_front();
+            } else {
+                front = front.mid(int(sent), front.size() - int(sent));
+                sent = 0;
+            }
+        }
+    }
+
+    if (m_fd >= 0 && m_queue.empty() && m_closeWhenFlushed)
+        closeSocket();
+    return total;
+}
+
+void EpollTransport::disconnectFromHost()
+{
+    if (m_fd < 0) return;
+    if (m_queue.empty()) {
+        closeSocket();
+        return;
+    }
+    // Закроем, когда уйдет очередь
+    m_closeWhenFlushed = true;
+    m_engine->markDirty(this);
+}
+
+void EpollTransport::abort()
+{
+    if (m_fd < 0) return;
+    closeSocket();
+}
+
+void EpollTransport::closeSocket()
+{
+    ::close(m_fd);
+    m_fd = -1;
+    m_queue.clear();
+    m_queued = 0;
+    m_unread.clear();
+    if (m_handler)
+        m_handler->transportClosed();
+}
+
+#endif // Q_OS_LINUX
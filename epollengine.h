@@ -0,0 +1,101 @@
+#ifndef EPOLLENGINE_H
+#define EPOLLENGINE_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "httptransport.h"
+
+#ifdef Q_OS_LINUX
+
+class QSocketNotifier;
+class EpollTransport;
+
+// Свой ввод-вывод воркера (server/io_engine=epoll) вместо QTcpServer и
+// QTcpSocket. У каждого воркера - свой слушающий сокет с SO_REUSEPORT
+// (ядро само раскидывает подключения, без передачи между потоками)
+// и свой epoll в режиме edge-triggered, в котором и listener, и все
+// соединения воркера. В цикл событий Qt встроен одним QSocketNotifier
+// на дескриптор epoll: таймеры и ответы из пула БД работают как раньше.
+//
+// За одно пробуждение: до MaxEvents событий из epoll_wait, accept до
+// EAGAIN, чтение в общий буфер воркера, а записанное обработчиками
+// уходит в конце пачки одним sendmsg на соединение (все ответы
+// pipelining и заголовки с телом - одним вызовом).
+class EpollEngine : public QObject
+{
+    Q_OBJECT
+public:
+    // Новое соединение: неблокирующий дескриптор и адрес клиента
+    typedef std::function<void(int socketDescriptor, const QHostAddress &peer)> AcceptHandler;
+
+    explicit EpollEngine(AcceptHandler onAccept, QObject *parent = nullptr);
+    ~EpollEngine();
+
+    bool isValid() const { return m_epollFd >= 0; }
+    // Слушать порт на всех адресах (IPv6 с IPv4, если есть); вызывать в потоке движка
+    bool listen(quint16 port);
+    // Приостановить/возобновить accept; можно из любого потока
+    void setAccepting(bool accepting);
+
+private:
+    friend class EpollTransport;
+
+    void processEvents();
+    void acceptPending();
+    void markDirty(EpollTransport *transport);
+    void forget(EpollTransport *transport);
+    void flushDirty();
+
+    AcceptHandler m_onAccept;
+    int m_epollFd;
+    int m_listenFd;
+    QSocketNotifier *m_notifier;
+    std::vector<char> m_readBuffer;          // общий буфер чтения всех соединений воркера
+    std::vector<EpollTransport *> m_dirty;   // есть что отправить в конце пачки
+    bool m_inBatch;
+};
+
+// Соединение в EpollEngine: неблокирующий сокет, чтение через общий
+// буфер движка и очередь частей ответа вместо буфера записи - тела
+// (кеш статики, готовый JSON) уходят в sendmsg без копирования.
+class EpollTransport : public HttpTransport
+{
+public:
+    EpollTransport(EpollEngine *engine, int socketDescriptor, const QHostAddress &peer);
+    ~EpollTransport();
+
+    bool isOpen() const override { return m_fd >= 0; }
+    qintptr socketDescriptor() const override { return m_fd; }
+    QHostAddress peerAddress() const override { return m_peer; }
+    QByteArray readAll() override;
+    void write(const HttpBody *parts, int count) override;
+    using HttpTransport::write;
+    qint64 bytesToWrite() const override { return m_queued; }
+    void disconnectFromHost() override;
+    void abort() override;
+
+private:
+    friend class EpollEngine;
+
+    void readable(char *buffer, int size);
+    // Отправить очередь; сколько байт ушло (-1 - сокет закрыт из-за ошибки)
+    qint64 flush();
+    void closeSocket();
+
+    EpollEngine *m_engine;
+    int m_fd;
+    QHostAddress m_peer;
+    QByteArray m_unread;              // прочитанное, но еще не забранное обработчиком
+    std::deque<HttpBody> m_queue;
+    qint64 m_queued;
+    bool m_dirty;
+    bool m_closeWhenFlushed;
+};
+
+#endif // Q_OS_LINUX
+
+#endif // EPOLLENGINE_H
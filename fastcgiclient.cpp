@@ -0,0 +1,423 @@
+#include "fastcgiclient.h"
+#include "httpserver.h"
+#include "metrics.h"
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+// FastCGI 1.0: типы записей и роли
+enum : quint8 {
+    FcgiVersion = 1,
+    FcgiBeginRequest = 1,
+    FcgiAbortRequest = 2,
+    FcgiEndRequest = 3,
+    FcgiParams = 4,
+    FcgiStdin = 5,
+    FcgiStdout = 6,
+    FcgiStderr = 7
+};
+
+const quint16 FcgiResponder = 1;
+const quint8 FcgiKeepConn = 1;
+const int FcgiHeaderSize = 8;
+const int FcgiMaxContent = 65535;
+// Заголовки скрипта без конца - считаем ответ битым
+const int MaxCgiHeaderSize = 64 * 1024;
+
+}
+
+struct FastCgiClient::Request
+{
+    quint16 id = 0;
+    HttpResponderPtr responder;
+    QByteArray payload;       // BEGIN_REQUEST + PARAMS + STDIN, готовые к записи
+    QByteArray headerBuffer;  // CGI-заголовки, пока не пришли целиком
+    bool headersSent = false;
+    Connection *connection = nullptr;
+    QTimer *timer = nullptr;
+    QElapsedTimer started;
+};
+
+struct FastCgiClient::Connection
+{
+    QIODevice *socket = nullptr;
+    bool connected = false;
+    QByteArray readBuffer;
+    QByteArray writeBuffer;   // до установки соединения
+    QHash<quint16, Request *> requests;
+    quint16 nextId = 1;
+};
+
+FastCgiClient::FastCgiClient(const QString &address, int maxConnections, int requestsPerConnection,
+                             int timeoutMs, QObject *parent) :
+    QObject(parent),
+    m_address(address),
+    m_maxConnections(qMax(1, maxConnections)),
+    m_requestsPerConnection(qBound(1, requestsPerConnection, 65535)),
+    m_timeoutMs(timeoutMs),
+    m_activeRequests(0)
+{
+}
+
+FastCgiClient::~FastCgiClient()
+{
+    while (!m_connections.isEmpty())
+        closeConnection(m_connections.first());
+    for (Request *request : m_queue) {
+        failRequest(request, 502, "FastCGI client stopped");
+        delete request;
+    }
+    m_queue.clear();
+}
+
+void FastCgiClient::execute(const QMap<QString, QString> &params, const QByteArray &stdinData,
+                            const HttpResponderPtr &responder)
+{
+    Request *request = new Request;
+    request->responder = responder;
+    request->started.start();
+
+    // id проставляется при отправке, поэтому payload собирается с нулем и правится позже
+    QByteArray begin(8, '\0');
+    begin[0] = char(FcgiResponder >> 8);
+    begin[1] = char(FcgiResponder & 0xff);
+    begin[2] = char(FcgiKeepConn);
+    request->payload.append(encodeRecord(FcgiBeginRequest, 0, begin));
+    request->payload.append(encodeRecord(FcgiParams, 0, encodeParams(params)));
+    request->payload.append(encodeRecord(FcgiParams, 0, QByteArray()));
+    request->payload.append(encodeRecord(FcgiStdin, 0, stdinData));
+    if (!stdinData.isEmpty())
+        request->payload.append(encodeRecord(FcgiStdin, 0, QByteArray()));
+
+    if (m_timeoutMs > 0) {
+        request->timer = new QTimer(this);
+        request->timer->setSingleShot(true);
+        connect(request->timer, &QTimer::timeout, this, [this, request]() { onTimeout(request); });
+        request->timer->start(m_timeoutMs);
+    }
+
+    ++m_activeRequests;
+    if (Connection *connection = pickConnection())
+        dispatch(request, connection);
+    else
+        m_queue.push_back(request);
+}
+
+FastCgiClient::Connection *FastCgiClient::pickConnection()
+{
+    // Самое свободное из открытых соединений, иначе новое, пока есть лимит
+    Connection *best = nullptr;
+    for (Connection *connection : m_connections) {
+        if (connection->requests.size() >= m_requestsPerConnection) continue;
+        if (!best || connection->requests.size() < best->requests.size())
+            best = connection;
+    }
+    if (best && best->requests.isEmpty())
+        return best;
+    if (m_connections.size() < m_maxConnections)
+        return openConnection();
+    return best;
+}
+
+FastCgiClient::Connection *FastCgiClient::openConnection()
+{
+    Connection *connection = new Connection;
+    m_connections.append(connection);
+
+    auto onConnected = [this, connection]() {
+        connection->connected = true;
+        if (!connection->writeBuffer.isEmpty()) {
+            connection->socket->write(connection->writeBuffer);
+            connection->writeBuffer.clear();
+        }
+    };
+
+    // host:port - TCP, иначе путь к unix-сокету
+    int colon = m_address.lastIndexOf(':');
+    if (colon > 0 && !m_address.startsWith('/')) {
+        QTcpSocket *socket = new QTcpSocket(this);
+        connection->socket = socket;
+        connect(socket, &QTcpSocket::connected, this, onConnected);
+        connect(socket, &QTcpSocket::disconnected, this, [this, connection]() { onDisconnected(connection); });
+        connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this,
+                [this, connection](QAbstractSocket::SocketError) { onDisconnected(connection); });
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        socket->connectToHost(m_address.left(colon), quint16(m_address.mid(colon + 1).toUInt()));
+    } else {
+        QLocalSocket *socket = new QLocalSocket(this);
+        connection->socket = socket;
+        connect(socket, &QLocalSocket::connected, this, onConnected);
+        connect(socket, &QLocalSocket::disconnected, this, [this, connection]() { onDisconnected(connection); });
+        connect(socket, QOverload<QLocalSocket::LocalSocketError>::of(&QLocalSocket::error), this,
+                [this, connection](QLocalSocket::LocalSocketError) { onDisconnected(connection); });
+        socket->connectToServer(m_address);
+    }
+    connect(connection->socket, &QIODevice::readyRead, this, [this, connection]() { onReadyRead(connection); });
+    return connection;
+}
+
+void FastCgiClient::dispatch(Request *request, Connection *connection)
+{
+    quint16 id = connection->nextId;
+    while (connection->requests.contains(id) || id == 0)
+        ++id;
+    connection->nextId = quint16(id + 1);
+
+    request->id = id;
+    request->connection = connection;
+    connection->requests.insert(id, request);
+
+    // Проставляем id во все записи запроса
+    char *data = request->payload.data();
+    for (int pos = 0; pos + FcgiHeaderSize <= request->payload.size();) {
+        data[pos + 2] = char(id >> 8);
+        data[pos + 3] = char(id & 0xff);
+        int length = (quint8(data[pos + 4]) << 8) | quint8(data[pos + 5]);
+        pos += FcgiHeaderSize + length + quint8(data[pos + 6]);
+    }
+
+    if (connection->connected)
+        connection->socket->write(request->payload);
+    else
+        connection->writeBuffer.append(request->payload);
+    request->payload.clear();
+}
+
+void FastCgiClient::dispatchQueued()
+{
+    while (!m_queue.empty()) {
+        Connection *connection = pickConnection();
+        if (!connection) return;
+        Request *request = m_queue.front();
+        m_queue.pop_front();
+        dispatch(request, connection);
+    }
+}
+
+void FastCgiClient::onReadyRead(Connection *connection)
+{
+    connection->readBuffer.append(connection->socket->readAll());
+
+    int pos = 0;
+    const QByteArray &buffer = connection->readBuffer;
+    while (buffer.size() - pos >= FcgiHeaderSize) {
+        const uchar *header = reinterpret_cast<const uchar *>(buffer.constData() + pos);
+        quint16 requestId = quint16((header[2] << 8) | header[3]);
+        int length = (header[4] << 8) | header[5];
+        int padding = header[6];
+        if (buffer.size() - pos < FcgiHeaderSize + length + padding)
+            break;
+
+        QByteArray content = buffer.mid(pos + FcgiHeaderSize, length);
+        pos += FcgiHeaderSize + length + padding;
+        handleRecord(connection, header[1], requestId, content);
+        // Соединение могло закрыться внутри обработчика
+        if (!m_connections.contains(connection)) return;
+    }
+    connection->readBuffer.remove(0, pos);
+}
+
+void FastCgiClient::handleRecord(Connection *connection, quint8 type, quint16 requestId, const QByteArray &content)
+{
+    Request *request = connection->requests.value(requestId);
+    if (!request) return; // ответ на уже отмененный запрос
+
+    switch (type) {
+    case FcgiStdout:
+        if (!content.isEmpty())
+            handleStdout(request, content);
+        break;
+    case FcgiStderr:
+        qWarning() << "PHP FastCGI stderr:" << content.trimmed();
+        break;
+    case FcgiEndRequest:
+        finishRequest(connection, request);
+        break;
+    default:
+        break;
+    }
+}
+
+void FastCgiClient::handleStdout(Request *request, const QByteArray &data)
+{
+    if (request->headersSent) {
+        request->responder->writeBody(data);
+        return;
+    }
+
+    request->headerBuffer.append(data);
+    int headerEnd = request->headerBuffer.indexOf("\r\n\r\n");
+    int separator = 4;
+    if (headerEnd == -1) {
+        headerEnd = request->headerBuffer.indexOf("\n\n");
+        separator = 2;
+    }
+    if (headerEnd == -1) {
+        if (request->headerBuffer.size() > MaxCgiHeaderSize) {
+            failRequest(request, 502, "Invalid response from PHP FastCGI");
+            request->headersSent = true; // остальной вывод скрипта игнорируем
+        }
+        return;
+    }
+
+    // Длину, если скрипт ее указал, сохраняем - тогда тело идет без chunked
+    QByteArray head = cgiHeadersToHttp(request->headerBuffer.left(headerEnd), true);
+    request->responder->beginStream(head + "\r\n");
+    request->headersSent = true;
+
+    QByteArray body = request->headerBuffer.mid(headerEnd + separator);
+    request->headerBuffer.clear();
+    if (!body.isEmpty())
+        request->responder->writeBody(body);
+}
+
+void FastCgiClient::finishRequest(Connection *connection, Request *request)
+{
+    connection->requests.remove(request->id);
+    if (request->responder->isStreaming())
+        request->responder->endStream();
+    else if (!request->responder->isSent())
+        failRequest(request, 502, "Invalid response from PHP FastCGI");
+    Metrics::global().php().record(request->started.nsecsElapsed() / 1000);
+
+    delete request->timer;
+    delete request;
+    --m_activeRequests;
+    dispatchQueued();
+}
+
+void FastCgiClient::failRequest(Request *request, int code, const QString &message)
+{
+    if (request->responder->isStreaming())
+        request->responder->abortStream();
+    else if (!request->responder->isSent())
+        request->responder->send(HttpServer::createErrorResponse(code, message));
+}
+
+void FastCgiClient::onTimeout(Request *request)
+{
+    qWarning() << "PHP FastCGI request timed out after" << m_timeoutMs << "ms";
+    failRequest(request, 504, "PHP FastCGI timeout");
+    Metrics::global().php().record(request->started.nsecsElapsed() / 1000);
+
+    Connection *connection = request->connection;
+    if (!connection) {
+        // Еще ждал свободного соединения
+        m_queue.erase(std::find(m_queue.begin(), m_queue.end(), request));
+    } else {
+        connection->requests.remove(request->id);
+        // Воркер мог повиснуть - просим прервать, а соединение с одним запросом просто закрываем
+        if (connection->requests.isEmpty()) {
+            closeConnection(connection);
+        } else if (connection->connected) {
+            connection->socket->write(encodeRecord(FcgiAbortRequest, request->id, QByteArray()));
+        }
+    }
+
+    request->timer->deleteLater();
+    delete request;
+    --m_activeRequests;
+    dispatchQueued();
+}
+
+void FastCgiClient::onDisconnected(Connection *connection)
+{
+    if (!m_connections.contains(connection)) return;
+
+    if (!connection->connected)
+        qWarning() << "Cannot connect to PHP FastCGI at" << m_address;
+
+    closeConnection(connection);
+    dispatchQueued();
+}
+
+void FastCgiClient::closeConnection(Connection *connection)
+{
+    m_connections.removeOne(connection);
+
+    for (Request *request : connection->requests) {
+        failRequest(request, 502, "PHP FastCGI connection lost");
+        Metrics::global().php().record(request->started.nsecsElapsed() / 1000);
+        delete request->timer;
+        delete request;
+        --m_activeRequests;
+    }
+    connection->requests.clear();
+
+    connection->socket->disconnect(this);
+    connection->socket->close();
+    connection->socket->deleteLater();
+    delete connection;
+}
+
+QByteArray FastCgiClient::encodeRecord(quint8 type, quint16 requestId, const QByteArray &content)
+{
+    QByteArray record;
+    int offset = 0;
+    // Пустое содержимое - тоже запись (конец потока PARAMS/STDIN)
+    do {
+        int length = qMin(FcgiMaxContent, content.size() - offset);
+        int padding = (8 - length % 8) % 8;
+        char header[FcgiHeaderSize] = {
+            char(FcgiVersion), char(type),
+            char(requestId >> 8), char(requestId & 0xff),
+            char(length >> 8), char(length & 0xff),
+            char(padding), 0
+        };
+        record.append(header, FcgiHeaderSize);
+        record.append(content.constData() + offset, length);
+        record.append(padding, '\0');
+        offset += length;
+    } while (offset < content.size());
+    return record;
+}
+
+QByteArray FastCgiClient::encodeParams(const QMap<QString, QString> &params)
+{
+    auto appendLength = [](QByteArray &out, int length) {
+        if (length < 128) {
+            out.append(char(length));
+        } else {
+            out.append(char(((length >> 24) & 0x7f) | 0x80));
+            out.append(char((length >> 16) & 0xff));
+            out.append(char((length >> 8) & 0xff));
+            out.append(char(length & 0xff));
+        }
+    };
+
+    QByteArray out;
+    for (auto it = params.begin(); it != params.end(); ++it) {
+        QByteArray name = it.key().toUtf8();
+        QByteArray value = it.value().toUtf8();
+        appendLength(out, name.size());
+        appendLength(out, value.size());
+        out.append(name);
+        out.append(value);
+    }
+    return out;
+}
+
+QByteArray FastCgiClient::cgiHeadersToHttp(const QByteArray &cgiHeaders, bool keepContentLength)
+{
+    QByteArray statusLine = "HTTP/1.1 200 OK\r\n";
+    QByteArray headers;
+    for (const QByteArray &line : cgiHeaders.split('\n')) {
+        QByteArray header = line.trimmed();
+        if (header.isEmpty()) continue;
+        QByteArray lower = header.toLower();
+        if (lower.startsWith("status:")) {
+            statusLine = "HTTP/1.1 " + header.mid(7).trimmed() + "\r\n";
+            continue;
+        }
+        if (lower.startsWith("content-length:") && !keepContentLength) continue;
+        // Кадрирование тела - забота соединения
+        if (lower.startsWith("transfer-encoding:") || lower.startsWith("connection:")) continue;
+        headers.append(header + "\r\n");
+    }
+    return statusLine + headers;
+}
@@ -0,0 +1,69 @@
+#ifndef FASTCGICLIENT_H
+#define FASTCGICLIENT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <deque>
+#include "httpresponder.h"
+
+class QIODevice;
+class QTimer;
+
+// Клиент FastCGI к долгоживущим PHP-воркерам (php-fpm или php-cgi -b).
+// Держит переиспользуемые соединения (FCGI_KEEP_CONN), при включенном
+// мультиплексировании ведет несколько запросов по одному соединению.
+// Вывод скрипта передается клиенту по мере прихода, без буферизации.
+// Живет в потоке воркера: у каждого потока свой клиент и свои соединения.
+class FastCgiClient : public QObject
+{
+    Q_OBJECT
+public:
+    // address - путь к unix-сокету или host:port
+    FastCgiClient(const QString &address, int maxConnections, int requestsPerConnection,
+                  int timeoutMs, QObject *parent = nullptr);
+    ~FastCgiClient();
+
+    // params - CGI-переменные (SCRIPT_FILENAME, QUERY_STRING, ...)
+    void execute(const QMap<QString, QString> &params, const QByteArray &stdinData,
+                 const HttpResponderPtr &responder);
+
+    int activeRequests() const { return m_activeRequests; }
+    int queuedRequests() const { return int(m_queue.size()); }
+
+    // CGI-заголовки скрипта -> строка статуса и заголовки HTTP (без пустой строки)
+    static QByteArray cgiHeadersToHttp(const QByteArray &cgiHeaders, bool keepContentLength);
+
+private:
+    struct Request;
+    struct Connection;
+
+    Connection *pickConnection();
+    Connection *openConnection();
+    void dispatch(Request *request, Connection *connection);
+    void dispatchQueued();
+    void onReadyRead(Connection *connection);
+    void onDisconnected(Connection *connection);
+    void handleRecord(Connection *connection, quint8 type, quint16 requestId, const QByteArray &content);
+    void handleStdout(Request *request, const QByteArray &data);
+    void finishRequest(Connection *connection, Request *request);
+    void failRequest(Request *request, int code, const QString &message);
+    void onTimeout(Request *request);
+    void closeConnection(Connection *connection);
+
+    static QByteArray encodeRecord(quint8 type, quint16 requestId, const QByteArray &content);
+    static QByteArray encodeParams(const QMap<QString, QString> &params);
+
+    QString m_address;
+    int m_maxConnections;
+    int m_requestsPerConnection;
+    int m_timeoutMs;
+
+    QList<Connection *> m_connections;
+    std::deque<Request *> m_queue;
+    int m_activeRequests;
+};
+
+#endif // FASTCGICLIENT_H
@@ -0,0 +1,555 @@
+#include "hpack.h"
+#include <QHash>
+
+namespace {
+
+const int StaticTableSize = 61;
+// Накладные расходы записи таблицы сверх имени и значения (RFC 7541, 4.1)
+const int EntryOverhead = 32;
+// Больше динамической таблицы кодеру не нужно, даже если клиент разрешает
+const int DefaultTableSize = 4096;
+
+struct StaticEntry
+{
+    const char *name;
+    const char *value;
+};
+
+// RFC 7541, приложения A и B
+const quint32 HuffmanCodes[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+    0x3fffffff
+};
+
+const quint8 HuffmanLengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+
+const StaticEntry StaticTable[StaticTableSize] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" }
+};
+
+// Код канонический: коды одной длины идут подряд, а любой более длинный
+// код начинается с префикса, большего всех кодов этой длины. Поэтому
+// символ находится сравнением с границей для каждой длины, без дерева.
+struct HuffmanDecodeTable
+{
+    quint32 first[32];   // первый код длины
+    quint32 limit[32];   // коды этой длины меньше limit
+    int offset[32];      // место первого символа длины в symbols
+    quint16 symbols[257];
+
+    HuffmanDecodeTable()
+    {
+        int count[32] = {};
+        for (int symbol = 0; symbol < 257; ++symbol)
+            ++count[HuffmanLengths[symbol]];
+
+        quint32 code = 0;
+        int position = 0;
+        for (int length = 1; length < 32; ++length) {
+            first[length] = code;
+            limit[length] = code + quint32(count[length]);
+            offset[length] = position;
+            position += count[length];
+            code = (code + quint32(count[length])) << 1;
+        }
+
+        int next[32];
+        for (int length = 0; length < 32; ++length)
+            next[length] = offset[length];
+        for (int symbol = 0; symbol < 257; ++symbol)
+            symbols[next[HuffmanLengths[symbol]]++] = quint16(symbol);
+    }
+};
+
+const HuffmanDecodeTable &huffmanDecodeTable()
+{
+    static const HuffmanDecodeTable table;
+    return table;
+}
+
+// Первый индекс статической таблицы для имени; записи с одним именем идут подряд
+const QHash<QByteArray, int> &staticNames()
+{
+    static const QHash<QByteArray, int> names = []() {
+        QHash<QByteArray, int> result;
+        for (int i = StaticTableSize - 1; i >= 0; --i)
+            result.insert(QByteArray(StaticTable[i].name), i + 1);
+        return result;
+    }();
+    return names;
+}
+
+int entrySize(const HpackHeader &header)
+{
+    return header.name.size() + header.value.size() + EntryOverhead;
+}
+
+void writeInteger(QByteArray &out, quint8 flags, int prefixBits, quint32 value)
+{
+    const quint32 max = (1u << prefixBits) - 1;
+    if (value < max) {
+        out.append(char(flags | value));
+        return;
+    }
+    out.append(char(flags | max));
+    value -= max;
+    while (value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+bool readInteger(const uchar *&p, const uchar *end, int prefixBits, quint32 &value)
+{
+    const quint32 max = (1u << prefixBits) - 1;
+    value = *p++ & max;
+    if (value < max)
+        return true;
+
+    // Больше 2^28 в заголовках не бывает - дальше только атака на переполнение
+    for (int shift = 0; shift <= 21; shift += 7) {
+        if (p == end)
+            return false;
+        uchar byte = *p++;
+        value += quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool readString(const uchar *&p, const uchar *end, QByteArray &out)
+{
+    if (p == end)
+        return false;
+    bool huffman = *p & 0x80;
+    quint32 length;
+    if (!readInteger(p, end, 7, length) || length > quint32(end - p))
+        return false;
+
+    const char *data = reinterpret_cast<const char *>(p);
+    p += length;
+    if (huffman) {
+        out.clear();
+        return HpackEncoder::huffmanDecode(data, int(length), out);
+    }
+    out = QByteArray(data, int(length));
+    return true;
+}
+
+}
+
+HpackDecoder::HpackDecoder(int maxTableSize) :
+    m_tableBytes(0),
+    m_tableLimit(maxTableSize),
+    m_maxTableSize(maxTableSize),
+    m_maxHeaderListSize(64 * 1024)
+{
+}
+
+HpackDecoder::Status HpackDecoder::decode(const char *data, int size, std::vector<HpackHeader> &headers)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + size;
+    int listSize = 0;
+    bool tooLarge = false;
+    bool headerSeen = false;
+
+    while (p < end) {
+        HpackHeader header;
+        uchar first = *p;
+
+        if (first & 0x80) {
+            // Индексированное поле
+            quint32 index;
+            if (!readInteger(p, end, 7, index))
+                return fail("Truncated index");
+            if (!lookup(index, header))
+                return fail(QString("Invalid index %1").arg(index));
+        } else if ((first & 0xe0) == 0x20) {
+            // Новый размер динамической таблицы - только в начале блока
+            quint32 limit;
+            if (headerSeen)
+                return fail("Table size update after a header field");
+            if (!readInteger(p, end, 5, limit))
+                return fail("Truncated table size update");
+            if (limit > quint32(m_maxTableSize))
+                return fail(QString("Table size %1 exceeds the advertised %2").arg(limit).arg(m_maxTableSize));
+            m_tableLimit = int(limit);
+            evict(m_tableLimit);
+            continue;
+        } else {
+            // Литерал: с добавлением в таблицу (01), без (0000) или никогда (0001)
+            bool indexing = (first & 0xc0) == 0x40;
+            quint32 nameIndex;
+            if (!readInteger(p, end, indexing ? 6 : 4, nameIndex))
+                return fail("Truncated literal");
+            if (nameIndex > 0) {
+                HpackHeader named;
+                if (!lookup(nameIndex, named))
+                    return fail(QString("Invalid name index %1").arg(nameIndex));
+                header.name = named.name;
+            } else if (!readString(p, end, header.name)) {
+                return fail("Invalid header name string");
+            }
+            if (!readString(p, end, header.value))
+                return fail("Invalid header value string");
+            if (indexing)
+                insert(header);
+        }
+
+        headerSeen = true;
+        // Слишком длинный список дочитываем до конца: таблица должна остаться согласованной
+        listSize += entrySize(header);
+        if (listSize > m_maxHeaderListSize)
+            tooLarge = true;
+        if (!tooLarge)
+            headers.push_back(header);
+    }
+
+    return tooLarge ? Status::TooLarge : Status::Ok;
+}
+
+HpackDecoder::Status HpackDecoder::fail(const QString &message)
+{
+    m_error = message;
+    return Status::Error;
+}
+
+bool HpackDecoder::lookup(quint32 index, HpackHeader &header) const
+{
+    if (index == 0)
+        return false;
+    if (index <= quint32(StaticTableSize)) {
+        header.name = QByteArray::fromRawData(StaticTable[index - 1].name, int(qstrlen(StaticTable[index - 1].name)));
+        header.value = QByteArray::fromRawData(StaticTable[index - 1].value, int(qstrlen(StaticTable[index - 1].value)));
+        return true;
+    }
+    quint32 dynamicIndex = index - StaticTableSize - 1;
+    if (dynamicIndex >= m_table.size())
+        return false;
+    header = m_table[dynamicIndex];
+    return true;
+}
+
+void HpackDecoder::insert(const HpackHeader &header)
+{
+    int size = entrySize(header);
+    // Запись больше таблицы просто очищает ее (RFC 7541, 4.4)
+    evict(m_tableLimit - size);
+    if (size > m_tableLimit)
+        return;
+    m_table.push_front(header);
+    m_tableBytes += size;
+}
+
+void HpackDecoder::evict(int limit)
+{
+    while (!m_table.empty() && m_tableBytes > qMax(0, limit)) {
+        m_tableBytes -= entrySize(m_table.back());
+        m_table.pop_back();
+    }
+}
+
+HpackEncoder::HpackEncoder() :
+    m_tableBytes(0),
+    m_tableLimit(DefaultTableSize),
+    m_pendingLimit(-1),
+    m_minPendingLimit(DefaultTableSize)
+{
+}
+
+void HpackEncoder::setMaxTableSize(int bytes)
+{
+    int limit = qBound(0, bytes, DefaultTableSize);
+    if (m_pendingLimit < 0) {
+        if (limit == m_tableLimit)
+            return;
+        m_minPendingLimit = limit;
+    }
+    m_pendingLimit = limit;
+    m_minPendingLimit = qMin(m_minPendingLimit, limit);
+}
+
+void HpackEncoder::begin(QByteArray &block)
+{
+    if (m_pendingLimit < 0)
+        return;
+
+    // Если размер уменьшался, декодер должен увидеть минимум, иначе он не выкинет нужные записи
+    if (m_minPendingLimit < m_pendingLimit) {
+        writeInteger(block, 0x20, 5, quint32(m_minPendingLimit));
+        evict(m_minPendingLimit);
+    }
+    writeInteger(block, 0x20, 5, quint32(m_pendingLimit));
+    m_tableLimit = m_pendingLimit;
+    evict(m_tableLimit);
+    m_pendingLimit = -1;
+}
+
+void HpackEncoder::add(QByteArray &block, const QByteArray &name, const QByteArray &value, Indexing indexing)
+{
+    int fullIndex = 0;
+    int nameIndex = 0;
+    find(name, value, fullIndex, nameIndex);
+    if (fullIndex > 0) {
+        writeInteger(block, 0x80, 7, quint32(fullIndex));
+        return;
+    }
+
+    switch (indexing) {
+    case Index:
+        writeInteger(block, 0x40, 6, quint32(nameIndex));
+        break;
+    case NoIndex:
+        writeInteger(block, 0x00, 4, quint32(nameIndex));
+        break;
+    case NeverIndex:
+        writeInteger(block, 0x10, 4, quint32(nameIndex));
+        break;
+    }
+    if (nameIndex == 0)
+        writeString(block, name);
+    writeString(block, value);
+
+    if (indexing == Index)
+        insert(name, value);
+}
+
+void HpackEncoder::find(const QByteArray &name, const QByteArray &value, int &fullIndex, int &nameIndex) const
+{
+    fullIndex = 0;
+    nameIndex = 0;
+
+    auto it = staticNames().constFind(name);
+    if (it != staticNames().constEnd()) {
+        nameIndex = it.value();
+        for (int i = nameIndex - 1; i < StaticTableSize && name == StaticTable[i].name; ++i) {
+            if (value == StaticTable[i].value) {
+                fullIndex = i + 1;
+                return;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m_table.size(); ++i) {
+        const HpackHeader &entry = m_table[i];
+        if (entry.name != name)
+            continue;
+        if (entry.value == value) {
+            fullIndex = StaticTableSize + 1 + int(i);
+            return;
+        }
+        if (nameIndex == 0)
+            nameIndex = StaticTableSize + 1 + int(i);
+    }
+}
+
+void HpackEncoder::insert(const QByteArray &name, const QByteArray &value)
+{
+    HpackHeader header;
+    header.name = name;
+    header.value = value;
+    int size = entrySize(header);
+    evict(m_tableLimit - size);
+    if (size > m_tableLimit)
+        return;
+    m_table.push_front(header);
+    m_tableBytes += size;
+}
+
+void HpackEncoder::evict(int limit)
+{
+    while (!m_table.empty() && m_tableBytes > qMax(0, limit)) {
+        m_tableBytes -= entrySize(m_table.back());
+        m_table.pop_back();
+    }
+}
+
+void HpackEncoder::writeString(QByteArray &block, const QByteArray &data)
+{
+    int encodedLength = huffmanLength(data);
+    if (encodedLength < data.size()) {
+        writeInteger(block, 0x80, 7, quint32(encodedLength));
+        huffmanEncode(data, block);
+    } else {
+        writeInteger(block, 0x00, 7, quint32(data.size()));
+        block.append(data);
+    }
+}
+
+int HpackEncoder::huffmanLength(const QByteArray &data)
+{
+    qint64 bits = 0;
+    for (char c : data)
+        bits += HuffmanLengths[uchar(c)];
+    return int((bits + 7) / 8);
+}
+
+void HpackEncoder::huffmanEncode(const QByteArray &data, QByteArray &out)
+{
+    quint64 accumulator = 0;
+    int bits = 0;
+    for (char c : data) {
+        uchar symbol = uchar(c);
+        accumulator = (accumulator << HuffmanLengths[symbol]) | HuffmanCodes[symbol];
+        bits += HuffmanLengths[symbol];
+        while (bits >= 8) {
+            bits -= 8;
+            out.append(char(accumulator >> bits));
+        }
+    }
+    // Дополнение - старшие биты EOS, то есть единицы
+    if (bits > 0)
+        out.append(char((accumulator << (8 - bits)) | (0xff >> bits)));
+}
+
+bool HpackEncoder::huffmanDecode(const char *data, int size, QByteArray &out)
+{
+    const HuffmanDecodeTable &table = huffmanDecodeTable();
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + size;
+    out.reserve(out.size() + size * 8 / 5);
+
+    quint64 accumulator = 0;
+    int bits = 0;
+    while (true) {
+        while (bits <= 56 && p < end) {
+            accumulator = (accumulator << 8) | *p++;
+            bits += 8;
+        }
+        if (bits == 0)
+            return true;
+
+        // Самый короткий код - 5 бит, самый длинный - 30
+        bool found = false;
+        for (int length = 5; length <= 30 && length <= bits; ++length) {
+            quint32 code = quint32(accumulator >> (bits - length)) & ((1u << length) - 1);
+            if (code < table.limit[length]) {
+                quint16 symbol = table.symbols[table.offset[length] + int(code - table.first[length])];
+                if (symbol == 256)
+                    return false;
+                out.append(char(symbol));
+                bits -= length;
+                found = true;
+                break;
+            }
+        }
+        if (found)
+            continue;
+
+        // Недописанный код в конце - это дополнение: не длиннее 7 бит и только единицы
+        quint64 mask = (quint64(1) << bits) - 1;
+        return bits <= 7 && (accumulator & mask) == mask;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <QByteArray>
+#include <QString>
+#include <deque>
+#include <vector>
+
+// Сжатие заголовков HTTP/2 (RFC 7541): статическая и динамическая
+// таблицы и код Хаффмана. Декодер и кодер - по одному на направление
+// соединения, их таблицы должны меняться в порядке блоков заголовков.
+
+struct HpackHeader
+{
+    QByteArray name;   // в нижнем регистре
+    QByteArray value;
+};
+
+class HpackDecoder
+{
+public:
+    enum class Status {
+        Ok,
+        TooLarge,   // блок разобран, но список длиннее maxHeaderListSize - запрос отклоняется
+        Error       // COMPRESSION_ERROR: состояние таблицы потеряно, соединение закрывается
+    };
+
+    // maxTableSize - SETTINGS_HEADER_TABLE_SIZE, объявленный клиенту
+    explicit HpackDecoder(int maxTableSize = 4096);
+
+    void setMaxHeaderListSize(int bytes) { m_maxHeaderListSize = bytes; }
+
+    Status decode(const char *data, int size, std::vector<HpackHeader> &headers);
+    QString errorString() const { return m_error; }
+
+private:
+    Status fail(const QString &message);
+    bool lookup(quint32 index, HpackHeader &header) const;
+    void insert(const HpackHeader &header);
+    void evict(int limit);
+
+    std::deque<HpackHeader> m_table;  // новые записи - в начале
+    int m_tableBytes;
+    int m_tableLimit;                 // текущий размер, меняется клиентом в блоках
+    int m_maxTableSize;
+    int m_maxHeaderListSize;
+    QString m_error;
+};
+
+class HpackEncoder
+{
+public:
+    enum Indexing {
+        Index,          // в динамическую таблицу: повтор займет байт-два
+        NoIndex,        // меняется от ответа к ответу (Content-Length)
+        NeverIndex      // секреты (Set-Cookie): посредники тоже не должны индексировать
+    };
+
+    HpackEncoder();
+
+    // SETTINGS_HEADER_TABLE_SIZE клиента; изменение уйдет в начале следующего блока
+    void setMaxTableSize(int bytes);
+
+    // Начать блок заголовков (обязательно перед первым add)
+    void begin(QByteArray &block);
+    void add(QByteArray &block, const QByteArray &name, const QByteArray &value, Indexing indexing = Index);
+
+    static int huffmanLength(const QByteArray &data);
+    static void huffmanEncode(const QByteArray &data, QByteArray &out);
+    // false - битый код, EOS или неправильное дополнение
+    static bool huffmanDecode(const char *data, int size, QByteArray &out);
+
+private:
+    // Индекс (статический - 1..61, динамический - дальше) полного совпадения или только имени
+    void find(const QByteArray &name, const QByteArray &value, int &fullIndex, int &nameIndex) const;
+    void insert(const QByteArray &name, const QByteArray &value);
+    void evict(int limit);
+    static void writeString(QByteArray &block, const QByteArray &data);
+
+    std::deque<HpackHeader> m_table;
+    int m_tableBytes;
+    int m_tableLimit;
+    int m_pendingLimit;   // -1 - размер не менялся
+    int m_minPendingLimit;
+};
+
+#endif // HPACK_H
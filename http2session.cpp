@@ -0,0 +1,1080 @@
+#include "http2session.h"
+#include "httpconnection.h"
+#include "httpserver.h"
+#include <QDebug>
+
+// Флаги кадров
+static const quint8 FlagEndStream = 0x1;
+static const quint8 FlagAck = 0x1;
+static const quint8 FlagEndHeaders = 0x4;
+static const quint8 FlagPadded = 0x8;
+static const quint8 FlagPriority = 0x20;
+
+static const int FrameHeaderSize = 9;
+// SETTINGS_MAX_FRAME_SIZE сервера - значение по умолчанию, больших кадров не принимаем
+static const int MaxFrameSize = 16384;
+// Начальные окна и размер таблицы HPACK до обмена SETTINGS (RFC 9113, 6.5.2)
+static const qint64 DefaultWindowSize = 65535;
+static const qint64 MaxWindowSize = 0x7fffffff;
+// Больше этого в буфере сокета не кладем - остальное ждет в потоках по приоритету
+static const qint64 OutputHighWater = 256 * 1024;
+// Сколько тела файла читаем за раз
+static const qint64 FileChunkSize = 64 * 1024;
+
+namespace {
+
+void appendUInt16(QByteArray &out, quint16 value)
+{
+    out.append(char(value >> 8));
+    out.append(char(value));
+}
+
+void appendUInt32(QByteArray &out, quint32 value)
+{
+    out.append(char(value >> 24));
+    out.append(char(value >> 16));
+    out.append(char(value >> 8));
+    out.append(char(value));
+}
+
+quint32 readUInt32(const char *data)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+// Убрать дополнение кадра с флагом PADDED; false - длина дополнения больше кадра
+bool stripPadding(quint8 flags, const char *&payload, int &length)
+{
+    if (!(flags & FlagPadded))
+        return true;
+    if (length < 1)
+        return false;
+    int padding = uchar(payload[0]);
+    ++payload;
+    --length;
+    if (padding > length)
+        return false;
+    length -= padding;
+    return true;
+}
+
+bool hasUpperCase(const QByteArray &name)
+{
+    for (char c : name) {
+        if (c >= 'A' && c <= 'Z')
+            return true;
+    }
+    return false;
+}
+
+// Заголовки соединения HTTP/1.1: в HTTP/2 запрещены в запросе и не передаются в ответе
+bool isConnectionHeader(const QByteArray &name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+}
+
+Http2Session::Http2Session(HttpConnection *connection) :
+    m_connection(connection),
+    m_server(connection->m_server),
+    m_settings(m_server->m_http2Settings),
+    m_inputPos(0),
+    m_prefaceReceived(false),
+    m_processing(false),
+    m_closed(false),
+    m_goingAway(false),
+    m_lastStreamId(0),
+    m_lastServedId(0),
+    m_headerStreamId(0),
+    m_headerFlags(0),
+    m_headerWeight(0),
+    m_peerMaxFrameSize(MaxFrameSize),
+    m_peerInitialWindow(DefaultWindowSize),
+    m_connectionSendWindow(DefaultWindowSize),
+    m_connectionReceiveWindow(DefaultWindowSize),
+    m_connectionUnacknowledged(0),
+    m_outputBytes(0)
+{
+    m_decoder.setMaxHeaderListSize(m_settings.maxHeaderListSize);
+    ++m_server->m_http2Connections;
+}
+
+Http2Session::~Http2Session()
+{
+    closeStreamWindows();
+}
+
+const QByteArray &Http2Session::preface()
+{
+    static const QByteArray value("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+    return value;
+}
+
+void Http2Session::start()
+{
+    QByteArray settings;
+    appendUInt16(settings, 0x3); // MAX_CONCURRENT_STREAMS
+    appendUInt32(settings, quint32(m_settings.maxConcurrentStreams));
+    appendUInt16(settings, 0x4); // INITIAL_WINDOW_SIZE
+    appendUInt32(settings, quint32(m_settings.streamWindowSize));
+    appendUInt16(settings, 0x6); // MAX_HEADER_LIST_SIZE
+    appendUInt32(settings, quint32(m_settings.maxHeaderListSize));
+    appendUInt16(settings, 0x9); // NO_RFC7540_PRIORITIES: приоритеты - заголовком priority
+    appendUInt32(settings, 1);
+    queueFrame(FrameSettings, 0, 0, settings);
+
+    // Окно соединения SETTINGS не меняет - только WINDOW_UPDATE
+    if (m_settings.connectionWindowSize > DefaultWindowSize) {
+        QByteArray increment;
+        appendUInt32(increment, quint32(m_settings.connectionWindowSize - DefaultWindowSize));
+        queueFrame(FrameWindowUpdate, 0, 0, increment);
+        m_connectionReceiveWindow = m_settings.connectionWindowSize;
+    }
+    flushOutput();
+}
+
+bool Http2Session::startUpgraded(HttpRequest request, const QByteArray &settings)
+{
+    // HTTP2-Settings - payload кадра SETTINGS в base64url
+    QByteArray payload = QByteArray::fromBase64(settings, QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
+    if (payload.size() % 6 != 0)
+        return false;
+
+    m_connection->m_socket->write(QByteArrayLiteral("HTTP/1.1 101 Switching Protocols\r\n"
+                                                    "Connection: Upgrade\r\nUpgrade: h2c\r\n\r\n"));
+    start();
+
+    m_processing = true;
+    if (applySettings(payload.constData(), payload.size())) {
+        // Запрос, пришедший в HTTP/1.1, - поток 1, уже закрытый клиентом
+        m_lastStreamId = 1;
+        Stream &stream = m_streams[1];
+        stream.id = 1;
+        stream.remoteClosed = true;
+        stream.receiveWindow = m_settings.streamWindowSize;
+        stream.sendWindow = m_peerInitialWindow;
+        stream.body.swap(request.body);
+        stream.request = std::move(request);
+        dispatch(1);
+    }
+    m_processing = false;
+    scheduleOutput();
+    return true;
+}
+
+void Http2Session::receive(const QByteArray &data)
+{
+    if (m_closed || data.isEmpty()) return;
+
+    if (m_inputPos >= m_input.size()) {
+        m_input = data;
+        m_inputPos = 0;
+    } else {
+        m_input.append(data);
+    }
+
+    m_processing = true;
+    processInput();
+    m_processing = false;
+    scheduleOutput();
+}
+
+void Http2Session::writable()
+{
+    scheduleOutput();
+}
+
+void Http2Session::idleTimeout()
+{
+    if (m_closed || !m_streams.empty())
+        return;
+
+    // Клиент без запросов: прощаемся так, чтобы он знал, что ничего не потеряно
+    QByteArray payload;
+    appendUInt32(payload, m_lastStreamId);
+    appendUInt32(payload, NoError);
+    queueFrame(FrameGoAway, 0, 0, payload);
+    flushOutput();
+    m_closed = true;
+    m_connection->closeAfterWrite();
+}
+
+void Http2Session::closeStreamWindows()
+{
+    for (auto &entry : m_streams) {
+        if (entry.second.window)
+            entry.second.window->close();
+    }
+}
+
+void Http2Session::processInput()
+{
+    if (!m_prefaceReceived) {
+        const QByteArray &expected = preface();
+        int available = qMin(m_input.size() - m_inputPos, expected.size());
+        if (memcmp(m_input.constData() + m_inputPos, expected.constData(), size_t(available)) != 0) {
+            connectionError(ProtocolError, "Invalid connection preface");
+            return;
+        }
+        if (available < expected.size())
+            return;
+        m_inputPos += expected.size();
+        m_prefaceReceived = true;
+    }
+
+    while (!m_closed && m_input.size() - m_inputPos >= FrameHeaderSize) {
+        const uchar *header = reinterpret_cast<const uchar *>(m_input.constData() + m_inputPos);
+        int length = (int(header[0]) << 16) | (int(header[1]) << 8) | int(header[2]);
+        if (length > MaxFrameSize) {
+            connectionError(FrameSizeError, QString("Frame of %1 bytes").arg(length));
+            return;
+        }
+        if (m_input.size() - m_inputPos < FrameHeaderSize + length)
+            break;
+
+        const char *payload = m_input.constData() + m_inputPos + FrameHeaderSize;
+        quint32 id = readUInt32(reinterpret_cast<const char *>(header) + 5) & 0x7fffffff;
+        m_inputPos += FrameHeaderSize + length;
+        handleFrame(header[3], header[4], id, payload, length);
+    }
+
+    // Разобранное выбрасываем, чтобы буфер не рос на долгом соединении
+    if (m_inputPos >= m_input.size()) {
+        m_input.clear();
+        m_inputPos = 0;
+    } else if (m_inputPos > MaxFrameSize) {
+        m_input.remove(0, m_inputPos);
+        m_inputPos = 0;
+    }
+}
+
+void Http2Session::handleFrame(quint8 type, quint8 flags, quint32 id, const char *payload, int length)
+{
+    // Блок заголовков не прерывается никакими другими кадрами
+    if (m_headerStreamId != 0 && (type != FrameContinuation || id != m_headerStreamId)) {
+        connectionError(ProtocolError, "Expected CONTINUATION");
+        return;
+    }
+
+    switch (type) {
+    case FrameData:
+        handleData(flags, id, payload, length);
+        break;
+    case FrameHeaders:
+        handleHeaders(flags, id, payload, length);
+        break;
+    case FramePriority:
+        if (id == 0) {
+            connectionError(ProtocolError, "PRIORITY on stream 0");
+        } else if (length != 5) {
+            resetStream(id, FrameSizeError);
+            removeStream(id);
+        } else if (Stream *stream = findStream(id)) {
+            stream->urgency = 7 - int(uchar(payload[4])) / 32;
+        }
+        break;
+    case FrameRstStream:
+        if (id == 0 || id > m_lastStreamId)
+            connectionError(ProtocolError, "RST_STREAM on idle stream");
+        else if (length != 4)
+            connectionError(FrameSizeError, "RST_STREAM of wrong size");
+        else
+            removeStream(id);   // клиент отменил запрос - обработчик увидит закрытое окно
+        break;
+    case FrameSettings:
+        handleSettings(flags, id, payload, length);
+        break;
+    case FramePushPromise:
+        connectionError(ProtocolError, "PUSH_PROMISE from client");
+        break;
+    case FramePing:
+        if (id != 0)
+            connectionError(ProtocolError, "PING on a stream");
+        else if (length != 8)
+            connectionError(FrameSizeError, "PING of wrong size");
+        else if (!(flags & FlagAck))
+            queueFrame(FramePing, FlagAck, 0, QByteArray(payload, length));
+        break;
+    case FrameGoAway:
+        if (id != 0) {
+            connectionError(ProtocolError, "GOAWAY on a stream");
+            break;
+        }
+        // Начатые запросы доотвечаем, новых не будет
+        m_goingAway = true;
+        break;
+    case FrameWindowUpdate:
+        handleWindowUpdate(id, payload, length);
+        break;
+    case FrameContinuation:
+        handleContinuation(flags, id, payload, length);
+        break;
+    case FramePriorityUpdate:
+        if (id != 0)
+            connectionError(ProtocolError, "PRIORITY_UPDATE on a stream");
+        else
+            handlePriorityUpdate(payload, length);
+        break;
+    default:
+        // Неизвестные типы кадров игнорируются (RFC 9113, 4.1)
+        break;
+    }
+}
+
+void Http2Session::handleData(quint8 flags, quint32 id, const char *payload, int length)
+{
+    if (id == 0) {
+        connectionError(ProtocolError, "DATA on stream 0");
+        return;
+    }
+
+    // В окна идет весь кадр вместе с дополнением
+    const int flowLength = length;
+    if (flowLength > m_connectionReceiveWindow) {
+        connectionError(FlowControlError, "Connection receive window exceeded");
+        return;
+    }
+    m_connectionReceiveWindow -= flowLength;
+    m_connectionUnacknowledged += flowLength;
+    if (m_connectionUnacknowledged >= m_settings.connectionWindowSize / 2) {
+        QByteArray increment;
+        appendUInt32(increment, quint32(m_connectionUnacknowledged));
+        queueFrame(FrameWindowUpdate, 0, 0, increment);
+        m_connectionReceiveWindow += m_connectionUnacknowledged;
+        m_connectionUnacknowledged = 0;
+    }
+
+    if (!stripPadding(flags, payload, length)) {
+        connectionError(ProtocolError, "Invalid DATA padding");
+        return;
+    }
+
+    Stream *stream = findStream(id);
+    if (!stream) {
+        // Поток уже сброшен - кадры, отправленные до RST_STREAM, просто отбрасываем
+        if (id > m_lastStreamId)
+            connectionError(ProtocolError, "DATA on idle stream");
+        return;
+    }
+    if (stream->remoteClosed) {
+        resetStream(id, StreamClosed);
+        removeStream(id);
+        return;
+    }
+    if (flowLength > stream->receiveWindow) {
+        resetStream(id, FlowControlError);
+        removeStream(id);
+        return;
+    }
+    stream->receiveWindow -= flowLength;
+    stream->unacknowledged += flowLength;
+
+    if (flags & FlagEndStream)
+        stream->remoteClosed = true;
+
+    // Ответ уже идет (тело слишком большое) - остаток тела не нужен
+    if (stream->dispatched)
+        return;
+
+    if (stream->body.size() + qint64(length) > m_server->maxBodySize()) {
+        respondError(id, 413, "Payload Too Large");
+        return;
+    }
+    stream->body.append(payload, length);
+
+    if (stream->remoteClosed) {
+        dispatch(id);
+        return;
+    }
+    if (stream->unacknowledged >= m_settings.streamWindowSize / 2) {
+        QByteArray increment;
+        appendUInt32(increment, quint32(stream->unacknowledged));
+        queueFrame(FrameWindowUpdate, 0, id, increment);
+        stream->receiveWindow += stream->unacknowledged;
+        stream->unacknowledged = 0;
+    }
+}
+
+void Http2Session::handleHeaders(quint8 flags, quint32 id, const char *payload, int length)
+{
+    if (id == 0) {
+        connectionError(ProtocolError, "HEADERS on stream 0");
+        return;
+    }
+    if (!stripPadding(flags, payload, length)) {
+        connectionError(ProtocolError, "Invalid HEADERS padding");
+        return;
+    }
+
+    int weight = 0;
+    if (flags & FlagPriority) {
+        if (length < 5) {
+            connectionError(FrameSizeError, "HEADERS priority truncated");
+            return;
+        }
+        weight = int(uchar(payload[4])) + 1;
+        payload += 5;
+        length -= 5;
+    }
+
+    m_headerStreamId = id;
+    m_headerFlags = flags;
+    m_headerWeight = weight;
+    m_headerBlock = QByteArray(payload, length);
+    if (flags & FlagEndHeaders)
+        headerBlockComplete();
+}
+
+void Http2Session::handleContinuation(quint8 flags, quint32 id, const char *payload, int length)
+{
+    if (m_headerStreamId == 0 || id != m_headerStreamId) {
+        connectionError(ProtocolError, "Unexpected CONTINUATION");
+        return;
+    }
+    // Сжатый блок не бывает длиннее списка заголовков - бесконечный CONTINUATION обрываем
+    if (m_headerBlock.size() + length > m_settings.maxHeaderListSize) {
+        connectionError(EnhanceYourCalm, "Header block too large");
+        return;
+    }
+    m_headerBlock.append(payload, length);
+    if (flags & FlagEndHeaders)
+        headerBlockComplete();
+}
+
+void Http2Session::headerBlockComplete()
+{
+    const quint32 id = m_headerStreamId;
+    const bool endStream = m_headerFlags & FlagEndStream;
+    const int weight = m_headerWeight;
+    QByteArray block;
+    block.swap(m_headerBlock);
+    m_headerStreamId = 0;
+
+    // Разбираем любой блок, даже ненужный: таблица HPACK общая для соединения
+    std::vector<HpackHeader> headers;
+    HpackDecoder::Status status = m_decoder.decode(block.constData(), block.size(), headers);
+    if (status == HpackDecoder::Status::Error) {
+        connectionError(CompressionError, m_decoder.errorString());
+        return;
+    }
+
+    if (Stream *stream = findStream(id)) {
+        // Трейлеры после тела: обязательно с END_STREAM, содержимое не нужно
+        if (stream->remoteClosed || !endStream) {
+            resetStream(id, ProtocolError);
+            removeStream(id);
+            return;
+        }
+        stream->remoteClosed = true;
+        if (!stream->dispatched)
+            dispatch(id);
+        return;
+    }
+    if (id <= m_lastStreamId)
+        return; // поток, который мы уже сбросили
+    if (id % 2 == 0) {
+        connectionError(ProtocolError, "Client stream with an even id");
+        return;
+    }
+    m_lastStreamId = id;
+    if (m_goingAway)
+        return;
+    if (int(m_streams.size()) >= m_settings.maxConcurrentStreams) {
+        resetStream(id, RefusedStream);
+        return;
+    }
+
+    Stream &stream = m_streams[id];
+    stream.id = id;
+    stream.remoteClosed = endStream;
+    stream.receiveWindow = m_settings.streamWindowSize;
+    stream.sendWindow = m_peerInitialWindow;
+    // Вес RFC 7540 (1..256) в urgency: 256 - 0, по умолчанию (16) - 7
+    if (weight > 0)
+        stream.urgency = 7 - (weight - 1) / 32;
+    m_connection->m_idleTimer.stop();
+
+    if (status == HpackDecoder::Status::TooLarge) {
+        respondError(id, 431, "Request Header Fields Too Large");
+        return;
+    }
+
+    // Псевдозаголовки - в строку запроса, остальные - в HttpHeaders поверх одного буфера
+    QByteArray method, path, scheme, authority, cookies;
+    QByteArray source;
+    struct Span { int name; int nameLength; int value; int valueLength; };
+    std::vector<Span> spans;
+    spans.reserve(headers.size() + 2);
+    bool valid = true;
+    bool regularSeen = false;
+    bool hasHost = false;
+    bool expectContinue = false;
+
+    auto addHeader = [&](const QByteArray &name, const QByteArray &value) {
+        spans.push_back({ source.size(), name.size(), source.size() + name.size(), value.size() });
+        source.append(name);
+        source.append(value);
+    };
+
+    for (const HpackHeader &header : headers) {
+        if (header.name.startsWith(':')) {
+            if (regularSeen)
+                valid = false;
+            if (header.name == ":method")
+                method = header.value;
+            else if (header.name == ":path")
+                path = header.value;
+            else if (header.name == ":scheme")
+                scheme = header.value;
+            else if (header.name == ":authority")
+                authority = header.value;
+            else
+                valid = false;
+            continue;
+        }
+        regularSeen = true;
+        if (hasUpperCase(header.name) || isConnectionHeader(header.name)
+            || (header.name == "te" && header.value != "trailers")) {
+            valid = false;
+            continue;
+        }
+        // Cookie в HTTP/2 может прийти несколькими полями (RFC 9113, 8.2.3)
+        if (header.name == "cookie") {
+            if (!cookies.isEmpty())
+                cookies.append("; ");
+            cookies.append(header.value);
+            continue;
+        }
+        if (header.name == "host")
+            hasHost = true;
+        else if (header.name == "priority")
+            applyPriority(stream, header.value);
+        else if (header.name == "expect")
+            expectContinue = header.value.toLower() == "100-continue";
+        addHeader(header.name, header.value);
+    }
+    if (!cookies.isEmpty())
+        addHeader(QByteArrayLiteral("cookie"), cookies);
+    if (!hasHost && !authority.isEmpty())
+        addHeader(QByteArrayLiteral("host"), authority);
+
+    // Разные content-length тоже делают запрос некорректным (RFC 9113, 8.1.1)
+    stream.request.headers.setSource(source);
+    for (const Span &span : spans) {
+        if (!stream.request.headers.append(span.name, span.nameLength, span.value, span.valueLength))
+            valid = false;
+    }
+
+    if (!valid || method.isEmpty() || path.isEmpty() || scheme.isEmpty()) {
+        resetStream(id, ProtocolError);
+        removeStream(id);
+        return;
+    }
+
+    stream.request.method = method;
+    stream.request.target = path;
+    stream.request.version = QByteArrayLiteral("HTTP/2");
+
+    if (stream.remoteClosed) {
+        dispatch(id);
+    } else if (expectContinue) {
+        QByteArray informational;
+        m_encoder.begin(informational);
+        m_encoder.add(informational, QByteArrayLiteral(":status"), QByteArrayLiteral("100"));
+        queueHeaderBlock(id, informational, false);
+    }
+}
+
+void Http2Session::handleSettings(quint8 flags, quint32 id, const char *payload, int length)
+{
+    if (id != 0) {
+        connectionError(ProtocolError, "SETTINGS on a stream");
+        return;
+    }
+    if (flags & FlagAck) {
+        if (length != 0)
+            connectionError(FrameSizeError, "SETTINGS ACK with payload");
+        return;
+    }
+    if (length % 6 != 0) {
+        connectionError(FrameSizeError, "SETTINGS of wrong size");
+        return;
+    }
+    if (applySettings(payload, length))
+        queueFrame(FrameSettings, FlagAck, 0);
+}
+
+bool Http2Session::applySettings(const char *payload, int length)
+{
+    for (int offset = 0; offset + 6 <= length; offset += 6) {
+        const uchar *p = reinterpret_cast<const uchar *>(payload + offset);
+        quint16 setting = quint16((p[0] << 8) | p[1]);
+        quint32 value = readUInt32(payload + offset + 2);
+
+        switch (setting) {
+        case 0x1: // HEADER_TABLE_SIZE
+            m_encoder.setMaxTableSize(int(qMin<quint32>(value, 1 << 30)));
+            break;
+        case 0x2: // ENABLE_PUSH - мы не шлем push, но значение проверяем
+            if (value > 1) {
+                connectionError(ProtocolError, "Invalid ENABLE_PUSH");
+                return false;
+            }
+            break;
+        case 0x4: { // INITIAL_WINDOW_SIZE - меняет окна и уже открытых потоков
+            if (value > MaxWindowSize) {
+                connectionError(FlowControlError, "Invalid INITIAL_WINDOW_SIZE");
+                return false;
+            }
+            qint64 delta = qint64(value) - m_peerInitialWindow;
+            m_peerInitialWindow = value;
+            for (auto &entry : m_streams) {
+                entry.second.sendWindow += delta;
+                if (entry.second.sendWindow > MaxWindowSize) {
+                    connectionError(FlowControlError, "Stream window overflow");
+                    return false;
+                }
+            }
+            break;
+        }
+        case 0x5: // MAX_FRAME_SIZE
+            if (value < quint32(MaxFrameSize) || value > 0xffffff) {
+                connectionError(ProtocolError, "Invalid MAX_FRAME_SIZE");
+                return false;
+            }
+            m_peerMaxFrameSize = value;
+            break;
+        default:
+            // MAX_CONCURRENT_STREAMS (push не используется), MAX_HEADER_LIST_SIZE и неизвестные
+            break;
+        }
+    }
+    return true;
+}
+
+void Http2Session::handleWindowUpdate(quint32 id, const char *payload, int length)
+{
+    if (length != 4) {
+        connectionError(FrameSizeError, "WINDOW_UPDATE of wrong size");
+        return;
+    }
+    qint64 increment = readUInt32(payload) & 0x7fffffff;
+
+    if (id == 0) {
+        if (increment == 0) {
+            connectionError(ProtocolError, "Zero WINDOW_UPDATE");
+            return;
+        }
+        m_connectionSendWindow += increment;
+        if (m_connectionSendWindow > MaxWindowSize)
+            connectionError(FlowControlError, "Connection send window overflow");
+        return;
+    }
+
+    Stream *stream = findStream(id);
+    if (!stream) {
+        if (id > m_lastStreamId)
+            connectionError(ProtocolError, "WINDOW_UPDATE on idle stream");
+        return;
+    }
+    stream->sendWindow += increment;
+    if (increment == 0 || stream->sendWindow > MaxWindowSize) {
+        resetStream(id, increment == 0 ? ProtocolError : FlowControlError);
+        removeStream(id);
+    }
+}
+
+void Http2Session::handlePriorityUpdate(const char *payload, int length)
+{
+    if (length < 4) {
+        connectionError(FrameSizeError, "PRIORITY_UPDATE truncated");
+        return;
+    }
+    quint32 id = readUInt32(payload) & 0x7fffffff;
+    if (id == 0) {
+        connectionError(ProtocolError, "PRIORITY_UPDATE for stream 0");
+        return;
+    }
+    // Обновление для еще не открытого потока не запоминаем - он получит приоритет из HEADERS
+    if (Stream *stream = findStream(id))
+        applyPriority(*stream, QByteArray(payload + 4, length - 4));
+}
+
+void Http2Session::applyPriority(Stream &stream, const QByteArray &field)
+{
+    // Словарь structured fields (RFC 9218): "u=2, i"; остальные параметры игнорируются
+    for (const QByteArray &item : field.split(',')) {
+        QByteArray parameter = item.trimmed();
+        if (parameter.startsWith("u=") && parameter.size() == 3 && parameter[2] >= '0' && parameter[2] <= '7')
+            stream.urgency = parameter[2] - '0';
+        else if (parameter == "i" || parameter == "i=?1")
+            stream.incremental = true;
+        else if (parameter == "i=?0")
+            stream.incremental = false;
+    }
+}
+
+void Http2Session::dispatch(quint32 id)
+{
+    Stream *stream = findStream(id);
+    if (!stream) return;
+    stream->dispatched = true;
+
+    HttpRequest request = std::move(stream->request);
+    request.body.swap(stream->body);
+    stream->headRequest = request.method == "HEAD";
+    if (m_server->compression().enabled) {
+        QByteArray acceptEncoding = request.headers.valueView(HttpHeaders::AcceptEncoding);
+        stream->encoding = HttpCompression::negotiate(acceptEncoding, HttpCompression::brotliSupported());
+        stream->gzipAllowed = HttpCompression::negotiate(acceptEncoding, false) == ContentEncoding::Gzip;
+    }
+    ++m_server->m_http2Streams;
+
+    // Ответ может прийти прямо отсюда - после вызова поток уже не трогаем
+    HttpResponderPtr responder(new HttpResponder(m_connection, id));
+    if (m_server->admitRequest(m_connection->m_clientKey, responder))
+        m_server->processRequest(request, responder);
+}
+
+void Http2Session::respondError(quint32 id, int status, const QString &message)
+{
+    if (Stream *stream = findStream(id)) {
+        stream->dispatched = true;
+        completeResponse(id, m_server->createErrorResponse(status, message), FileBody());
+    }
+}
+
+void Http2Session::completeResponse(quint32 id, const HttpResponse &response, const FileBody &file)
+{
+    Stream *stream = findStream(id);
+    if (m_closed || !stream || stream->headersSent) return;
+
+    HttpResponse head = file.isNull()
+        ? HttpCompression::compressResponse(response, stream->encoding, m_server->compression())
+        : response;
+
+    if (!file.isNull() && !stream->headRequest) {
+        std::unique_ptr<QFile> body(new QFile(file.path));
+        if (body->open(QIODevice::ReadOnly) && body->seek(file.offset)) {
+            stream->file = std::move(body);
+            stream->fileRemaining = file.length;
+        } else {
+            // Заголовки еще не ушли - в отличие от HTTP/1.1 можно ответить честной ошибкой
+            qWarning() << "Failed to open file for streaming:" << file.path;
+            head = HttpConnection::internalErrorResponse();
+        }
+    }
+
+    bool hasBody = !stream->headRequest && (!head.body().isEmpty() || stream->fileRemaining > 0);
+    if (hasBody && !head.body().isEmpty())
+        stream->data.push_back(head.body());
+    stream->complete = true;
+    sendHeaders(*stream, head, !hasBody);
+    scheduleOutput();
+}
+
+void Http2Session::beginStream(quint32 id, const QByteArray &head, const StreamWindowPtr &window)
+{
+    Stream *stream = findStream(id);
+    if (m_closed || !stream || stream->headersSent) {
+        window->close();
+        return;
+    }
+    stream->window = window;
+
+    // Кадрирует DATA, поэтому chunked не нужен - только сжатие, если длина не указана
+    HttpResponse response = HttpResponse::fromRaw(head);
+    if (!response.isFramed() && stream->gzipAllowed && HttpCompression::isCompressibleHead(response.head())) {
+        stream->gzip = std::make_shared<GzipStream>(m_server->compression().gzipLevel);
+        if (stream->gzip->isValid())
+            response = HttpCompression::encodedHead(response, ContentEncoding::Gzip);
+        else
+            stream->gzip.reset();
+    }
+    // У HEAD тела нет: обработчику закрытое окно скажет, что писать некуда
+    sendHeaders(*stream, response, stream->headRequest);
+    scheduleOutput();
+}
+
+void Http2Session::writeStream(quint32 id, const QByteArray &data)
+{
+    Stream *stream = findStream(id);
+    if (m_closed || !stream || stream->complete) return;
+
+    stream->windowBytes += data.size();
+    QByteArray chunk = stream->gzip ? stream->gzip->write(data) : data;
+    if (!chunk.isEmpty())
+        stream->data.push_back(chunk);
+    scheduleOutput();
+}
+
+void Http2Session::endStream(quint32 id)
+{
+    Stream *stream = findStream(id);
+    if (m_closed || !stream || stream->complete) return;
+
+    if (stream->gzip) {
+        QByteArray tail = stream->gzip->finish();
+        if (!tail.isEmpty())
+            stream->data.push_back(tail);
+        stream->gzip.reset();
+    }
+    stream->complete = true;
+    scheduleOutput();
+}
+
+void Http2Session::abortStream(quint32 id)
+{
+    Stream *stream = findStream(id);
+    if (m_closed || !stream) return;
+
+    if (!stream->headersSent) {
+        completeResponse(id, m_server->createErrorResponse(502, "Bad Gateway"), FileBody());
+        return;
+    }
+    // Обрывается только этот поток, остальные запросы соединения живут
+    resetStream(id, InternalError);
+    removeStream(id);
+    scheduleOutput();
+}
+
+void Http2Session::sendHeaders(Stream &stream, const HttpResponse &response, bool endStream)
+{
+    QByteArray block;
+    m_encoder.begin(block);
+    m_encoder.add(block, QByteArrayLiteral(":status"), QByteArray::number(response.status() > 0 ? response.status() : 500));
+
+    // Заголовки ответа HTTP/1.1 без строки статуса, имена - строчными
+    const QByteArray &head = response.head();
+    int lineStart = head.indexOf("\r\n");
+    while (lineStart != -1 && lineStart + 2 < head.size()) {
+        lineStart += 2;
+        int lineEnd = head.indexOf("\r\n", lineStart);
+        if (lineEnd == -1)
+            lineEnd = head.size();
+        int colon = head.indexOf(':', lineStart);
+        if (colon > lineStart && colon < lineEnd) {
+            QByteArray name = head.mid(lineStart, colon - lineStart).trimmed().toLower();
+            QByteArray value = head.mid(colon + 1, lineEnd - colon - 1).trimmed();
+            if (!isConnectionHeader(name)) {
+                // Длина у каждого ответа своя, а куки не должны оседать в таблицах посредников
+                HpackEncoder::Indexing indexing = HpackEncoder::Index;
+                if (name == "content-length")
+                    indexing = HpackEncoder::NoIndex;
+                else if (name == "set-cookie")
+                    indexing = HpackEncoder::NeverIndex;
+                m_encoder.add(block, name, value, indexing);
+            }
+        }
+        lineStart = lineEnd;
+    }
+    if (!response.hasDate()) {
+        // "Date: ...\r\n" - значение без имени и перевода строки
+        QByteArray date = HttpResponse::dateHeader();
+        m_encoder.add(block, QByteArrayLiteral("date"), date.mid(6, date.size() - 8));
+    }
+
+    stream.headersSent = true;
+    if (endStream)
+        stream.endSent = true;
+    queueHeaderBlock(stream.id, block, endStream);
+    if (endStream)
+        finishStream(stream.id);
+}
+
+void Http2Session::queueHeaderBlock(quint32 id, const QByteArray &block, bool endStream)
+{
+    // Блок длиннее кадра клиента - HEADERS и CONTINUATION подряд
+    int offset = 0;
+    bool first = true;
+    do {
+        int size = qMin(int(m_peerMaxFrameSize), block.size() - offset);
+        bool last = offset + size == block.size();
+        quint8 flags = (last ? FlagEndHeaders : 0) | (first && endStream ? FlagEndStream : 0);
+        queueFrame(first ? FrameHeaders : FrameContinuation, flags, id, HttpBody(block, offset, size));
+        offset += size;
+        first = false;
+    } while (offset < block.size());
+}
+
+void Http2Session::queueFrame(quint8 type, quint8 flags, quint32 id, const HttpBody &payload)
+{
+    QByteArray header;
+    header.reserve(FrameHeaderSize);
+    header.append(char(payload.size() >> 16));
+    header.append(char(payload.size() >> 8));
+    header.append(char(payload.size()));
+    header.append(char(type));
+    header.append(char(flags));
+    appendUInt32(header, id);
+
+    // Тело кадра не копируется: DATA - срез тела ответа из кеша или обработчика
+    m_output.push_back(header);
+    if (!payload.isEmpty())
+        m_output.push_back(payload);
+    m_outputBytes += FrameHeaderSize + payload.size();
+}
+
+void Http2Session::resetStream(quint32 id, ErrorCode code)
+{
+    QByteArray payload;
+    appendUInt32(payload, code);
+    queueFrame(FrameRstStream, 0, id, payload);
+}
+
+void Http2Session::connectionError(ErrorCode code, const QString &message)
+{
+    if (m_closed) return;
+    qDebug() << "HTTP/2 connection error" << code << ":" << message;
+
+    QByteArray payload;
+    appendUInt32(payload, m_lastStreamId);
+    appendUInt32(payload, code);
+    payload.append(message.toUtf8());
+    queueFrame(FrameGoAway, 0, 0, payload);
+    flushOutput();
+
+    m_closed = true;
+    closeStreamWindows();
+    m_connection->closeAfterWrite();
+}
+
+void Http2Session::scheduleOutput()
+{
+    // Во время разбора ввода ответы только копятся - отправим одним write в конце
+    if (m_processing || m_closed) return;
+
+    pumpData();
+    flushOutput();
+
+    if (m_streams.empty()) {
+        if (m_goingAway) {
+            m_closed = true;
+            m_connection->closeAfterWrite();
+        } else {
+            m_connection->m_idleTimer.start();
+        }
+    }
+}
+
+void Http2Session::pumpData()
+{
+    while (m_connection->m_socket->bytesToWrite() + m_outputBytes < OutputHighWater) {
+        Stream *stream = nextReadyStream();
+        if (!stream)
+            break;
+        sendDataFrame(*stream);
+    }
+}
+
+Http2Session::Stream *Http2Session::nextReadyStream()
+{
+    // Меньший urgency - раньше. При равном: не-incremental по порядку потоков (целиком
+    // один за другим), incremental - по кадру от каждого по кругу
+    Stream *best = nullptr;
+    for (auto &entry : m_streams) {
+        Stream &stream = entry.second;
+        if (!stream.headersSent || stream.endSent)
+            continue;
+        bool hasData = !stream.data.empty() || stream.fileRemaining > 0;
+        bool canSend = hasData ? stream.sendWindow > 0 && m_connectionSendWindow > 0 : stream.complete;
+        if (!canSend)
+            continue;
+
+        if (!best || stream.urgency < best->urgency) {
+            best = &stream;
+        } else if (stream.urgency == best->urgency && best->incremental) {
+            if (!stream.incremental || (best->id <= m_lastServedId && stream.id > m_lastServedId))
+                best = &stream;
+        }
+    }
+    return best;
+}
+
+void Http2Session::sendDataFrame(Stream &stream)
+{
+    const quint32 id = stream.id;
+    if (stream.data.empty() && stream.fileRemaining > 0 && !refillFromFile(stream)) {
+        qWarning() << "Failed to read file while streaming";
+        resetStream(id, InternalError);
+        removeStream(id);
+        return;
+    }
+
+    HttpBody part;
+    if (!stream.data.empty()) {
+        HttpBody &front = stream.data.front();
+        qint64 allowed = qMin(qMin(qint64(front.size()), qint64(m_peerMaxFrameSize)),
+                              qMin(stream.sendWindow, m_connectionSendWindow));
+        part = front.mid(0, int(allowed));
+        if (allowed == front.size())
+            stream.data.pop_front();
+        else
+            front = front.mid(int(allowed), front.size() - int(allowed));
+        stream.sendWindow -= allowed;
+        m_connectionSendWindow -= allowed;
+    }
+    m_lastServedId = id;
+
+    if (stream.data.empty() && stream.windowBytes > 0) {
+        stream.window->consumed(stream.windowBytes);
+        stream.windowBytes = 0;
+    }
+
+    // Пустой DATA с END_STREAM окна не тратит - конец потока, когда тела больше нет
+    bool last = stream.complete && stream.data.empty() && stream.fileRemaining == 0;
+    queueFrame(FrameData, last ? FlagEndStream : 0, id, part);
+    if (last) {
+        stream.endSent = true;
+        finishStream(id);
+    }
+}
+
+bool Http2Session::refillFromFile(Stream &stream)
+{
+    QByteArray chunk = stream.file->read(qMin(stream.fileRemaining, FileChunkSize));
+    if (chunk.isEmpty())
+        return false;
+    stream.fileRemaining -= chunk.size();
+    if (stream.fileRemaining == 0)
+        stream.file.reset();
+    stream.data.push_back(chunk);
+    return true;
+}
+
+void Http2Session::finishStream(quint32 id)
+{
+    Stream *stream = findStream(id);
+    if (!stream) return;
+    // Ответ ушел, а клиент еще шлет тело (например, после 413) - пусть перестанет
+    if (!stream->remoteClosed)
+        resetStream(id, NoError);
+    removeStream(id);
+}
+
+void Http2Session::removeStream(quint32 id)
+{
+    auto it = m_streams.find(id);
+    if (it == m_streams.end()) return;
+    if (it->second.window)
+        it->second.window->close();
+    m_streams.erase(it);
+}
+
+Http2Session::Stream *Http2Session::findStream(quint32 id)
+{
+    auto it = m_streams.find(id);
+    return it == m_streams.end() ? nullptr : &it->second;
+}
+
+void Http2Session::flushOutput()
+{
+    if (m_output.empty()) return;
+    if (m_connection->m_socket->isOpen())
+        m_connection->m_socket->write(m_output.data(), int(m_output.size()));
+    m_output.clear();
+    m_outputBytes = 0;
+}
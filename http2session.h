@@ -0,0 +1,194 @@
+#ifndef HTTP2SESSION_H
+#define HTTP2SESSION_H
+
+#include <QByteArray>
+#include <QFile>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+#include "hpack.h"
+#include "httpcompression.h"
+#include "httprequestparser.h"
+#include "httpresponder.h"
+#include "httpresponse.h"
+
+class HttpConnection;
+class HttpServer;
+
+// Настройки HTTP/2 сервера ([http2])
+struct Http2Settings
+{
+    bool enabled = true;
+    int maxConcurrentStreams = 100;
+    int streamWindowSize = 1024 * 1024;      // сколько тела запроса клиент шлет, не дожидаясь нас
+    int connectionWindowSize = 4 * 1024 * 1024;
+    int maxHeaderListSize = 64 * 1024;
+};
+
+// HTTP/2 поверх одного HttpConnection (RFC 9113): кадры, HPACK,
+// управление потоком и приоритеты. Каждый поток - обычный запрос:
+// HttpResponder с номером потока вместо номера в очереди pipelining,
+// обработчики статики, PHP и /api/db те же. Ответы не ждут друг друга -
+// DATA разных потоков чередуются по приоритету.
+//
+// Приоритеты - по RFC 9218: urgency 0..7 и incremental из заголовка
+// priority и кадра PRIORITY_UPDATE. Дерево зависимостей RFC 7540
+// (устаревшее в RFC 9113) не строится: вес из HEADERS/PRIORITY только
+// переводится в urgency для клиентов, которые шлют лишь его.
+//
+// Все вызовы - в потоке соединения. Обработчик может ответить прямо
+// из processRequest: пока разбирается ввод, отправка откладывается.
+class Http2Session
+{
+public:
+    explicit Http2Session(HttpConnection *connection);
+    ~Http2Session();
+
+    // Начать сессию: SETTINGS сервера. Дальше клиент шлет преамбулу
+    void start();
+    // Upgrade: h2c - запрос HTTP/1.1 становится потоком 1, settings - из HTTP2-Settings
+    bool startUpgraded(HttpRequest request, const QByteArray &settings);
+
+    void receive(const QByteArray &data);
+    // Буфер записи транспорта освободился
+    void writable();
+    // Простой соединения: GOAWAY и закрытие, если нет активных потоков
+    void idleTimeout();
+    void closeStreamWindows();
+
+    // Ответы от HttpResponder, id - номер потока
+    void completeResponse(quint32 id, const HttpResponse &response, const FileBody &file);
+    void beginStream(quint32 id, const QByteArray &head, const StreamWindowPtr &window);
+    void writeStream(quint32 id, const QByteArray &data);
+    void endStream(quint32 id);
+    void abortStream(quint32 id);
+
+    // Преамбула клиента
+    static const QByteArray &preface();
+
+private:
+    struct Stream
+    {
+        quint32 id = 0;
+        HttpRequest request;
+        QByteArray body;
+        bool remoteClosed = false;  // END_STREAM от клиента
+        bool dispatched = false;    // запрос отдан обработчику
+        bool headRequest = false;
+        qint64 receiveWindow = 0;
+        qint64 unacknowledged = 0;  // принято байт без WINDOW_UPDATE
+        qint64 sendWindow = 0;
+
+        // Ответ
+        bool headersSent = false;
+        bool complete = false;      // все тело в data или в file
+        bool endSent = false;
+        std::deque<HttpBody> data;
+        std::unique_ptr<QFile> file;
+        qint64 fileRemaining = 0;
+        StreamWindowPtr window;
+        qint64 windowBytes = 0;     // тело в data, о котором обработчик еще не знает
+        ContentEncoding encoding = ContentEncoding::Identity;
+        bool gzipAllowed = false;
+        std::shared_ptr<GzipStream> gzip;
+
+        int urgency = 3;
+        bool incremental = false;
+    };
+
+    enum FrameType : quint8 {
+        FrameData = 0x0,
+        FrameHeaders = 0x1,
+        FramePriority = 0x2,
+        FrameRstStream = 0x3,
+        FrameSettings = 0x4,
+        FramePushPromise = 0x5,
+        FramePing = 0x6,
+        FrameGoAway = 0x7,
+        FrameWindowUpdate = 0x8,
+        FrameContinuation = 0x9,
+        FramePriorityUpdate = 0x10
+    };
+
+    enum ErrorCode : quint32 {
+        NoError = 0x0,
+        ProtocolError = 0x1,
+        InternalError = 0x2,
+        FlowControlError = 0x3,
+        StreamClosed = 0x5,
+        FrameSizeError = 0x6,
+        RefusedStream = 0x7,
+        Cancel = 0x8,
+        CompressionError = 0x9,
+        EnhanceYourCalm = 0xb
+    };
+
+    // Разбор входящих кадров
+    void processInput();
+    void handleFrame(quint8 type, quint8 flags, quint32 id, const char *payload, int length);
+    void handleData(quint8 flags, quint32 id, const char *payload, int length);
+    void handleHeaders(quint8 flags, quint32 id, const char *payload, int length);
+    void handleContinuation(quint8 flags, quint32 id, const char *payload, int length);
+    void handleSettings(quint8 flags, quint32 id, const char *payload, int length);
+    void handleWindowUpdate(quint32 id, const char *payload, int length);
+    void handlePriorityUpdate(const char *payload, int length);
+    void headerBlockComplete();
+    bool applySettings(const char *payload, int length);
+    void dispatch(quint32 id);
+    void respondError(quint32 id, int status, const QString &message);
+
+    // Отправка
+    // Заголовки ответа; с endStream поток после этого удаляется
+    void sendHeaders(Stream &stream, const HttpResponse &response, bool endStream);
+    void queueHeaderBlock(quint32 id, const QByteArray &block, bool endStream);
+    void queueFrame(quint8 type, quint8 flags, quint32 id, const HttpBody &payload = HttpBody());
+    void resetStream(quint32 id, ErrorCode code);
+    void connectionError(ErrorCode code, const QString &message);
+    void scheduleOutput();
+    void pumpData();
+    Stream *nextReadyStream();
+    void sendDataFrame(Stream &stream);
+    bool refillFromFile(Stream &stream);
+    // Ответ отправлен целиком: поток закрывается (RST_STREAM, если клиент еще шлет тело)
+    void finishStream(quint32 id);
+    void removeStream(quint32 id);
+    void flushOutput();
+
+    Stream *findStream(quint32 id);
+    static void applyPriority(Stream &stream, const QByteArray &field);
+
+    HttpConnection *m_connection;
+    HttpServer *m_server;
+    const Http2Settings &m_settings;
+    HpackDecoder m_decoder;
+    HpackEncoder m_encoder;
+    std::map<quint32, Stream> m_streams;  // по номеру: при равной срочности раньше - меньший
+
+    QByteArray m_input;
+    int m_inputPos;
+    bool m_prefaceReceived;
+    bool m_processing;        // идет разбор ввода, отправку делаем после
+    bool m_closed;            // GOAWAY отправлен, соединение закрывается
+    bool m_goingAway;         // новых потоков не принимаем
+    quint32 m_lastStreamId;   // последний принятый поток клиента
+    quint32 m_lastServedId;   // для чередования incremental-потоков
+
+    // CONTINUATION: блок заголовков, собираемый из нескольких кадров
+    quint32 m_headerStreamId;
+    quint8 m_headerFlags;
+    int m_headerWeight;       // вес RFC 7540 из HEADERS, 0 - не было
+    QByteArray m_headerBlock;
+
+    // Параметры клиента
+    quint32 m_peerMaxFrameSize;
+    qint64 m_peerInitialWindow;
+    qint64 m_connectionSendWindow;
+    qint64 m_connectionReceiveWindow;
+    qint64 m_connectionUnacknowledged;
+
+    std::vector<HttpBody> m_output;   // кадры, ждущие одного write в транспорт
+    qint64 m_outputBytes;
+};
+
+#endif // HTTP2SESSION_H
@@ -0,0 +1,271 @@
+#include "httpcompression.h"
+#include <QList>
+#include <zlib.h>
+
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+struct GzipStream::State
+{
+    z_stream stream;
+};
+
+bool HttpCompression::brotliSupported()
+{
+#ifdef HAVE_BROTLI
+    return true;
+#else
+    return false;
+#endif
+}
+
+ContentEncoding HttpCompression::negotiate(const QByteArray &acceptEncoding, bool allowBrotli)
+{
+    if (acceptEncoding.isEmpty())
+        return ContentEncoding::Identity;
+
+    // q по умолчанию 1, q=0 - кодировка запрещена; * - все не названные явно
+    double gzipQ = -1, brotliQ = -1, anyQ = -1;
+    for (const QByteArray &item : acceptEncoding.split(',')) {
+        QList<QByteArray> parts = item.split(';');
+        QByteArray coding = parts.value(0).trimmed().toLower();
+        double q = 1.0;
+        for (int i = 1; i < parts.size(); ++i) {
+            QByteArray param = parts[i].trimmed();
+            if (param.startsWith("q=")) {
+                bool ok = false;
+                q = param.mid(2).toDouble(&ok);
+                if (!ok) q = 0;
+            }
+        }
+        if (coding == "gzip" || coding == "x-gzip") gzipQ = q;
+        else if (coding == "br") brotliQ = q;
+        else if (coding == "*") anyQ = q;
+    }
+    if (gzipQ < 0) gzipQ = anyQ;
+    if (brotliQ < 0) brotliQ = anyQ;
+
+    if (allowBrotli && brotliQ > 0 && brotliQ >= gzipQ)
+        return ContentEncoding::Brotli;
+    if (gzipQ > 0)
+        return ContentEncoding::Gzip;
+    return ContentEncoding::Identity;
+}
+
+QByteArray HttpCompression::token(ContentEncoding encoding)
+{
+    switch (encoding) {
+    case ContentEncoding::Gzip: return "gzip";
+    case ContentEncoding::Brotli: return "br";
+    case ContentEncoding::Identity: break;
+    }
+    return "identity";
+}
+
+bool HttpCompression::isCompressible(const QByteArray &mimeType)
+{
+    QByteArray type = mimeType.toLower();
+    int semicolon = type.indexOf(';');
+    if (semicolon != -1) type = type.left(semicolon).trimmed();
+
+    return type.startsWith("text/")
+        || type == "application/javascript"
+        || type == "application/json"
+        || type == "application/x-ndjson"
+        || type == "application/msgpack"
+        || type == "application/cbor"
+        || type == "application/xml"
+        || type == "image/svg+xml";
+}
+
+QByteArray HttpCompression::gzip(const QByteArray &data, int level)
+{
+    z_stream stream = {};
+    // 15 + 16: окно 32 КБ и обертка gzip вместо zlib
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return QByteArray();
+
+    QByteArray out;
+    out.resize(int(deflateBound(&stream, uLong(data.size()))));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = uInt(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(out.data());
+    stream.avail_out = uInt(out.size());
+
+    int result = ::deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END)
+        return QByteArray();
+
+    out.resize(int(stream.total_out));
+    return out;
+}
+
+QByteArray HttpCompression::brotli(const QByteArray &data, int quality)
+{
+#ifdef HAVE_BROTLI
+    size_t size = BrotliEncoderMaxCompressedSize(size_t(data.size()));
+    if (size == 0) return QByteArray();
+
+    QByteArray out;
+    out.resize(int(size));
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               size_t(data.size()), reinterpret_cast<const uint8_t *>(data.constData()),
+                               &size, reinterpret_cast<uint8_t *>(out.data())))
+        return QByteArray();
+    out.resize(int(size));
+    return out;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(quality);
+    return QByteArray();
+#endif
+}
+
+QByteArray HttpCompression::compress(const QByteArray &data, ContentEncoding encoding,
+                                     int gzipLevel, int brotliQuality)
+{
+    switch (encoding) {
+    case ContentEncoding::Gzip: return gzip(data, gzipLevel);
+    case ContentEncoding::Brotli: return brotli(data, brotliQuality);
+    case ContentEncoding::Identity: break;
+    }
+    return QByteArray();
+}
+
+QByteArray HttpCompression::headerValue(const QByteArray &head, const QByteArray &lowerName)
+{
+    int pos = head.indexOf("\r\n");
+    while (pos != -1 && pos + 2 < head.size()) {
+        int lineStart = pos + 2;
+        int lineEnd = head.indexOf("\r\n", lineStart);
+        if (lineEnd == -1) lineEnd = head.size();
+        if (lineEnd == lineStart) break; // конец заголовков
+
+        int colon = head.indexOf(':', lineStart);
+        if (colon != -1 && colon < lineEnd
+            && head.mid(lineStart, colon - lineStart).trimmed().toLower() == lowerName)
+            return head.mid(colon + 1, lineEnd - colon - 1).trimmed();
+        pos = lineEnd;
+    }
+    return QByteArray();
+}
+
+bool HttpCompression::isCompressibleHead(const QByteArray &head)
+{
+    // 206 - диапазон конкретного представления, 1xx/204/304 без тела
+    int status = head.mid(9, 3).toInt();
+    if (status < 200 || status == 204 || status == 206 || status == 304)
+        return false;
+
+    // Кодировку уже выбрал обработчик (например, готовый .gz из кеша)
+    if (!headerValue(head, "content-encoding").isEmpty()
+        || headerValue(head, "vary").toLower().contains("accept-encoding"))
+        return false;
+
+    return isCompressible(headerValue(head, "content-type"));
+}
+
+HttpResponse HttpCompression::compressResponse(const HttpResponse &response, ContentEncoding encoding,
+                                               const CompressionSettings &settings)
+{
+    if (!settings.enabled || encoding == ContentEncoding::Identity)
+        return response;
+
+    int bodySize = response.body().size();
+    if (bodySize < settings.minSize || !response.isFramed())
+        return response;
+
+    const QByteArray &head = response.head();
+    if (!isCompressibleHead(head))
+        return response;
+
+    QByteArray body = compress(response.body().toByteArray(), encoding,
+                               settings.gzipLevel, settings.brotliQuality);
+    if (body.isEmpty() || body.size() >= bodySize)
+        return response;
+
+    HttpResponse compressed = encodedHead(response, encoding);
+    compressed.addHeader("Content-Length", QByteArray::number(body.size()));
+    compressed.setBody(body);
+    return compressed;
+}
+
+HttpResponse HttpCompression::encodedHead(const HttpResponse &response, ContentEncoding encoding)
+{
+    // Content-Length меняется, ETag относится к исходнику, остальное переносим как есть
+    const QByteArray &head = response.head();
+    int statusEnd = head.indexOf("\r\n") + 2;
+    HttpResponse encoded = HttpResponse::fromRaw(head.left(statusEnd));
+    int lineStart = statusEnd;
+    while (lineStart < head.size()) {
+        int lineEnd = head.indexOf("\r\n", lineStart);
+        if (lineEnd == -1) lineEnd = head.size();
+        QByteArray line = head.mid(lineStart, lineEnd - lineStart);
+        QByteArray lower = line.toLower();
+        if (lower.startsWith("etag:"))
+            encoded.addHeader("ETag", encodedEtag(line.mid(5).trimmed(), encoding));
+        else if (!line.isEmpty() && !lower.startsWith("content-length:"))
+            encoded.addHeader(line + "\r\n");
+        lineStart = lineEnd + 2;
+    }
+    encoded.addHeader("Content-Encoding", token(encoding));
+    encoded.addHeader(QByteArrayLiteral("Vary: Accept-Encoding\r\n"));
+    return encoded;
+}
+
+QByteArray HttpCompression::encodedEtag(const QByteArray &etag, ContentEncoding encoding)
+{
+    // "abc" -> "abc-gzip", W/"abc" -> W/"abc-gzip"
+    if (etag.endsWith('"'))
+        return etag.left(etag.size() - 1) + "-" + token(encoding) + "\"";
+    return etag + "-" + token(encoding);
+}
+
+GzipStream::GzipStream(int level) :
+    m_state(new State),
+    m_valid(false)
+{
+    m_state->stream = z_stream();
+    m_valid = deflateInit2(&m_state->stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+GzipStream::~GzipStream()
+{
+    if (m_valid)
+        deflateEnd(&m_state->stream);
+}
+
+QByteArray GzipStream::write(const QByteArray &data)
+{
+    return deflate(data, Z_SYNC_FLUSH);
+}
+
+QByteArray GzipStream::finish()
+{
+    return deflate(QByteArray(), Z_FINISH);
+}
+
+QByteArray GzipStream::deflate(const QByteArray &data, int flush)
+{
+    if (!m_valid) return QByteArray();
+
+    z_stream &stream = m_state->stream;
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = uInt(data.size());
+
+    QByteArray out;
+    char buffer[16 * 1024];
+    do {
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = sizeof(buffer);
+        int result = ::deflate(&stream, flush);
+        if (result == Z_STREAM_ERROR) {
+            m_valid = false;
+            return out;
+        }
+        out.append(buffer, int(sizeof(buffer) - stream.avail_out));
+    } while (stream.avail_out == 0);
+    return out;
+}
@@ -0,0 +1,78 @@
+#ifndef HTTPCOMPRESSION_H
+#define HTTPCOMPRESSION_H
+
+#include <QByteArray>
+#include <QString>
+#include <memory>
+#include "httpresponse.h"
+
+// Настройки сжатия ответов ([compression] в конфиге)
+struct CompressionSettings
+{
+    bool enabled = true;
+    int gzipLevel = 6;            // динамические ответы сжимаются на лету
+    int brotliQuality = 4;
+    int staticGzipLevel = 9;      // статика сжимается один раз при загрузке в кеш
+    int staticBrotliQuality = 11;
+    int minSize = 1024;           // меньше - не сжимаем, заголовки съедят выигрыш
+};
+
+enum class ContentEncoding { Identity, Gzip, Brotli };
+
+// Согласование Accept-Encoding и сжатие тел gzip / brotli.
+// brotli доступен, только если сервер собран с CONFIG+=brotli.
+class HttpCompression
+{
+public:
+    static bool brotliSupported();
+
+    // Лучшая кодировка из Accept-Encoding с учетом q-значений.
+    // allowBrotli - есть ли у нас brotli-представление (библиотека или готовый .br)
+    static ContentEncoding negotiate(const QByteArray &acceptEncoding, bool allowBrotli);
+    static QByteArray token(ContentEncoding encoding);
+    static bool isCompressible(const QByteArray &mimeType);
+
+    // Пустой результат - сжать не удалось
+    static QByteArray gzip(const QByteArray &data, int level);
+    static QByteArray brotli(const QByteArray &data, int quality);
+    static QByteArray compress(const QByteArray &data, ContentEncoding encoding, int gzipLevel, int brotliQuality);
+
+    // Сжать готовый HTTP-ответ с Content-Length, если это имеет смысл:
+    // подходящий статус и тип, тело не меньше minSize, кодировку
+    // еще никто не выбрал. Иначе ответ возвращается как есть
+    static HttpResponse compressResponse(const HttpResponse &response, ContentEncoding encoding,
+                                         const CompressionSettings &settings);
+
+    // Можно ли сжимать поток с такими заголовками (без Content-Length)
+    static bool isCompressibleHead(const QByteArray &head);
+    // Заголовки для тела в кодировке encoding: без Content-Length, с Content-Encoding
+    // и Vary, ETag - с суффиксом кодировки
+    static HttpResponse encodedHead(const HttpResponse &response, ContentEncoding encoding);
+    // У каждого представления свой ETag, иначе кеш ответит 304 с телом в чужой кодировке
+    static QByteArray encodedEtag(const QByteArray &etag, ContentEncoding encoding);
+
+    // Значение заголовка из блока заголовков ответа (имя в нижнем регистре)
+    static QByteArray headerValue(const QByteArray &head, const QByteArray &lowerName);
+};
+
+// Потоковое gzip-сжатие тела, длина которого заранее неизвестна
+class GzipStream
+{
+public:
+    explicit GzipStream(int level);
+    ~GzipStream();
+
+    bool isValid() const { return m_valid; }
+    // Каждый кусок сбрасывается (Z_SYNC_FLUSH), чтобы клиент не ждал следующего
+    QByteArray write(const QByteArray &data);
+    QByteArray finish();
+
+private:
+    QByteArray deflate(const QByteArray &data, int flush);
+
+    struct State;
+    std::unique_ptr<State> m_state;
+    bool m_valid;
+};
+
+#endif // HTTPCOMPRESSION_H
@@ -0,0 +1,663 @@
+#include "httpconnection.h"
+#include "http2session.h"
+#include "httpserver.h"
+#include "metrics.h"
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+// Сколько запросов одного соединения может обрабатываться одновременно
+static const size_t MaxPipelinedRequests = 16;
+
+// Сколько байт файла отдаем за один вызов sendfile / write
+static const qint64 SendfileChunkSize = 1024 * 1024;
+static const qint64 BufferedChunkSize = 64 * 1024;
+
+// Больше этого в буфере сокета тело потока не кладем - ждем bytesWritten
+static const qint64 StreamHighWater = 256 * 1024;
+
+HttpConnection::HttpConnection(HttpServer *server, HttpTransport *transport, QObject *parent) :
+    QObject(parent),
+    m_server(server),
+    m_socket(transport),
+    m_sendfileSupported(true),
+    m_nextSequence(0),
+    m_clientKey(0),
+    m_requestsServed(0),
+    m_lastRequestQueued(false),
+    m_processing(false),
+    m_continueDeferred(false),
+    m_closing(false),
+    m_valid(false),
+    m_detectHttp2(server->m_http2Settings.enabled)
+{
+    if (!m_socket->isOpen())
+        return;
+    m_valid = true;
+    Metrics::global().connectionOpened();
+    m_clientKey = RateLimiter::clientKey(m_socket->peerAddress());
+
+    m_parser.setMaxBodySize(m_server->maxBodySize());
+
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(m_server->keepAliveTimeout() * 1000);
+    m_requestTimer.setSingleShot(true);
+    m_requestTimer.setInterval(m_server->requestTimeout() * 1000);
+
+    m_socket->setHandler(this);
+    connect(&m_idleTimer, &QTimer::timeout, this, &HttpConnection::onIdleTimeout);
+    connect(&m_requestTimer, &QTimer::timeout, this, &HttpConnection::onRequestTimeout);
+
+    m_idleTimer.start();
+}
+
+HttpConnection::~HttpConnection()
+{
+    // Обработчики, ждущие освобождения окна, не должны висеть до таймаута
+    closeStreamWindows();
+    if (m_valid)
+        Metrics::global().connectionClosed();
+}
+
+void HttpConnection::transportReadyRead()
+{
+    if (m_closing || m_lastRequestQueued) {
+        // После "Connection: close" входящие данные уже не интересны
+        m_socket->readAll();
+        return;
+    }
+
+    if (m_http2) {
+        m_http2->receive(m_socket->readAll());
+        return;
+    }
+
+    m_parser.append(m_socket->readAll());
+
+    if (m_detectHttp2) {
+        // Prior knowledge и ALPN h2: клиент сразу начинает с преамбулы
+        const QByteArray &preface = Http2Session::preface();
+        QByteArray start = m_parser.peekBuffered(preface.size());
+        if (!preface.startsWith(start)) {
+            m_detectHttp2 = false;
+        } else {
+            if (start.size() == preface.size())
+                switchToHttp2();
+            return;
+        }
+    }
+
+    processBufferedRequests();
+}
+
+void HttpConnection::switchToHttp2()
+{
+    m_detectHttp2 = false;
+    m_requestTimer.stop();
+    m_http2.reset(new Http2Session(this));
+    m_http2->start();
+    m_http2->receive(m_parser.takeBufferedData());
+}
+
+bool HttpConnection::wantsHttp2Upgrade(const HttpRequest &request) const
+{
+    // Upgrade только в открытом HTTP/1.1 и только когда предыдущие ответы, включая
+    // тело из файла, уже в сокете - иначе 101 и кадры попадут в середину тела.
+    // Upgrade необязателен: иначе запрос просто обслуживается по HTTP/1.1
+    if (!m_server->m_http2Settings.enabled || m_socket->isEncrypted() || !m_pending.empty() || m_stream.file
+        || request.version != "HTTP/1.1" || !request.headers.contains(HttpHeaders::Http2Settings))
+        return false;
+
+    for (const QByteArray &token : request.headers.valueView(HttpHeaders::Upgrade).split(',')) {
+        if (token.trimmed().toLower() == "h2c")
+            return true;
+    }
+    return false;
+}
+
+bool HttpConnection::upgradeToHttp2(const HttpRequest &request)
+{
+    m_http2.reset(new Http2Session(this));
+    if (!m_http2->startUpgraded(request, request.headers.value(HttpHeaders::Http2Settings))) {
+        // Битый HTTP2-Settings - отвечаем как обычно по HTTP/1.1
+        m_http2.reset();
+        return false;
+    }
+    // После 101 клиент шлет преамбулу; она могла прийти вместе с запросом
+    m_http2->receive(m_parser.takeBufferedData());
+    return true;
+}
+
+void HttpConnection::processBufferedRequests()
+{
+    m_processing = true;
+
+    // В буфере может лежать несколько запросов подряд - ставим их в очередь по порядку
+    while (!m_closing && !m_lastRequestQueued && m_pending.size() < MaxPipelinedRequests) {
+        HttpRequestParser::Status status = m_parser.parse();
+        if (status == HttpRequestParser::Status::NeedMore) {
+            // Промежуточный ответ нельзя вклинить в тело предыдущего ответа
+            if (m_parser.takeContinueRequest())
+                m_continueDeferred = true;
+            break;
+        }
+
+        if (status == HttpRequestParser::Status::Error) {
+            // Ошибка разбора отвечается после уже принятых запросов
+            PendingResponse pending;
+            pending.sequence = m_nextSequence++;
+            pending.ready = true;
+            pending.complete = true;
+            pending.response = m_server->createErrorResponse(m_parser.errorCode(), m_parser.errorString());
+            m_pending.push_back(pending);
+            m_lastRequestQueued = true;
+            break;
+        }
+
+        HttpRequest request = m_parser.takeRequest();
+        m_detectHttp2 = false;
+        // Следующему запросу - свой срок
+        m_requestTimer.stop();
+        // Клиент не дождался 100 Continue и прислал тело сам
+        m_continueDeferred = false;
+        if (wantsHttp2Upgrade(request)) {
+            m_processing = false;
+            m_idleTimer.stop();
+            m_requestTimer.stop();
+            if (upgradeToHttp2(request))
+                return;
+            m_processing = true;
+        }
+        ++m_requestsServed;
+
+        int requestsLeft = m_server->maxKeepAliveRequests() - m_requestsServed;
+        bool keepAlive = wantsKeepAlive(request) && requestsLeft > 0;
+        if (!keepAlive)
+            m_lastRequestQueued = true;
+
+        PendingResponse pending;
+        pending.sequence = m_nextSequence++;
+        pending.keepAlive = keepAlive;
+        pending.requestsLeft = requestsLeft;
+        pending.chunkedAllowed = request.version != "HTTP/1.0";
+        pending.headRequest = request.method == "HEAD";
+        if (m_server->compression().enabled) {
+            QByteArray acceptEncoding = request.headers.valueView(HttpHeaders::AcceptEncoding);
+            pending.encoding = HttpCompression::negotiate(acceptEncoding, HttpCompression::brotliSupported());
+            pending.gzipAllowed = HttpCompression::negotiate(acceptEncoding, false) == ContentEncoding::Gzip;
+        }
+        m_pending.push_back(pending);
+        m_idleTimer.stop();
+
+        HttpResponderPtr responder(new HttpResponder(this, pending.sequence));
+        if (m_server->admitRequest(m_clientKey, responder))
+            m_server->processRequest(request, responder);
+    }
+
+    m_processing = false;
+    updateRequestTimer();
+    flushResponses();
+}
+
+void HttpConnection::updateRequestTimer()
+{
+    // Пока запрос не начат, соединение простаивает и его закрывает m_idleTimer.
+    // Клиент, ждущий 100 Continue, и очередь, в которую не разбираем новые
+    // запросы, ждут сервер - срок клиента не идет
+    if (m_closing || m_lastRequestQueued || m_continueDeferred || m_pending.size() >= MaxPipelinedRequests
+        || !m_parser.requestStarted()) {
+        m_requestTimer.stop();
+        return;
+    }
+    m_idleTimer.stop();
+    if (!m_requestTimer.isActive())
+        m_requestTimer.start();
+}
+
+void HttpConnection::sendDeferredContinue()
+{
+    if (!m_continueDeferred || m_closing || m_stream.file || !m_pending.empty())
+        return;
+    m_continueDeferred = false;
+    m_socket->write(QByteArrayLiteral("HTTP/1.1 100 Continue\r\n\r\n"));
+    // Тело клиент начнет слать только теперь
+    m_requestTimer.start();
+}
+
+HttpConnection::PendingResponse *HttpConnection::findPending(quint64 sequence)
+{
+    for (PendingResponse &pending : m_pending) {
+        if (pending.sequence == sequence)
+            return &pending;
+    }
+    return nullptr;
+}
+
+void HttpConnection::completeResponse(quint64 sequence, const HttpResponse &response, const FileBody &file)
+{
+    if (m_http2) {
+        if (!m_closing)
+            m_http2->completeResponse(quint32(sequence), response, file);
+        return;
+    }
+    if (PendingResponse *pending = findPending(sequence)) {
+        // Тело из файла идет через sendfile как есть, остальное сжимаем по Accept-Encoding
+        pending->response = file.isNull()
+            ? HttpCompression::compressResponse(response, pending->encoding, m_server->compression())
+            : response;
+        // Длина в заголовках та же, что у GET, но тело у HEAD не отправляется
+        pending->file = pending->headRequest ? FileBody() : file;
+        pending->ready = true;
+        pending->complete = true;
+    }
+    responseProgressed();
+}
+
+void HttpConnection::beginStream(quint64 sequence, const QByteArray &head, const StreamWindowPtr &window)
+{
+    if (m_http2) {
+        if (m_closing)
+            window->close();
+        else
+            m_http2->beginStream(quint32(sequence), head, window);
+        return;
+    }
+    PendingResponse *pending = findPending(sequence);
+    if (!pending) {
+        window->close();
+        return;
+    }
+    pending->window = window;
+
+    pending->response = HttpResponse::fromRaw(head);
+    if (pending->response.isFramed()) {
+        // Длину знает сам обработчик - тело идет как есть
+        pending->chunked = false;
+    } else {
+        // Длина неизвестна - можно сжимать на лету
+        if (pending->gzipAllowed && HttpCompression::isCompressibleHead(pending->response.head())) {
+            pending->gzip = std::make_shared<GzipStream>(m_server->compression().gzipLevel);
+            if (pending->gzip->isValid())
+                pending->response = HttpCompression::encodedHead(pending->response, ContentEncoding::Gzip);
+            else
+                pending->gzip.reset();
+        }
+
+        if (pending->chunkedAllowed) {
+            pending->chunked = true;
+            pending->response.addHeader(QByteArrayLiteral("Transfer-Encoding: chunked\r\n"));
+        } else {
+            // HTTP/1.0 не знает chunked - конец тела обозначим закрытием соединения
+            pending->chunked = false;
+            pending->keepAlive = false;
+        }
+    }
+    pending->ready = true;
+
+    if (pending->headRequest) {
+        // У HEAD тела нет: обработчику закрытое окно скажет, что писать некуда
+        window->close();
+        pending->window.reset();
+        pending->gzip.reset();
+        pending->chunked = false;
+        pending->complete = true;
+    }
+    flushResponses();
+}
+
+void HttpConnection::writeStream(quint64 sequence, const QByteArray &data)
+{
+    if (m_http2) {
+        if (!m_closing)
+            m_http2->writeStream(quint32(sequence), data);
+        return;
+    }
+    PendingResponse *pending = findPending(sequence);
+    if (!pending || pending->complete) return;
+
+    pending->windowBytes += data.size();
+    appendStreamBody(*pending, pending->gzip ? pending->gzip->write(data) : data);
+    flushResponses();
+}
+
+void HttpConnection::appendStreamBody(PendingResponse &pending, const QByteArray &data)
+{
+    // Пустой chunk означал бы конец тела
+    if (data.isEmpty()) return;
+
+    if (pending.chunked) {
+        pending.data.append(QByteArray::number(data.size(), 16));
+        pending.data.append("\r\n");
+        pending.data.append(data);
+        pending.data.append("\r\n");
+    } else {
+        pending.data.append(data);
+    }
+}
+
+void HttpConnection::endStream(quint64 sequence)
+{
+    if (m_http2) {
+        if (!m_closing)
+            m_http2->endStream(quint32(sequence));
+        return;
+    }
+    PendingResponse *pending = findPending(sequence);
+    if (!pending || pending->complete) return;
+
+    if (pending->gzip) {
+        appendStreamBody(*pending, pending->gzip->finish());
+        pending->gzip.reset();
+    }
+    if (pending->chunked)
+        pending->data.append("0\r\n\r\n");
+    pending->complete = true;
+    responseProgressed();
+}
+
+void HttpConnection::abortStream(quint64 sequence)
+{
+    if (m_http2) {
+        if (!m_closing)
+            m_http2->abortStream(quint32(sequence));
+        return;
+    }
+    PendingResponse *pending = findPending(sequence);
+    // Ответ HEAD уже готов без тела - обрыв потока ему не мешает
+    if (!pending || pending->complete) return;
+
+    if (!pending->started) {
+        // Клиент еще ничего не получил - можно честно ответить ошибкой
+        pending->response = m_server->createErrorResponse(502, "Bad Gateway");
+        pending->data.clear();
+        pending->gzip.reset();
+        pending->chunked = false;
+        pending->ready = true;
+        pending->complete = true;
+        responseProgressed();
+        return;
+    }
+    abortConnection();
+}
+
+void HttpConnection::responseProgressed()
+{
+    flushResponses();
+
+    // Очередь освободилась - разбираем то, что клиент успел прислать
+    if (!m_processing && !m_closing && m_parser.hasBufferedData())
+        processBufferedRequests();
+}
+
+void HttpConnection::flushResponses()
+{
+    // Пока идет отправка файла, следующие ответы ждут своей очереди
+    while (!m_closing && !m_stream.file && !m_pending.empty()) {
+        PendingResponse &front = m_pending.front();
+        if (!front.ready) break;
+
+        if (!front.started) {
+            front.started = true;
+            QByteArray tail = connectionHeaders(front.response, front.keepAlive,
+                                                m_server->keepAliveTimeout(), front.requestsLeft);
+            writeResponse(front.response.head(), tail,
+                          front.headRequest ? HttpBody() : front.response.body());
+            front.response = HttpResponse();
+        }
+        if (!front.data.isEmpty()) {
+            // Медленный клиент: тело потока ждет в очереди, а не в буфере сокета
+            if (front.window && m_socket->bytesToWrite() >= StreamHighWater)
+                break;
+            m_socket->write(front.data);
+            front.data.clear();
+        }
+        if (front.windowBytes > 0) {
+            front.window->consumed(front.windowBytes);
+            front.windowBytes = 0;
+        }
+
+        // Потоковый ответ еще не закончен - ждем следующих кусков
+        if (!front.complete) break;
+
+        FileBody file = front.file;
+        bool keepAlive = front.keepAlive;
+        m_pending.pop_front();
+
+        if (!file.isNull()) {
+            // Заголовки уже ушли - если файл не открылся, остается только оборвать соединение
+            if (!startFileStream(file, !keepAlive))
+                abortConnection();
+            return;
+        }
+
+        if (!keepAlive) {
+            closeAfterWrite();
+            return;
+        }
+    }
+
+    if (!m_closing && !m_stream.file && m_pending.empty()) {
+        sendDeferredContinue();
+        // Начатый запрос ограничивает m_requestTimer, а не простой
+        if (!m_parser.requestStarted())
+            m_idleTimer.start();
+    }
+}
+
+bool HttpConnection::startFileStream(const FileBody &body, bool closeWhenDone)
+{
+    std::unique_ptr<QFile> file(new QFile(body.path));
+    if (!file->open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open file for streaming:" << body.path;
+        return false;
+    }
+
+    m_stream.file = std::move(file);
+    m_stream.offset = body.offset;
+    m_stream.remaining = body.length;
+    m_stream.closeWhenDone = closeWhenDone;
+    m_idleTimer.stop();
+
+    pumpFileStream();
+    return true;
+}
+
+void HttpConnection::transportBytesWritten(qint64 bytes)
+{
+    Metrics::global().bytesSent(bytes);
+
+    if (m_http2) {
+        if (!m_closing)
+            m_http2->writable();
+        return;
+    }
+
+    if (m_stream.file) {
+        if (m_socket->bytesToWrite() == 0)
+            pumpFileStream();
+        return;
+    }
+
+    // Досылаем тело потока, придержанное из-за медленного клиента
+    if (!m_pending.empty() && m_pending.front().started && !m_pending.front().data.isEmpty()
+        && m_socket->bytesToWrite() < StreamHighWater)
+        flushResponses();
+}
+
+void HttpConnection::pumpFileStream()
+{
+    while (m_stream.remaining > 0) {
+        // Мимо буфера записи транспорта писать можно, только когда он пуст,
+        // иначе байты перемешаются. Продолжим по bytesWritten
+        if (m_socket->bytesToWrite() > 0)
+            return;
+
+#ifdef Q_OS_LINUX
+        // У TLS без kTLS sendfile отдал бы открытый текст - тогда читаем и пишем через транспорт
+        if (m_sendfileSupported && m_socket->allowsDirectWrite()) {
+            off_t offset = off_t(m_stream.offset);
+            ssize_t sent = ::sendfile(int(m_socket->socketDescriptor()), m_stream.file->handle(),
+                                      &offset, size_t(qMin(m_stream.remaining, SendfileChunkSize)));
+            if (sent > 0) {
+                Metrics::global().bytesSent(sent);
+                m_stream.offset += sent;
+                m_stream.remaining -= sent;
+                continue;
+            }
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent == 0 || (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                    // ФС или сокет не умеют sendfile - дальше обычной записью
+                    m_sendfileSupported = false;
+                } else {
+                    qWarning() << "sendfile failed:" << (sent == 0 ? "file truncated" : strerror(errno));
+                    abortConnection();
+                    return;
+                }
+            }
+            // EAGAIN: буфер сокета полон. Отдаем небольшой кусок через транспорт,
+            // он дождется готовности сокета и пришлет bytesWritten
+        }
+#endif
+
+        if (!m_stream.file->seek(m_stream.offset)) {
+            abortConnection();
+            return;
+        }
+        QByteArray chunk = m_stream.file->read(qMin(m_stream.remaining, BufferedChunkSize));
+        if (chunk.isEmpty()) {
+            qWarning() << "Failed to read file while streaming";
+            abortConnection();
+            return;
+        }
+        m_stream.offset += chunk.size();
+        m_stream.remaining -= chunk.size();
+        m_socket->write(chunk);
+    }
+
+    bool closeWhenDone = m_stream.closeWhenDone;
+    m_stream = FileStream();
+
+    if (closeWhenDone) {
+        closeAfterWrite();
+        return;
+    }
+    flushResponses();
+}
+
+void HttpConnection::transportClosed()
+{
+    deleteLater();
+}
+
+void HttpConnection::onIdleTimeout()
+{
+    if (m_http2) {
+        m_http2->idleTimeout();
+        return;
+    }
+    if (m_pending.empty() && !m_stream.file)
+        closeAfterWrite();
+}
+
+void HttpConnection::onRequestTimeout()
+{
+    if (m_http2 || m_closing || m_lastRequestQueued)
+        return;
+    // Запрос шел по байту - отвечаем 408 после уже принятых запросов и закрываем
+    PendingResponse pending;
+    pending.sequence = m_nextSequence++;
+    pending.ready = true;
+    pending.complete = true;
+    pending.response = m_server->createErrorResponse(408, "Request Timeout");
+    m_pending.push_back(pending);
+    m_lastRequestQueued = true;
+    flushResponses();
+}
+
+bool HttpConnection::wantsKeepAlive(const HttpRequest &request) const
+{
+    if (m_server->keepAliveTimeout() <= 0)
+        return false;
+
+    QByteArray connection = request.headers.valueView(HttpHeaders::Connection).toLower();
+    // HTTP/1.1 держит соединение по умолчанию, HTTP/1.0 - только по просьбе клиента
+    if (request.version == "HTTP/1.0")
+        return connection.contains("keep-alive");
+    return !connection.contains("close");
+}
+
+void HttpConnection::closeAfterWrite()
+{
+    m_closing = true;
+    m_idleTimer.stop();
+    m_requestTimer.stop();
+    closeStreamWindows();
+    m_pending.clear();
+    // disconnectFromHost дождется отправки буфера записи
+    m_socket->disconnectFromHost();
+}
+
+void HttpConnection::abortConnection()
+{
+    // Часть тела уже отправлена - корректно завершить ответ нельзя
+    m_closing = true;
+    m_idleTimer.stop();
+    m_requestTimer.stop();
+    closeStreamWindows();
+    m_pending.clear();
+    m_stream = FileStream();
+    m_socket->abort();
+}
+
+void HttpConnection::closeStreamWindows()
+{
+    if (m_http2)
+        m_http2->closeStreamWindows();
+    for (PendingResponse &pending : m_pending) {
+        if (pending.window)
+            pending.window->close();
+    }
+}
+
+HttpResponse HttpConnection::internalErrorResponse()
+{
+    static const QByteArray body = "{\"status\":\"error\",\"code\":500,\"message\":\"Internal Server Error\"}";
+    return HttpResponse(500, "application/json", body);
+}
+
+QByteArray HttpConnection::connectionHeaders(const HttpResponse &response, bool &keepAlive,
+                                             int timeoutSec, int requestsLeft)
+{
+    // Без длины клиент определит конец ответа только по закрытию соединения
+    if (response.isNull() || !response.isFramed())
+        keepAlive = false;
+
+    QByteArray tail;
+    tail.reserve(128);
+    if (keepAlive) {
+        tail.append("Connection: keep-alive\r\nKeep-Alive: timeout=");
+        tail.append(QByteArray::number(timeoutSec));
+        tail.append(", max=");
+        tail.append(QByteArray::number(requestsLeft));
+        tail.append("\r\n");
+    } else {
+        tail.append("Connection: close\r\n");
+    }
+    if (!response.hasDate())
+        tail.append(HttpResponse::dateHeader());
+    tail.append("\r\n");
+    return tail;
+}
+
+void HttpConnection::writeResponse(const QByteArray &head, const QByteArray &tail, const HttpBody &body)
+{
+    // Заголовки и тело одним вызовом, без склейки в общий буфер
+    const HttpBody parts[3] = { head, tail, body };
+    m_socket->write(parts, 3);
+}
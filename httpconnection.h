@@ -0,0 +1,127 @@
+#ifndef HTTPCONNECTION_H
+#define HTTPCONNECTION_H
+
+#include <QObject>
+#include <QTimer>
+#include <QFile>
+#include <deque>
+#include <memory>
+#include "httpcompression.h"
+#include "httprequestparser.h"
+#include "httpresponder.h"
+#include "httptransport.h"
+
+class Http2Session;
+class HttpServer;
+
+// Одно клиентское соединение: сокет, парсер и keep-alive.
+// Запросы, пришедшие пачкой (pipelining), обрабатываются по порядку,
+// ответы пишутся в сокет в том же порядке, даже если готовы вразнобой.
+// HTTP/2 (преамбула первыми байтами или Upgrade: h2c) передается
+// Http2Session, и дальше номер в очереди - это номер потока.
+class HttpConnection : public QObject, private HttpTransport::Handler
+{
+    Q_OBJECT
+public:
+    // Соединение становится владельцем transport
+    HttpConnection(HttpServer *server, HttpTransport *transport, QObject *parent = nullptr);
+    ~HttpConnection();
+
+    bool isValid() const { return m_valid; }
+
+    // Вызываются HttpResponder в потоке соединения
+    void completeResponse(quint64 sequence, const HttpResponse &response, const FileBody &file = FileBody());
+    void beginStream(quint64 sequence, const QByteArray &head, const StreamWindowPtr &window);
+    void writeStream(quint64 sequence, const QByteArray &data);
+    void endStream(quint64 sequence);
+    void abortStream(quint64 sequence);
+
+    // Заголовки Connection/Keep-Alive (и Date) для ответа вместе с пустой
+    // строкой, завершающей заголовки. Если длина ответа неизвестна,
+    // соединение придется закрыть.
+    static QByteArray connectionHeaders(const HttpResponse &response, bool &keepAlive,
+                                        int timeoutSec, int requestsLeft);
+    static HttpResponse internalErrorResponse();
+
+private slots:
+    void onIdleTimeout();
+    void onRequestTimeout();
+
+private:
+    friend class Http2Session;
+
+    void transportReadyRead() override;
+    void transportBytesWritten(qint64 bytes) override;
+    void transportClosed() override;
+
+    struct PendingResponse
+    {
+        quint64 sequence = 0;
+        bool keepAlive = false;
+        int requestsLeft = 0;
+        bool chunkedAllowed = true; // клиент HTTP/1.1
+        bool headRequest = false;   // HEAD: отправляются только заголовки
+        bool ready = false;         // заголовки известны
+        bool complete = false;      // все тело уже в response / data (или в file)
+        bool started = false;       // заголовки записаны в сокет
+        bool chunked = false;       // тело потока кадрируется chunked
+        HttpResponse response;      // заголовки и тело, пока не записаны в сокет
+        QByteArray data;            // еще не записанное тело потока
+        FileBody file;
+        StreamWindowPtr window;     // учет тела потока для обработчика
+        ContentEncoding encoding = ContentEncoding::Identity; // для готовых ответов
+        bool gzipAllowed = false;   // потоки сжимаются только gzip
+        std::shared_ptr<GzipStream> gzip;
+        qint64 windowBytes = 0;     // тело в data, о котором обработчик еще не знает
+    };
+
+    // Отправка тела из файла: постоянная память независимо от размера файла
+    struct FileStream
+    {
+        std::unique_ptr<QFile> file;
+        qint64 offset = 0;
+        qint64 remaining = 0;
+        bool closeWhenDone = false;
+    };
+
+    void processBufferedRequests();
+    PendingResponse *findPending(quint64 sequence);
+    void appendStreamBody(PendingResponse &pending, const QByteArray &data);
+    void responseProgressed();
+    void flushResponses();
+    void writeResponse(const QByteArray &head, const QByteArray &tail, const HttpBody &body);
+    bool startFileStream(const FileBody &body, bool closeWhenDone);
+    void pumpFileStream();
+    bool wantsKeepAlive(const HttpRequest &request) const;
+    // Срок на прием запроса: идет с первого байта, частичные чтения его не продлевают
+    void updateRequestTimer();
+    // 100 Continue, когда все предыдущие ответы уже в сокете
+    void sendDeferredContinue();
+    bool wantsHttp2Upgrade(const HttpRequest &request) const;
+    bool upgradeToHttp2(const HttpRequest &request);
+    void switchToHttp2();
+    void closeAfterWrite();
+    void abortConnection();
+    void closeStreamWindows();
+
+    HttpServer *m_server;
+    std::unique_ptr<HttpTransport> m_socket;
+    HttpRequestParser m_parser;
+    QTimer m_idleTimer;
+    QTimer m_requestTimer;
+    std::deque<PendingResponse> m_pending;
+    FileStream m_stream;
+    bool m_sendfileSupported;
+    quint64 m_nextSequence;
+    quint64 m_clientKey;      // ключ адреса клиента для лимита частоты
+    int m_requestsServed;
+    bool m_lastRequestQueued; // после запроса без keep-alive новые не принимаем
+    bool m_processing;        // защита от рекурсии при синхронных ответах
+    bool m_continueDeferred;  // 100 Continue ждет, пока допишутся предыдущие ответы
+    bool m_closing;
+    bool m_valid;
+    bool m_detectHttp2;       // первые байты еще могут оказаться преамбулой HTTP/2
+    std::unique_ptr<Http2Session> m_http2;
+};
+
+#endif // HTTPCONNECTION_H
@@ -0,0 +1,233 @@
+#include "httpheaders.h"
+#include <QtGlobal>
+
+namespace {
+
+struct KnownName
+{
+    const char *name;
+    int length;
+};
+
+// В порядке HttpHeaders::Field, в нижнем регистре
+constexpr KnownName kKnownNames[HttpHeaders::KnownCount] = {
+    { "accept", 6 },
+    { "accept-encoding", 15 },
+    { "authorization", 13 },
+    { "cache-control", 13 },
+    { "connection", 10 },
+    { "content-length", 14 },
+    { "content-type", 12 },
+    { "cookie", 6 },
+    { "expect", 6 },
+    { "host", 4 },
+    { "http2-settings", 14 },
+    { "if-modified-since", 17 },
+    { "if-none-match", 13 },
+    { "if-range", 8 },
+    { "origin", 6 },
+    { "range", 5 },
+    { "referer", 7 },
+    { "te", 2 },
+    { "transfer-encoding", 17 },
+    { "upgrade", 7 },
+    { "user-agent", 10 },
+    { "x-forwarded-for", 15 }
+};
+
+constexpr char lowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? char(c + ('a' - 'A')) : c;
+}
+
+// Длина, первый и последний символ различают все известные имена
+constexpr int slotOf(int length, char first, char last)
+{
+    return (length + 6 * lowerAscii(first) + 3 * lowerAscii(last)) & 63;
+}
+
+struct SlotTable
+{
+    qint8 field[64];
+    bool collisionFree;
+};
+
+constexpr SlotTable buildSlots()
+{
+    SlotTable table = {};
+    table.collisionFree = true;
+    for (int i = 0; i < 64; ++i)
+        table.field[i] = -1;
+    for (int f = 0; f < HttpHeaders::KnownCount; ++f) {
+        const KnownName &known = kKnownNames[f];
+        int slot = slotOf(known.length, known.name[0], known.name[known.length - 1]);
+        if (table.field[slot] != -1)
+            table.collisionFree = false;
+        table.field[slot] = qint8(f);
+    }
+    return table;
+}
+
+constexpr SlotTable kSlots = buildSlots();
+static_assert(kSlots.collisionFree, "header name hash has collisions, change slotOf()");
+
+// Чем склеивать повторы поля (RFC 9110, 5.3); nullptr - поле не список
+const char *listSeparator(HttpHeaders::Field field)
+{
+    switch (field) {
+    case HttpHeaders::Accept:
+    case HttpHeaders::AcceptEncoding:
+    case HttpHeaders::CacheControl:
+    case HttpHeaders::Connection:
+    case HttpHeaders::Expect:
+    case HttpHeaders::IfNoneMatch:
+    case HttpHeaders::Te:
+    case HttpHeaders::Upgrade:
+    case HttpHeaders::XForwardedFor:
+        return ", ";
+    case HttpHeaders::Cookie:
+        return "; ";    // RFC 6265, 5.4
+    default:
+        return nullptr;
+    }
+}
+
+bool equalsIgnoreCase(const char *a, const char *b, int length)
+{
+    for (int i = 0; i < length; ++i) {
+        if (lowerAscii(a[i]) != lowerAscii(b[i]))
+            return false;
+    }
+    return true;
+}
+
+}
+
+HttpHeaders::HttpHeaders() :
+    m_ownedFields(0)
+{
+    for (Span &span : m_known)
+        span = { 0, -1 };
+}
+
+void HttpHeaders::setSource(const QByteArray &source)
+{
+    m_source = source;
+}
+
+HttpHeaders::Field HttpHeaders::field(const char *name, int length)
+{
+    if (length <= 0) return Unknown;
+    qint8 candidate = kSlots.field[slotOf(length, name[0], name[length - 1])];
+    if (candidate < 0) return Unknown;
+    const KnownName &known = kKnownNames[candidate];
+    if (known.length != length || !equalsIgnoreCase(name, known.name, length))
+        return Unknown;
+    return Field(candidate);
+}
+
+QByteArray HttpHeaders::name(Field field)
+{
+    if (field >= KnownCount) return QByteArray();
+    return QByteArray::fromRawData(kKnownNames[field].name, kKnownNames[field].length);
+}
+
+bool HttpHeaders::append(int nameOffset, int nameLength, int valueOffset, int valueLength)
+{
+    Field known = field(m_source.constData() + nameOffset, nameLength);
+    if (known == Unknown) {
+        m_other.append({ { nameOffset, nameLength }, { valueOffset, valueLength } });
+        return true;
+    }
+    if (!contains(known)) {
+        m_known[known] = { valueOffset, valueLength };
+        m_ownedFields &= ~(1u << known);
+        return true;
+    }
+
+    // Посредник мог взять первое значение, а мы - последнее (request smuggling)
+    if (known == Host || known == TransferEncoding)
+        return false;
+    if (known == ContentLength)
+        return knownView(known) == view({ valueOffset, valueLength });
+
+    const char *separator = listSeparator(known);
+    if (separator) {
+        // Склеенное значение - в m_values, m_source остается общим с парсером
+        QByteArray joined = knownView(known) + separator + view({ valueOffset, valueLength });
+        set(known, joined);
+    }
+    return true;
+}
+
+void HttpHeaders::set(Field field, const QByteArray &value)
+{
+    if (field >= KnownCount) return;
+    m_known[field] = { m_values.size(), value.size() };
+    m_values.append(value);
+    m_ownedFields |= 1u << field;
+}
+
+void HttpHeaders::remove(Field field)
+{
+    if (field < KnownCount) {
+        m_known[field] = { 0, -1 };
+        m_ownedFields &= ~(1u << field);
+    }
+}
+
+QByteArray HttpHeaders::view(const Span &span) const
+{
+    return QByteArray::fromRawData(m_source.constData() + span.offset, span.length);
+}
+
+QByteArray HttpHeaders::knownView(Field field) const
+{
+    const Span &span = m_known[field];
+    const QByteArray &storage = m_ownedFields & (1u << field) ? m_values : m_source;
+    return QByteArray::fromRawData(storage.constData() + span.offset, span.length);
+}
+
+QByteArray HttpHeaders::value(Field field, const QByteArray &defaultValue) const
+{
+    if (field >= KnownCount || m_known[field].length < 0)
+        return defaultValue;
+    QByteArray view = knownView(field);
+    return QByteArray(view.constData(), view.size());
+}
+
+QByteArray HttpHeaders::valueView(Field field, const QByteArray &defaultValue) const
+{
+    if (field >= KnownCount || m_known[field].length < 0)
+        return defaultValue;
+    return knownView(field);
+}
+
+QByteArray HttpHeaders::value(const QByteArray &name) const
+{
+    Field known = field(name.constData(), name.size());
+    if (known != Unknown)
+        return value(known);
+
+    QByteArray result;
+    bool found = false;
+    for (const Other &other : m_other) {
+        if (other.name.length != name.size()
+            || !equalsIgnoreCase(m_source.constData() + other.name.offset, name.constData(), name.size()))
+            continue;
+        if (found)
+            result.append(", ");
+        result.append(m_source.constData() + other.value.offset, other.value.length);
+        found = true;
+    }
+    return result;
+}
+
+int HttpHeaders::size() const
+{
+    int count = m_other.size();
+    for (const Span &span : m_known) {
+        if (span.length >= 0) ++count;
+    }
+    return count;
+}
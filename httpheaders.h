@@ -0,0 +1,98 @@
+#ifndef HTTPHEADERS_H
+#define HTTPHEADERS_H
+
+#include <QByteArray>
+#include <QVarLengthArray>
+
+// Заголовки запроса без копирования: имена и значения хранятся как
+// смещения в буфере, из которого разобран запрос (буфер разделяется
+// с парсером, а не копируется). Известные заголовки ищутся по
+// совершенному хешу, построенному при компиляции, остальные лежат
+// в маленьком встроенном массиве.
+class HttpHeaders
+{
+public:
+    enum Field : quint8 {
+        Accept,
+        AcceptEncoding,
+        Authorization,
+        CacheControl,
+        Connection,
+        ContentLength,
+        ContentType,
+        Cookie,
+        Expect,
+        Host,
+        Http2Settings,
+        IfModifiedSince,
+        IfNoneMatch,
+        IfRange,
+        Origin,
+        Range,
+        Referer,
+        Te,
+        TransferEncoding,
+        Upgrade,
+        UserAgent,
+        XForwardedFor,
+        KnownCount,
+        Unknown = KnownCount
+    };
+    static_assert(KnownCount <= 32, "m_ownedFields holds one bit per known field");
+
+    HttpHeaders();
+
+    // Буфер, в который указывают смещения append()
+    void setSource(const QByteArray &source);
+    // Заголовок из source. Повтор поля-списка дописывается через запятую
+    // (Cookie - через "; "), у остальных полей действует первое значение.
+    // false - повтор, по которому посредник и сервер могут разойтись:
+    // Host, второй Transfer-Encoding или Content-Length с другим значением.
+    // Такой запрос отклоняется
+    bool append(int nameOffset, int nameLength, int valueOffset, int valueLength);
+
+    void set(Field field, const QByteArray &value);
+    void remove(Field field);
+
+    bool contains(Field field) const { return m_known[field].length >= 0; }
+    // Копия значения - ее можно хранить сколько угодно
+    QByteArray value(Field field, const QByteArray &defaultValue = QByteArray()) const;
+    // Значение без копирования (QByteArray::fromRawData): годится, пока жив этот
+    // объект и до следующего set(). Копии такого QByteArray указывают туда же,
+    // поэтому сохранять его (в ключ кеша, в поле класса) нельзя - только value()
+    QByteArray valueView(Field field, const QByteArray &defaultValue = QByteArray()) const;
+    // Любой заголовок по имени без учета регистра, копией; повторы через запятую
+    QByteArray value(const QByteArray &name) const;
+
+    int size() const;
+    bool isEmpty() const { return size() == 0; }
+
+    static Field field(const char *name, int length);
+    static QByteArray name(Field field);
+
+private:
+    struct Span
+    {
+        int offset;
+        int length;   // -1 - заголовка нет
+    };
+
+    struct Other
+    {
+        Span name;
+        Span value;
+    };
+
+    QByteArray view(const Span &span) const;
+    QByteArray knownView(Field field) const;
+
+    QByteArray m_source;
+    Span m_known[KnownCount];
+    // Значения из set() - в своем буфере: m_source разделяется с буфером
+    // парсера, и дописывание в него скопировало бы весь принятый запрос
+    QByteArray m_values;
+    quint32 m_ownedFields;   // бит поля - его Span указывает в m_values
+    QVarLengthArray<Other, 8> m_other;
+};
+
+#endif // HTTPHEADERS_H
@@ -0,0 +1,289 @@
+#include "httprequestparser.h"
+#include <cstring>
+
+HttpRequestParser::HttpRequestParser() :
+    m_pos(0),
+    m_scanPos(0),
+    m_state(State::Head),
+    m_remaining(0),
+    m_continuePending(false),
+    m_maxHeaderSize(64 * 1024),
+    m_maxBodySize(64 * 1024 * 1024),
+    m_errorCode(0)
+{
+}
+
+void HttpRequestParser::append(const QByteArray &data)
+{
+    if (m_state == State::Failed) return;
+
+    // Все предыдущие данные разобраны - просто начинаем буфер заново
+    if (m_pos >= m_buffer.size()) {
+        m_buffer = data;
+        m_pos = 0;
+        m_scanPos = 0;
+        return;
+    }
+
+    // Разобранное начало отбрасываем здесь, а не в takeRequest: буфер может
+    // разделяться с заголовками выданного запроса, и сдвиг на месте его бы скопировал
+    if (m_pos > 0) {
+        int scanOffset = m_scanPos - m_pos;
+        m_buffer = m_buffer.mid(m_pos) + data;
+        m_pos = 0;
+        m_scanPos = scanOffset;
+        return;
+    }
+    m_buffer.append(data);
+}
+
+QByteArray HttpRequestParser::takeBufferedData()
+{
+    QByteArray data = m_buffer.mid(m_pos);
+    m_buffer.clear();
+    m_pos = 0;
+    m_scanPos = 0;
+    return data;
+}
+
+void HttpRequestParser::consume(int bytes)
+{
+    m_pos += bytes;
+    m_scanPos = m_pos;
+}
+
+HttpRequestParser::Status HttpRequestParser::fail(int code, const QString &message)
+{
+    m_state = State::Failed;
+    m_errorCode = code;
+    m_errorString = message;
+    return Status::Error;
+}
+
+HttpRequestParser::Status HttpRequestParser::parse()
+{
+    for (;;) {
+        switch (m_state) {
+        case State::Failed:
+            return Status::Error;
+
+        case State::Done:
+            // Предыдущий запрос еще не забрали
+            return Status::Complete;
+
+        case State::Head: {
+            // Пустые строки перед строкой запроса допустимы (RFC 7230, 3.5)
+            while (m_buffer.size() - m_pos >= 2 && m_buffer.at(m_pos) == '\r' && m_buffer.at(m_pos + 1) == '\n')
+                consume(2);
+
+            // Ищем конец заголовков только в новых данных
+            int from = qMax(m_pos, m_scanPos - 3);
+            int headEnd = m_buffer.indexOf("\r\n\r\n", from);
+            if (headEnd == -1) {
+                if (m_buffer.size() - m_pos > m_maxHeaderSize)
+                    return fail(431, "Request Header Fields Too Large");
+                m_scanPos = m_buffer.size();
+                return Status::NeedMore;
+            }
+            if (headEnd - m_pos > m_maxHeaderSize)
+                return fail(431, "Request Header Fields Too Large");
+
+            if (!parseHead(headEnd))
+                return Status::Error;
+            consume(headEnd + 4 - m_pos);
+
+            QByteArray transferEncoding = m_request.headers.valueView(HttpHeaders::TransferEncoding);
+            // Обе длины сразу - признак подмены границ запроса (RFC 9112, 6.3)
+            if (m_request.headers.contains(HttpHeaders::TransferEncoding)
+                && m_request.headers.contains(HttpHeaders::ContentLength))
+                return fail(400, "Both Transfer-Encoding and Content-Length");
+            if (m_request.headers.contains(HttpHeaders::TransferEncoding)) {
+                // Снимаем только chunked: любая другая кодировка дошла бы до обработчиков
+                // нераспакованной, а "gzip, chunked" или "xchunked" посредник мог бы
+                // прочитать иначе. Пустые элементы списка допустимы (RFC 9110, 5.6.1)
+                int codings = 0;
+                bool chunked = false;
+                for (const QByteArray &item : transferEncoding.split(',')) {
+                    QByteArray coding = item.trimmed().toLower();
+                    if (coding.isEmpty())
+                        continue;
+                    ++codings;
+                    chunked = coding == "chunked";
+                }
+                if (codings != 1 || !chunked)
+                    return fail(501, "Unsupported Transfer-Encoding");
+                m_state = State::ChunkSize;
+            } else if (m_request.headers.contains(HttpHeaders::ContentLength)) {
+                bool ok = false;
+                m_remaining = m_request.headers.valueView(HttpHeaders::ContentLength).toLongLong(&ok);
+                if (!ok || m_remaining < 0)
+                    return fail(400, "Invalid Content-Length");
+                if (m_remaining > m_maxBodySize)
+                    return fail(413, "Payload Too Large");
+                m_request.body.reserve(int(qMin<qint64>(m_remaining, 1024 * 1024)));
+                m_state = m_remaining > 0 ? State::Body : State::Done;
+            } else {
+                m_state = State::Done;
+            }
+
+            if (m_state != State::Done
+                && m_request.headers.valueView(HttpHeaders::Expect).toLower() == "100-continue") {
+                m_continuePending = true;
+            }
+            break;
+        }
+
+        case State::Body:
+        case State::ChunkData: {
+            int available = m_buffer.size() - m_pos;
+            if (available == 0) return Status::NeedMore;
+
+            int take = int(qMin<qint64>(available, m_remaining));
+            m_request.body.append(m_buffer.constData() + m_pos, take);
+            consume(take);
+            m_remaining -= take;
+            if (m_remaining > 0) return Status::NeedMore;
+
+            m_state = m_state == State::Body ? State::Done : State::ChunkDataEnd;
+            break;
+        }
+
+        case State::ChunkSize: {
+            int lineEnd = m_buffer.indexOf("\r\n", m_pos);
+            if (lineEnd == -1) {
+                if (m_buffer.size() - m_pos > 1024)
+                    return fail(400, "Invalid chunk size");
+                return Status::NeedMore;
+            }
+
+            QByteArray sizeLine = m_buffer.mid(m_pos, lineEnd - m_pos);
+            int extPos = sizeLine.indexOf(';'); // расширения чанков игнорируем
+            if (extPos != -1) sizeLine.truncate(extPos);
+
+            bool ok = false;
+            qint64 chunkSize = sizeLine.trimmed().toLongLong(&ok, 16);
+            if (!ok || chunkSize < 0)
+                return fail(400, "Invalid chunk size");
+            // Сумма переполнилась бы при размере около 7fffffffffffffff
+            if (chunkSize > m_maxBodySize - m_request.body.size())
+                return fail(413, "Payload Too Large");
+
+            consume(lineEnd + 2 - m_pos);
+            if (chunkSize == 0) {
+                m_state = State::ChunkTrailer;
+            } else {
+                m_remaining = chunkSize;
+                m_state = State::ChunkData;
+            }
+            break;
+        }
+
+        case State::ChunkDataEnd:
+            if (m_buffer.size() - m_pos < 2) return Status::NeedMore;
+            if (m_buffer.at(m_pos) != '\r' || m_buffer.at(m_pos + 1) != '\n')
+                return fail(400, "Invalid chunk terminator");
+            consume(2);
+            m_state = State::ChunkSize;
+            break;
+
+        case State::ChunkTrailer: {
+            // Трейлеры пропускаем до пустой строки
+            int lineEnd = m_buffer.indexOf("\r\n", m_pos);
+            if (lineEnd == -1) {
+                if (m_buffer.size() - m_pos > m_maxHeaderSize)
+                    return fail(431, "Request Header Fields Too Large");
+                return Status::NeedMore;
+            }
+            bool lastLine = lineEnd == m_pos;
+            consume(lineEnd + 2 - m_pos);
+            if (lastLine) {
+                m_request.headers.remove(HttpHeaders::TransferEncoding);
+                m_request.headers.set(HttpHeaders::ContentLength, QByteArray::number(m_request.body.size()));
+                m_state = State::Done;
+            }
+            break;
+        }
+        }
+    }
+}
+
+bool HttpRequestParser::parseHead(int headEnd)
+{
+    const char *data = m_buffer.constData();
+    int lineEnd = m_buffer.indexOf("\r\n", m_pos);
+
+    // Строка запроса: метод путь версия
+    int methodEnd = m_buffer.indexOf(' ', m_pos);
+    int targetEnd = methodEnd == -1 || methodEnd > lineEnd ? -1 : m_buffer.indexOf(' ', methodEnd + 1);
+    if (methodEnd <= m_pos || targetEnd <= methodEnd + 1 || targetEnd > lineEnd
+        || memchr(data + targetEnd + 1, ' ', size_t(lineEnd - targetEnd - 1))) {
+        fail(400, "Bad Request");
+        return false;
+    }
+    if (lineEnd - targetEnd - 1 < 7 || qstrncmp(data + targetEnd + 1, "HTTP/1.", 7) != 0) {
+        fail(505, "HTTP Version Not Supported");
+        return false;
+    }
+
+    m_request.method = m_buffer.mid(m_pos, methodEnd - m_pos);
+    m_request.target = m_buffer.mid(methodEnd + 1, targetEnd - methodEnd - 1);
+    m_request.version = m_buffer.mid(targetEnd + 1, lineEnd - targetEnd - 1);
+
+    // Заголовки: запоминаем только смещения, буфер разделяется с запросом
+    m_request.headers.setSource(m_buffer);
+    int lineStart = lineEnd + 2;
+    while (lineStart < headEnd) {
+        lineEnd = m_buffer.indexOf("\r\n", lineStart);
+        if (lineEnd == -1 || lineEnd > headEnd) lineEnd = headEnd;
+
+        int colonPos = m_buffer.indexOf(':', lineStart);
+        if (colonPos <= lineStart || colonPos > lineEnd) {
+            fail(400, "Malformed header line");
+            return false;
+        }
+
+        // Пробел перед двоеточием или в начале строки (obs-fold) запрещен (RFC 9112, 5.1 и 5.2):
+        // посредник мог понять такое имя иначе
+        int nameStart = lineStart, nameEnd = colonPos;
+        if (data[nameStart] == ' ' || data[nameStart] == '\t'
+            || data[nameEnd - 1] == ' ' || data[nameEnd - 1] == '\t') {
+            fail(400, "Whitespace in header name");
+            return false;
+        }
+        int valueStart = colonPos + 1, valueEnd = lineEnd;
+        while (valueStart < valueEnd && (data[valueStart] == ' ' || data[valueStart] == '\t')) ++valueStart;
+        while (valueEnd > valueStart && (data[valueEnd - 1] == ' ' || data[valueEnd - 1] == '\t')) --valueEnd;
+
+        if (!m_request.headers.append(nameStart, nameEnd - nameStart, valueStart, valueEnd - valueStart)) {
+            fail(400, "Conflicting repeated header");
+            return false;
+        }
+        lineStart = lineEnd + 2;
+    }
+    return true;
+}
+
+HttpRequest HttpRequestParser::takeRequest()
+{
+    HttpRequest request = std::move(m_request);
+    m_request = HttpRequest();
+    m_state = State::Head;
+    m_remaining = 0;
+    m_continuePending = false;
+
+    // Все разобрано - отпускаем буфер, он остается только у заголовков запроса.
+    // Иначе начало отбросит следующий append(), чтобы буфер не рос
+    if (m_pos >= m_buffer.size()) {
+        m_buffer = QByteArray();
+        m_pos = 0;
+        m_scanPos = 0;
+    }
+    return request;
+}
+
+bool HttpRequestParser::takeContinueRequest()
+{
+    bool pending = m_continuePending;
+    m_continuePending = false;
+    return pending;
+}
@@ -0,0 +1,91 @@
+#ifndef HTTPREQUESTPARSER_H
+#define HTTPREQUESTPARSER_H
+
+#include <QByteArray>
+#include <QString>
+#include "httpheaders.h"
+
+// Разобранный HTTP-запрос
+struct HttpRequest
+{
+    QByteArray method;
+    QByteArray target;   // путь вместе с query-строкой
+    QByteArray version;
+    HttpHeaders headers; // ссылаются на буфер, из которого разобран запрос
+    QByteArray body;
+};
+
+// Инкрементальный парсер HTTP/1.1 для одного соединения.
+// Копит байты из сокета и отдает запрос только когда он пришел целиком:
+// строка запроса, заголовки и ровно Content-Length байт тела (или chunked).
+class HttpRequestParser
+{
+public:
+    enum class Status {
+        NeedMore,   // данных пока не хватает
+        Complete,   // запрос готов, забрать через takeRequest()
+        Error       // запрос битый, код в errorCode()
+    };
+
+    HttpRequestParser();
+
+    void setMaxHeaderSize(int bytes) { m_maxHeaderSize = bytes; }
+    void setMaxBodySize(qint64 bytes) { m_maxBodySize = bytes; }
+
+    // Добавить прочитанные из сокета данные
+    void append(const QByteArray &data);
+
+    // Продвинуть разбор. После Complete в буфере может остаться
+    // следующий запрос (pipelining), поэтому parse() вызывается в цикле.
+    Status parse();
+
+    HttpRequest takeRequest();
+
+    // Клиент прислал "Expect: 100-continue" и ждет промежуточный ответ
+    bool takeContinueRequest();
+
+    int errorCode() const { return m_errorCode; }
+    QString errorString() const { return m_errorString; }
+    bool hasBufferedData() const { return m_pos < m_buffer.size(); }
+    // Пришла часть следующего запроса, но он еще не разобран целиком
+    bool requestStarted() const
+    {
+        return m_state != State::Done && m_state != State::Failed && (m_state != State::Head || hasBufferedData());
+    }
+    // Начало неразобранных данных (распознать преамбулу HTTP/2)
+    QByteArray peekBuffered(int bytes) const { return m_buffer.mid(m_pos, bytes); }
+    // Забрать неразобранные данные: соединение переходит на другой протокол
+    QByteArray takeBufferedData();
+
+private:
+    enum class State {
+        Head,
+        Body,
+        ChunkSize,
+        ChunkData,
+        ChunkDataEnd,
+        ChunkTrailer,
+        Done,
+        Failed
+    };
+
+    Status fail(int code, const QString &message);
+    bool parseHead(int headEnd);
+    void consume(int bytes);
+
+    QByteArray m_buffer;
+    int m_pos;        // начало неразобранных данных в m_buffer
+    int m_scanPos;    // откуда продолжать поиск конца заголовков
+    State m_state;
+    HttpRequest m_request;
+    qint64 m_remaining;
+    bool m_continuePending;
+
+    int m_maxHeaderSize;
+    qint64 m_maxBodySize;
+
+    int m_errorCode;
+    QString m_errorString;
+};
+
+#endif // HTTPREQUESTPARSER_H
@@ -0,0 +1,163 @@
+#include "httpresponder.h"
+#include "httpconnection.h"
+#include <QDeadlineTimer>
+#include <QThread>
+
+void StreamWindow::produced(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_buffered += bytes;
+}
+
+void StreamWindow::consumed(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_buffered -= bytes;
+    m_drained.wakeAll();
+}
+
+bool StreamWindow::waitBelow(qint64 limit, int timeoutMs)
+{
+    QDeadlineTimer deadline(timeoutMs);
+    QMutexLocker locker(&m_mutex);
+    while (!m_closed && m_buffered >= limit) {
+        if (!m_drained.wait(&m_mutex, deadline))
+            return false;
+    }
+    return !m_closed;
+}
+
+void StreamWindow::close()
+{
+    QMutexLocker locker(&m_mutex);
+    m_closed = true;
+    m_drained.wakeAll();
+}
+
+HttpResponder::HttpResponder(HttpConnection *connection, quint64 sequence) :
+    m_connection(connection),
+    m_context(connection->parent()),
+    m_sequence(sequence),
+    m_window(new StreamWindow),
+    m_sent(false),
+    m_streaming(false),
+    m_route(Metrics::RouteStatic),
+    m_status(0)
+{
+    m_timer.start();
+}
+
+HttpResponder::~HttpResponder()
+{
+    // Обработчик потерял ответ (исключение, забытая ветка) - не вешаем клиента
+    if (!m_sent.load())
+        send(HttpConnection::internalErrorResponse());
+    else if (m_streaming.load())
+        abortStream();
+}
+
+void HttpResponder::send(const HttpResponse &response)
+{
+    if (m_sent.exchange(true)) return;
+    finished(response.status());
+
+    quint64 sequence = m_sequence;
+    post([sequence, response](HttpConnection *connection) {
+        connection->completeResponse(sequence, response);
+    });
+}
+
+void HttpResponder::sendFile(const HttpResponse &head, const QString &path, qint64 offset, qint64 length)
+{
+    if (m_sent.exchange(true)) return;
+    finished(head.status());
+
+    FileBody file;
+    file.path = path;
+    file.offset = offset;
+    file.length = length;
+
+    quint64 sequence = m_sequence;
+    post([sequence, head, file](HttpConnection *connection) {
+        connection->completeResponse(sequence, head, file);
+    });
+}
+
+void HttpResponder::beginStream(const QByteArray &head)
+{
+    if (m_sent.exchange(true)) return;
+    m_status.store(Metrics::statusFromResponse(head));
+    m_streaming.store(true);
+
+    quint64 sequence = m_sequence;
+    StreamWindowPtr window = m_window;
+    post([sequence, head, window](HttpConnection *connection) {
+        connection->beginStream(sequence, head, window);
+    });
+}
+
+void HttpResponder::writeBody(const QByteArray &data)
+{
+    if (!m_streaming.load() || data.isEmpty()) return;
+
+    m_window->produced(data.size());
+    quint64 sequence = m_sequence;
+    post([sequence, data](HttpConnection *connection) {
+        connection->writeStream(sequence, data);
+    });
+}
+
+void HttpResponder::endStream()
+{
+    if (!m_streaming.exchange(false)) return;
+    finished(m_status.load());
+
+    quint64 sequence = m_sequence;
+    post([sequence](HttpConnection *connection) {
+        connection->endStream(sequence);
+    });
+}
+
+void HttpResponder::abortStream()
+{
+    if (!m_streaming.exchange(false)) return;
+    finished(m_status.load());
+
+    quint64 sequence = m_sequence;
+    post([sequence](HttpConnection *connection) {
+        connection->abortStream(sequence);
+    });
+}
+
+bool HttpResponder::waitForDrain(qint64 maxBuffered, int timeoutMs)
+{
+    QObject *context = m_context.data();
+    if (!context) return false;
+    // В потоке соединения ждать нельзя - сокет в этом же цикле событий
+    if (QThread::currentThread() == context->thread()) return true;
+    return m_window->waitBelow(maxBuffered, timeoutMs);
+}
+
+void HttpResponder::finished(int status)
+{
+    Metrics::global().requestFinished(Metrics::Route(m_route.load()), status, m_timer.nsecsElapsed() / 1000);
+}
+
+void HttpResponder::post(std::function<void(HttpConnection *)> action)
+{
+    QObject *context = m_context.data();
+    if (!context) return;
+
+    // Уже в потоке соединения - выполняем сразу
+    if (QThread::currentThread() == context->thread()) {
+        if (m_connection)
+            action(m_connection.data());
+        return;
+    }
+
+    QPointer<HttpConnection> connection = m_connection;
+    QMetaObject::invokeMethod(context, [connection, action]() {
+        if (connection)
+            action(connection.data());
+    }, Qt::QueuedConnection);
+}
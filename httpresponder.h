@@ -0,0 +1,107 @@
+#ifndef HTTPRESPONDER_H
+#define HTTPRESPONDER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+#include <QElapsedTimer>
+#include "httpresponse.h"
+#include "metrics.h"
+
+class HttpConnection;
+
+// Тело ответа, которое отправляется прямо из файла (sendfile), не через память
+struct FileBody
+{
+    QString path;
+    qint64 offset = 0;
+    qint64 length = 0;
+
+    bool isNull() const { return path.isEmpty(); }
+};
+
+// Окно потокового ответа: сколько байт тела передано соединению,
+// но еще не отдано сокету. Через него обработчик из чужого потока
+// притормаживает, если клиент читает медленнее, чем мы производим.
+class StreamWindow
+{
+public:
+    void produced(qint64 bytes);
+    void consumed(qint64 bytes);
+    // false - таймаут или соединение закрыто
+    bool waitBelow(qint64 limit, int timeoutMs);
+    void close();
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_drained;
+    qint64 m_buffered = 0;
+    bool m_closed = false;
+};
+
+typedef QSharedPointer<StreamWindow> StreamWindowPtr;
+
+// Ручка для ответа на один запрос. Обработчик может ответить сразу
+// или позже из другого потока (например, из пула БД) - ответ вернется
+// в поток соединения и встанет в очередь pipelining на свое место.
+//
+// Ответ отдается либо целиком (send/sendFile), либо потоком:
+// beginStream(заголовки без длины) -> writeBody()... -> endStream().
+// Кадрирование тела (chunked) делает соединение.
+class HttpResponder
+{
+public:
+    HttpResponder(HttpConnection *connection, quint64 sequence);
+    ~HttpResponder();
+
+    // Потокобезопасно, срабатывает только первый вызов
+    void send(const HttpResponse &response);
+    // Ответ, собранный одним буфером (CGI)
+    void send(const QByteArray &response) { send(HttpResponse::fromRaw(response)); }
+    // Заголовки из head, тело - length байт файла начиная с offset
+    void sendFile(const HttpResponse &head, const QString &path, qint64 offset, qint64 length);
+
+    // Потоковый ответ. Вызовы из одного потока приходят в соединение по порядку
+    void beginStream(const QByteArray &head);
+    void writeBody(const QByteArray &data);
+    void endStream();
+    // Оборвать начатый поток: клиент увидит разрыв соединения
+    void abortStream();
+
+    // Ждать, пока в соединении не останется меньше maxBuffered байт тела.
+    // Только для обработчиков вне потока соединения (в нем сразу true).
+    // false - клиент ушел или не читает дольше timeoutMs
+    bool waitForDrain(qint64 maxBuffered, int timeoutMs);
+
+    // Маршрут для метрик; время считается от создания ручки
+    void setRoute(Metrics::Route route) { m_route.store(route); }
+    // Сколько запрос уже ждет ответа (для сброса нагрузки по сроку в очереди)
+    qint64 elapsedMs() const { return m_timer.elapsed(); }
+
+    bool isSent() const { return m_sent.load(); }
+    bool isStreaming() const { return m_streaming.load(); }
+
+private:
+    void post(std::function<void(HttpConnection *)> action);
+    void finished(int status);
+
+    QPointer<HttpConnection> m_connection;
+    // Объект, переживающий соединение и живущий в его потоке (воркер)
+    QPointer<QObject> m_context;
+    quint64 m_sequence;
+    StreamWindowPtr m_window;
+    std::atomic<bool> m_sent;
+    std::atomic<bool> m_streaming;
+    std::atomic<int> m_route;
+    std::atomic<int> m_status;    // статус начатого потока
+    QElapsedTimer m_timer;
+};
+
+typedef QSharedPointer<HttpResponder> HttpResponderPtr;
+
+#endif // HTTPRESPONDER_H
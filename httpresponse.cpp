@@ -0,0 +1,210 @@
+#include "httpresponse.h"
+#include <cstdio>
+#include <ctime>
+
+namespace {
+
+bool startsWithIgnoreCase(const char *data, int length, const char *prefix, int prefixLength)
+{
+    if (length < prefixLength) return false;
+    return qstrnicmp(data, prefix, uint(prefixLength)) == 0;
+}
+
+}
+
+HttpBody::HttpBody(const QByteArray &data, int offset, int size) :
+    m_data(data),
+    m_offset(qBound(0, offset, data.size())),
+    m_size(qBound(0, size, data.size() - m_offset))
+{
+}
+
+HttpBody HttpBody::mid(int offset, int size) const
+{
+    offset = qBound(0, offset, m_size);
+    return HttpBody(m_data, m_offset + offset, qMin(size, m_size - offset));
+}
+
+QByteArray HttpBody::toByteArray() const
+{
+    if (m_offset == 0 && m_size == m_data.size())
+        return m_data;
+    return QByteArray(constData(), m_size);
+}
+
+HttpResponse::HttpResponse() :
+    m_status(0),
+    m_hasLength(false),
+    m_hasDate(false)
+{
+}
+
+HttpResponse::HttpResponse(int status) :
+    m_head(statusLine(status)),
+    m_status(status),
+    m_hasLength(false),
+    m_hasDate(false)
+{
+}
+
+HttpResponse::HttpResponse(int status, const QByteArray &contentType, const HttpBody &body) :
+    m_body(body),
+    m_status(status),
+    m_hasLength(true),
+    m_hasDate(false)
+{
+    // Заголовки собираются в один заранее выделенный буфер, тело в него не попадает
+    QByteArray line = statusLine(status);
+    m_head.reserve(line.size() + contentType.size() + 64);
+    m_head.append(line);
+    m_head.append("Content-Type: ");
+    m_head.append(contentType);
+    m_head.append("\r\nContent-Length: ");
+    m_head.append(QByteArray::number(body.size()));
+    m_head.append("\r\n");
+}
+
+HttpResponse HttpResponse::fromRaw(const QByteArray &raw)
+{
+    HttpResponse response;
+    int headEnd = raw.indexOf("\r\n\r\n");
+    if (headEnd == -1) {
+        response.m_head = raw;
+        if (!response.m_head.endsWith("\r\n"))
+            response.m_head.append("\r\n");
+    } else {
+        response.m_head = raw.left(headEnd + 2);
+        response.m_body = HttpBody(raw, headEnd + 4, raw.size() - headEnd - 4);
+    }
+
+    // "HTTP/1.1 200 ..." - код всегда с 9-го символа
+    const QByteArray &head = response.m_head;
+    if (head.size() >= 12 && head.startsWith("HTTP/")) {
+        const char *code = head.constData() + 9;
+        if (code[0] >= '1' && code[0] <= '5' && code[1] >= '0' && code[1] <= '9' && code[2] >= '0' && code[2] <= '9')
+            response.m_status = (code[0] - '0') * 100 + (code[1] - '0') * 10 + (code[2] - '0');
+    }
+
+    int lineStart = head.indexOf("\r\n");
+    while (lineStart != -1 && lineStart + 2 < head.size()) {
+        lineStart += 2;
+        int lineEnd = head.indexOf("\r\n", lineStart);
+        if (lineEnd == -1) lineEnd = head.size();
+        response.noteHeader(head.constData() + lineStart, lineEnd - lineStart);
+        lineStart = lineEnd;
+    }
+    return response;
+}
+
+HttpResponse &HttpResponse::addHeader(const QByteArray &lines)
+{
+    int lineStart = 0;
+    while (lineStart < lines.size()) {
+        int lineEnd = lines.indexOf("\r\n", lineStart);
+        if (lineEnd == -1) lineEnd = lines.size();
+        noteHeader(lines.constData() + lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 2;
+    }
+    m_head.append(lines);
+    return *this;
+}
+
+HttpResponse &HttpResponse::addHeader(const char *name, const QByteArray &value)
+{
+    int start = m_head.size();
+    m_head.append(name);
+    m_head.append(": ");
+    m_head.append(value);
+    m_head.append("\r\n");
+    noteHeader(m_head.constData() + start, m_head.size() - start);
+    return *this;
+}
+
+void HttpResponse::noteHeader(const char *line, int length)
+{
+    if (startsWithIgnoreCase(line, length, "content-length:", 15)) {
+        m_hasLength = true;
+    } else if (startsWithIgnoreCase(line, length, "transfer-encoding:", 18)) {
+        if (QByteArray::fromRawData(line, length).toLower().contains("chunked"))
+            m_hasLength = true;
+    } else if (startsWithIgnoreCase(line, length, "date:", 5)) {
+        m_hasDate = true;
+    }
+}
+
+bool HttpResponse::isFramed() const
+{
+    // У 1xx, 204 и 304 тела нет по определению
+    return m_hasLength || (m_status >= 100 && m_status < 200) || m_status == 204 || m_status == 304;
+}
+
+QByteArray HttpResponse::toByteArray() const
+{
+    QByteArray result;
+    result.reserve(size());
+    result.append(m_head);
+    result.append("\r\n");
+    result.append(m_body.constData(), m_body.size());
+    return result;
+}
+
+QByteArray HttpResponse::statusLine(int status)
+{
+    switch (status) {
+    case 100: return QByteArrayLiteral("HTTP/1.1 100 Continue\r\n");
+    case 101: return QByteArrayLiteral("HTTP/1.1 101 Switching Protocols\r\n");
+    case 200: return QByteArrayLiteral("HTTP/1.1 200 OK\r\n");
+    case 201: return QByteArrayLiteral("HTTP/1.1 201 Created\r\n");
+    case 204: return QByteArrayLiteral("HTTP/1.1 204 No Content\r\n");
+    case 206: return QByteArrayLiteral("HTTP/1.1 206 Partial Content\r\n");
+    case 301: return QByteArrayLiteral("HTTP/1.1 301 Moved Permanently\r\n");
+    case 302: return QByteArrayLiteral("HTTP/1.1 302 Found\r\n");
+    case 304: return QByteArrayLiteral("HTTP/1.1 304 Not Modified\r\n");
+    case 400: return QByteArrayLiteral("HTTP/1.1 400 Bad Request\r\n");
+    case 401: return QByteArrayLiteral("HTTP/1.1 401 Unauthorized\r\n");
+    case 403: return QByteArrayLiteral("HTTP/1.1 403 Forbidden\r\n");
+    case 404: return QByteArrayLiteral("HTTP/1.1 404 Not Found\r\n");
+    case 405: return QByteArrayLiteral("HTTP/1.1 405 Method Not Allowed\r\n");
+    case 408: return QByteArrayLiteral("HTTP/1.1 408 Request Timeout\r\n");
+    case 413: return QByteArrayLiteral("HTTP/1.1 413 Payload Too Large\r\n");
+    case 416: return QByteArrayLiteral("HTTP/1.1 416 Range Not Satisfiable\r\n");
+    case 429: return QByteArrayLiteral("HTTP/1.1 429 Too Many Requests\r\n");
+    case 431: return QByteArrayLiteral("HTTP/1.1 431 Request Header Fields Too Large\r\n");
+    case 500: return QByteArrayLiteral("HTTP/1.1 500 Internal Server Error\r\n");
+    case 501: return QByteArrayLiteral("HTTP/1.1 501 Not Implemented\r\n");
+    case 502: return QByteArrayLiteral("HTTP/1.1 502 Bad Gateway\r\n");
+    case 503: return QByteArrayLiteral("HTTP/1.1 503 Service Unavailable\r\n");
+    case 504: return QByteArrayLiteral("HTTP/1.1 504 Gateway Timeout\r\n");
+    case 505: return QByteArrayLiteral("HTTP/1.1 505 HTTP Version Not Supported\r\n");
+    default: break;
+    }
+    return "HTTP/1.1 " + QByteArray::number(status) + " Error\r\n";
+}
+
+QByteArray HttpResponse::dateHeader()
+{
+    static const char days[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char months[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    // У каждого потока своя копия - без блокировок, форматируем раз в секунду
+    thread_local time_t cachedSecond = 0;
+    thread_local QByteArray cached;
+
+    time_t now = ::time(nullptr);
+    if (now != cachedSecond || cached.isEmpty()) {
+        struct tm parts;
+#ifdef Q_OS_WIN
+        gmtime_s(&parts, &now);
+#else
+        gmtime_r(&now, &parts);
+#endif
+        // strftime зависит от локали, а в HTTP-дате имена всегда английские
+        char buffer[64];
+        int length = std::snprintf(buffer, sizeof(buffer), "Date: %s, %02d %s %04d %02d:%02d:%02d GMT\r\n",
+                                   days[parts.tm_wday], parts.tm_mday, months[parts.tm_mon],
+                                   parts.tm_year + 1900, parts.tm_hour, parts.tm_min, parts.tm_sec);
+        cached = QByteArray(buffer, length);
+        cachedSecond = now;
+    }
+    return cached;
+}
@@ -0,0 +1,79 @@
+#ifndef HTTPRESPONSE_H
+#define HTTPRESPONSE_H
+
+#include <QByteArray>
+
+// Тело ответа: разделяемый буфер и диапазон в нем. Копирование тела -
+// это только счетчик ссылок QByteArray, поэтому тело из кеша статики
+// или готовый JSON уходят клиенту без копирования на каждый запрос.
+class HttpBody
+{
+public:
+    HttpBody() : m_offset(0), m_size(0) {}
+    HttpBody(const QByteArray &data) : m_data(data), m_offset(0), m_size(data.size()) {}
+    HttpBody(const QByteArray &data, int offset, int size);
+
+    const char *constData() const { return m_data.constData() + m_offset; }
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+
+    // Часть тела без копирования
+    HttpBody mid(int offset, int size) const;
+    // Копирует, только если тело - часть буфера
+    QByteArray toByteArray() const;
+
+private:
+    QByteArray m_data;
+    int m_offset;
+    int m_size;
+};
+
+// Ответ из двух частей: блок заголовков (строка статуса и заголовки,
+// без завершающей пустой строки) и тело. Соединение дописывает
+// Connection/Keep-Alive и Date и отправляет части одним writev,
+// не склеивая их в общий буфер.
+class HttpResponse
+{
+public:
+    HttpResponse();
+    explicit HttpResponse(int status);
+    // Ответ с телом: строка статуса, Content-Type и Content-Length
+    HttpResponse(int status, const QByteArray &contentType, const HttpBody &body);
+
+    // Ответ, собранный целиком в одном буфере (CGI, старый код): тело не копируется
+    static HttpResponse fromRaw(const QByteArray &raw);
+
+    // lines - готовые строки "Name: value\r\n" (одна или несколько)
+    HttpResponse &addHeader(const QByteArray &lines);
+    HttpResponse &addHeader(const char *name, const QByteArray &value);
+    // Тело без изменения заголовков (Content-Length уже в head)
+    void setBody(const HttpBody &body) { m_body = body; }
+
+    bool isNull() const { return m_head.isEmpty(); }
+    int status() const { return m_status; }
+    const QByteArray &head() const { return m_head; }
+    const HttpBody &body() const { return m_body; }
+
+    // Клиент найдет конец ответа без закрытия соединения
+    bool isFramed() const;
+    bool hasDate() const { return m_hasDate; }
+
+    int size() const { return m_head.size() + 2 + m_body.size(); }
+    QByteArray toByteArray() const;
+
+    // "HTTP/1.1 404 Not Found\r\n" - для известных кодов без аллокаций
+    static QByteArray statusLine(int status);
+    // "Date: ...\r\n", пересобирается не чаще раза в секунду в каждом потоке
+    static QByteArray dateHeader();
+
+private:
+    void noteHeader(const char *line, int length);
+
+    QByteArray m_head;
+    HttpBody m_body;
+    int m_status;
+    bool m_hasLength;  // Content-Length или chunked
+    bool m_hasDate;
+};
+
+#endif // HTTPRESPONSE_H
@@ -0,0 +1,305 @@
+#include "httprouter.h"
+#include <QDebug>
+#include <QUrl>
+#include <cstring>
+
+QByteArray RouteParams::name(int index) const
+{
+    if (!m_names || index < 0 || index >= m_count) return QByteArray();
+    return m_names->at(index);
+}
+
+QByteArray RouteParams::value(int index) const
+{
+    if (index < 0 || index >= m_count) return QByteArray();
+    return QByteArray::fromRawData(m_target.constData() + m_spans[index].offset, m_spans[index].length);
+}
+
+QByteArray RouteParams::value(const char *name) const
+{
+    for (int i = 0; i < m_count; ++i) {
+        if (m_names->at(i) == name)
+            return value(i);
+    }
+    return QByteArray();
+}
+
+QString RouteParams::text(const char *name) const
+{
+    return QUrl::fromPercentEncoding(value(name));
+}
+
+// Узел дерева во время регистрации маршрутов; compile() раскладывает их в массив
+struct HttpRouter::BuildNode
+{
+    QByteArray label;
+    std::vector<std::unique_ptr<BuildNode>> children;
+    std::unique_ptr<BuildNode> param;
+    QVector<int> routes;
+    QVector<int> wildcardRoutes;
+};
+
+HttpRouter::HttpRouter() :
+    m_root(new BuildNode),
+    m_compiled(false)
+{
+}
+
+HttpRouter::~HttpRouter() = default;
+
+bool HttpRouter::add(const QByteArray &method, const QByteArray &pattern, RouteHandler handler,
+                     Execution execution, Metrics::Route metricsRoute)
+{
+    if (m_compiled) {
+        qWarning() << "Route added after the server started:" << method << pattern;
+        return false;
+    }
+    if (!pattern.startsWith('/')) {
+        qWarning() << "Invalid route pattern:" << pattern;
+        return false;
+    }
+
+    // Сначала разбираем шаблон целиком, чтобы некорректный не оставил следов в дереве
+    struct Token
+    {
+        char kind; // 0 - точный текст, ':' или '*'
+        QByteArray text;
+    };
+    QVector<Token> tokens;
+    Route route;
+    int pos = 0;
+    while (pos < pattern.size()) {
+        char c = pattern.at(pos);
+        if ((c == ':' || c == '*') && pattern.at(pos - 1) == '/') {
+            int end = pattern.indexOf('/', pos);
+            if (end == -1) end = pattern.size();
+            QByteArray name = pattern.mid(pos + 1, end - pos - 1);
+            if ((c == ':' && name.isEmpty()) || (c == '*' && end != pattern.size())
+                || route.paramNames.size() == RouteParams::MaxCount) {
+                qWarning() << "Invalid route pattern:" << pattern;
+                return false;
+            }
+            route.paramNames.append(name);
+            tokens.append({ c, name });
+            pos = end;
+            continue;
+        }
+
+        int end = pos + 1;
+        while (end < pattern.size() && !((pattern.at(end) == ':' || pattern.at(end) == '*')
+                                         && pattern.at(end - 1) == '/'))
+            ++end;
+        tokens.append({ 0, pattern.mid(pos, end - pos) });
+        pos = end;
+    }
+
+    BuildNode *node = m_root.get();
+    bool wildcard = false;
+    for (const Token &token : tokens) {
+        if (token.kind == 0) {
+            node = insertStatic(node, token.text);
+        } else if (token.kind == ':') {
+            if (!node->param) node->param.reset(new BuildNode);
+            node = node->param.get();
+        } else {
+            wildcard = true;
+        }
+    }
+
+    QVector<int> &routes = wildcard ? node->wildcardRoutes : node->routes;
+    for (int index : routes) {
+        if (m_routes.at(index).method == method) {
+            qWarning() << "Route already registered:" << method << pattern;
+            return false;
+        }
+    }
+
+    route.method = method;
+    route.pattern = pattern;
+    route.handler = std::move(handler);
+    route.execution = execution;
+    route.metricsRoute = metricsRoute;
+    routes.append(m_routes.size());
+    m_routes.append(route);
+    return true;
+}
+
+HttpRouter::BuildNode *HttpRouter::insertStatic(BuildNode *node, QByteArray text)
+{
+    while (!text.isEmpty()) {
+        // У детей узла разные первые байты - кандидат всегда один
+        BuildNode *next = nullptr;
+        for (const std::unique_ptr<BuildNode> &child : node->children) {
+            if (child->label.at(0) == text.at(0)) {
+                next = child.get();
+                break;
+            }
+        }
+        if (!next) {
+            node->children.emplace_back(new BuildNode);
+            node->children.back()->label = text;
+            return node->children.back().get();
+        }
+
+        int common = 0;
+        int limit = qMin(next->label.size(), text.size());
+        while (common < limit && next->label.at(common) == text.at(common))
+            ++common;
+
+        // Текст расходится с ребром посередине - общая часть становится отдельным узлом
+        if (common < next->label.size()) {
+            std::unique_ptr<BuildNode> tail(new BuildNode);
+            tail->label = next->label.mid(common);
+            tail->children = std::move(next->children);
+            tail->param = std::move(next->param);
+            tail->routes = next->routes;
+            tail->wildcardRoutes = next->wildcardRoutes;
+            next->children.clear();
+            next->routes.clear();
+            next->wildcardRoutes.clear();
+            next->label.truncate(common);
+            next->children.push_back(std::move(tail));
+        }
+        node = next;
+        text = text.mid(common);
+    }
+    return node;
+}
+
+void HttpRouter::compile()
+{
+    if (m_compiled) return;
+
+    m_nodes.clear();
+    m_firstBytes.clear();
+    m_labels.clear();
+    m_routeRefs.clear();
+    m_nodes.append(Node());
+    m_firstBytes.append('\0');
+    flatten(m_root.get(), 0);
+
+    m_root.reset();
+    m_compiled = true;
+}
+
+void HttpRouter::flatten(const BuildNode *build, int index)
+{
+    Node node;
+    node.labelOffset = m_labels.size();
+    node.labelLength = build->label.size();
+    m_labels.append(build->label);
+
+    node.routesBegin = m_routeRefs.size();
+    node.routesCount = build->routes.size();
+    m_routeRefs += build->routes;
+    node.wildcardBegin = m_routeRefs.size();
+    node.wildcardCount = build->wildcardRoutes.size();
+    m_routeRefs += build->wildcardRoutes;
+
+    // Место под детей выделяем сразу, чтобы они легли подряд
+    node.firstChild = m_nodes.size();
+    node.childCount = int(build->children.size());
+    for (const std::unique_ptr<BuildNode> &child : build->children) {
+        m_nodes.append(Node());
+        m_firstBytes.append(child->label.at(0));
+    }
+    if (build->param) {
+        node.paramChild = m_nodes.size();
+        m_nodes.append(Node());
+        m_firstBytes.append('\0');
+    }
+    m_nodes[index] = node;
+
+    for (int i = 0; i < node.childCount; ++i)
+        flatten(build->children[i].get(), node.firstChild + i);
+    if (build->param)
+        flatten(build->param.get(), node.paramChild);
+}
+
+const HttpRouter::Route *HttpRouter::match(const QByteArray &method, const QByteArray &target,
+                                           RouteParams &params, bool *methodNotAllowed) const
+{
+    if (methodNotAllowed) *methodNotAllowed = false;
+    params.m_count = 0;
+    if (!m_compiled) return nullptr;
+
+    const char *path = target.constData();
+    const char *query = static_cast<const char *>(std::memchr(path, '?', target.size()));
+    int length = query ? int(query - path) : target.size();
+
+    bool methodMismatch = false;
+    int route = matchNode(0, path, 0, length, method, params, methodMismatch);
+    if (route < 0) {
+        params.m_count = 0;
+        if (methodNotAllowed) *methodNotAllowed = methodMismatch;
+        return nullptr;
+    }
+
+    const Route &found = m_routes.at(route);
+    params.m_target = target;
+    params.m_names = &found.paramNames;
+    return &found;
+}
+
+int HttpRouter::matchNode(int index, const char *path, int pos, int length, const QByteArray &method,
+                          RouteParams &params, bool &methodMismatch) const
+{
+    // Метка узла уже совпала, pos - следующий байт пути
+    const Node &node = m_nodes.at(index);
+    if (pos == length && node.routesCount > 0) {
+        int route = selectRoute(node.routesBegin, node.routesCount, method, methodMismatch);
+        if (route >= 0) return route;
+    }
+
+    if (pos < length && node.childCount > 0) {
+        const char *first = m_firstBytes.constData() + node.firstChild;
+        const char *found = static_cast<const char *>(std::memchr(first, path[pos], node.childCount));
+        if (found) {
+            int childIndex = node.firstChild + int(found - first);
+            const Node &child = m_nodes.at(childIndex);
+            if (child.labelLength <= length - pos
+                && std::memcmp(m_labels.constData() + child.labelOffset, path + pos, child.labelLength) == 0) {
+                int route = matchNode(childIndex, path, pos + child.labelLength, length, method,
+                                      params, methodMismatch);
+                if (route >= 0) return route;
+            }
+        }
+    }
+
+    if (node.paramChild >= 0 && pos < length && path[pos] != '/' && params.m_count < RouteParams::MaxCount) {
+        const char *slash = static_cast<const char *>(std::memchr(path + pos, '/', length - pos));
+        int end = slash ? int(slash - path) : length;
+        int saved = params.m_count;
+        params.m_spans[saved].offset = pos;
+        params.m_spans[saved].length = end - pos;
+        params.m_count = saved + 1;
+        int route = matchNode(node.paramChild, path, end, length, method, params, methodMismatch);
+        if (route >= 0) return route;
+        params.m_count = saved;
+    }
+
+    if (node.wildcardCount > 0 && params.m_count < RouteParams::MaxCount) {
+        int route = selectRoute(node.wildcardBegin, node.wildcardCount, method, methodMismatch);
+        if (route >= 0) {
+            params.m_spans[params.m_count].offset = pos;
+            params.m_spans[params.m_count].length = length - pos;
+            ++params.m_count;
+            return route;
+        }
+    }
+    return -1;
+}
+
+int HttpRouter::selectRoute(int begin, int count, const QByteArray &method, bool &methodMismatch) const
+{
+    // Маршрут для конкретного метода важнее маршрута для любого
+    int any = -1;
+    for (int i = begin; i < begin + count; ++i) {
+        int route = m_routeRefs.at(i);
+        const QByteArray &routeMethod = m_routes.at(route).method;
+        if (routeMethod == method) return route;
+        if (routeMethod.isEmpty()) any = route;
+    }
+    if (any < 0) methodMismatch = true;
+    return any;
+}
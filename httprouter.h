@@ -0,0 +1,125 @@
+#ifndef HTTPROUTER_H
+#define HTTPROUTER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "httprequestparser.h"
+#include "httpresponder.h"
+#include "metrics.h"
+
+// Части пути, совпавшие с :name и *name шаблона маршрута. Хранятся
+// смещениями в target запроса - сопоставление ничего не копирует.
+class RouteParams
+{
+public:
+    static const int MaxCount = 8;
+
+    int size() const { return m_count; }
+    QByteArray name(int index) const;
+    // Значение как в запросе (%XX не раскодированы) - живет не дольше этого объекта
+    QByteArray value(int index) const;
+    QByteArray value(const char *name) const;
+    // Раскодированное из %XX и UTF-8 значение
+    QString text(const char *name) const;
+
+private:
+    friend class HttpRouter;
+
+    struct Span
+    {
+        int offset;
+        int length;
+    };
+
+    QByteArray m_target;
+    const QVector<QByteArray> *m_names = nullptr; // имена из шаблона совпавшего маршрута
+    Span m_spans[MaxCount];
+    int m_count = 0;
+};
+
+// Обработчик маршрута: отвечает через responder сразу или позже из любого потока
+typedef std::function<void(const HttpRequest &request, const RouteParams &params,
+                           const HttpResponderPtr &responder)> RouteHandler;
+
+// Таблица маршрутов. Шаблоны собираются в radix-дерево (общие префиксы
+// хранятся один раз), путь сопоставляется за один проход без аллокаций.
+// Шаблон - путь от '/', в котором
+//   ":name" - один непустой сегмент (до следующего '/'),
+//   "*name" - остаток пути, возможно пустой (только в конце, имя можно опустить),
+//   остальное сравнивается побайтно.
+// Если подходят несколько маршрутов, точный текст важнее :name, а :name важнее *.
+class HttpRouter
+{
+public:
+    // Где выполняется обработчик
+    enum class Execution {
+        Inline,   // в потоке соединения - быстрые обработчики без ожиданий
+        Blocking  // в пуле потоков БД - обработчику можно ждать (запросы в БД)
+    };
+
+    struct Route
+    {
+        QByteArray method;              // пустой - любой метод
+        QByteArray pattern;
+        QVector<QByteArray> paramNames; // в порядке появления в шаблоне
+        RouteHandler handler;
+        Execution execution = Execution::Inline;
+        Metrics::Route metricsRoute = Metrics::RouteApi;
+    };
+
+    HttpRouter();
+    ~HttpRouter();
+
+    // false - шаблон некорректен, такой маршрут уже есть или таблица уже собрана
+    bool add(const QByteArray &method, const QByteArray &pattern, RouteHandler handler,
+             Execution execution = Execution::Inline, Metrics::Route metricsRoute = Metrics::RouteApi);
+
+    // Собрать дерево. Дальше таблица только читается, и match() можно
+    // вызывать из любых потоков без блокировок
+    void compile();
+    bool isCompiled() const { return m_compiled; }
+
+    // Маршрут для target (query отбрасывается) или nullptr. methodNotAllowed -
+    // путь подошел, но ни один из его маршрутов не принимает этот метод
+    const Route *match(const QByteArray &method, const QByteArray &target, RouteParams &params,
+                       bool *methodNotAllowed = nullptr) const;
+
+private:
+    struct BuildNode;
+
+    // Узел собранного дерева. Дети одного узла лежат в m_nodes подряд,
+    // их первые байты - в m_firstBytes по тем же индексам (поиск через memchr)
+    struct Node
+    {
+        int labelOffset = 0;   // точная часть пути в m_labels
+        int labelLength = 0;
+        int firstChild = 0;
+        int childCount = 0;
+        int paramChild = -1;   // :name после узла
+        int routesBegin = 0;   // маршруты, которые заканчиваются в узле, в m_routeRefs
+        int routesCount = 0;
+        int wildcardBegin = 0; // маршруты с * после узла
+        int wildcardCount = 0;
+    };
+
+    static BuildNode *insertStatic(BuildNode *node, QByteArray text);
+    void flatten(const BuildNode *build, int index);
+    int matchNode(int index, const char *path, int pos, int length, const QByteArray &method,
+                  RouteParams &params, bool &methodMismatch) const;
+    int selectRoute(int begin, int count, const QByteArray &method, bool &methodMismatch) const;
+
+    QVector<Route> m_routes;
+    std::unique_ptr<BuildNode> m_root; // до compile()
+    bool m_compiled;
+
+    QVector<Node> m_nodes;
+    QByteArray m_firstBytes;
+    QByteArray m_labels;
+    QVector<int> m_routeRefs;
+};
+
+#endif // HTTPROUTER_H
@@ -1,7 +1,18 @@
 #include "httpserver.h"
+#include "dbchangelistener.h"
+#include "dbpagetoken.h"
+#include "fastcgiclient.h"
+#include "httpconnection.h"
+#include "httpworker.h"
+#include "metrics.h"
+#include "phpcgirunner.h"
+#include "phpcgisupervisor.h"
+#include "staticfilecache.h"
 #include <QTcpSocket>
 #include <QFile>
 #include <QFileInfo>
+#include <QDir>
+#include <QHash>
 #include <QDateTime>
 #include <QUrl>
 #include <QUrlQuery>
@@ -12,12 +23,81 @@
 #include <QCoreApplication>
 #include <QEventLoop>
 #include <QtCore/QString>
+#include <QRunnable>
+#include <vector>
+
+namespace {
+
+// Задача для QThreadPool из произвольной функции
+class TaskRunnable : public QRunnable
+{
+public:
+    explicit TaskRunnable(std::function<void()> task) : m_task(std::move(task)) {}
+    void run() override { m_task(); }
+
+private:
+    std::function<void()> m_task;
+};
+
+// Query-строка из target запроса (без '?')
+QString targetQuery(const QByteArray &target)
+{
+    int queryStart = target.indexOf('?');
+    return queryStart == -1 ? QString() : QString::fromUtf8(target.mid(queryStart + 1));
+}
+
+}
 
 HttpServer::HttpServer(QObject *parent) : QTcpServer(parent),
     m_settings(new QSettings("/home/kexicake/projects/simple-http-server/http_server.ini", QSettings::IniFormat)),
     m_documentRoot("/home/kexicake/projects/simple-http-server/www"),
     m_phpCgiPath("/usr/bin/php-cgi"),
-    m_authEnabled(true)
+    m_authEnabled(true),
+    m_phpFastCgi(false),
+    m_fastCgiAddress("/tmp/simple-http-server-php.sock"),
+    m_fastCgiMaxConnections(8),
+    m_fastCgiRequestsPerConnection(1),
+    m_phpTimeoutMs(30000),
+    m_phpMaxProcesses(8),
+    m_phpQueueSize(64),
+    m_phpRetryAfter(1),
+    m_phpSupervisor(nullptr),
+    m_phpRunner(nullptr),
+    m_maxConnections(10000),
+    m_resumeConnections(9000),
+    m_queueDeadlineMs(10000),
+    m_retryAfter(1),
+    m_openConnections(0),
+    m_acceptPaused(false),
+    m_acceptCheckQueued(false),
+    m_acceptPauses(0),
+    m_shedRequests(0),
+    m_keepAliveTimeout(5),
+    m_requestTimeout(60),
+    m_maxKeepAliveRequests(100),
+    m_maxBodySize(64 * 1024 * 1024),
+    m_workerCount(QThread::idealThreadCount()),
+    m_nativeIo(false),
+    m_nativeListening(false),
+    m_tlsPort(0),
+    m_tlsListener(nullptr),
+    m_http2Connections(0),
+    m_http2Streams(0),
+    m_staticCache(nullptr),
+    m_streamThreshold(1024 * 1024),
+    m_metricsEnabled(true),
+    m_metricsPath("/metrics"),
+    m_dbCacheBypass(true),
+    m_dbNotifyChannel("table_changed"),
+    m_changeListener(nullptr),
+    m_bulkBatchRows(5000),
+    m_bulkUseCopy(true),
+    m_pageSize(100),
+    m_maxPageSize(1000),
+    m_streamSelect(false),
+    m_streamBatchRows(500),
+    m_streamWindowBytes(256 * 1024),
+    m_streamWriteTimeoutMs(30000)
 {
     // Проверка доступности файла конфига
     if (!QFile::exists(m_settings->fileName())) {
@@ -35,11 +115,126 @@ HttpServer::HttpServer(QObject *parent) : QTcpServer(parent),
     setDocumentRoot(m_settings->value("server/document_root", m_documentRoot).toString());
     setPhpCgiPath(m_settings->value("php/cgi_path", m_phpCgiPath).toString());
     m_authEnabled = m_settings->value("auth/enabled", true).toBool();
+    m_authCache.reset(new AuthCache(m_settings->value("auth/cache_size", 4096).toInt(),
+                                    m_settings->value("auth/cache_ttl_ms", 60000).toInt(),
+                                    m_settings->value("auth/negative_ttl_ms", 10000).toInt(),
+                                    m_settings->value("auth/max_failures", 5).toInt()));
+
+    // PHP: cgi - процесс на запрос, fastcgi - постоянные воркеры
+    m_phpFastCgi = m_settings->value("php/mode", "cgi").toString() == "fastcgi";
+    m_fastCgiAddress = m_settings->value("php/fastcgi_address", m_fastCgiAddress).toString();
+    m_fastCgiMaxConnections = m_settings->value("php/fastcgi_max_connections", m_fastCgiMaxConnections).toInt();
+    m_fastCgiRequestsPerConnection = m_settings->value("php/fastcgi_requests_per_connection",
+                                                       m_fastCgiRequestsPerConnection).toInt();
+    m_phpTimeoutMs = m_settings->value("php/timeout_ms", m_phpTimeoutMs).toInt();
+    m_phpMaxProcesses = m_settings->value("php/max_processes", m_phpMaxProcesses).toInt();
+    m_phpQueueSize = m_settings->value("php/queue_size", m_phpQueueSize).toInt();
+    m_phpRetryAfter = m_settings->value("php/retry_after", m_phpRetryAfter).toInt();
+    int spawnChildren = m_settings->value("php/fastcgi_spawn", 0).toInt();
+    if (m_phpFastCgi && spawnChildren > 0)
+        m_phpSupervisor = new PhpCgiSupervisor(m_phpCgiPath, m_fastCgiAddress, spawnChildren, this);
+
+    // Keep-alive
+    m_keepAliveTimeout = m_settings->value("server/keep_alive_timeout", m_keepAliveTimeout).toInt();
+    m_requestTimeout = qMax(1, m_settings->value("server/request_timeout", m_requestTimeout).toInt());
+    m_maxKeepAliveRequests = m_settings->value("server/keep_alive_max_requests", m_maxKeepAliveRequests).toInt();
+    m_maxBodySize = m_settings->value("server/max_body_size", m_maxBodySize).toLongLong();
+
+    // Перегрузка: лимит соединений, частота запросов с одного адреса, срок ожидания в очереди
+    m_maxConnections = m_settings->value("limits/max_connections", m_maxConnections).toInt();
+    // Гистерезис: после паузы принимаем снова, когда освободится десятая часть
+    m_resumeConnections = m_maxConnections - qMax(1, m_maxConnections / 10);
+    m_queueDeadlineMs = m_settings->value("limits/queue_deadline_ms", m_queueDeadlineMs).toInt();
+    m_retryAfter = qMax(1, m_settings->value("limits/retry_after", m_retryAfter).toInt());
+    double rateLimit = m_settings->value("limits/rate_limit_rps", 0).toDouble();
+    m_rateLimiter.reset(new RateLimiter(rateLimit,
+                                        m_settings->value("limits/rate_limit_burst", 0).toDouble(),
+                                        m_settings->value("limits/rate_limit_clients", 65536).toInt()));
+
+    // Кеш статики
+    m_staticCache = new StaticFileCache(
+        m_settings->value("static/cache_max_bytes", 64 * 1024 * 1024).toLongLong(),
+        m_settings->value("static/cache_max_file_size", 1024 * 1024).toLongLong(),
+        m_settings->value("static/revalidate_ms", 1000).toInt(),
+        this);
+    m_streamThreshold = m_settings->value("static/stream_threshold", m_streamThreshold).toLongLong();
+
+    // Сжатие
+    m_compression.enabled = m_settings->value("compression/enabled", m_compression.enabled).toBool();
+    m_compression.gzipLevel = m_settings->value("compression/gzip_level", m_compression.gzipLevel).toInt();
+    m_compression.brotliQuality = m_settings->value("compression/brotli_quality", m_compression.brotliQuality).toInt();
+    m_compression.staticGzipLevel = m_settings->value("compression/static_gzip_level",
+                                                      m_compression.staticGzipLevel).toInt();
+    m_compression.staticBrotliQuality = m_settings->value("compression/static_brotli_quality",
+                                                          m_compression.staticBrotliQuality).toInt();
+    m_compression.minSize = m_settings->value("compression/min_size", m_compression.minSize).toInt();
+
+    // Потоки: 0 - по числу ядер
+    int workers = m_settings->value("server/worker_threads", 0).toInt();
+    if (workers > 0) m_workerCount = workers;
+    if (m_workerCount < 1) m_workerCount = 1;
+
+    // Ввод-вывод: qt - QTcpServer/QTcpSocket (везде), epoll - свой цикл в каждом воркере (Linux)
+    m_nativeIo = m_settings->value("server/io_engine", "qt").toString() == "epoll";
+#ifndef Q_OS_LINUX
+    if (m_nativeIo) {
+        qWarning() << "server/io_engine=epoll is only available on Linux, using Qt sockets";
+        m_nativeIo = false;
+    }
+#endif
+
+    // HTTPS: сертификат загружается в startServer(), там же и ошибки
+    m_tlsPort = m_settings->value("tls/port", m_tlsPort).toInt();
+    m_tlsSettings.certificateFile = m_settings->value("tls/certificate", "cert.pem").toString();
+    m_tlsSettings.privateKeyFile = m_settings->value("tls/private_key", "key.pem").toString();
+    m_tlsSettings.ciphers = m_settings->value("tls/ciphers").toString();
+    m_tlsSettings.cipherSuites = m_settings->value("tls/ciphersuites").toString();
+    m_tlsSettings.minVersion = m_settings->value("tls/min_version", m_tlsSettings.minVersion).toString();
+    m_tlsSettings.sessionCacheSize = m_settings->value("tls/session_cache_size",
+                                                       m_tlsSettings.sessionCacheSize).toInt();
+    m_tlsSettings.sessionTimeoutSec = m_settings->value("tls/session_timeout", m_tlsSettings.sessionTimeoutSec).toInt();
+    m_tlsSettings.sessionTickets = m_settings->value("tls/session_tickets", m_tlsSettings.sessionTickets).toBool();
+    m_tlsSettings.ktls = m_settings->value("tls/ktls", m_tlsSettings.ktls).toBool();
+
+    // HTTP/2: без TLS - prior knowledge и Upgrade: h2c, с TLS - ALPN
+    m_http2Settings.enabled = m_settings->value("http2/enabled", m_http2Settings.enabled).toBool();
+    m_http2Settings.maxConcurrentStreams = qMax(1, m_settings->value("http2/max_concurrent_streams",
+                                                                     m_http2Settings.maxConcurrentStreams).toInt());
+    m_http2Settings.streamWindowSize = qBound(65535, m_settings->value("http2/stream_window_size",
+                                                                       m_http2Settings.streamWindowSize).toInt(),
+                                              0x7fffffff);
+    m_http2Settings.connectionWindowSize = qBound(65535, m_settings->value("http2/connection_window_size",
+                                                                           m_http2Settings.connectionWindowSize).toInt(),
+                                                  0x7fffffff);
+    m_http2Settings.maxHeaderListSize = qMax(4096, m_settings->value("http2/max_header_list_size",
+                                                                     m_http2Settings.maxHeaderListSize).toInt());
+    m_tlsSettings.http2 = m_http2Settings.enabled;
+
+    // Метрики
+    m_metricsEnabled = m_settings->value("metrics/enabled", m_metricsEnabled).toBool();
+    m_metricsPath = m_settings->value("metrics/path", m_metricsPath).toString();
+
+    // Кеш ответов /api/db: TTL по умолчанию и для отдельных таблиц ([db_cache_ttl], 0 - не кешировать)
+    if (m_settings->value("db_cache/enabled", true).toBool()) {
+        m_dbCache.reset(new DbResponseCache(m_settings->value("db_cache/max_bytes", 32 * 1024 * 1024).toLongLong(),
+                                            m_settings->value("db_cache/max_entry_bytes", 1024 * 1024).toLongLong(),
+                                            m_settings->value("db_cache/ttl_ms", 5000).toInt()));
+    } else {
+        m_dbCache.reset(new DbResponseCache(0, 0, 0));
+    }
+    m_settings->beginGroup("db_cache_ttl");
+    for (const QString &table : m_settings->childKeys())
+        m_dbCache->setTableTtl(table, m_settings->value(table).toInt());
+    m_settings->endGroup();
+    m_dbCacheBypass = m_settings->value("db_cache/allow_bypass", m_dbCacheBypass).toBool();
+    m_dbNotifyChannel = m_settings->value("db_cache/notify_channel", m_dbNotifyChannel).toString();
 
     // Настройка БД
     QString dbConnStr = m_settings->value("database/connection_string",
         "dbname=simple_http_db user=postgres password=postgres host=localhost port=5432").toString();
     configureDatabase(dbConnStr);
+
+    registerBuiltinRoutes();
 }
 HttpServer::~HttpServer()
 {
@@ -49,25 +244,118 @@ HttpServer::~HttpServer()
 
 bool HttpServer::startServer(quint16 port)
 {
-    if (!listen(QHostAddress::Any, port)){
+    // Дальше маршруты только читаются, из всех воркеров сразу
+    m_router.compile();
+
+    if (m_phpSupervisor)
+        m_phpSupervisor->start();
+    else if (!m_phpFastCgi)
+        m_phpRunner = new PhpCgiRunner(m_phpCgiPath, m_phpMaxProcesses, m_phpQueueSize, m_phpTimeoutMs,
+                                       m_phpRetryAfter, this);
+
+    // Изменения таблиц в обход сервера сбрасывают кеш ответов и авторизаций
+    if (m_dbPool && m_dbCache->isEnabled() && !m_dbNotifyChannel.isEmpty() && !m_changeListener) {
+        m_changeListener = new DbChangeListener(m_dbConnectionStr, m_dbNotifyChannel,
+                                                [this](const QString &table) { tableChanged(table); }, this);
+        m_changeListener->start();
+    }
+
+    for (int i = 0; i < m_workerCount; ++i) {
+        HttpWorker *worker = new HttpWorker(this, i);
+        worker->start();
+        m_workers.append(worker);
+    }
+
+    m_acceptPaused.store(false);
+    if (m_nativeIo) {
+        for (HttpWorker *worker : m_workers) {
+            if (!worker->listenNative(port)) {
+                qWarning() << "Failed to start server: worker" << worker->index() << "cannot listen on port" << port;
+                stopServer();
+                return false;
+            }
+        }
+        m_nativeListening = true;
+    } else if (!listen(QHostAddress::Any, port)){
         qWarning() << "Failed to start server:" << errorString();
+        stopServer();
         return false;
     }
 
+    if (m_tlsPort > 0) {
+        m_tlsContext.reset(new TlsContext(m_tlsSettings));
+        if (!m_tlsContext->isValid()) {
+            qWarning() << "Failed to start HTTPS:" << m_tlsContext->errorString();
+            stopServer();
+            return false;
+        }
+        m_tlsListener = new TlsListener([this](qintptr socketDescriptor) {
+            m_openConnections.fetch_add(1);
+            updateAccepting();
+            dispatchConnection(socketDescriptor, m_tlsContext.get());
+        }, this);
+        if (!m_tlsListener->listen(QHostAddress::Any, quint16(m_tlsPort))) {
+            qWarning() << "Failed to start HTTPS:" << m_tlsListener->errorString();
+            stopServer();
+            return false;
+        }
+        // Лимит соединений общий: если HTTP уже на паузе, HTTPS тоже не принимает
+        if (m_acceptPaused.load())
+            m_tlsListener->pauseAccepting();
+    }
+
     qInfo() << "Server started on port" << port;
+    if (m_tlsListener)
+        qInfo() << "HTTPS on port" << m_tlsPort;
+    qInfo() << "Worker threads:" << m_workerCount << (m_nativeIo ? "(epoll)" : "(Qt sockets)");
     qInfo() << "Server dir:" << QCoreApplication::applicationDirPath();
     qInfo() << "Document root:" << m_documentRoot;
     qInfo() << "PHP CHI root:" << m_phpCgiPath;
+    if (m_phpFastCgi)
+        qInfo() << "PHP FastCGI:" << m_fastCgiAddress;
     qDebug() << "Config file location:" << m_settings->fileName();
     return true;
 }
 
 void HttpServer::stopServer()
 {
-    if (isListening()){
+    bool wasListening = isListening() || m_nativeListening;
+    if (isListening())
         close();
-        qInfo() << "Server stopped";
+    if (m_tlsListener) {
+        m_tlsListener->close();
+        delete m_tlsListener;
+        m_tlsListener = nullptr;
+    }
+    // Свои listener'ы воркеров закрываются вместе с воркерами, до того - без новых подключений
+    if (m_nativeListening) {
+        for (HttpWorker *worker : m_workers)
+            worker->setAccepting(false);
+        m_nativeListening = false;
     }
+
+    // Ответы из пула БД отправляются через воркеры - дожидаемся их до остановки
+    m_dbExecutor.waitForDone();
+
+    for (HttpWorker *worker : m_workers) {
+        worker->stop();
+        delete worker;
+    }
+    m_workers.clear();
+
+    if (m_phpSupervisor)
+        m_phpSupervisor->stop();
+    delete m_phpRunner;
+    m_phpRunner = nullptr;
+
+    if (m_changeListener) {
+        m_changeListener->stop();
+        delete m_changeListener;
+        m_changeListener = nullptr;
+    }
+
+    if (wasListening)
+        qInfo() << "Server stopped";
 }
 
 void HttpServer::setDocumentRoot(const QString &path)
@@ -87,78 +375,255 @@ void HttpServer::configureDatabase(const QString &connStr)
     m_dbConnectionStr = connStr;
     m_settings->setValue("database.connection_string", m_dbConnectionStr);
 
-    try {
-        m_dbConnection = std::make_unique<pqxx::connection>(m_dbConnectionStr.toStdString());
-        qInfo() << "Connected to PostgreSQL database:" << QString::fromStdString(m_dbConnection->dbname());
-    } catch (const std::exception &e) {
-        qWarning() << "Database connection error:" << e.what();
+    int poolMin = m_settings->value("database/pool_min", 2).toInt();
+    int poolMax = m_settings->value("database/pool_max", 16).toInt();
+    int acquireTimeout = m_settings->value("database/acquire_timeout_ms", 5000).toInt();
+    int healthCheck = m_settings->value("database/health_check_interval", 30).toInt();
+    int statementCache = m_settings->value("database/statement_cache_size", 64).toInt();
+
+    // Массовая вставка
+    m_bulkBatchRows = qMax(1, m_settings->value("database/bulk_batch_rows", m_bulkBatchRows).toInt());
+    m_bulkUseCopy = m_settings->value("database/bulk_method", "copy").toString() != "insert";
+
+    // Постраничная выдача GET /api/db
+    m_pageSize = m_settings->value("database/page_size", m_pageSize).toInt();
+    m_maxPageSize = m_settings->value("database/max_page_size", m_maxPageSize).toInt();
+
+    // Потоковая выдача SELECT
+    m_streamSelect = m_settings->value("database/stream_select", m_streamSelect).toBool();
+    m_streamBatchRows = qMax(1, m_settings->value("database/stream_batch_rows", m_streamBatchRows).toInt());
+    m_streamWindowBytes = m_settings->value("database/stream_window_bytes", m_streamWindowBytes).toLongLong();
+    m_streamWriteTimeoutMs = m_settings->value("database/stream_write_timeout_ms", m_streamWriteTimeoutMs).toInt();
+
+    m_dbExecutor.waitForDone();
+    m_dbPool.reset(new DbConnectionPool(m_dbConnectionStr, poolMin, poolMax,
+                                        acquireTimeout, healthCheck, statementCache));
+    // Запросы к БД выполняются на отдельных потоках, по одному на соединение пула
+    m_dbExecutor.setMaxThreadCount(m_dbPool->maxSize());
+
+    if (m_dbPool->warmUp()) {
+        qInfo() << "Connected to PostgreSQL database, pool size" << poolMin << "-" << poolMax;
     }
 }
 
-void HttpServer::incomingConnection(qintptr socketDescriptor)
+void HttpServer::runDbTask(std::function<void()> task)
 {
-    QTcpSocket *socket = new QTcpSocket(this);
-    connect(socket, &QTcpSocket::readyRead, [this, socket]() {
-        // Чтение запроса
-        QByteArray requestData = socket->readAll();
+    m_dbExecutor.start(new TaskRunnable(std::move(task)));
+}
 
-        // Парсинг запроса
-        QString requestStr = QString::fromUtf8(requestData);
+DbConnectionPool::Stats HttpServer::dbPoolStats() const
+{
+    if (!m_dbPool) return DbConnectionPool::Stats();
+    return m_dbPool->stats();
+}
 
-        QStringList lines = requestStr.split("\r\n");
-//        for (int i = 0; i < lines.size(); ++i)
-//            qInfo() << lines[i];
-        if (lines.isEmpty()) {
-            socket->write(createErrorResponse(400, "Bad Request"));
-            socket->disconnectFromHost();
-            return;
-        }
+HttpResponse HttpServer::metricsResponse() const
+{
+    QByteArray body = Metrics::global().exposition();
+
+    // Состояние пула и кеша снимаем в момент запроса, а не на каждом событии
+    if (m_dbPool) {
+        DbConnectionPool::Stats pool = m_dbPool->stats();
+        body += "# HELP db_pool_connections Pooled PostgreSQL connections by state.\n"
+                "# TYPE db_pool_connections gauge\n"
+                "db_pool_connections{state=\"idle\"} " + QByteArray::number(pool.idle) + "\n"
+                "db_pool_connections{state=\"in_use\"} " + QByteArray::number(pool.inUse) + "\n"
+                "# TYPE db_pool_max_connections gauge\n"
+                "db_pool_max_connections " + QByteArray::number(pool.maxSize) + "\n"
+                "# TYPE db_pool_acquires_total counter\n"
+                "db_pool_acquires_total " + QByteArray::number(pool.acquires) + "\n"
+                "# TYPE db_pool_acquire_waits_total counter\n"
+                "db_pool_acquire_waits_total " + QByteArray::number(pool.waits) + "\n"
+                "# TYPE db_pool_acquire_timeouts_total counter\n"
+                "db_pool_acquire_timeouts_total " + QByteArray::number(pool.timeouts) + "\n"
+                "# TYPE db_pool_connect_failures_total counter\n"
+                "db_pool_connect_failures_total " + QByteArray::number(pool.connectFailures) + "\n"
+                "# TYPE db_pool_acquire_wait_seconds_total counter\n"
+                "db_pool_acquire_wait_seconds_total " + QByteArray::number(double(pool.totalWaitUs) / 1e6, 'f', 6) + "\n";
+    }
+    body += "# TYPE auth_cache_hits_total counter\n"
+            "auth_cache_hits_total " + QByteArray::number(m_authCache->hits()) + "\n"
+            "# TYPE auth_cache_misses_total counter\n"
+            "auth_cache_misses_total " + QByteArray::number(m_authCache->misses()) + "\n"
+            "# TYPE auth_throttled_total counter\n"
+            "auth_throttled_total " + QByteArray::number(m_authCache->throttled()) + "\n";
+    body += "# TYPE db_cache_hits_total counter\n"
+            "db_cache_hits_total " + QByteArray::number(m_dbCache->hits()) + "\n"
+            "# HELP db_cache_stale_hits_total Expired entries served while another request refreshed them.\n"
+            "# TYPE db_cache_stale_hits_total counter\n"
+            "db_cache_stale_hits_total " + QByteArray::number(m_dbCache->staleHits()) + "\n"
+            "# TYPE db_cache_misses_total counter\n"
+            "db_cache_misses_total " + QByteArray::number(m_dbCache->misses()) + "\n"
+            "# HELP db_cache_coalesced_total Misses that waited for an identical query already in flight.\n"
+            "# TYPE db_cache_coalesced_total counter\n"
+            "db_cache_coalesced_total " + QByteArray::number(m_dbCache->coalesced()) + "\n"
+            "# TYPE db_cache_invalidations_total counter\n"
+            "db_cache_invalidations_total " + QByteArray::number(m_dbCache->invalidations()) + "\n"
+            "# TYPE db_cache_entries gauge\n"
+            "db_cache_entries " + QByteArray::number(m_dbCache->entries()) + "\n"
+            "# TYPE db_cache_bytes gauge\n"
+            "db_cache_bytes " + QByteArray::number(m_dbCache->bytes()) + "\n";
+    body += "# TYPE static_cache_hits_total counter\n"
+            "static_cache_hits_total " + QByteArray::number(m_staticCache->hits()) + "\n"
+            "# TYPE static_cache_misses_total counter\n"
+            "static_cache_misses_total " + QByteArray::number(m_staticCache->misses()) + "\n";
+    if (m_phpRunner) {
+        body += "# TYPE php_cgi_processes gauge\n"
+                "php_cgi_processes " + QByteArray::number(m_phpRunner->runningProcesses()) + "\n"
+                "# TYPE php_cgi_max_processes gauge\n"
+                "php_cgi_max_processes " + QByteArray::number(m_phpRunner->maxProcesses()) + "\n"
+                "# TYPE php_cgi_queued gauge\n"
+                "php_cgi_queued " + QByteArray::number(m_phpRunner->queuedRequests()) + "\n"
+                "# HELP php_cgi_rejected_total Requests answered 503 because all processes and queue slots were busy.\n"
+                "# TYPE php_cgi_rejected_total counter\n"
+                "php_cgi_rejected_total " + QByteArray::number(m_phpRunner->rejected()) + "\n"
+                "# TYPE php_cgi_timeouts_total counter\n"
+                "php_cgi_timeouts_total " + QByteArray::number(m_phpRunner->timedOut()) + "\n";
+    }
 
-        // Метод путь и версия http, первая строка запроса короч
-        QStringList requestLine = lines[0].split(' ');
-        if (requestLine.size() < 3) {
-            socket->write(createErrorResponse(400, "Bad Request"));
-            socket->disconnectFromHost();
-            return;
-        }
+    body += "# TYPE connections_max gauge\n"
+            "connections_max " + QByteArray::number(m_maxConnections) + "\n"
+            "# TYPE connections_accept_paused gauge\n"
+            "connections_accept_paused " + QByteArray(m_acceptPaused.load() ? "1" : "0") + "\n"
+            "# HELP connections_accept_pauses_total Times accepting was paused at limits/max_connections.\n"
+            "# TYPE connections_accept_pauses_total counter\n"
+            "connections_accept_pauses_total " + QByteArray::number(m_acceptPauses.load()) + "\n"
+            "# HELP rate_limited_total Requests answered 429 by the per-client rate limit.\n"
+            "# TYPE rate_limited_total counter\n"
+            "rate_limited_total " + QByteArray::number(m_rateLimiter->limited()) + "\n"
+            "# TYPE rate_limit_evictions_total counter\n"
+            "rate_limit_evictions_total " + QByteArray::number(m_rateLimiter->evictions()) + "\n"
+            "# HELP load_shed_total Requests answered 503 after waiting longer than limits/queue_deadline_ms.\n"
+            "# TYPE load_shed_total counter\n"
+            "load_shed_total " + QByteArray::number(m_shedRequests.load()) + "\n"
+            "# HELP http2_connections_total Connections that switched to HTTP/2 (prior knowledge, Upgrade or ALPN).\n"
+            "# TYPE http2_connections_total counter\n"
+            "http2_connections_total " + QByteArray::number(m_http2Connections.load()) + "\n"
+            "# HELP http2_streams_total HTTP/2 streams dispatched as requests.\n"
+            "# TYPE http2_streams_total counter\n"
+            "http2_streams_total " + QByteArray::number(m_http2Streams.load()) + "\n";
+
+    if (m_tlsContext) {
+        body += "# HELP tls_handshakes_total Completed TLS handshakes, full or resumed session.\n"
+                "# TYPE tls_handshakes_total counter\n"
+                "tls_handshakes_total{type=\"full\"} " + QByteArray::number(m_tlsContext->fullHandshakes()) + "\n"
+                "tls_handshakes_total{type=\"resumed\"} " + QByteArray::number(m_tlsContext->resumedHandshakes()) + "\n"
+                "# TYPE tls_handshake_failures_total counter\n"
+                "tls_handshake_failures_total " + QByteArray::number(m_tlsContext->failedHandshakes()) + "\n"
+                "# HELP tls_handshake_seconds_total Time spent in TLS handshakes.\n"
+                "# TYPE tls_handshake_seconds_total counter\n"
+                "tls_handshake_seconds_total " + QByteArray::number(m_tlsContext->handshakeSeconds(), 'f', 6) + "\n"
+                "# HELP tls_ktls_connections_total Connections encrypted by the kernel (kTLS) after the handshake.\n"
+                "# TYPE tls_ktls_connections_total counter\n"
+                "tls_ktls_connections_total " + QByteArray::number(m_tlsContext->ktlsConnections()) + "\n";
+    }
 
-        QString method = requestLine[0];
-        QString path = requestLine[1];
-        QString httpVersion = requestLine[2];
+    return HttpResponse(200, "text/plain; version=0.0.4; charset=utf-8", body);
+}
 
-        // Парсинг заголовков
-        QMap<QString, QString> headers;
-        int i = 1;
-        for (; i < lines.size(); ++i) {
-            if (lines[i].isEmpty()) break;
+void HttpServer::incomingConnection(qintptr socketDescriptor)
+{
+    m_openConnections.fetch_add(1);
+    updateAccepting();
+    dispatchConnection(socketDescriptor, nullptr);
+}
 
-            int colonPos = lines[i].indexOf(':');
-            if (colonPos > 0) {
-                QString key = lines[i].left(colonPos).trimmed();
-                QString value = lines[i].mid(colonPos).trimmed();
-                headers[key.toLower()] = value;
-            }
-        }
+void HttpServer::dispatchConnection(qintptr socketDescriptor, TlsContext *tls)
+{
+    // Отдаем сокет наименее загруженному воркеру
+    HttpWorker *target = nullptr;
+    for (HttpWorker *worker : m_workers) {
+        if (!target || worker->activeConnections() < target->activeConnections())
+            target = worker;
+    }
 
-        // Body - тело запроса если есть
-        QByteArray body;
-        int emptyLineIndex = requestData.indexOf("\r\n\r\n");
-        if (emptyLineIndex != -1) {
-            body = requestData.mid(emptyLineIndex + 4); // +4 для пропуска \r\n\r\n
+    if (!target) {
+        HttpTransport *transport = tls ? static_cast<HttpTransport *>(new TlsTransport(tls, socketDescriptor))
+                                       : new QtSocketTransport(socketDescriptor);
+        HttpConnection *connection = new HttpConnection(this, transport, this);
+        if (!connection->isValid()) {
+            delete connection;
+            connectionClosed();
+            return;
         }
+        connect(connection, &QObject::destroyed, this, [this]() { connectionClosed(); });
+        return;
+    }
+    target->addConnection(socketDescriptor, tls);
+}
 
-        // Сама обработка запроса
-        QByteArray response = processRequest(method, path, headers, body);
-        socket->write(response);
-        socket->disconnectFromHost();
-    });
-    connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+void HttpServer::connectionOpened()
+{
+    int open = m_openConnections.fetch_add(1) + 1;
+    if (m_maxConnections > 0 && open >= m_maxConnections && !m_acceptPaused.load())
+        queueAcceptCheck();
+}
 
-    if (!socket->setSocketDescriptor(socketDescriptor)) {
-        delete socket;
-        return;
+void HttpServer::connectionClosed()
+{
+    int open = m_openConnections.fetch_sub(1) - 1;
+    if (m_acceptPaused.load() && open <= m_resumeConnections)
+        queueAcceptCheck();
+}
+
+void HttpServer::queueAcceptCheck()
+{
+    // Accept приостанавливается и возобновляется в потоке сервера; одной проверки в очереди достаточно
+    if (m_acceptCheckQueued.exchange(true)) return;
+    QMetaObject::invokeMethod(this, [this]() {
+        m_acceptCheckQueued.store(false);
+        updateAccepting();
+    }, Qt::QueuedConnection);
+}
+
+void HttpServer::updateAccepting()
+{
+    if (m_maxConnections <= 0 || !(isListening() || m_nativeListening)) return;
+
+    // Лишние подключения ждут в backlog ядра, а не занимают дескрипторы и память.
+    // Уже поставленные в accept соединения досдаются - лимит мягкий на пару штук
+    if (!m_acceptPaused.load() && m_openConnections.load() >= m_maxConnections) {
+        m_acceptPaused.store(true);
+        setAccepting(false);
+        ++m_acceptPauses;
+        qWarning() << "Connection limit reached:" << m_maxConnections << "- accepting paused";
+    }
+    // Перепроверка после паузы: соединение могло закрыться, пока флаг еще не стоял
+    if (m_acceptPaused.load() && m_openConnections.load() <= m_resumeConnections) {
+        m_acceptPaused.store(false);
+        setAccepting(true);
     }
 }
+
+void HttpServer::setAccepting(bool accepting)
+{
+    if (m_tlsListener) {
+        if (accepting)
+            m_tlsListener->resumeAccepting();
+        else
+            m_tlsListener->pauseAccepting();
+    }
+    if (m_nativeListening) {
+        for (HttpWorker *worker : m_workers)
+            worker->setAccepting(accepting);
+    } else if (accepting) {
+        resumeAccepting();
+    } else {
+        pauseAccepting();
+    }
+}
+
+bool HttpServer::admitRequest(quint64 clientKey, const HttpResponderPtr &responder)
+{
+    int retryAfterMs = 0;
+    if (m_rateLimiter->allow(clientKey, &retryAfterMs))
+        return true;
+
+    HttpResponse response = createErrorResponse(429, "Too many requests");
+    response.addHeader("Retry-After", QByteArray::number(qMax(1, (retryAfterMs + 999) / 1000)));
+    responder->send(response);
+    return false;
+}
 QMap<QString, QString> HttpServer::parseFormUrlEncoded(const QByteArray &data) {
     QMap<QString, QString> result;
     QUrlQuery query(QString::fromUtf8(data));
@@ -171,54 +636,267 @@ QString HttpServer::jsonToString(const QJsonObject &jsonBody) {
     QJsonDocument doc(jsonBody);
     return doc.toJson(QJsonDocument::Compact);
 }
-QByteArray HttpServer::processRequest(const QString &method, const QString &path, const QMap<QString, QString> &headers, const QByteArray &body)
+bool HttpServer::addRoute(const QByteArray &method, const QByteArray &pattern, RouteHandler handler,
+                          HttpRouter::Execution execution, Metrics::Route metricsRoute)
 {
-    // Разбор URL
-    QUrl url(path);
-    QString cleanPath = url.path();
+    return m_router.add(method, pattern, std::move(handler), execution, metricsRoute);
+}
+
+void HttpServer::registerBuiltinRoutes()
+{
+    if (m_metricsEnabled) {
+        m_router.add("", m_metricsPath.toUtf8(),
+                     [this](const HttpRequest &, const RouteParams &, const HttpResponderPtr &responder) {
+                         responder->send(metricsResponse());
+                     }, HttpRouter::Execution::Inline, Metrics::RouteMetrics);
+    }
+
+    // API ходит в БД - выполняется вне сетевого потока, ответ придет асинхронно
+    RouteHandler db = [this](const HttpRequest &request, const RouteParams &route, const HttpResponderPtr &responder) {
+        handleApiDb(request, route, responder);
+    };
+    m_router.add("", "/api/db/:table", db, HttpRouter::Execution::Blocking, Metrics::RouteApiDb);
+    m_router.add("", "/api/db/:table/", db, HttpRouter::Execution::Blocking, Metrics::RouteApiDb);
+    m_router.add("", "/api/db/:table/:id", db, HttpRouter::Execution::Blocking, Metrics::RouteApiDb);
+    m_router.add("", "/api/*path",
+                 [this](const HttpRequest &request, const RouteParams &route, const HttpResponderPtr &responder) {
+                     handleApiFallback(request, route, responder);
+                 }, HttpRouter::Execution::Blocking, Metrics::RouteApi);
+}
+
+void HttpServer::processRequest(const HttpRequest &request, const HttpResponderPtr &responder)
+{
+    RouteParams params;
+    bool methodNotAllowed = false;
+    if (const HttpRouter::Route *route = m_router.match(request.method, request.target, params, &methodNotAllowed)) {
+        responder->setRoute(route->metricsRoute);
+        // Дерево после startServer() не меняется - указатель на маршрут живет дольше задачи
+        if (route->execution == HttpRouter::Execution::Blocking) {
+            runDbTask([this, route, request, params, responder]() {
+                // Пока запрос ждал свободный поток, клиент мог уже сдаться - не тратим на него БД
+                if (m_queueDeadlineMs > 0 && responder->elapsedMs() > m_queueDeadlineMs) {
+                    ++m_shedRequests;
+                    HttpResponse response = createErrorResponse(503, "Server overloaded");
+                    response.addHeader("Retry-After", QByteArray::number(m_retryAfter));
+                    responder->send(response);
+                    return;
+                }
+                route->handler(request, params, responder);
+            });
+        } else {
+            route->handler(request, params, responder);
+        }
+        return;
+    }
 
+    if (methodNotAllowed) {
+        responder->send(createErrorResponse(405, "Method not allowed"));
+        return;
+    }
+
+    // Все остальное - файлы из document root и PHP
+    serveDocumentRoot(QString::fromLatin1(request.method), QString::fromUtf8(request.target),
+                      request.headers, request.body, responder);
+}
+
+bool HttpServer::isAuthorized(const HttpHeaders &headers)
+{
+    return !m_authEnabled || checkAuthentication(headers);
+}
+
+bool HttpServer::readApiRequest(const HttpRequest &request, QMap<QString, QString> &params, QJsonObject &jsonBody,
+                                const HttpResponderPtr &responder)
+{
     // Проверка аутентификации для API
-//    if (cleanPath.startsWith("/api/") && !checkAuthentication(headers)) {
-//        return createErrorResponse(401, "Unauthorized");
-//    }
+    if (!isAuthorized(request.headers)) {
+        responder->send(createErrorResponse(401, "Unauthorized"));
+        return false;
+    }
 
-    // Обработка API запросов
-    if (cleanPath.startsWith("/api/")) {
-        QString apiPath = cleanPath.mid(5); // Убираем "/api/"
-        // Определение Content-Type
-            QString contentType = headers.value("content-type", "application/x-www-form-urlencoded");
+    // Определение Content-Type
+    QByteArray contentType = request.headers.valueView(HttpHeaders::ContentType, "application/x-www-form-urlencoded");
+
+    // Парсинг параметров в зависимости от метода и Content-Type
+    if (request.method == "GET") {
+        params = parseQueryParams(targetQuery(request.target));
+    }
+    else if (contentType.contains("application/json")) {
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(request.body, &parseError);
+        if (parseError.error == QJsonParseError::NoError) {
+            jsonBody = doc.object();
+        } else {
+            responder->send(createErrorResponse(400, "Invalid JSON: " + parseError.errorString()));
+            return false;
+        }
+    }
+    else if (contentType.contains("application/x-www-form-urlencoded")) {
+        params = parseFormUrlEncoded(request.body);
+    }
 
-            // Парсинг параметров в зависимости от метода и Content-Type
-            QMap<QString, QString> params;
-            QJsonObject jsonBody;
+    // Логирование запроса (для отладки)
+    qDebug() << "API Request:" << request.method << request.target << "\n" << "Params:" << params << "\n" << "JSON:" << jsonToString(jsonBody);
+    return true;
+}
 
-            if (method == "GET") {
-                params = parseQueryParams(url.query());
-            }
-            else if (contentType.contains("application/json")) {
-                QJsonParseError parseError;
-                QJsonDocument doc = QJsonDocument::fromJson(body, &parseError);
-                if (parseError.error == QJsonParseError::NoError) {
-                    jsonBody = doc.object();
-                } else {
-                    return createErrorResponse(400, "Invalid JSON: " + parseError.errorString());
-                }
+void HttpServer::handleApiDb(const HttpRequest &request, const RouteParams &route, const HttpResponderPtr &responder)
+{
+    // Массив строк в теле - массовая вставка, тело разбирается только один раз
+    if (request.method == "POST" && m_dbPool) {
+        DbBulkInsert::Format format = DbBulkInsert::detect(request.headers.valueView(HttpHeaders::ContentType),
+                                                           request.body);
+        if (format != DbBulkInsert::Format::None) {
+            if (!isAuthorized(request.headers)) {
+                responder->send(createErrorResponse(401, "Unauthorized"));
+                return;
             }
-            else if (contentType.contains("application/x-www-form-urlencoded")) {
-                params = parseFormUrlEncoded(body);
+            QMap<QString, QString> options = parseQueryParams(targetQuery(request.target));
+            QString atomic = options.value("_atomic", "1").toLower();
+            try {
+                responder->send(handleDbBulkInsert(route.text("table"), format, request.body,
+                                                   atomic != "0" && atomic != "false"));
+            } catch (const std::exception &e) {
+                responder->send(createErrorResponse(500, QString("Database error: ") + e.what()));
             }
+            return;
+        }
+    }
+
+    QMap<QString, QString> params;
+    QJsonObject jsonBody;
+    if (!readApiRequest(request, params, jsonBody, responder))
+        return;
+
+    QString method = QString::fromLatin1(request.method);
+    QString table = route.text("table");
+    QString identifier = route.text("id");
+
+    if (method == "GET" && m_dbPool) {
+        // Формат тела: _format или Accept; _layout=columns - по массиву на колонку
+        DbEncoder::Format format = DbEncoder::negotiate(request.headers.valueView(HttpHeaders::Accept));
+        if (params.contains("_format") && !DbEncoder::parseFormat(params["_format"], format)) {
+            responder->send(createErrorResponse(400, "Invalid _format"));
+            return;
+        }
+        QString layoutName = params.value("_layout", "rows").toLower();
+        if (layoutName != "rows" && layoutName != "columns") {
+            responder->send(createErrorResponse(400, "Invalid _layout"));
+            return;
+        }
+        DbEncoder::Layout layout = layoutName == "columns" ? DbEncoder::Layout::Columns : DbEncoder::Layout::Rows;
+
+        QMap<QString, QString> query = params;
+        if (!identifier.isEmpty() && !query.contains("id"))
+            query["id"] = identifier;
+
+        // Большие выборки - потоком по курсору, без сборки всего ответа в памяти
+        if (wantsStreamedSelect(query) && DbEncoder::supportsStreaming(format, layout)) {
+            streamDbSelect(table, query, format, responder);
+            return;
+        }
+
+        // Повторяющиеся выборки - готовым ответом из кеша
+        if (m_dbCache->isCacheable(table) && !bypassesDbCache(params, request.headers)) {
+            serveCachedSelect(table, query, format, layout, responder);
+            return;
+        }
+
+        try {
+            responder->send(handleDbSelect(table, query, format, layout));
+        } catch (const std::exception &e) {
+            responder->send(createErrorResponse(500, QString("Database error: ") + e.what()));
+        }
+        return;
+    }
+
+    responder->send(serveDbApi(method, table, identifier, params, jsonBody));
+}
+
+bool HttpServer::bypassesDbCache(const QMap<QString, QString> &params, const HttpHeaders &headers) const
+{
+    if (!m_dbCacheBypass) return false;
+    if (params.contains("_cache")) {
+        QString value = params.value("_cache").toLower();
+        return value == "0" || value == "false";
+    }
+    QByteArray cacheControl = headers.valueView(HttpHeaders::CacheControl).toLower();
+    return cacheControl.contains("no-cache") || cacheControl.contains("no-store");
+}
+
+void HttpServer::serveCachedSelect(const QString &table, const QMap<QString, QString> &params,
+                                   DbEncoder::Format format, DbEncoder::Layout layout,
+                                   const HttpResponderPtr &responder)
+{
+    // Формат мог прийти из Accept, а не из параметров
+    QByteArray key = DbResponseCache::key(table, params);
+    key.append('\x1d');
+    key.append(DbEncoder::token(format));
+    HttpResponse response;
+    quint64 generation = 0;
+    switch (m_dbCache->lookup(table, key, responder, response, generation)) {
+    case DbResponseCache::Status::Hit:
+        responder->send(response);
+        return;
+    case DbResponseCache::Status::Wait:
+        return;
+    case DbResponseCache::Status::Load:
+        break;
+    }
+
+    // complete() обязателен и при ошибке - иначе ждущие запросы не получат ответ
+    try {
+        response = handleDbSelect(table, params, format, layout);
+    } catch (const std::exception &e) {
+        response = createErrorResponse(500, QString("Database error: ") + e.what());
+    }
+    m_dbCache->complete(table, key, response, generation);
+    responder->send(response);
+}
+
+void HttpServer::handleApiFallback(const HttpRequest &request, const RouteParams &route, const HttpResponderPtr &responder)
+{
+    if (!isAuthorized(request.headers)) {
+        responder->send(createErrorResponse(401, "Unauthorized"));
+        return;
+    }
+
+    QByteArray rest = route.value("path");
+    if (rest.isEmpty())
+        responder->send(createErrorResponse(400, "Invalid API path"));
+    else if (rest != "db" && rest != "db/")
+        responder->send(createErrorResponse(404, "API endpoint not found"));
+    else if (!m_dbPool)
+        responder->send(createErrorResponse(503, "Database not available"));
+    else
+        responder->send(createErrorResponse(400, "Database table not specified"));
+}
 
-            // Логирование запроса (для отладки)
-            qDebug() << "API Request:" << method << apiPath << "\n" << "Params:" << params << "\n" << "JSON:" << jsonToString(jsonBody);
+void HttpServer::serveDocumentRoot(const QString &method, const QString &path, const HttpHeaders &headers,
+                                   const QByteArray &body, const HttpResponderPtr &responder)
+{
+    // Разбор URL
+    QUrl url(path);
+    QString cleanPath = url.path();
 
-            // Обработка API
-            return serveApi(apiPath, method, params, jsonBody);
+    // Определение файла для обслуживания. cleanPath убирает "..", чтобы не выйти за document root
+    QString documentPath = QDir::cleanPath("/" + cleanPath);
+
+    // /api/ обслуживает роутер. Путь, который стал /api/ только после раскодирования
+    // %XX или склейки "//", не должен обойти аутентификацию через файлы из www/api
+    if (documentPath == "/api" || documentPath.startsWith("/api/")) {
+        responder->send(createErrorResponse(404, "Not Found"));
+        return;
     }
 
-    // Определение файла для обслуживания
-    QString filePath = m_documentRoot + cleanPath;
-    if (filePath.endsWith('/')) {
-        filePath += "index.html";
+    QString filePath = m_documentRoot + documentPath;
+    if (cleanPath.endsWith('/')) {
+        filePath += filePath.endsWith('/') ? "index.html" : "/index.html";
+    }
+
+    // Горячие файлы отдаются из памяти, без обращения к диску
+    if (StaticFileCache::EntryPtr cached = m_staticCache->lookup(filePath)) {
+        responder->send(StaticFileCache::respond(*cached, headers));
+        return;
     }
 
     QFileInfo fileInfo(filePath);
@@ -226,7 +904,8 @@ QByteArray HttpServer::processRequest(const QString &method, const QString &path
     // Проверка существования файла
     if (!fileInfo.exists()) {
         qDebug() << "Method:" << method << "\n" << "Filepath:" << filePath << " Not Found";
-        return createErrorResponse(404, "Not Found");
+        responder->send(createErrorResponse(404, "Not Found"));
+        return;
     }
 
     // Проверка на директорию
@@ -235,74 +914,138 @@ QByteArray HttpServer::processRequest(const QString &method, const QString &path
         fileInfo.setFile(filePath);
 
         if (!fileInfo.exists()) {
-            return createErrorResponse(403, "Forbidden");
+            responder->send(createErrorResponse(403, "Forbidden"));
+            return;
         }
     }
 
     // Обработка PHP скриптов
     if (fileInfo.suffix().toLower() == "php") {
+        responder->setRoute(Metrics::RoutePhp);
         QMap<QString, QString> params = parseQueryParams(url.query());
-        return executePhpScript(filePath, params, body);
+        if (m_phpFastCgi)
+            fastCgiClient()->execute(cgiEnvironment(filePath, params, body), body, responder);
+        else
+            m_phpRunner->execute(filePath, cgiEnvironment(filePath, params, body), body, responder);
+        return;
     }
 
     // Отдача статического файла
-    return serveStaticFile(filePath);
+    serveStaticFile(filePath, headers, responder);
 }
 
-QByteArray HttpServer::serveStaticFile(const QString &filePath)
+QByteArray HttpServer::mimeTypeForSuffix(const QString &suffix)
 {
+    static const QHash<QString, QByteArray> mimeTypes = {
+        { "html", "text/html" },
+        { "css", "text/css" },
+        { "js", "application/javascript" },
+        { "json", "application/json" },
+        { "jpg", "image/jpeg" },
+        { "jpeg", "image/jpeg" },
+        { "png", "image/png" },
+        { "gif", "image/gif" },
+        { "svg", "image/svg+xml" }
+    };
+    return mimeTypes.value(suffix.toLower(), "text/plain");
+}
+
+void HttpServer::serveStaticFile(const QString &filePath, const HttpHeaders &headers,
+                                 const HttpResponderPtr &responder)
+{
+    Metrics::ScopedTimer timer(Metrics::global().staticFile());
+    QFileInfo fileInfo(filePath);
+    if (!fileInfo.isReadable()) {
+        responder->send(createErrorResponse(403, "Forbidden"));
+        return;
+    }
+
+    // Большие файлы не читаем в память: тело уходит через sendfile прямо из файла
+    if (fileInfo.size() > m_streamThreshold) {
+        QByteArray mimeType = mimeTypeForSuffix(fileInfo.suffix());
+        QByteArray etag = StaticFileCache::makeEtag(fileInfo);
+        QByteArray validators = StaticFileCache::validatorHeaders(etag, fileInfo.lastModified());
+
+        // Большие файлы на лету не сжимаем, но готовые .br / .gz рядом отдаем
+        bool varies = m_compression.enabled && HttpCompression::isCompressible(mimeType);
+        if (varies) {
+            validators.append(StaticFileCache::varyHeader());
+            if (!headers.contains(HttpHeaders::Range)) {
+                QString brotliPath = StaticFileCache::precompressedPath(fileInfo, ContentEncoding::Brotli);
+                ContentEncoding encoding = HttpCompression::negotiate(headers.valueView(HttpHeaders::AcceptEncoding),
+                                                                      !brotliPath.isEmpty());
+                QString encodedPath = encoding == ContentEncoding::Brotli ? brotliPath
+                    : encoding == ContentEncoding::Gzip ? StaticFileCache::precompressedPath(fileInfo, encoding)
+                    : QString();
+                if (!encodedPath.isEmpty()) {
+                    QByteArray encodedEtag = HttpCompression::encodedEtag(etag, encoding);
+                    QByteArray encodedValidators = StaticFileCache::validatorHeaders(encodedEtag, fileInfo.lastModified())
+                        + StaticFileCache::varyHeader();
+                    if (StaticFileCache::isNotModified(headers, encodedEtag, fileInfo.lastModified())) {
+                        responder->send(StaticFileCache::notModifiedResponse(encodedValidators));
+                        return;
+                    }
+                    qint64 encodedSize = QFileInfo(encodedPath).size();
+                    responder->sendFile(StaticFileCache::makeHead(200, mimeType, encodedSize, encodedValidators
+                                            + "Content-Encoding: " + HttpCompression::token(encoding) + "\r\n"),
+                                        encodedPath, 0, encodedSize);
+                    return;
+                }
+            }
+        }
+
+        if (StaticFileCache::isNotModified(headers, etag, fileInfo.lastModified())) {
+            responder->send(StaticFileCache::notModifiedResponse(validators));
+            return;
+        }
+
+        qint64 size = fileInfo.size();
+        qint64 start = 0, end = size - 1;
+        switch (StaticFileCache::parseRange(headers, etag, fileInfo.lastModified(), size, start, end)) {
+        case StaticFileCache::RangeResult::Unsatisfiable:
+            responder->send(StaticFileCache::rangeNotSatisfiableResponse(size));
+            return;
+        case StaticFileCache::RangeResult::Partial: {
+            QByteArray contentRange = "bytes " + QByteArray::number(start) + "-" + QByteArray::number(end)
+                + "/" + QByteArray::number(size);
+            responder->sendFile(StaticFileCache::makeHead(206, mimeType, end - start + 1, validators, contentRange),
+                                filePath, start, end - start + 1);
+            return;
+        }
+        case StaticFileCache::RangeResult::Full:
+            responder->sendFile(StaticFileCache::makeHead(200, mimeType, size, validators), filePath, 0, size);
+            return;
+        }
+        return;
+    }
+
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly)) {
-        return createErrorResponse(403, "Forbidden");
+        responder->send(createErrorResponse(403, "Forbidden"));
+        return;
     }
 
     QByteArray content = file.readAll();
     file.close();
 
-    // Определение MIME-типа
-    QString mimeType = "text/plain";
-    QString suffix = QFileInfo(filePath).suffix().toLower();
-
-    if (suffix == "html") mimeType = "text/html";
-    else if (suffix == "css") mimeType = "text/css";
-    else if (suffix == "js") mimeType = "application/javascript";
-    else if (suffix == "json") mimeType = "application/json";
-    else if (suffix == "jpg" || suffix == "jpeg") mimeType = "image/jpeg";
-    else if (suffix == "png") mimeType = "image/png";
-    else if (suffix == "gif") mimeType = "image/gif";
-    else if (suffix == "svg") mimeType = "image/svg+xml";
-
-    // Формирование ответа
-    QByteArray response;
-    response.append("HTTP/1.1 200 OK\r\n");
-    response.append("Content-Type: " + mimeType.toUtf8() + "\r\n");
-    response.append("Content-Length: " + QByteArray::number(content.size()) + "\r\n");
-    response.append("Connection: close\r\n");
-    response.append("\r\n");
-    response.append(content);
+    // Ответы 200 и 304 собираются один раз и кладутся в кеш
+    StaticFileCache::EntryPtr entry = StaticFileCache::makeEntry(
+        fileInfo, mimeTypeForSuffix(fileInfo.suffix()), content, m_compression);
+    m_staticCache->insert(filePath, entry);
 
-    return response;
+    responder->send(StaticFileCache::respond(*entry, headers));
 }
 
-QByteArray HttpServer::executePhpScript(const QString &scriptPath, const QMap<QString, QString> &params, const QByteArray &postData)
+QMap<QString, QString> HttpServer::cgiEnvironment(const QString &scriptPath, const QMap<QString, QString> &params,
+                                                  const QByteArray &postData) const
 {
-    QProcess phpProcess;
-    QFileInfo phpFile(m_phpCgiPath);
-    if (!phpFile.exists() || !phpFile.isExecutable()) {
-        qWarning() << "Invalid PHP-CGI path:" << m_phpCgiPath;
-        return createErrorResponse(500, "PHP-CGI path is invalid or not executable");
-    }
-    QFileInfo scriptFile(scriptPath);
-    if (!scriptFile.exists() || !scriptFile.isReadable()) {
-        qWarning() << "Script file missing or unreadable:" << scriptPath;
-        return createErrorResponse(500, "Script file missing or unreadable");
-    }
-    // Установка переменных окружения CGI
-    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    // Одни и те же переменные уходят в окружение php-cgi и в FastCGI PARAMS
+    QMap<QString, QString> env;
     env.insert("GATEWAY_INTERFACE", "CGI/1.1");
     env.insert("REQUEST_METHOD", postData.isEmpty() ? "GET" : "POST");
     env.insert("SCRIPT_FILENAME", scriptPath);
     env.insert("SCRIPT_NAME", QFileInfo(scriptPath).fileName());
+    env.insert("DOCUMENT_ROOT", m_documentRoot);
     env.insert("REDIRECT_STATUS", "200");
     env.insert("SERVER_PROTOCOL", "HTTP/1.1");
     env.insert("CONTENT_TYPE", "application/x-www-form-urlencoded");
@@ -316,187 +1059,524 @@ QByteArray HttpServer::executePhpScript(const QString &scriptPath, const QMap<QS
         queryString += QUrl::toPercentEncoding(it.key()) + "=" + QUrl::toPercentEncoding(it.value());
     }
     env.insert("QUERY_STRING", queryString);
+    return env;
+}
 
-    phpProcess.setProcessEnvironment(env);
+FastCgiClient *HttpServer::fastCgiClient()
+{
+    // Свой клиент в каждом потоке: сокеты QIODevice привязаны к потоку
+    if (!m_fastCgiClients.hasLocalData())
+        m_fastCgiClients.setLocalData(new FastCgiClient(m_fastCgiAddress, m_fastCgiMaxConnections,
+                                                        m_fastCgiRequestsPerConnection, m_phpTimeoutMs));
+    return m_fastCgiClients.localData();
+}
 
-    // Запуск PHP-CGI
-    phpProcess.start(m_phpCgiPath, QStringList() << "-f" << scriptPath);
-    if (!phpProcess.waitForStarted()) {
-        qWarning() << "Failed to start PHP CGI process.";
-        return createErrorResponse(500, "Failed to start PHP CGI process");
-    }
+HttpResponse HttpServer::cgiToHttpResponse(const QByteArray &cgiOutput, int headerEnd)
+{
+    // php-cgi отдает CGI-заголовки без строки статуса и без длины тела,
+    // а для keep-alive нужен полноценный HTTP-ответ
+    HttpResponse response = HttpResponse::fromRaw(FastCgiClient::cgiHeadersToHttp(cgiOutput.left(headerEnd), false));
+
+    // Тело - хвост вывода php-cgi, без копирования
+    int bodySize = cgiOutput.size() - headerEnd - 4;
+    response.addHeader("Content-Length", QByteArray::number(bodySize));
+    response.setBody(HttpBody(cgiOutput, headerEnd + 4, bodySize));
+    return response;
+}
 
-    // Отправка POST-данных
-    if (!postData.isEmpty()) {
-        phpProcess.write(postData);
-    }
-    phpProcess.closeWriteChannel();
+//QMap<QString, QString> HttpServer::jsonToMap(const QJsonObject &json) {
+//    QMap<QString, QString> result;
+//    for (auto it = json.begin(); it != json.end(); ++it) {
+//        result[it.key()] = it.value().toString();
+//    }
+//    return result;
+//}
 
-    if (!phpProcess.waitForFinished()) {
-        qWarning() << "PHP CGI did not finish properly.";
-        return createErrorResponse(500, "PHP CGI did not finish properly");
+HttpResponse HttpServer::serveDbApi(const QString &method, const QString &table, const QString &identifier,
+                                    const QMap<QString, QString> &params, const QJsonObject &jsonBody)
+{
+    if (!m_dbPool) {
+        return createErrorResponse(503, "Database not available");
     }
 
-    QByteArray stdOut = phpProcess.readAllStandardOutput();
-    QByteArray stdErr = phpProcess.readAllStandardError();
+    QMap<QString, QString> allParams = params;
 
-    if (!stdErr.isEmpty()) {
-        qWarning() << "PHP CGI stderr:" << stdErr;
+    // Добавляем параметры из JSON тела, если есть
+    if (!jsonBody.isEmpty()) {
+        for (auto it = jsonBody.begin(); it != jsonBody.end(); ++it) {
+            allParams[it.key()] = it.value().toString();
+        }
     }
 
-    if (stdOut.isEmpty()) {
-        return createErrorResponse(500, "Empty response from PHP CGI:\n" + stdErr);
+    // /api/db/<table>/<id> - id из пути, если его не передали параметром
+    if (!identifier.isEmpty() && !allParams.contains("id")) {
+        allParams["id"] = identifier;
     }
 
-    // Проверка наличия заголовков
-    int headerEnd = stdOut.indexOf("\r\n\r\n");
-    if (headerEnd == -1) {
-        return createErrorResponse(500, "Invalid response from PHP CGI:\n" + stdOut + "\n" + stdErr);
+    try {
+        if (method == "GET") {
+            return handleDbSelect(table, allParams);
+        }
+        else if (method == "POST") {
+            return handleDbInsert(table, allParams);
+        }
+        else if (method == "PUT") {
+            if (!allParams.contains("id")) {
+                return createErrorResponse(400, "ID not specified for update");
+            }
+            return handleDbUpdate(table, allParams);
+        }
+        else if (method == "DELETE") {
+            if (!allParams.contains("id")) {
+                return createErrorResponse(400, "ID not specified for deletion");
+            }
+            return handleDbDelete(table, allParams);
+        }
+        else {
+            return createErrorResponse(405, "Method not allowed");
+        }
+    } catch (const std::exception &e) {
+        return createErrorResponse(500, QString("Database error: ") + e.what());
     }
+}
+// Имя из параметров клиента в ключе кеша выражений: с длиной впереди,
+// иначе колонка "a,b" дала бы тот же ключ, что и две колонки "a" и "b"
+static std::string keyName(const std::string &name)
+{
+    return std::to_string(name.size()) + ":" + name;
+}
 
-    return stdOut;
+// Список колонок - часть ключа кеша выражений
+static std::string joinColumns(const std::vector<std::string> &columns)
+{
+    std::string joined;
+    for (const std::string &column : columns)
+        joined += keyName(column);
+    return joined;
 }
 
-//QMap<QString, QString> HttpServer::jsonToMap(const QJsonObject &json) {
-//    QMap<QString, QString> result;
-//    for (auto it = json.begin(); it != json.end(); ++it) {
-//        result[it.key()] = it.value().toString();
-//    }
-//    return result;
-//}
+namespace {
+
+// Ключ постраничной выборки: дополняет _order до полного порядка, по нему
+// продолжается следующая страница. Есть у всех таблиц /api/db (как и в PUT/DELETE)
+const char *const PageKeyColumn = "id";
+
+// Разобранные параметры выборки /api/db/<table>
+struct SelectQuery
+{
+    std::vector<std::string> columns; // фильтры col = $N
+    std::vector<std::string> values;
+    std::string orderColumn;
+    bool orderDesc = false;
+    int limit = -1;                   // -1 - без LIMIT
+    bool paged = false;               // порядок дополнен id, в ответе next
+    DbPageToken after;                // _after: продолжить после этой строки
+};
+
+// Откуда начинать страницу. Сравнение строк (col, id) > ($a, $b) идет по
+// индексу (col, id) и стоит одинаково на любой глубине, в отличие от OFFSET
+enum class Seek
+{
+    None,       // с начала
+    After,      // (col, id) > ($a, $b) или id > $b
+    NullsAfter, // col IS NULL AND id > $b
+    Nulls,      // col IS NULL
+    Values      // col IS NOT NULL
+};
+
+bool sortsByColumn(const SelectQuery &query)
+{
+    return !query.orderColumn.empty();
+}
+
+Seek firstSeek(const SelectQuery &query)
+{
+    if (!query.after.isValid())
+        return Seek::None;
+    if (!sortsByColumn(query) || query.after.value)
+        return Seek::After;
+    return Seek::NullsAfter;
+}
+
+// NULL в PostgreSQL больше любого значения: при ASC строки с NULL в колонке
+// сортировки идут после остальных, при DESC - перед ними. Сравнение строк
+// их не видит, поэтому страница на границе добирается вторым запросом
+Seek followingSeek(const SelectQuery &query)
+{
+    if (!query.after.isValid() || !sortsByColumn(query))
+        return Seek::None;
+    bool inNulls = !query.after.value;
+    if (!query.orderDesc && !inNulls)
+        return Seek::Nulls;
+    if (query.orderDesc && inNulls)
+        return Seek::Values;
+    return Seek::None;
+}
 
-QByteArray HttpServer::serveApi(const QString &apiPath, const QString &method,
-                               const QMap<QString, QString> &params,
-                               const QJsonObject &jsonBody)
+// pageSize > 0 - постраничная выдача: _limit не больше maxPageSize, по умолчанию pageSize
+bool parseSelectQuery(const QMap<QString, QString> &params, SelectQuery &query, QString &error,
+                      int pageSize = 0, int maxPageSize = 0)
 {
-    // Разделяем путь API на компоненты
-    QStringList pathParts = apiPath.split('/', QString::SkipEmptyParts);
-    if (pathParts.isEmpty()) {
-        return createErrorResponse(400, "Invalid API path");
+    // Фильтры - все параметры, кроме служебных (_order, _limit, _after, _stream)
+    for (auto it = params.begin(); it != params.end(); ++it) {
+        if (it.key().startsWith("_")) continue;
+        query.columns.push_back(it.key().toStdString());
+        query.values.push_back(it.value().toStdString());
     }
 
-    QString resource = pathParts[0];
-    QString action = pathParts.size() > 1 ? pathParts[1] : "";
-    QString identifier = pathParts.size() > 2 ? pathParts[2] : "";
+    // _order=column, _order=column desc или _order=-column
+    if (params.contains("_order")) {
+        QString order = params["_order"].trimmed();
+        if (order.startsWith('-')) {
+            query.orderDesc = true;
+            order = order.mid(1);
+        } else {
+            QStringList orderParts = order.split(' ', QString::SkipEmptyParts);
+            if (orderParts.size() == 2 && orderParts[1].compare("desc", Qt::CaseInsensitive) == 0) {
+                query.orderDesc = true;
+            } else if (orderParts.size() > 2
+                       || (orderParts.size() == 2 && orderParts[1].compare("asc", Qt::CaseInsensitive) != 0)) {
+                error = "Invalid _order";
+                return false;
+            }
+            order = orderParts.value(0);
+        }
+        if (order.isEmpty()) {
+            error = "Invalid _order";
+            return false;
+        }
+        query.orderColumn = order.toStdString();
+    }
+
+    query.paged = pageSize > 0;
+    if (query.paged) {
+        // Сортировка по id - это сортировка по одному ключу
+        if (query.orderColumn == PageKeyColumn)
+            query.orderColumn.clear();
+    } else if (params.contains("_after")) {
+        error = "_after is not supported for this select";
+        return false;
+    }
 
-    // Обработка запросов к базе данных
-    if (resource == "db") {
-        if (!m_dbConnection) {
-            return createErrorResponse(503, "Database not available");
+    if (params.contains("_after")) {
+        if (!DbPageToken::decode(params["_after"].toLatin1(), query.after)) {
+            error = "Invalid _after";
+            return false;
+        }
+        // Порядок задает токен; _order, если передан, должен с ним совпадать
+        if (params.contains("_order")
+            && (query.after.column != query.orderColumn || query.after.desc != query.orderDesc)) {
+            error = "_after does not match _order";
+            return false;
         }
+        query.orderColumn = query.after.column;
+        query.orderDesc = query.after.desc;
+    }
 
-        if (action.isEmpty()) {
-            return createErrorResponse(400, "Database table not specified");
+    if (params.contains("_limit")) {
+        bool ok = false;
+        int limit = params["_limit"].toInt(&ok);
+        if (!ok || limit < (query.paged ? 1 : 0)) {
+            error = "Invalid _limit";
+            return false;
         }
+        query.limit = query.paged && maxPageSize > 0 ? qMin(limit, maxPageSize) : limit;
+    } else if (query.paged) {
+        query.limit = pageSize;
+    }
+    return true;
+}
 
-        QString table = action;
-        QMap<QString, QString> allParams = params;
+std::string selectCacheKey(const std::string &table, const SelectQuery &query, Seek seek)
+{
+    return "select|" + table + "|" + joinColumns(query.columns) + "|" + keyName(query.orderColumn)
+        + (query.orderDesc ? "|desc" : "|asc") + (query.limit >= 0 ? "|limit" : "")
+        + (query.paged ? "|paged|" + std::to_string(int(seek)) : "");
+}
 
-        // Добавляем параметры из JSON тела, если есть
-        if (!jsonBody.isEmpty()) {
-            for (auto it = jsonBody.begin(); it != jsonBody.end(); ++it) {
-                allParams[it.key()] = it.value().toString();
-            }
-        }
+std::string buildSelectSql(pqxx::connection &conn, const std::string &table, const SelectQuery &query,
+                           Seek seek = Seek::None)
+{
+    std::string sql = "SELECT * FROM " + conn.quote_name(table);
+    int param = 0;
+    std::vector<std::string> conditions;
+    for (const std::string &column : query.columns) {
+        conditions.push_back(conn.quote_name(column) + " = $" + std::to_string(++param));
+    }
 
-        try {
-            if (method == "GET") {
-                return handleDbSelect(table, allParams);
-            }
-            else if (method == "POST") {
-                return handleDbInsert(table, allParams);
-            }
-            else if (method == "PUT") {
-                if (identifier.isEmpty() && !allParams.contains("id")) {
-                    return createErrorResponse(400, "ID not specified for update");
-                }
-                return handleDbUpdate(table, allParams);
-            }
-            else if (method == "DELETE") {
-                if (identifier.isEmpty() && !allParams.contains("id")) {
-                    return createErrorResponse(400, "ID not specified for deletion");
-                }
-                return handleDbDelete(table, allParams);
-            }
-            else {
-                return createErrorResponse(405, "Method not allowed");
-            }
-        } catch (const std::exception &e) {
-            return createErrorResponse(500, QString("Database error: ") + e.what());
+    const std::string key = conn.quote_name(PageKeyColumn);
+    const std::string column = sortsByColumn(query) ? conn.quote_name(query.orderColumn) : std::string();
+    const std::string direction = query.orderDesc ? " DESC" : " ASC";
+    const char *after = query.orderDesc ? " < " : " > ";
+    switch (seek) {
+    case Seek::None:
+        break;
+    case Seek::After:
+        if (column.empty()) {
+            conditions.push_back(key + after + "$" + std::to_string(++param));
+        } else {
+            conditions.push_back("(" + column + ", " + key + ")" + after + "($" + std::to_string(param + 1)
+                                 + ", $" + std::to_string(param + 2) + ")");
+            param += 2;
         }
+        break;
+    case Seek::NullsAfter:
+        conditions.push_back(column + " IS NULL AND " + key + after + "$" + std::to_string(++param));
+        break;
+    case Seek::Nulls:
+        conditions.push_back(column + " IS NULL");
+        break;
+    case Seek::Values:
+        conditions.push_back(column + " IS NOT NULL");
+        break;
+    }
+
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        sql += i == 0 ? " WHERE " : " AND ";
+        sql += conditions[i];
     }
 
-    return createErrorResponse(404, "API endpoint not found");
+    if (query.paged) {
+        sql += " ORDER BY " + (column.empty() ? std::string() : column + direction + ", ") + key + direction;
+    } else if (!query.orderColumn.empty()) {
+        sql += " ORDER BY " + conn.quote_name(query.orderColumn) + direction;
+    }
+    if (query.limit >= 0) {
+        sql += " LIMIT $" + std::to_string(++param);
+    }
+    return sql;
 }
-QByteArray HttpServer::handleDbSelect(const QString &table, const QMap<QString, QString> &params)
+
+// Параметры в порядке buildSelectSql: фильтры, ключ продолжения, LIMIT
+pqxx::params selectParams(const SelectQuery &query, Seek seek, int limit)
 {
-    pqxx::work txn(*m_dbConnection);
-    QJsonObject result;
+    pqxx::params values;
+    for (const std::string &value : query.values)
+        values.append(value);
+    if (seek == Seek::After && sortsByColumn(query))
+        values.append(*query.after.value);
+    if (seek == Seek::After || seek == Seek::NullsAfter)
+        values.append(query.after.key);
+    if (limit >= 0)
+        values.append(limit);
+    return values;
+}
+
+// Поиск колонки по точному имени (pqxx::row::operator[] приводит имя к нижнему регистру)
+int columnIndex(const pqxx::result &result, const std::string &name)
+{
+    for (pqxx::row::size_type i = 0; i < result.columns(); ++i) {
+        if (name == result.column_name(i))
+            return int(i);
+    }
+    return -1;
+}
+
+DbPageToken pageToken(const SelectQuery &query, const pqxx::result &result, int row)
+{
+    DbPageToken token;
+    token.column = query.orderColumn;
+    token.desc = query.orderDesc;
+    if (sortsByColumn(query)) {
+        const pqxx::field value = result[row][columnIndex(result, query.orderColumn)];
+        if (!value.is_null())
+            token.value = value.c_str();
+    }
+    token.key = result[row][columnIndex(result, PageKeyColumn)].c_str();
+    return token;
+}
+
+}
+
+HttpResponse HttpServer::handleDbSelect(const QString &table, const QMap<QString, QString> &params,
+                                      DbEncoder::Format format, DbEncoder::Layout layout)
+{
+    Metrics::ScopedTimer timer(Metrics::global().dbQuery(Metrics::DbSelect));
+    SelectQuery query;
+    QString error;
+    if (!parseSelectQuery(params, query, error, m_pageSize, m_maxPageSize)) {
+        return createErrorResponse(400, error);
+    }
 
-    std::string query = "SELECT * FROM " + table.toStdString();
+    DbConnectionPool::Lease conn = m_dbPool->acquire();
+    if (!conn) {
+        return createErrorResponse(503, "Database not available");
+    }
 
-    if (!params.isEmpty()) {
-        query += " WHERE ";
-        bool first = true;
-        for (auto it = params.begin(); it != params.end(); ++it) {
-            if (!first) query += " AND ";
-            first = false;
-            query += it.key().toStdString() + " = " + txn.quote(it.value().toStdString());
+    std::string tableName = table.toStdString();
+    auto prepare = [&](Seek seek) {
+        return conn.statements().prepare(*conn, selectCacheKey(tableName, query, seek), [&]() {
+            return buildSelectSql(*conn, tableName, query, seek);
+        });
+    };
+    const Seek seek = firstSeek(query);
+    const Seek following = followingSeek(query);
+    std::string statement = prepare(seek);
+    std::string followingStatement = following != Seek::None ? prepare(following) : std::string();
+
+    pqxx::work txn(*conn);
+    pqxx::result res;
+    pqxx::result tail;
+    int count = 0;
+    QByteArray next;
+
+    if (!query.paged) {
+        res = txn.exec_prepared(statement, selectParams(query, seek, query.limit));
+        count = int(res.size());
+    } else {
+        // Лишняя строка показывает, есть ли следующая страница
+        const int fetch = query.limit + 1;
+        res = txn.exec_prepared(statement, selectParams(query, seek, fetch));
+        if (!followingStatement.empty() && int(res.size()) < fetch) {
+            tail = txn.exec_prepared(followingStatement, selectParams(query, following, fetch - int(res.size())));
+        }
+        count = qMin(int(res.size() + tail.size()), query.limit);
+        if (int(res.size() + tail.size()) > query.limit) {
+            const int last = count - 1;
+            next = last < int(res.size()) ? pageToken(query, res, last).encode()
+                                          : pageToken(query, tail, last - int(res.size())).encode();
         }
     }
+    txn.commit();
 
-    if (params.contains("_order")) {
-        query += " ORDER BY " + params["_order"].toStdString();
+    // Тело пишется прямо из результата; хвост страницы - из второго запроса
+    const int fromFirst = qMin(int(res.size()), count);
+    DbEncoder encoder(format, layout);
+    encoder.begin(res, count, query.paged);
+    encoder.appendRows(res, fromFirst);
+    encoder.appendRows(tail, count - fromFirst);
+    encoder.finish(next);
+
+    HttpResponse response(200, DbEncoder::contentType(format), encoder.takeOutput());
+    response.addHeader(QByteArrayLiteral("Vary: Accept\r\n"));
+    // У NDJSON и CSV нет обертки - следующая страница в заголовке
+    if (!next.isEmpty() && !DbEncoder::hasEnvelope(format)) {
+        response.addHeader("X-Next-Page", next);
     }
+    return response;
+}
 
-    if (params.contains("_limit")) {
-        query += " LIMIT " + params["_limit"].toStdString();
+bool HttpServer::wantsStreamedSelect(const QMap<QString, QString> &params) const
+{
+    if (!params.contains("_stream"))
+        return m_streamSelect;
+    QString value = params.value("_stream").toLower();
+    return value != "0" && value != "false";
+}
+
+void HttpServer::streamDbSelect(const QString &table, const QMap<QString, QString> &params,
+                                DbEncoder::Format format, const HttpResponderPtr &responder)
+{
+    Metrics::ScopedTimer timer(Metrics::global().dbQuery(Metrics::DbSelectStream));
+    SelectQuery query;
+    QString error;
+    if (!parseSelectQuery(params, query, error)) {
+        responder->send(createErrorResponse(400, error));
+        return;
     }
 
-    pqxx::result res = txn.exec(query);
+    DbConnectionPool::Lease conn = m_dbPool->acquire();
+    if (!conn) {
+        responder->send(createErrorResponse(503, "Database not available"));
+        return;
+    }
+
+    try {
+        // Курсор живет до конца транзакции; строки читаем пачками,
+        // так что память ограничена размером пачки, а не таблицы
+        pqxx::work txn(*conn);
+        txn.exec_params("DECLARE api_select NO SCROLL CURSOR FOR "
+                        + buildSelectSql(*conn, table.toStdString(), query),
+                        selectParams(query, Seek::None, query.limit));
+        const std::string fetch = "FETCH FORWARD " + std::to_string(m_streamBatchRows) + " FROM api_select";
+
+        DbEncoder encoder(format);
+        for (;;) {
+            pqxx::result batch = txn.exec(fetch);
+
+            if (!responder->isStreaming()) {
+                // Заголовки уходят после первой пачки: ошибка запроса еще может стать 500
+                responder->beginStream("HTTP/1.1 200 OK\r\n"
+                                       "Content-Type: " + DbEncoder::contentType(format) + "\r\n"
+                                       "Vary: Accept\r\n"
+                                       "\r\n");
+                encoder.begin(batch);
+            }
+
+            encoder.appendRows(batch);
+
+            if (batch.size() < pqxx::result::size_type(m_streamBatchRows))
+                break;
 
-    QJsonArray items;
-    for (auto row : res) {
-        QJsonObject item;
-        for (auto field : row) {
-            item[QString::fromStdString(field.name())] = QString::fromStdString(field.c_str());
+            responder->writeBody(encoder.takeOutput());
+            // Клиент читает медленнее, чем мы выбираем - ждем, держа курсор открытым
+            if (!responder->waitForDrain(m_streamWindowBytes, m_streamWriteTimeoutMs)) {
+                qWarning() << "Streaming select aborted: client is gone or too slow";
+                responder->abortStream();
+                return;
+            }
         }
-        items.append(item);
-    }
 
-    result["status"] = "success";
-    result["data"] = items;
-    txn.commit();
-    return createJsonResponse(result);
+        encoder.finish();
+        responder->writeBody(encoder.takeOutput());
+        txn.exec("CLOSE api_select");
+        txn.commit();
+        responder->endStream();
+    } catch (const std::exception &e) {
+        if (responder->isStreaming())
+            responder->abortStream();
+        else
+            responder->send(createErrorResponse(500, QString("Database error: ") + e.what()));
+    }
 }
 
-QByteArray HttpServer::handleDbInsert(const QString &table, const QMap<QString, QString> &params)
+HttpResponse HttpServer::handleDbInsert(const QString &table, const QMap<QString, QString> &params)
 {
+    Metrics::ScopedTimer timer(Metrics::global().dbQuery(Metrics::DbInsert));
     if (params.isEmpty()) {
         return createErrorResponse(400, "No data provided");
     }
 
-    pqxx::work txn(*m_dbConnection);
-    QJsonObject result;
-
-    std::string columns, values;
-    bool first = true;
+    std::vector<std::string> columns;
+    pqxx::params values;
     for (auto it = params.begin(); it != params.end(); ++it) {
         if (it.key().startsWith("_")) continue; // Пропускаем служебные параметры
-        if (!first) {
-            columns += ", ";
-            values += ", ";
-        }
-        first = false;
-        columns += it.key().toStdString();
-        values += txn.quote(it.value().toStdString());
+        columns.push_back(it.key().toStdString());
+        values.append(it.value().toStdString());
+    }
+
+    if (columns.empty()) {
+        return createErrorResponse(400, "No data provided");
     }
 
-    std::string query = "INSERT INTO " + table.toStdString() +
-                       " (" + columns + ") VALUES (" + values + ") RETURNING id";
+    DbConnectionPool::Lease conn = m_dbPool->acquire();
+    if (!conn) {
+        return createErrorResponse(503, "Database not available");
+    }
+
+    std::string tableName = table.toStdString();
+    std::string key = "insert|" + tableName + "|" + joinColumns(columns);
+
+    std::string statement = conn.statements().prepare(*conn, key, [&]() {
+        std::string names, placeholders;
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (i > 0) {
+                names += ", ";
+                placeholders += ", ";
+            }
+            names += conn->quote_name(columns[i]);
+            placeholders += "$" + std::to_string(i + 1);
+        }
+        return "INSERT INTO " + conn->quote_name(tableName) +
+               " (" + names + ") VALUES (" + placeholders + ") RETURNING id";
+    });
 
-    pqxx::result res = txn.exec(query);
+    pqxx::work txn(*conn);
+    QJsonObject result;
+
+    pqxx::result res = txn.exec_prepared(statement, values);
     txn.commit();
+    tableChanged(table);
 
     if (!res.empty()) {
         result["status"] = "success";
@@ -509,8 +1589,125 @@ QByteArray HttpServer::handleDbInsert(const QString &table, const QMap<QString,
     return createJsonResponse(result);
 }
 
-QByteArray HttpServer::handleDbUpdate(const QString &table, const QMap<QString, QString> &params)
+HttpResponse HttpServer::handleDbBulkInsert(const QString &table, DbBulkInsert::Format format,
+                                            const QByteArray &body, bool atomic)
+{
+    Metrics::ScopedTimer timer(Metrics::global().dbQuery(Metrics::DbInsert));
+    std::vector<DbBulkInsert::Batch> batches;
+    QString error;
+    if (!DbBulkInsert::parse(format, body, m_bulkBatchRows, batches, error)) {
+        return createErrorResponse(400, error);
+    }
+    if (batches.empty()) {
+        return createErrorResponse(400, "No data provided");
+    }
+
+    DbConnectionPool::Lease conn = m_dbPool->acquire();
+    if (!conn) {
+        return createErrorResponse(503, "Database not available");
+    }
+
+    std::string tableName = table.toStdString();
+    bool useCopy = m_bulkUseCopy;
+    int insertedRows = 0;
+    int failedRows = 0;
+    QJsonArray report;
+
+    // Все пачки - одна транзакция и один commit; каждая пачка в своей
+    // точке сохранения, чтобы ошибка откатывала только ее
+    pqxx::work txn(*conn);
+    for (size_t i = 0; i < batches.size(); ++i) {
+        const DbBulkInsert::Batch &batch = batches[i];
+        QJsonObject status;
+        status["batch"] = int(i);
+        status["first_row"] = batch.firstRow;
+        status["rows"] = int(batch.rows.size());
+
+        if (atomic && failedRows > 0) {
+            status["status"] = "skipped";
+            report.append(status);
+            continue;
+        }
+
+        std::vector<long long> ids;
+        QString message;
+        if (useCopy) {
+            try {
+                pqxx::subtransaction savepoint(txn, "bulk_batch");
+                DbBulkInsert::copyBatch(savepoint, tableName, batch, int(i), ids);
+                savepoint.commit();
+                status["method"] = "copy";
+            } catch (const pqxx::insufficient_privilege &e) {
+                // Нет прав на временные таблицы - дальше многострочными INSERT
+                qWarning() << "Bulk insert: COPY unavailable, falling back to INSERT:" << e.what();
+                useCopy = false;
+            } catch (const pqxx::feature_not_supported &e) {
+                qWarning() << "Bulk insert: COPY unavailable, falling back to INSERT:" << e.what();
+                useCopy = false;
+            } catch (const std::exception &e) {
+                message = e.what();
+            }
+        }
+        if (!useCopy && message.isEmpty()) {
+            ids.clear();
+            try {
+                pqxx::subtransaction savepoint(txn, "bulk_batch");
+                DbBulkInsert::insertBatch(savepoint, tableName, batch, ids);
+                savepoint.commit();
+                status["method"] = "insert";
+            } catch (const std::exception &e) {
+                message = e.what();
+            }
+        }
+
+        if (!message.isEmpty()) {
+            failedRows += int(batch.rows.size());
+            status["status"] = "error";
+            status["message"] = message;
+        } else {
+            insertedRows += int(ids.size());
+            QJsonArray batchIds;
+            for (long long id : ids)
+                batchIds.append(qint64(id));
+            status["status"] = "success";
+            status["ids"] = batchIds;
+        }
+        report.append(status);
+    }
+
+    QJsonObject result;
+    if (atomic && failedRows > 0) {
+        txn.abort();
+        // Загруженные пачки откатились вместе с остальными
+        for (int i = 0; i < report.size(); ++i) {
+            QJsonObject status = report.at(i).toObject();
+            if (status.value("status").toString() == "success") {
+                status["status"] = "rolled_back";
+                status.remove("ids");
+                report[i] = status;
+            }
+        }
+        result["status"] = "error";
+        result["message"] = "Bulk insert failed, nothing was inserted";
+        result["inserted"] = 0;
+        result["batches"] = report;
+        return createJsonResponse(result, 400);
+    }
+
+    txn.commit();
+    if (insertedRows > 0)
+        tableChanged(table);
+
+    result["status"] = failedRows == 0 ? "success" : insertedRows > 0 ? "partial" : "error";
+    result["inserted"] = insertedRows;
+    result["failed"] = failedRows;
+    result["batches"] = report;
+    return createJsonResponse(result, insertedRows > 0 || failedRows == 0 ? 200 : 400);
+}
+
+HttpResponse HttpServer::handleDbUpdate(const QString &table, const QMap<QString, QString> &params)
 {
+    Metrics::ScopedTimer timer(Metrics::global().dbQuery(Metrics::DbUpdate));
     if (params.isEmpty()) {
         return createErrorResponse(400, "No data provided");
     }
@@ -519,29 +1716,45 @@ QByteArray HttpServer::handleDbUpdate(const QString &table, const QMap<QString,
         return createErrorResponse(400, "ID not specified");
     }
 
-    pqxx::work txn(*m_dbConnection);
-    QJsonObject result;
-
-    std::string setClause;
-    bool first = true;
+    std::vector<std::string> columns;
+    pqxx::params values;
     for (auto it = params.begin(); it != params.end(); ++it) {
         if (it.key() == "id" || it.key().startsWith("_")) continue;
-        if (!first) setClause += ", ";
-        first = false;
-        setClause += it.key().toStdString() + " = " + txn.quote(it.value().toStdString());
+        columns.push_back(it.key().toStdString());
+        values.append(it.value().toStdString());
     }
 
-    if (setClause.empty()) {
+    if (columns.empty()) {
         return createErrorResponse(400, "No fields to update");
     }
+    values.append(params["id"].toStdString());
+
+    DbConnectionPool::Lease conn = m_dbPool->acquire();
+    if (!conn) {
+        return createErrorResponse(503, "Database not available");
+    }
+
+    std::string tableName = table.toStdString();
+    std::string key = "update|" + tableName + "|" + joinColumns(columns);
 
-    std::string query = "UPDATE " + table.toStdString() +
-                       " SET " + setClause +
-                       " WHERE id = " + txn.quote(params["id"].toStdString()) +
-                       " RETURNING id";
+    std::string statement = conn.statements().prepare(*conn, key, [&]() {
+        std::string setClause;
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (i > 0) setClause += ", ";
+            setClause += conn->quote_name(columns[i]) + " = $" + std::to_string(i + 1);
+        }
+        return "UPDATE " + conn->quote_name(tableName) +
+               " SET " + setClause +
+               " WHERE id = $" + std::to_string(columns.size() + 1) +
+               " RETURNING id";
+    });
+
+    pqxx::work txn(*conn);
+    QJsonObject result;
 
-    pqxx::result res = txn.exec(query);
+    pqxx::result res = txn.exec_prepared(statement, values);
     txn.commit();
+    tableChanged(table);
 
     if (!res.empty()) {
         result["status"] = "success";
@@ -554,21 +1767,29 @@ QByteArray HttpServer::handleDbUpdate(const QString &table, const QMap<QString,
     return createJsonResponse(result);
 }
 
-QByteArray HttpServer::handleDbDelete(const QString &table, const QMap<QString, QString> &params)
+HttpResponse HttpServer::handleDbDelete(const QString &table, const QMap<QString, QString> &params)
 {
+    Metrics::ScopedTimer timer(Metrics::global().dbQuery(Metrics::DbDelete));
     if (!params.contains("id")) {
         return createErrorResponse(400, "ID not specified");
     }
 
-    pqxx::work txn(*m_dbConnection);
-    QJsonObject result;
+    DbConnectionPool::Lease conn = m_dbPool->acquire();
+    if (!conn) {
+        return createErrorResponse(503, "Database not available");
+    }
 
-    std::string query = "DELETE FROM " + table.toStdString() +
-                       " WHERE id = " + txn.quote(params["id"].toStdString()) +
-                       " RETURNING id";
+    std::string tableName = table.toStdString();
+    std::string statement = conn.statements().prepare(*conn, "delete|" + tableName, [&]() {
+        return "DELETE FROM " + conn->quote_name(tableName) + " WHERE id = $1 RETURNING id";
+    });
 
-    pqxx::result res = txn.exec(query);
+    pqxx::work txn(*conn);
+    QJsonObject result;
+
+    pqxx::result res = txn.exec_prepared(statement, params["id"].toStdString());
     txn.commit();
+    tableChanged(table);
 
     if (!res.empty()) {
         result["status"] = "success";
@@ -592,61 +1813,54 @@ QMap<QString, QString> HttpServer::parseQueryParams(const QString &query)
 
     return params;
 }
-QByteArray HttpServer::createJsonResponse(const QJsonObject &json)
+HttpResponse HttpServer::createJsonResponse(const QJsonObject &json, int code)
 {
-    QJsonDocument doc(json);
-    QByteArray jsonData = doc.toJson();
-
-    QByteArray response;
-    response.append("HTTP/1.1 200 OK\r\n");
-    response.append("Content-Type: application/json\r\n");
-    response.append("Content-Length: " + QByteArray::number(jsonData.size()) + "\r\n");
-    response.append("Connection: close\r\n");
-    response.append("\r\n");
-    response.append(jsonData);
+    if (code >= 400)
+        Metrics::global().errorResponse(code);
 
-    return response;
+    // Тело не склеивается с заголовками - уходит в сокет как есть
+    QJsonDocument doc(json);
+    return HttpResponse(code, "application/json", doc.toJson());
 }
 
-QByteArray HttpServer::createErrorResponse(int code, const QString &message)
+HttpResponse HttpServer::createErrorResponse(int code, const QString &message)
 {
+    Metrics::global().errorResponse(code);
+
     QJsonObject json;
     json["status"] = "error";
     json["code"] = code;
     json["message"] = message;
 
+    // Строка статуса берется из готовой таблицы HttpResponse::statusLine
     QJsonDocument doc(json);
-    QByteArray jsonData = doc.toJson();
-
-    QString statusLine;
-    switch (code) {
-        case 400: statusLine = "HTTP/1.1 400 Bad Request"; break;
-        case 401: statusLine = "HTTP/1.1 401 Unauthorized"; break;
-        case 403: statusLine = "HTTP/1.1 403 Forbidden"; break;
-        case 404: statusLine = "HTTP/1.1 404 Not Found"; break;
-        case 500: statusLine = "HTTP/1.1 500 Internal Server Error"; break;
-        default: statusLine = "HTTP/1.1 " + QString::number(code) + " Error"; break;
-    }
-
-    QByteArray response;
-    response.append(statusLine.toUtf8() + "\r\n");
-    response.append("Content-Type: application/json\r\n");
-    response.append("Content-Length: " + QByteArray::number(jsonData.size()) + "\r\n");
-    response.append("Connection: close\r\n");
-    response.append("\r\n");
-    response.append(jsonData);
+    return HttpResponse(code, "application/json", doc.toJson());
+}
+void HttpServer::tableChanged(const QString &table)
+{
+    // Пустое имя - изменилось неизвестно что (после переподключения LISTEN)
+    m_dbCache->invalidate(table);
 
-    return response;
+    // Пароли могли поменяться - и успешные, и неудачные проверки больше не верны
+    if (table.isEmpty() || table == "users")
+        m_authCache->invalidateAll();
 }
-bool HttpServer::checkAuthentication(const QMap<QString, QString> &headers)
+
+bool HttpServer::checkAuthentication(const HttpHeaders &headers)
 {
-    QString authHeader = headers.value("authorization");
+    QByteArray authHeader = headers.valueView(HttpHeaders::Authorization);
     if (!authHeader.startsWith("Basic ")) {
         qDebug() << "Invalid auth header format";
         return false;
     }
 
-    QByteArray authData = QByteArray::fromBase64(authHeader.mid(6).toUtf8());
+    // Повторная проверка того же заголовка - поиск в хеше, без разбора и без БД
+    QByteArray cacheKey = m_authCache->key(authHeader);
+    AuthCache::Result cached = m_authCache->lookup(cacheKey);
+    if (cached != AuthCache::Result::Miss)
+        return cached == AuthCache::Result::Allowed;
+
+    QByteArray authData = QByteArray::fromBase64(authHeader.mid(6));
     QString authStr = QString::fromUtf8(authData);
     QStringList parts = authStr.split(':');
 
@@ -658,63 +1872,57 @@ bool HttpServer::checkAuthentication(const QMap<QString, QString> &headers)
     QString username = parts[0];
     QString password = parts[1];
 
-    // Проверка учетных данных
-    if (!m_dbConnection) {
-        qWarning() << "Database connection not available for auth";
-        return false;
+    bool authenticated = verifyCredentials(cacheKey, username, password);
+    if (!authenticated) {
+        qDebug() << "Authentication failed for user:" << username;
     }
+    return authenticated;
+}
 
-    try {
-        pqxx::work txn(*m_dbConnection);
-        std::string query = "SELECT password FROM users WHERE username = " +
-                          txn.quote(username.toStdString());
-
-        pqxx::result res = txn.exec(query);
-
-        if (res.empty()) {
-            qDebug() << "User not found:" << username;
-            return false;
-        }
-
-        std::string dbPassword = res[0][0].as<std::string>();
-        bool authenticated = (password == QString::fromStdString(dbPassword));
-
-        if (!authenticated) {
-            qDebug() << "Invalid password for user:" << username;
-        }
+bool HttpServer::validateCredentials(const QString &username, const QString &password)
+{
+    QByteArray cacheKey = m_authCache->key(username, password);
+    AuthCache::Result cached = m_authCache->lookup(cacheKey);
+    if (cached != AuthCache::Result::Miss)
+        return cached == AuthCache::Result::Allowed;
 
-        return authenticated;
+    return verifyCredentials(cacheKey, username, password);
+}
 
-    } catch (const std::exception &e) {
-        qWarning() << "Auth error:" << e.what();
+bool HttpServer::verifyCredentials(const QByteArray &cacheKey, const QString &username, const QString &password)
+{
+    if (m_authCache->isThrottled(username)) {
+        qDebug() << "Too many failed logins for user:" << username;
         return false;
     }
-}
 
-bool HttpServer::validateCredentials(const QString &username, const QString &password)
-{
-    if (!m_dbConnection) {
-        qWarning() << "Database not connected for auth validation";
+    // Поколение до запроса: если users поменяют, пока ждем БД, результат не кешируем
+    quint64 generation = m_authCache->generation();
+
+    DbConnectionPool::Lease conn;
+    if (m_dbPool) conn = m_dbPool->acquire();
+    if (!conn) {
+        qWarning() << "Database connection not available for auth";
         return false;
     }
 
     try {
-        pqxx::work txn(*m_dbConnection);
-        std::string query = "SELECT password FROM users WHERE username = " +
-                          txn.quote(username.toStdString());
+        std::string statement = conn.statements().prepare(*conn, "auth|users", []() {
+            return std::string("SELECT password FROM users WHERE username = $1");
+        });
 
-        pqxx::result res = txn.exec(query);
+        pqxx::work txn(*conn);
+        pqxx::result res = txn.exec_prepared(statement, username.toStdString());
 
-        if (res.empty()) {
-            return false; // Пользователь не найден
-        }
+        bool authenticated = !res.empty()
+            && password == QString::fromStdString(res[0][0].as<std::string>());
 
-        std::string dbPassword = res[0][0].as<std::string>();
-        return (password == QString::fromStdString(dbPassword));
+        // Ошибки БД выше не кешируются - только ответ "есть/нет такой пары"
+        m_authCache->insert(cacheKey, username, authenticated, generation);
+        return authenticated;
 
     } catch (const std::exception &e) {
-        qWarning() << "Auth validation error:" << e.what();
+        qWarning() << "Auth error:" << e.what();
         return false;
     }
 }
-
@@ -4,13 +4,39 @@
 #include <QTcpServer>
 #include <QObject>
 #include <QTcpServer>
+#include <QJsonObject>
 #include <QMap>
 #include <QString>
 #include <QProcess>
 #include <QSettings>
+#include <QVector>
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <pqxx/pqxx>
+#include "authcache.h"
+#include "dbbulkinsert.h"
+#include "dbconnectionpool.h"
+#include "dbencoder.h"
+#include "dbresponsecache.h"
+#include "http2session.h"
+#include "httpcompression.h"
+#include "httpheaders.h"
+#include "httpresponse.h"
+#include "httpresponder.h"
+#include "httprouter.h"
+#include "ratelimiter.h"
+#include "tlstransport.h"
 
+class DbChangeListener;
+class FastCgiClient;
 class HttpConnection;
+class HttpWorker;
+class PhpCgiRunner;
+class PhpCgiSupervisor;
+class StaticFileCache;
 
 class HttpServer : public QTcpServer
 {
@@ -28,40 +54,190 @@ public:
     void setPhpCgiPath(const QString &path);
     void configureDatabase(const QString &connStr);
 
+    int keepAliveTimeout() const { return m_keepAliveTimeout; }
+    int requestTimeout() const { return m_requestTimeout; }
+    int maxKeepAliveRequests() const { return m_maxKeepAliveRequests; }
+    qint64 maxBodySize() const { return m_maxBodySize; }
+    int workerCount() const { return m_workerCount; }
+    const CompressionSettings &compression() const { return m_compression; }
+    DbConnectionPool::Stats dbPoolStats() const;
+    // Ответ для /metrics в текстовом формате Prometheus
+    HttpResponse metricsResponse() const;
+
+    // Маршрут с обработчиком на C++ (шаблоны - см. HttpRouter). Регистрировать
+    // до startServer(); точные маршруты важнее встроенных /api/*.
+    // false - шаблон некорректен или уже занят
+    bool addRoute(const QByteArray &method, const QByteArray &pattern, RouteHandler handler,
+                  HttpRouter::Execution execution = HttpRouter::Execution::Inline,
+                  Metrics::Route metricsRoute = Metrics::RouteApi);
+    // Basic-аутентификация как для /api/ (true, если auth выключен).
+    // Может сходить в БД - только из Blocking-обработчиков
+    bool isAuthorized(const HttpHeaders &headers);
+
     // API
-    QByteArray handleDbSelect(const QString &table, const QMap<QString, QString> &params);
-    QByteArray handleDbInsert(const QString &table, const QMap<QString, QString> &params);
-    QByteArray handleDbUpdate(const QString &table, const QMap<QString, QString> &params);
-    QByteArray handleDbDelete(const QString &table, const QMap<QString, QString> &params);
+    HttpResponse handleDbSelect(const QString &table, const QMap<QString, QString> &params,
+                                DbEncoder::Format format = DbEncoder::Format::Json,
+                                DbEncoder::Layout layout = DbEncoder::Layout::Rows);
+    HttpResponse handleDbInsert(const QString &table, const QMap<QString, QString> &params);
+    // Массовая вставка тела (JSON-массив, NDJSON, CSV) одной транзакцией.
+    // atomic - при ошибке любой пачки откатить все
+    HttpResponse handleDbBulkInsert(const QString &table, DbBulkInsert::Format format,
+                                    const QByteArray &body, bool atomic);
+    HttpResponse handleDbUpdate(const QString &table, const QMap<QString, QString> &params);
+    HttpResponse handleDbDelete(const QString &table, const QMap<QString, QString> &params);
+
+    // Разбор параметров и сборка ответов (без состояния сервера)
+    static QMap<QString, QString> parseQueryParams(const QString &query);
+    static QMap<QString, QString> parseFormUrlEncoded(const QByteArray &data);
+    static HttpResponse createJsonResponse(const QJsonObject &json, int code = 200);
+    static HttpResponse createErrorResponse(int code, const QString &message);
+    // Вывод php-cgi (CGI-заголовки, пустая строка на headerEnd, тело) -> HTTP-ответ
+    static HttpResponse cgiToHttpResponse(const QByteArray &cgiOutput, int headerEnd);
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 
 private:
+    friend class Http2Session;
+    friend class HttpConnection;
+    friend class HttpWorker;
+
     QSettings *m_settings;
     QString m_documentRoot;
     QString m_phpCgiPath;
     bool m_authEnabled;
+    std::unique_ptr<AuthCache> m_authCache; // проверенные Authorization, чтобы не ходить в БД
+
+    // PHP через FastCGI (php/mode=fastcgi), иначе php-cgi на каждый запрос
+    bool m_phpFastCgi;
+    QString m_fastCgiAddress;
+    int m_fastCgiMaxConnections;        // на поток воркера
+    int m_fastCgiRequestsPerConnection; // >1 - мультиплексирование
+    int m_phpTimeoutMs;
+    int m_phpMaxProcesses;              // php/mode=cgi: одновременных php-cgi
+    int m_phpQueueSize;                 // ждущих свободного процесса, дальше - 503
+    int m_phpRetryAfter;                // Retry-After в секундах для отказов
+    PhpCgiSupervisor *m_phpSupervisor;  // свои php-cgi -b, если не внешний php-fpm
+    PhpCgiRunner *m_phpRunner;          // php-cgi на запрос, создается в startServer()
+    QThreadStorage<FastCgiClient *> m_fastCgiClients;
+    FastCgiClient *fastCgiClient();
+
+    // Защита от перегрузки ([limits])
+    int m_maxConnections;               // 0 - без ограничения
+    int m_resumeConnections;            // ниже - снова принимаем соединения
+    int m_queueDeadlineMs;              // дольше ждал в пуле БД - 503 без выполнения
+    int m_retryAfter;                   // Retry-After в секундах для 503
+    std::atomic<int> m_openConnections;
+    std::atomic<bool> m_acceptPaused;   // меняется только в потоке сервера
+    std::atomic<bool> m_acceptCheckQueued;
+    std::atomic<quint64> m_acceptPauses;
+    std::atomic<quint64> m_shedRequests;
+    std::unique_ptr<RateLimiter> m_rateLimiter;
+    // Соединение принято своим accept воркера / закрыто (из любого потока)
+    void connectionOpened();
+    void connectionClosed();
+    void queueAcceptCheck();
+    // Приостановить или возобновить accept по числу соединений; только в потоке сервера
+    void updateAccepting();
+    void setAccepting(bool accepting);
+    // Лимит частоты клиента; false - ответ 429 уже отправлен
+    bool admitRequest(quint64 clientKey, const HttpResponderPtr &responder);
+
+    // Keep-alive
+    int m_keepAliveTimeout;      // секунды простоя до закрытия соединения
+    int m_requestTimeout;        // секунды от первого байта запроса до его конца
+    int m_maxKeepAliveRequests;  // запросов на одно соединение
+    qint64 m_maxBodySize;
+
+    // Рабочие потоки
+    int m_workerCount;
+    QVector<HttpWorker *> m_workers;
+    // server/io_engine=epoll: воркеры сами слушают порт и ведут сокеты через epoll
+    bool m_nativeIo;
+    bool m_nativeListening;
+
+    // HTTPS ([tls]): свой порт рядом с HTTP, сокеты раздаются тем же воркерам
+    int m_tlsPort;                      // 0 - без HTTPS
+    TlsContext::Settings m_tlsSettings;
+    std::unique_ptr<TlsContext> m_tlsContext; // создается в startServer()
+    TlsListener *m_tlsListener;
+    // Отдать принятый сокет наименее загруженному воркеру; tls - HTTPS
+    void dispatchConnection(qintptr socketDescriptor, TlsContext *tls);
+
+    // HTTP/2 ([http2]): h2c и h2 через ALPN на порту HTTPS
+    Http2Settings m_http2Settings;
+    std::atomic<quint64> m_http2Connections;
+    std::atomic<quint64> m_http2Streams;
+
+    // Статика
+    StaticFileCache *m_staticCache;
+    qint64 m_streamThreshold;    // файлы больше отдаются потоком через sendfile
+
+    // Сжатие ответов
+    CompressionSettings m_compression;
+
+    // Метрики
+    bool m_metricsEnabled;
+    QString m_metricsPath;
 
     // БД
     QString m_dbConnectionStr;
-    std::unique_ptr<pqxx::connection> m_dbConnection;
+    std::unique_ptr<DbConnectionPool> m_dbPool;
+    QThreadPool m_dbExecutor;
+    void runDbTask(std::function<void()> task);
+
+    // Кеш ответов GET /api/db ([db_cache]); сбрасывается записью сервера и NOTIFY
+    std::unique_ptr<DbResponseCache> m_dbCache;
+    bool m_dbCacheBypass;         // клиент может обойти кеш: _cache=0 или Cache-Control: no-cache
+    QString m_dbNotifyChannel;    // пустой - LISTEN не нужен
+    DbChangeListener *m_changeListener;
+    bool bypassesDbCache(const QMap<QString, QString> &params, const HttpHeaders &headers) const;
+    void serveCachedSelect(const QString &table, const QMap<QString, QString> &params,
+                           DbEncoder::Format format, DbEncoder::Layout layout,
+                           const HttpResponderPtr &responder);
+
+    // Массовая вставка: строк в пачке и COPY (иначе многострочные INSERT)
+    int m_bulkBatchRows;
+    bool m_bulkUseCopy;
+
+    // Постраничный GET /api/db: строк на странице по умолчанию (0 - без страниц) и максимум для _limit
+    int m_pageSize;
+    int m_maxPageSize;
+
+    // Потоковая выдача SELECT по курсору (_stream=1 или database/stream_select)
+    bool m_streamSelect;
+    int m_streamBatchRows;        // строк на один FETCH
+    qint64 m_streamWindowBytes;   // сколько тела может ждать отправки клиенту
+    int m_streamWriteTimeoutMs;   // сколько ждем медленного клиента
+    bool wantsStreamedSelect(const QMap<QString, QString> &params) const;
+    void streamDbSelect(const QString &table, const QMap<QString, QString> &params,
+                        DbEncoder::Format format, const HttpResponderPtr &responder);
+
+    // Маршруты: встроенные регистрируются в конструкторе, дерево собирается в startServer()
+    HttpRouter m_router;
+    void registerBuiltinRoutes();
 
     // Обработчики
-    QByteArray processRequest(const QString &method, const QString &path, const QMap<QString, QString> &headers, const QByteArray &body);
-    QByteArray serveStaticFile(const QString &filePath);
-    QByteArray executePhpScript(const QString &scriptPath, const QMap<QString, QString> &params, const QByteArray &postData);
-    QByteArray serveApi(const QString &apiPath, const QString &method,
-                       const QMap<QString, QString> &params,
-                       const QJsonObject &jsonBody);
+    void processRequest(const HttpRequest &request, const HttpResponderPtr &responder);
+    void serveDocumentRoot(const QString &method, const QString &path, const HttpHeaders &headers,
+                           const QByteArray &body, const HttpResponderPtr &responder);
+    void handleApiDb(const HttpRequest &request, const RouteParams &route, const HttpResponderPtr &responder);
+    void handleApiFallback(const HttpRequest &request, const RouteParams &route, const HttpResponderPtr &responder);
+    bool readApiRequest(const HttpRequest &request, QMap<QString, QString> &params, QJsonObject &jsonBody,
+                        const HttpResponderPtr &responder);
+    void serveStaticFile(const QString &filePath, const HttpHeaders &headers,
+                         const HttpResponderPtr &responder);
+    static QByteArray mimeTypeForSuffix(const QString &suffix);
+    QMap<QString, QString> cgiEnvironment(const QString &scriptPath, const QMap<QString, QString> &params,
+                                          const QByteArray &postData) const;
+    HttpResponse serveDbApi(const QString &method, const QString &table, const QString &identifier,
+                            const QMap<QString, QString> &params, const QJsonObject &jsonBody);
 
     // Вспомогательные методы
-    QMap<QString, QString> parseQueryParams(const QString &query);
-    QMap<QString, QString> parseFormUrlEncoded(const QByteArray &data);
-    QByteArray createJsonResponse(const QJsonObject &json);
     QString jsonToString(const QJsonObject &jsonBody);
-    QByteArray createErrorResponse(int code, const QString &message);
-    bool checkAuthentication(const QMap<QString, QString> &headers);;
+    bool checkAuthentication(const HttpHeaders &headers);
     bool validateCredentials(const QString &username, const QString &password);
+    bool verifyCredentials(const QByteArray &cacheKey, const QString &username, const QString &password);
+    void tableChanged(const QString &table);
     QByteArray createUnauthorizedResponse();
 };
 
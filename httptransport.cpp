@@ -0,0 +1,121 @@
+#include "httptransport.h"
+#include "metrics.h"
+#include <QDebug>
+#include <QTcpSocket>
+
+#ifdef Q_OS_LINUX
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+
+// Частей на один writev; HTTP/2 передает пачку кадров - она уходит за несколько вызовов
+static const int MaxWriteParts = 16;
+
+QtSocketTransport::QtSocketTransport(qintptr socketDescriptor) :
+    m_socket(new QTcpSocket),
+    m_open(false)
+{
+    if (!m_socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning() << "Failed to set socket descriptor:" << m_socket->errorString();
+        return;
+    }
+    m_open = true;
+
+    QObject::connect(m_socket, &QTcpSocket::readyRead, m_socket, [this]() {
+        if (m_handler) m_handler->transportReadyRead();
+    });
+    QObject::connect(m_socket, &QTcpSocket::bytesWritten, m_socket, [this](qint64 bytes) {
+        if (m_handler) m_handler->transportBytesWritten(bytes);
+    });
+    QObject::connect(m_socket, &QTcpSocket::disconnected, m_socket, [this]() {
+        if (m_handler) m_handler->transportClosed();
+    });
+}
+
+QtSocketTransport::~QtSocketTransport()
+{
+    // abort() в деструкторе сокета прислал бы disconnected уже удаляемому обработчику
+    m_socket->disconnect();
+    delete m_socket;
+}
+
+qintptr QtSocketTransport::socketDescriptor() const
+{
+    return m_socket->socketDescriptor();
+}
+
+QHostAddress QtSocketTransport::peerAddress() const
+{
+    return m_socket->peerAddress();
+}
+
+QByteArray QtSocketTransport::readAll()
+{
+    return m_socket->readAll();
+}
+
+void QtSocketTransport::write(const HttpBody *parts, int count)
+{
+    qint64 written = 0;
+
+#ifdef Q_OS_LINUX
+    // Части пачками по MaxWriteParts, без склейки в общий буфер.
+    // Мимо буфера QTcpSocket писать можно, только когда он пуст
+    if (m_socket->bytesToWrite() == 0) {
+        int next = 0;
+        while (next < count) {
+            iovec iov[MaxWriteParts];
+            int iovCount = 0;
+            qint64 batchSize = 0;
+            for (; next < count && iovCount < MaxWriteParts; ++next) {
+                if (parts[next].isEmpty()) continue;
+                iov[iovCount].iov_base = const_cast<char *>(parts[next].constData());
+                iov[iovCount].iov_len = size_t(parts[next].size());
+                batchSize += parts[next].size();
+                ++iovCount;
+            }
+            if (iovCount == 0)
+                break;
+
+            ssize_t result;
+            do {
+                result = ::writev(int(m_socket->socketDescriptor()), iov, iovCount);
+            } while (result < 0 && errno == EINTR);
+            // EAGAIN и ошибки - остаток уйдет через QTcpSocket, он же сообщит об обрыве
+            if (result <= 0)
+                break;
+            written += result;
+            Metrics::global().bytesSent(result);
+            // Ядро взяло не все - следующую пачку писать нельзя, порядок сохранит буфер сокета
+            if (result < batchSize)
+                break;
+        }
+    }
+#endif
+
+    // Что не ушло сразу - в буфер сокета, Qt допишет по готовности
+    for (int i = 0; i < count; ++i) {
+        if (written >= parts[i].size()) {
+            written -= parts[i].size();
+            continue;
+        }
+        m_socket->write(parts[i].constData() + written, parts[i].size() - written);
+        written = 0;
+    }
+}
+
+qint64 QtSocketTransport::bytesToWrite() const
+{
+    return m_socket->bytesToWrite();
+}
+
+void QtSocketTransport::disconnectFromHost()
+{
+    // disconnectFromHost дождется отправки буфера записи
+    m_socket->disconnectFromHost();
+}
+
+void QtSocketTransport::abort()
+{
+    m_socket->abort();
+}
@@ -0,0 +1,89 @@
+#ifndef HTTPTRANSPORT_H
+#define HTTPTRANSPORT_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include "httpresponse.h"
+
+class QTcpSocket;
+
+// Сокет клиента под HttpConnection: чтение, буферизованная запись и
+// события готовности. Реализации - QtSocketTransport (QTcpSocket,
+// переносимо) и EpollTransport (свой цикл epoll воркера, только Linux).
+//
+// Все вызовы - в потоке соединения. События приходят обработчику
+// прямыми вызовами; transportClosed может прийти и изнутри
+// disconnectFromHost/abort, как disconnected у QTcpSocket.
+class HttpTransport
+{
+public:
+    class Handler
+    {
+    public:
+        virtual ~Handler() {}
+        virtual void transportReadyRead() = 0;
+        // Сколько байт из буфера записи ушло в сокет. Байты, отправленные
+        // сразу из write(), сюда не попадают - они уже учтены в метриках
+        virtual void transportBytesWritten(qint64 bytes) = 0;
+        virtual void transportClosed() = 0;
+    };
+
+    virtual ~HttpTransport() {}
+
+    void setHandler(Handler *handler) { m_handler = handler; }
+
+    virtual bool isOpen() const = 0;
+    // Дескриптор для sendfile и записи мимо буфера (только при bytesToWrite() == 0)
+    virtual qintptr socketDescriptor() const = 0;
+    // Можно ли писать в дескриптор мимо транспорта (sendfile). У TLS - только с kTLS
+    virtual bool allowsDirectWrite() const { return true; }
+    // TLS: h2c Upgrade на таком соединении не делается
+    virtual bool isEncrypted() const { return false; }
+    virtual QHostAddress peerAddress() const = 0;
+
+    // Все прочитанное. Данные могут ссылаться на буфер чтения транспорта -
+    // годятся до возврата в цикл событий, хранить - только копией (append)
+    virtual QByteArray readAll() = 0;
+
+    // Записать части по порядку, не склеивая. Что не ушло сразу, ждет
+    // в буфере записи и дописывается по готовности сокета
+    virtual void write(const HttpBody *parts, int count) = 0;
+    void write(const QByteArray &data)
+    {
+        HttpBody body(data);
+        write(&body, 1);
+    }
+    virtual qint64 bytesToWrite() const = 0;
+
+    // Закрыть после отправки буфера записи
+    virtual void disconnectFromHost() = 0;
+    // Закрыть сразу, буфер записи теряется
+    virtual void abort() = 0;
+
+protected:
+    Handler *m_handler = nullptr;
+};
+
+// Транспорт на QTcpSocket
+class QtSocketTransport : public HttpTransport
+{
+public:
+    explicit QtSocketTransport(qintptr socketDescriptor);
+    ~QtSocketTransport();
+
+    bool isOpen() const override { return m_open; }
+    qintptr socketDescriptor() const override;
+    QHostAddress peerAddress() const override;
+    QByteArray readAll() override;
+    void write(const HttpBody *parts, int count) override;
+    using HttpTransport::write;
+    qint64 bytesToWrite() const override;
+    void disconnectFromHost() override;
+    void abort() override;
+
+private:
+    QTcpSocket *m_socket;
+    bool m_open;
+};
+
+#endif // HTTPTRANSPORT_H
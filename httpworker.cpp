@@ -0,0 +1,110 @@
+#include "httpworker.h"
+#include "epollengine.h"
+#include "httpconnection.h"
+#include "httpserver.h"
+#include "tlstransport.h"
+#include <QDebug>
+
+HttpWorker::HttpWorker(HttpServer *server, int index) :
+    m_server(server),
+    m_index(index),
+    m_engine(nullptr),
+    m_activeConnections(0)
+{
+    m_thread.setObjectName(QString("http-worker-%1").arg(index));
+    moveToThread(&m_thread);
+}
+
+HttpWorker::~HttpWorker()
+{
+    stop();
+}
+
+void HttpWorker::start()
+{
+    m_thread.start();
+}
+
+void HttpWorker::stop()
+{
+    if (!m_thread.isRunning()) return;
+
+    // Соединения - дочерние объекты воркера, закрываем их в его же потоке
+    QMetaObject::invokeMethod(this, [this]() {
+        qDeleteAll(findChildren<HttpConnection *>(QString(), Qt::FindDirectChildrenOnly));
+#ifdef Q_OS_LINUX
+        // Транспорты соединений уже закрыты - теперь можно и сам epoll
+        delete m_engine;
+        m_engine = nullptr;
+#endif
+        moveToThread(m_thread.thread());
+    }, Qt::BlockingQueuedConnection);
+
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void HttpWorker::addConnection(qintptr socketDescriptor, TlsContext *tls)
+{
+    m_activeConnections.ref();
+    QMetaObject::invokeMethod(this, [this, socketDescriptor, tls]() {
+        createConnection(socketDescriptor, tls);
+    }, Qt::QueuedConnection);
+}
+
+bool HttpWorker::listenNative(quint16 port)
+{
+#ifdef Q_OS_LINUX
+    bool listening = false;
+    // Уведомитель epoll должен жить в потоке воркера
+    QMetaObject::invokeMethod(this, [this, port, &listening]() {
+        m_engine = new EpollEngine([this](int socketDescriptor, const QHostAddress &peer) {
+            m_activeConnections.ref();
+            m_server->connectionOpened();
+            adoptConnection(new EpollTransport(m_engine, socketDescriptor, peer));
+        }, this);
+        listening = m_engine->listen(port);
+        if (!listening) {
+            delete m_engine;
+            m_engine = nullptr;
+        }
+    }, Qt::BlockingQueuedConnection);
+    return listening;
+#else
+    Q_UNUSED(port);
+    return false;
+#endif
+}
+
+void HttpWorker::setAccepting(bool accepting)
+{
+#ifdef Q_OS_LINUX
+    if (m_engine)
+        m_engine->setAccepting(accepting);
+#else
+    Q_UNUSED(accepting);
+#endif
+}
+
+void HttpWorker::createConnection(qintptr socketDescriptor, TlsContext *tls)
+{
+    if (tls)
+        adoptConnection(new TlsTransport(tls, socketDescriptor));
+    else
+        adoptConnection(new QtSocketTransport(socketDescriptor));
+}
+
+void HttpWorker::adoptConnection(HttpTransport *transport)
+{
+    HttpConnection *connection = new HttpConnection(m_server, transport, this);
+    if (!connection->isValid()) {
+        delete connection;
+        m_activeConnections.deref();
+        m_server->connectionClosed();
+        return;
+    }
+    connect(connection, &QObject::destroyed, this, [this]() {
+        m_activeConnections.deref();
+        m_server->connectionClosed();
+    });
+}
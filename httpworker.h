@@ -0,0 +1,49 @@
+#ifndef HTTPWORKER_H
+#define HTTPWORKER_H
+
+#include <QObject>
+#include <QThread>
+#include <QAtomicInt>
+
+class EpollEngine;
+class HttpServer;
+class HttpTransport;
+class TlsContext;
+
+// Рабочий поток со своим event loop. Владеет принятыми сокетами:
+// соединение живет и обрабатывается целиком в потоке воркера.
+class HttpWorker : public QObject
+{
+    Q_OBJECT
+public:
+    HttpWorker(HttpServer *server, int index);
+    ~HttpWorker();
+
+    void start();
+    void stop();
+
+    int index() const { return m_index; }
+    int activeConnections() const { return m_activeConnections.loadAcquire(); }
+
+    // Можно вызывать из любого потока - сокет будет создан в потоке воркера.
+    // С tls - HTTPS-соединение, рукопожатие тоже в потоке воркера
+    void addConnection(qintptr socketDescriptor, TlsContext *tls = nullptr);
+
+    // server/io_engine=epoll: свой listener и цикл epoll вместо подключений
+    // от QTcpServer. Вызывать после start(); false - не удалось (или не Linux)
+    bool listenNative(quint16 port);
+    // Приостановить/возобновить accept своего listener'а; из любого потока
+    void setAccepting(bool accepting);
+
+private:
+    void createConnection(qintptr socketDescriptor, TlsContext *tls);
+    void adoptConnection(HttpTransport *transport);
+
+    HttpServer *m_server;
+    int m_index;
+    EpollEngine *m_engine;      // только при io_engine=epoll
+    QThread m_thread;
+    QAtomicInt m_activeConnections;
+};
+
+#endif // HTTPWORKER_H
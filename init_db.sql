@@ -17,6 +17,19 @@ CREATE TABLE users (
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
 );
 
+-- Уведомление об изменении таблицы для кеша ответов сервера (db_cache/notify_channel).
+-- Нужно для правок в обход сервера; свои записи сервер учитывает сам
+CREATE OR REPLACE FUNCTION notify_table_changed() RETURNS trigger AS $$
+BEGIN
+    PERFORM pg_notify('table_changed', TG_TABLE_NAME);
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER users_changed
+    AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON users
+    FOR EACH STATEMENT EXECUTE FUNCTION notify_table_changed();
+
 -- Тестовые данные
 INSERT INTO users (username, password, email) VALUES
 ('admin', 'admin123', 'admin@example.com'),
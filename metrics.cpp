@@ -0,0 +1,157 @@
+#include "metrics.h"
+
+// Границы корзин, мкс: от 0.25 мс до 10 с
+const qint64 LatencyHistogram::s_boundsUs[LatencyHistogram::BucketCount] = {
+    250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 7500000, 10000000
+};
+
+LatencyHistogram::LatencyHistogram() :
+    m_count(0),
+    m_sumUs(0)
+{
+    for (std::atomic<quint64> &bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(qint64 microseconds)
+{
+    if (microseconds < 0) microseconds = 0;
+    int bucket = 0;
+    while (bucket < BucketCount && microseconds > s_boundsUs[bucket])
+        ++bucket;
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumUs.fetch_add(quint64(microseconds), std::memory_order_relaxed);
+}
+
+void LatencyHistogram::write(QByteArray &out, const char *name, const QByteArray &labels) const
+{
+    const QByteArray prefix = labels.isEmpty() ? QByteArray() : labels + ",";
+    quint64 cumulative = 0;
+    for (int i = 0; i <= BucketCount; ++i) {
+        cumulative += m_buckets[i].load(std::memory_order_relaxed);
+        QByteArray le = i < BucketCount ? QByteArray::number(double(s_boundsUs[i]) / 1e6) : QByteArray("+Inf");
+        out += name + QByteArray("_bucket{") + prefix + "le=\"" + le + "\"} " + QByteArray::number(cumulative) + "\n";
+    }
+    QByteArray braces = labels.isEmpty() ? QByteArray() : "{" + labels + "}";
+    out += name + QByteArray("_sum") + braces + " "
+        + QByteArray::number(double(m_sumUs.load(std::memory_order_relaxed)) / 1e6, 'f', 6) + "\n";
+    out += name + QByteArray("_count") + braces + " "
+        + QByteArray::number(m_count.load(std::memory_order_relaxed)) + "\n";
+}
+
+Metrics::Metrics() :
+    m_bytesSent(0),
+    m_activeConnections(0)
+{
+    for (RouteMetrics &route : m_routes) {
+        for (std::atomic<quint64> &counter : route.responses)
+            counter.store(0, std::memory_order_relaxed);
+    }
+    for (std::atomic<quint64> &counter : m_errors)
+        counter.store(0, std::memory_order_relaxed);
+}
+
+Metrics &Metrics::global()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+void Metrics::requestFinished(Route route, int status, qint64 microseconds)
+{
+    RouteMetrics &metrics = m_routes[route];
+    metrics.latency.record(microseconds);
+    if (status > 0 && status < MaxStatus)
+        metrics.responses[status].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::errorResponse(int status)
+{
+    if (status > 0 && status < MaxStatus)
+        m_errors[status].fetch_add(1, std::memory_order_relaxed);
+}
+
+const char *Metrics::routeName(Route route)
+{
+    switch (route) {
+    case RouteStatic: return "static";
+    case RoutePhp: return "php";
+    case RouteApiDb: return "api_db";
+    case RouteApi: return "api";
+    case RouteMetrics: return "metrics";
+    case RouteCount: break;
+    }
+    return "unknown";
+}
+
+int Metrics::statusFromResponse(const QByteArray &response)
+{
+    // "HTTP/1.1 200 ..." - код всегда с 9-го символа
+    if (response.size() < 12 || !response.startsWith("HTTP/")) return 0;
+    const char *code = response.constData() + 9;
+    if (code[0] < '1' || code[0] > '5' || code[1] < '0' || code[1] > '9' || code[2] < '0' || code[2] > '9')
+        return 0;
+    return (code[0] - '0') * 100 + (code[1] - '0') * 10 + (code[2] - '0');
+}
+
+QByteArray Metrics::exposition() const
+{
+    QByteArray out;
+    out.reserve(16 * 1024);
+
+    out += "# HELP http_requests_total Completed HTTP requests by route and status code.\n"
+           "# TYPE http_requests_total counter\n";
+    for (int route = 0; route < RouteCount; ++route) {
+        for (int status = 0; status < MaxStatus; ++status) {
+            quint64 count = m_routes[route].responses[status].load(std::memory_order_relaxed);
+            if (count == 0) continue;
+            out += QByteArray("http_requests_total{route=\"") + routeName(Route(route)) + "\",code=\""
+                + QByteArray::number(status) + "\"} " + QByteArray::number(count) + "\n";
+        }
+    }
+
+    out += "# HELP http_request_duration_seconds Time from parsed request to the last response byte queued.\n"
+           "# TYPE http_request_duration_seconds histogram\n";
+    for (int route = 0; route < RouteCount; ++route) {
+        m_routes[route].latency.write(out, "http_request_duration_seconds",
+                                      QByteArray("route=\"") + routeName(Route(route)) + "\"");
+    }
+
+    out += "# HELP http_error_responses_total Error responses built by the server.\n"
+           "# TYPE http_error_responses_total counter\n";
+    for (int status = 0; status < MaxStatus; ++status) {
+        quint64 count = m_errors[status].load(std::memory_order_relaxed);
+        if (count == 0) continue;
+        out += "http_error_responses_total{code=\"" + QByteArray::number(status) + "\"} "
+            + QByteArray::number(count) + "\n";
+    }
+
+    out += "# HELP http_response_bytes_total Bytes written to client sockets.\n"
+           "# TYPE http_response_bytes_total counter\n"
+           "http_response_bytes_total " + QByteArray::number(m_bytesSent.load(std::memory_order_relaxed)) + "\n";
+    out += "# HELP http_active_connections Open client connections.\n"
+           "# TYPE http_active_connections gauge\n"
+           "http_active_connections " + QByteArray::number(m_activeConnections.load(std::memory_order_relaxed)) + "\n";
+
+    static const char *const dbOperations[DbOperationCount] = {
+        "select", "select_stream", "insert", "update", "delete"
+    };
+    out += "# HELP db_query_duration_seconds Time spent in /api/db handlers, including pool wait.\n"
+           "# TYPE db_query_duration_seconds histogram\n";
+    for (int operation = 0; operation < DbOperationCount; ++operation) {
+        m_db[operation].write(out, "db_query_duration_seconds",
+                              QByteArray("operation=\"") + dbOperations[operation] + "\"");
+    }
+
+    out += "# HELP php_request_duration_seconds Time to execute a PHP script (CGI or FastCGI).\n"
+           "# TYPE php_request_duration_seconds histogram\n";
+    m_php.write(out, "php_request_duration_seconds", QByteArray());
+
+    out += "# HELP static_serve_duration_seconds Time to prepare a static file response (cache misses).\n"
+           "# TYPE static_serve_duration_seconds histogram\n";
+    m_static.write(out, "static_serve_duration_seconds", QByteArray());
+    return out;
+}
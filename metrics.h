@@ -0,0 +1,94 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <atomic>
+
+// Гистограмма задержек с фиксированными границами корзин.
+// Запись - несколько relaxed-атомиков, без блокировок и выделения памяти.
+class LatencyHistogram
+{
+public:
+    static const int BucketCount = 16;
+
+    LatencyHistogram();
+
+    void record(qint64 microseconds);
+
+    // Строки _bucket/_sum/_count в формате Prometheus; labels - "route=\"static\"" или пусто
+    void write(QByteArray &out, const char *name, const QByteArray &labels) const;
+
+private:
+    static const qint64 s_boundsUs[BucketCount];
+
+    std::atomic<quint64> m_buckets[BucketCount + 1]; // последняя - +Inf
+    std::atomic<quint64> m_count;
+    std::atomic<quint64> m_sumUs;
+};
+
+// Счетчики сервера для /metrics. Один экземпляр на процесс: считать
+// нужно и в статических помощниках (createErrorResponse), и в потоках
+// воркеров и пула БД. Все записи - атомики без блокировок.
+class Metrics
+{
+public:
+    enum Route { RouteStatic, RoutePhp, RouteApiDb, RouteApi, RouteMetrics, RouteCount };
+    enum DbOperation { DbSelect, DbSelectStream, DbInsert, DbUpdate, DbDelete, DbOperationCount };
+
+    static Metrics &global();
+
+    // Ответ на запрос ушел целиком (или поток завершен)
+    void requestFinished(Route route, int status, qint64 microseconds);
+    void errorResponse(int status);
+    void bytesSent(qint64 bytes) { m_bytesSent.fetch_add(quint64(bytes), std::memory_order_relaxed); }
+    void connectionOpened() { m_activeConnections.fetch_add(1, std::memory_order_relaxed); }
+    void connectionClosed() { m_activeConnections.fetch_sub(1, std::memory_order_relaxed); }
+
+    LatencyHistogram &dbQuery(DbOperation operation) { return m_db[operation]; }
+    LatencyHistogram &php() { return m_php; }
+    LatencyHistogram &staticFile() { return m_static; }
+
+    // Текст в формате Prometheus 0.0.4 (без метрик, которые добавляет сервер)
+    QByteArray exposition() const;
+
+    static const char *routeName(Route route);
+    // Код из строки статуса "HTTP/1.1 200 OK", 0 - не разобрать
+    static int statusFromResponse(const QByteArray &response);
+
+    // Записывает время жизни в гистограмму
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(LatencyHistogram &histogram) : m_histogram(histogram) { m_timer.start(); }
+        ~ScopedTimer() { m_histogram.record(m_timer.nsecsElapsed() / 1000); }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        LatencyHistogram &m_histogram;
+        QElapsedTimer m_timer;
+    };
+
+private:
+    Metrics();
+
+    static const int MaxStatus = 600;
+
+    struct alignas(64) RouteMetrics
+    {
+        LatencyHistogram latency;
+        std::atomic<quint64> responses[MaxStatus];
+    };
+
+    RouteMetrics m_routes[RouteCount];
+    std::atomic<quint64> m_errors[MaxStatus];
+    LatencyHistogram m_db[DbOperationCount];
+    LatencyHistogram m_php;
+    LatencyHistogram m_static;
+    std::atomic<quint64> m_bytesSent;
+    std::atomic<qint64> m_activeConnections;
+};
+
+#endif // METRICS_H
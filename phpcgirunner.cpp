@@ -0,0 +1,207 @@
+#include "phpcgirunner.h"
+#include "httpserver.h"
+#include "metrics.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QTimer>
+#include <algorithm>
+
+struct PhpCgiRunner::Request
+{
+    QString scriptPath;
+    QMap<QString, QString> environment;
+    QByteArray stdinData;
+    HttpResponderPtr responder;
+    QProcess *process = nullptr;  // nullptr - еще в очереди
+    QTimer *timer = nullptr;
+    QElapsedTimer started;
+    bool answered = false;        // ответ ушел по таймауту, ждем только завершения процесса
+};
+
+PhpCgiRunner::PhpCgiRunner(const QString &phpCgiPath, int maxProcesses, int queueSize, int timeoutMs,
+                           int retryAfterSeconds, QObject *parent) :
+    QObject(parent),
+    m_phpCgiPath(phpCgiPath),
+    m_maxProcesses(qMax(1, maxProcesses)),
+    m_queueSize(qMax(0, queueSize)),
+    m_timeoutMs(timeoutMs),
+    m_retryAfterSeconds(qMax(1, retryAfterSeconds)),
+    m_baseEnvironment(QProcessEnvironment::systemEnvironment()),
+    m_admitted(0),
+    m_running(0),
+    m_rejected(0),
+    m_timedOut(0)
+{
+}
+
+PhpCgiRunner::~PhpCgiRunner()
+{
+    for (Request *request : m_queue) {
+        request->responder->send(HttpServer::createErrorResponse(503, "PHP runner stopped"));
+        delete request->timer;
+        delete request;
+    }
+    m_queue.clear();
+
+    // Вывод работающих скриптов уже никому не нужен
+    for (Request *request : m_active) {
+        request->process->disconnect(this);
+        request->process->kill();
+        request->process->waitForFinished(1000);
+        if (!request->answered)
+            request->responder->send(HttpServer::createErrorResponse(503, "PHP runner stopped"));
+        delete request->process;
+        delete request->timer;
+        delete request;
+    }
+    m_active.clear();
+}
+
+void PhpCgiRunner::execute(const QString &scriptPath, const QMap<QString, QString> &cgiEnvironment,
+                           const QByteArray &stdinData, const HttpResponderPtr &responder)
+{
+    // Нет места ни среди процессов, ни в очереди - отказ сразу, в потоке запроса
+    if (m_admitted.fetch_add(1, std::memory_order_relaxed) >= m_maxProcesses + m_queueSize) {
+        m_admitted.fetch_sub(1, std::memory_order_relaxed);
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        responder->send(busyResponse("Too many PHP requests"));
+        return;
+    }
+
+    Request *request = new Request;
+    request->scriptPath = scriptPath;
+    request->environment = cgiEnvironment;
+    request->stdinData = stdinData;
+    request->responder = responder;
+    request->started.start();
+
+    // Процессы создаются и слушаются в потоке runner'а
+    QMetaObject::invokeMethod(this, [this, request]() { enqueue(request); });
+}
+
+void PhpCgiRunner::enqueue(Request *request)
+{
+    if (m_timeoutMs > 0) {
+        request->timer = new QTimer(this);
+        request->timer->setSingleShot(true);
+        connect(request->timer, &QTimer::timeout, this, [this, request]() { onTimeout(request); });
+        request->timer->start(int(qMax<qint64>(0, m_timeoutMs - request->started.elapsed())));
+    }
+    m_queue.push_back(request);
+    startQueued();
+}
+
+void PhpCgiRunner::startQueued()
+{
+    while (!m_queue.empty() && m_running.load(std::memory_order_relaxed) < m_maxProcesses) {
+        Request *request = m_queue.front();
+        m_queue.pop_front();
+        start(request);
+    }
+}
+
+void PhpCgiRunner::start(Request *request)
+{
+    m_running.fetch_add(1, std::memory_order_relaxed);
+    m_active.append(request);
+
+    QProcess *process = new QProcess(this);
+    request->process = process;
+
+    QProcessEnvironment env = m_baseEnvironment;
+    for (auto it = request->environment.begin(); it != request->environment.end(); ++it)
+        env.insert(it.key(), it.value());
+    process->setProcessEnvironment(env);
+
+    connect(process, &QProcess::started, this, [process, request]() {
+        if (!request->stdinData.isEmpty())
+            process->write(request->stdinData);
+        process->closeWriteChannel();
+    });
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [this, request]() { onFinished(request); });
+    connect(process, &QProcess::errorOccurred, this, [this, request](QProcess::ProcessError error) {
+        // Не запустившийся процесс не присылает finished
+        if (error == QProcess::FailedToStart)
+            onFinished(request);
+    });
+
+    process->start(m_phpCgiPath, QStringList() << "-f" << request->scriptPath);
+}
+
+void PhpCgiRunner::onFinished(Request *request)
+{
+    QProcess *process = request->process;
+    if (request->answered) {
+        release(request);
+        return;
+    }
+
+    QByteArray stdOut = process->readAllStandardOutput();
+    QByteArray stdErr = process->readAllStandardError();
+    if (!stdErr.isEmpty()) {
+        qWarning() << "PHP CGI stderr:" << stdErr;
+    }
+
+    HttpResponse response;
+    int headerEnd = stdOut.indexOf("\r\n\r\n");
+    if (process->error() == QProcess::FailedToStart) {
+        qWarning() << "Failed to start PHP CGI process:" << m_phpCgiPath;
+        response = HttpServer::createErrorResponse(500, "Failed to start PHP CGI process");
+    } else if (process->exitStatus() != QProcess::NormalExit) {
+        qWarning() << "PHP CGI did not finish properly.";
+        response = HttpServer::createErrorResponse(500, "PHP CGI did not finish properly");
+    } else if (stdOut.isEmpty()) {
+        response = HttpServer::createErrorResponse(500, "Empty response from PHP CGI:\n" + stdErr);
+    } else if (headerEnd == -1) {
+        response = HttpServer::createErrorResponse(500, "Invalid response from PHP CGI:\n" + stdOut + "\n" + stdErr);
+    } else {
+        response = HttpServer::cgiToHttpResponse(stdOut, headerEnd);
+    }
+
+    request->responder->send(response);
+    Metrics::global().php().record(request->started.nsecsElapsed() / 1000);
+    release(request);
+}
+
+void PhpCgiRunner::onTimeout(Request *request)
+{
+    m_timedOut.fetch_add(1, std::memory_order_relaxed);
+    Metrics::global().php().record(request->started.nsecsElapsed() / 1000);
+
+    if (!request->process) {
+        // Так и не дождался свободного процесса
+        m_queue.erase(std::find(m_queue.begin(), m_queue.end(), request));
+        m_admitted.fetch_sub(1, std::memory_order_relaxed);
+        request->responder->send(busyResponse("PHP queue wait timed out"));
+        request->timer->deleteLater();
+        delete request;
+        return;
+    }
+
+    // Место процесса освободится, когда придет finished
+    qWarning() << "PHP CGI script timed out after" << m_timeoutMs << "ms, killing" << request->scriptPath;
+    request->responder->send(HttpServer::createErrorResponse(504, "PHP CGI timeout"));
+    request->answered = true;
+    request->process->kill();
+}
+
+void PhpCgiRunner::release(Request *request)
+{
+    m_active.removeOne(request);
+    m_running.fetch_sub(1, std::memory_order_relaxed);
+    m_admitted.fetch_sub(1, std::memory_order_relaxed);
+
+    request->process->deleteLater();
+    delete request->timer;
+    delete request;
+    startQueued();
+}
+
+HttpResponse PhpCgiRunner::busyResponse(const QString &message) const
+{
+    HttpResponse response = HttpServer::createErrorResponse(503, message);
+    response.addHeader("Retry-After", QByteArray::number(m_retryAfterSeconds));
+    return response;
+}
@@ -0,0 +1,68 @@
+#ifndef PHPCGIRUNNER_H
+#define PHPCGIRUNNER_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QObject>
+#include <QProcessEnvironment>
+#include <QString>
+#include <atomic>
+#include <deque>
+#include "httpresponder.h"
+#include "httpresponse.h"
+
+// php-cgi на каждый запрос (php/mode=cgi) без блокировки потоков:
+// процесс запускается асинхронно, ответ уходит responder'у по сигналу
+// finished. Одновременно работает не больше maxProcesses процессов,
+// остальные запросы ждут в очереди FIFO; если и она полна, запрос сразу
+// получает 503 с Retry-After. Скрипт, не уложившийся в timeoutMs (вместе
+// с ожиданием в очереди), убивается.
+// Живет в потоке сервера, execute() можно звать из любого потока.
+class PhpCgiRunner : public QObject
+{
+    Q_OBJECT
+public:
+    PhpCgiRunner(const QString &phpCgiPath, int maxProcesses, int queueSize, int timeoutMs,
+                 int retryAfterSeconds, QObject *parent = nullptr);
+    ~PhpCgiRunner();
+
+    // cgiEnvironment - CGI-переменные запроса поверх окружения сервера
+    void execute(const QString &scriptPath, const QMap<QString, QString> &cgiEnvironment,
+                 const QByteArray &stdinData, const HttpResponderPtr &responder);
+
+    int runningProcesses() const { return m_running.load(std::memory_order_relaxed); }
+    int queuedRequests() const { return qMax(0, m_admitted.load(std::memory_order_relaxed) - runningProcesses()); }
+    int maxProcesses() const { return m_maxProcesses; }
+    quint64 rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+    quint64 timedOut() const { return m_timedOut.load(std::memory_order_relaxed); }
+
+private:
+    struct Request;
+
+    void enqueue(Request *request);
+    void startQueued();
+    void start(Request *request);
+    void onFinished(Request *request);
+    void onTimeout(Request *request);
+    void release(Request *request);
+    HttpResponse busyResponse(const QString &message) const;
+
+    QString m_phpCgiPath;
+    int m_maxProcesses;
+    int m_queueSize;
+    int m_timeoutMs;
+    int m_retryAfterSeconds;
+    QProcessEnvironment m_baseEnvironment;
+
+    // Принятые запросы (работают и ждут): проверяется в потоке запроса без блокировок
+    std::atomic<int> m_admitted;
+    std::atomic<int> m_running;
+    std::atomic<quint64> m_rejected;
+    std::atomic<quint64> m_timedOut;
+
+    // Очередь и процессы - только в потоке runner'а
+    std::deque<Request *> m_queue;
+    QList<Request *> m_active;
+};
+
+#endif // PHPCGIRUNNER_H
@@ -0,0 +1,114 @@
+#include "phpcgisupervisor.h"
+#include <QDebug>
+#include <QFile>
+
+namespace {
+const int MinRestartDelayMs = 500;
+const int MaxRestartDelayMs = 30000;
+// Проработал дольше - считаем, что это не цикл падений
+const int StableRunMs = 10000;
+}
+
+PhpCgiSupervisor::PhpCgiSupervisor(const QString &phpCgiPath, const QString &address, int children,
+                                   QObject *parent) :
+    QObject(parent),
+    m_phpCgiPath(phpCgiPath),
+    m_address(address),
+    m_children(children),
+    m_process(this),
+    m_restartDelayMs(MinRestartDelayMs),
+    m_running(false)
+{
+    m_restartTimer.setSingleShot(true);
+    connect(&m_restartTimer, &QTimer::timeout, this, &PhpCgiSupervisor::relaunch);
+    connect(&m_process, &QProcess::started, this, &PhpCgiSupervisor::onStarted);
+    connect(&m_process, &QProcess::errorOccurred, this, &PhpCgiSupervisor::onErrorOccurred);
+    connect(&m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &PhpCgiSupervisor::onFinished);
+    m_process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+}
+
+PhpCgiSupervisor::~PhpCgiSupervisor()
+{
+    stop();
+}
+
+void PhpCgiSupervisor::start()
+{
+    if (m_running) return;
+    m_running = true;
+    m_restartDelayMs = MinRestartDelayMs;
+    launch(true);
+}
+
+void PhpCgiSupervisor::stop()
+{
+    m_running = false;
+    m_restartTimer.stop();
+    if (m_process.state() == QProcess::NotRunning) return;
+
+    m_process.terminate();
+    if (!m_process.waitForFinished(3000)) {
+        m_process.kill();
+        m_process.waitForFinished(1000);
+    }
+}
+
+void PhpCgiSupervisor::relaunch()
+{
+    launch(false);
+}
+
+void PhpCgiSupervisor::launch(bool wait)
+{
+    if (!m_running) return;
+
+    // Сокет от прошлого запуска мешает php-cgi сделать bind
+    if (m_address.startsWith('/') && QFile::exists(m_address))
+        QFile::remove(m_address);
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("PHP_FCGI_CHILDREN", QString::number(m_children));
+    // Воркеры не перезапускаются по счетчику запросов - за этим следит сам php-cgi
+    env.insert("PHP_FCGI_MAX_REQUESTS", "0");
+    m_process.setProcessEnvironment(env);
+
+    m_process.start(m_phpCgiPath, QStringList() << "-b" << m_address);
+    // Итог запуска приходит сигналами started / errorOccurred, в том числе из waitForStarted
+    if (wait)
+        m_process.waitForStarted();
+}
+
+void PhpCgiSupervisor::onStarted()
+{
+    qInfo() << "PHP FastCGI workers started on" << m_address << "children:" << m_children;
+    m_uptime.start();
+}
+
+void PhpCgiSupervisor::onErrorOccurred(QProcess::ProcessError error)
+{
+    // Падение запущенного процесса придет еще и в onFinished
+    if (!m_running || error != QProcess::FailedToStart) return;
+
+    qWarning() << "Failed to start PHP FastCGI workers:" << m_process.errorString();
+    scheduleRestart();
+}
+
+void PhpCgiSupervisor::onFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    if (!m_running) return;
+
+    if (m_uptime.isValid() && m_uptime.elapsed() > StableRunMs)
+        m_restartDelayMs = MinRestartDelayMs;
+
+    qWarning() << "PHP FastCGI workers exited, code" << exitCode
+               << (exitStatus == QProcess::CrashExit ? "(crash)" : "")
+               << "- restarting in" << m_restartDelayMs << "ms";
+    scheduleRestart();
+}
+
+void PhpCgiSupervisor::scheduleRestart()
+{
+    m_restartTimer.start(m_restartDelayMs);
+    m_restartDelayMs = qMin(m_restartDelayMs * 2, MaxRestartDelayMs);
+}
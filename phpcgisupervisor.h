@@ -0,0 +1,46 @@
+#ifndef PHPCGISUPERVISOR_H
+#define PHPCGISUPERVISOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QString>
+#include <QTimer>
+
+// Держит запущенным php-cgi в режиме FastCGI (php-cgi -b адрес).
+// Детей-воркеров php-cgi порождает сам (PHP_FCGI_CHILDREN), мы лишь
+// перезапускаем мастер-процесс, если он упал.
+class PhpCgiSupervisor : public QObject
+{
+    Q_OBJECT
+public:
+    PhpCgiSupervisor(const QString &phpCgiPath, const QString &address, int children,
+                     QObject *parent = nullptr);
+    ~PhpCgiSupervisor();
+
+    void start();
+    void stop();
+
+private slots:
+    void onStarted();
+    void onErrorOccurred(QProcess::ProcessError error);
+    void onFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void relaunch();
+
+private:
+    // wait - ждать запуска (только при старте сервера); перезапуски идут
+    // по сигналам и не блокируют поток сервера
+    void launch(bool wait);
+    void scheduleRestart();
+
+    QString m_phpCgiPath;
+    QString m_address;
+    int m_children;
+    QProcess m_process;
+    QTimer m_restartTimer;
+    QElapsedTimer m_uptime;
+    int m_restartDelayMs;  // растет при частых падениях
+    bool m_running;
+};
+
+#endif // PHPCGISUPERVISOR_H
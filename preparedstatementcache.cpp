@@ -0,0 +1,50 @@
+#include "preparedstatementcache.h"
+#include <QDebug>
+
+// Страница keyset готовит два выражения подряд (текущая страница и проверка
+// следующей) и выполняет оба после подготовки: при емкости 1 второе
+// вытеснило бы первое до exec_prepared
+static const int MinCapacity = 2;
+
+PreparedStatementCache::PreparedStatementCache(int capacity) :
+    m_capacity(qMax(MinCapacity, capacity)),
+    m_nextId(0),
+    m_hits(0),
+    m_misses(0)
+{
+}
+
+std::string PreparedStatementCache::prepare(pqxx::connection &conn, const std::string &key,
+                                            const std::function<std::string()> &buildSql)
+{
+    auto found = m_items.find(key);
+    if (found != m_items.end()) {
+        ++m_hits;
+        m_lru.splice(m_lru.begin(), m_lru, found->second.lruPos);
+        return found->second.name;
+    }
+
+    ++m_misses;
+
+    // Освобождаем место под новую форму
+    while (int(m_items.size()) >= m_capacity) {
+        auto victim = m_items.find(m_lru.back());
+        try {
+            conn.unprepare(victim->second.name);
+        } catch (const std::exception &e) {
+            qWarning() << "Failed to deallocate prepared statement:" << e.what();
+        }
+        m_items.erase(victim);
+        m_lru.pop_back();
+    }
+
+    std::string name = "stmt_" + std::to_string(++m_nextId);
+    conn.prepare(name, buildSql());
+
+    m_lru.push_front(key);
+    Item item;
+    item.name = name;
+    item.lruPos = m_lru.begin();
+    m_items.emplace(key, item);
+    return name;
+}
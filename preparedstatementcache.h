@@ -0,0 +1,45 @@
+#ifndef PREPAREDSTATEMENTCACHE_H
+#define PREPAREDSTATEMENTCACHE_H
+
+#include <QtGlobal>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <pqxx/pqxx>
+
+// Кеш подготовленных выражений одного соединения.
+// Ключ описывает форму запроса (операция, таблица, набор колонок),
+// каждая форма готовится на сервере один раз, лишние вытесняются по LRU.
+// Не потокобезопасен - живет вместе с соединением из пула.
+class PreparedStatementCache
+{
+public:
+    explicit PreparedStatementCache(int capacity);
+
+    // Имя подготовленного выражения для формы key. При промахе
+    // SQL строится через buildSql и готовится на соединении.
+    // Вызывать вне открытой транзакции.
+    std::string prepare(pqxx::connection &conn, const std::string &key,
+                        const std::function<std::string()> &buildSql);
+
+    int size() const { return int(m_items.size()); }
+    quint64 hits() const { return m_hits; }
+    quint64 misses() const { return m_misses; }
+
+private:
+    struct Item
+    {
+        std::string name;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    int m_capacity;
+    std::unordered_map<std::string, Item> m_items;
+    std::list<std::string> m_lru; // ключи, в начале - самые свежие
+    quint64 m_nextId;
+    quint64 m_hits;
+    quint64 m_misses;
+};
+
+#endif // PREPAREDSTATEMENTCACHE_H
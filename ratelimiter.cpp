@@ -0,0 +1,99 @@
+#include "ratelimiter.h"
+#include <QMutexLocker>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int ShardCount = 64;       // степень двойки
+const int MaxProbe = 8;          // сколько ячеек смотрим, прежде чем вытеснять
+
+// Перемешивание splitmix64: соседние адреса должны попадать в разные шарды
+quint64 mix(quint64 value)
+{
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+}
+
+RateLimiter::RateLimiter(double rate, double burst, int maxClients) :
+    m_rate(rate),
+    m_burst(burst > 0 ? qMax(1.0, burst) : qMax(1.0, rate * 2)),
+    m_shardSize(MaxProbe),
+    m_limited(0),
+    m_evictions(0)
+{
+    if (!isEnabled()) return;
+
+    while (m_shardSize * ShardCount < maxClients)
+        m_shardSize *= 2;
+    m_shards.reset(new Shard[ShardCount]);
+    for (int i = 0; i < ShardCount; ++i)
+        m_shards[i].slots.reset(new Slot[m_shardSize]);
+    m_clock.start();
+}
+
+quint64 RateLimiter::clientKey(const QHostAddress &address)
+{
+    bool isV4 = false;
+    quint32 v4 = address.toIPv4Address(&isV4);   // и IPv4-mapped IPv6
+    quint64 key;
+    if (isV4) {
+        key = mix(v4);
+    } else {
+        Q_IPV6ADDR v6 = address.toIPv6Address();
+        quint64 prefix;
+        std::memcpy(&prefix, v6.c, sizeof(prefix));
+        key = mix(prefix ^ 0x6a09e667f3bcc909ULL);
+    }
+    return key ? key : 1;
+}
+
+bool RateLimiter::allow(quint64 key, int *retryAfterMs)
+{
+    if (!isEnabled()) return true;
+
+    Shard &shard = m_shards[(key >> 58) & (ShardCount - 1)];
+    const int mask = m_shardSize - 1;
+    const qint64 now = m_clock.elapsed();
+
+    QMutexLocker locker(&shard.mutex);
+
+    Slot *slot = nullptr;
+    Slot *oldest = nullptr;
+    for (int probe = 0; probe < MaxProbe; ++probe) {
+        Slot *candidate = &shard.slots[(key + probe) & mask];
+        if (candidate->key == key || candidate->key == 0) {
+            slot = candidate;
+            break;
+        }
+        if (!oldest || candidate->updatedMs < oldest->updatedMs)
+            oldest = candidate;
+    }
+
+    if (!slot) {
+        slot = oldest;
+        ++m_evictions;
+    }
+    if (slot->key != key) {
+        // Новый клиент начинает с полным ведром
+        slot->key = key;
+        slot->tokens = m_burst;
+    } else {
+        slot->tokens = qMin(m_burst, slot->tokens + double(now - slot->updatedMs) * m_rate / 1000.0);
+    }
+    slot->updatedMs = now;
+
+    if (slot->tokens >= 1.0) {
+        slot->tokens -= 1.0;
+        return true;
+    }
+
+    ++m_limited;
+    if (retryAfterMs)
+        *retryAfterMs = int(std::ceil((1.0 - slot->tokens) * 1000.0 / m_rate));
+    return false;
+}
@@ -0,0 +1,63 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QMutex>
+#include <atomic>
+#include <memory>
+
+// Ограничение частоты запросов по клиенту (token bucket): в ведре до burst
+// жетонов, пополняется rate в секунду, запрос забирает один.
+//
+// Ведра лежат в хеш-таблице фиксированного размера с открытой адресацией,
+// разбитой на шарды со своим мьютексом - воркеры редко ждут друг друга,
+// а память не растет от числа адресов. Ключ ищется среди нескольких
+// соседних ячеек; если все заняты, место освобождает самое давнее ведро
+// (оно почти наверняка уже полное, т.е. ничего не теряет).
+class RateLimiter
+{
+public:
+    // rate <= 0 - ограничение выключено, burst <= 0 - два rate;
+    // maxClients - сколько ведер помнить
+    RateLimiter(double rate, double burst, int maxClients);
+
+    bool isEnabled() const { return m_rate > 0; }
+
+    // Ключ клиента: IPv4-адрес или сеть /64 для IPv6 (у одного клиента
+    // обычно целая сеть, по полному адресу лимит обходится перебором)
+    static quint64 clientKey(const QHostAddress &address);
+
+    // true - запрос можно выполнять. Иначе в retryAfterMs - через сколько
+    // в ведре появится жетон
+    bool allow(quint64 key, int *retryAfterMs = nullptr);
+
+    quint64 limited() const { return m_limited.load(); }
+    quint64 evictions() const { return m_evictions.load(); }
+
+private:
+    struct Slot
+    {
+        quint64 key = 0;       // 0 - свободна
+        qint64 updatedMs = 0;
+        double tokens = 0;
+    };
+
+    // Отдельная строка кеша на шард, чтобы мьютексы соседей не мешали друг другу
+    struct alignas(64) Shard
+    {
+        QMutex mutex;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    double m_rate;
+    double m_burst;
+    int m_shardSize;           // ячеек в шарде, степень двойки
+    std::unique_ptr<Shard[]> m_shards;
+    QElapsedTimer m_clock;
+
+    std::atomic<quint64> m_limited;
+    std::atomic<quint64> m_evictions;
+};
+
+#endif // RATELIMITER_H
@@ -0,0 +1,74 @@
+# Код сервера без main.cpp: общий для сервера, бенчмарков и тестов.
+# Новые файлы сервера добавляются только сюда
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+        $$PWD/authcache.cpp \
+        $$PWD/dbbulkinsert.cpp \
+        $$PWD/dbchangelistener.cpp \
+        $$PWD/dbconnectionpool.cpp \
+        $$PWD/dbencoder.cpp \
+        $$PWD/dbjson.cpp \
+        $$PWD/dbpagetoken.cpp \
+        $$PWD/dbresponsecache.cpp \
+        $$PWD/epollengine.cpp \
+        $$PWD/fastcgiclient.cpp \
+        $$PWD/hpack.cpp \
+        $$PWD/http2session.cpp \
+        $$PWD/httpcompression.cpp \
+        $$PWD/httpconnection.cpp \
+        $$PWD/httpheaders.cpp \
+        $$PWD/httprequestparser.cpp \
+        $$PWD/httpresponder.cpp \
+        $$PWD/httpresponse.cpp \
+        $$PWD/httprouter.cpp \
+        $$PWD/httpserver.cpp \
+        $$PWD/httptransport.cpp \
+        $$PWD/httpworker.cpp \
+        $$PWD/metrics.cpp \
+        $$PWD/phpcgirunner.cpp \
+        $$PWD/phpcgisupervisor.cpp \
+        $$PWD/preparedstatementcache.cpp \
+        $$PWD/ratelimiter.cpp \
+        $$PWD/staticfilecache.cpp \
+        $$PWD/tlstransport.cpp
+
+HEADERS += \
+    $$PWD/authcache.h \
+    $$PWD/dbbulkinsert.h \
+    $$PWD/dbchangelistener.h \
+    $$PWD/dbconnectionpool.h \
+    $$PWD/dbencoder.h \
+    $$PWD/dbjson.h \
+    $$PWD/dbpagetoken.h \
+    $$PWD/dbresponsecache.h \
+    $$PWD/epollengine.h \
+    $$PWD/fastcgiclient.h \
+    $$PWD/hpack.h \
+    $$PWD/http2session.h \
+    $$PWD/httpcompression.h \
+    $$PWD/httpconnection.h \
+    $$PWD/httpheaders.h \
+    $$PWD/httprequestparser.h \
+    $$PWD/httpresponder.h \
+    $$PWD/httpresponse.h \
+    $$PWD/httprouter.h \
+    $$PWD/httpserver.h \
+    $$PWD/httptransport.h \
+    $$PWD/httpworker.h \
+    $$PWD/metrics.h \
+    $$PWD/phpcgirunner.h \
+    $$PWD/phpcgisupervisor.h \
+    $$PWD/preparedstatementcache.h \
+    $$PWD/ratelimiter.h \
+    $$PWD/staticfilecache.h \
+    $$PWD/tlstransport.h
+
+LIBS += -lpqxx -lpq -lz -lssl -lcrypto
+
+# Сжатие brotli (нужен libbrotlienc): qmake CONFIG+=brotli
+brotli {
+    DEFINES += HAVE_BROTLI
+    LIBS += -lbrotlienc
+}
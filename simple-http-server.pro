@@ -1,6 +1,6 @@
 QT += core network
 
-CONFIG += c++14 console
+CONFIG += c++17 console
 CONFIG -= app_bundle
 
 # The following define makes your compiler emit warnings if you use
@@ -14,20 +14,24 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(server.pri)
+
 SOURCES += \
-        httpserver.cpp \
         main.cpp
 
-LIBS += -lpqxx -lpq
+# Бенчмарки (bench/bench.pro): make bench
+bench.commands = $(MKDIR) bench && cd bench && $(QMAKE) $$PWD/bench/bench.pro && $(MAKE)
+QMAKE_EXTRA_TARGETS += bench
+
+# Тесты (tests/tests.pro, QtTest): make tests
+tests.commands = $(MKDIR) tests && cd tests && $(QMAKE) $$PWD/tests/tests.pro && $(MAKE) && $(MAKE) check
+QMAKE_EXTRA_TARGETS += tests
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
-HEADERS += \
-    httpserver.h
-
 DISTFILES += \
     README.md \
     http_server.ini \
@@ -0,0 +1,343 @@
+#include "staticfilecache.h"
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QLocale>
+#include <QStringList>
+
+StaticFileCache::StaticFileCache(qint64 maxBytes, qint64 maxFileSize, int revalidateMs, QObject *parent) :
+    QObject(parent),
+    m_maxBytes(maxBytes),
+    m_maxFileSize(maxFileSize),
+    m_revalidateMs(revalidateMs),
+    m_totalCost(0),
+    m_watcher(new QFileSystemWatcher(this)),
+    m_hits(0),
+    m_misses(0)
+{
+    m_clock.start();
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &StaticFileCache::onFileChanged);
+}
+
+StaticFileCache::EntryPtr StaticFileCache::lookup(const QString &path)
+{
+    EntryPtr entry;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_entries.find(path);
+        if (it == m_entries.end()) {
+            ++m_misses;
+            return EntryPtr();
+        }
+        entry = it->entry;
+        m_lru.splice(m_lru.begin(), m_lru, it->lruPos);
+    }
+
+    // Подстраховка на случай, если watcher пропустил изменение
+    qint64 now = m_clock.elapsed();
+    if (m_revalidateMs >= 0 && now - entry->checkedAt.load() > m_revalidateMs) {
+        QFileInfo info(path);
+        if (!info.exists() || info.size() != entry->fileSize || info.lastModified() != entry->lastModified) {
+            invalidate(path);
+            ++m_misses;
+            return EntryPtr();
+        }
+        entry->checkedAt.store(now);
+    }
+
+    ++m_hits;
+    return entry;
+}
+
+void StaticFileCache::insert(const QString &path, const EntryPtr &entry)
+{
+    if (!isCacheable(entry->fileSize)) return;
+    entry->checkedAt.store(m_clock.elapsed());
+
+    bool isNew = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        isNew = !m_entries.contains(path);
+        removeLocked(path);
+
+        // Вытесняем давно не использованные файлы
+        while (!m_lru.empty() && m_totalCost + entry->cost > m_maxBytes)
+            removeLocked(m_lru.back());
+        if (entry->cost > m_maxBytes) return;
+
+        m_lru.push_front(path);
+        Slot slot;
+        slot.entry = entry;
+        slot.lruPos = m_lru.begin();
+        m_entries.insert(path, slot);
+        m_totalCost += entry->cost;
+    }
+
+    if (isNew)
+        watch(path);
+}
+
+void StaticFileCache::invalidate(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    removeLocked(path);
+}
+
+void StaticFileCache::removeLocked(const QString &path)
+{
+    auto it = m_entries.find(path);
+    if (it == m_entries.end()) return;
+    m_totalCost -= it->entry->cost;
+    m_lru.erase(it->lruPos);
+    m_entries.erase(it);
+}
+
+void StaticFileCache::watch(const QString &path)
+{
+    // QFileSystemWatcher живет в потоке кеша, а insert зовут воркеры
+    QMetaObject::invokeMethod(this, [this, path]() {
+        if (!m_watcher->files().contains(path))
+            m_watcher->addPath(path);
+    }, Qt::QueuedConnection);
+}
+
+void StaticFileCache::onFileChanged(const QString &path)
+{
+    invalidate(path);
+    // После замены файла через rename наблюдение снимается - следующий insert поставит заново
+    if (!QFileInfo::exists(path))
+        m_watcher->removePath(path);
+}
+
+StaticFileCache::EntryPtr StaticFileCache::makeEntry(const QFileInfo &info, const QByteArray &mimeType,
+                                                     const QByteArray &content,
+                                                     const CompressionSettings &compression)
+{
+    EntryPtr entry(new Entry);
+    entry->etag = makeEtag(info);
+    entry->mimeType = mimeType;
+    entry->lastModified = info.lastModified();
+    entry->fileSize = content.size();
+    entry->checkedAt.store(0);
+    entry->varies = compression.enabled && HttpCompression::isCompressible(mimeType)
+        && content.size() >= compression.minSize;
+
+    QByteArray validators = validatorHeaders(entry->etag, entry->lastModified);
+    if (entry->varies)
+        validators.append(varyHeader());
+    entry->response = makeHead(200, mimeType, content.size(), validators);
+    entry->response.setBody(content);
+
+    entry->notModified = notModifiedResponse(validators);
+    entry->cost = entry->response.size() + entry->notModified.size();
+
+    if (!entry->varies)
+        return entry;
+
+    // Сжимаем один раз на версию файла: запись и так сбрасывается при смене mtime
+    auto encode = [&](ContentEncoding encoding, Encoded &encoded) {
+        QByteArray body;
+        QString sibling = precompressedPath(info, encoding);
+        if (!sibling.isEmpty()) {
+            QFile file(sibling);
+            if (file.open(QIODevice::ReadOnly))
+                body = file.readAll();
+        } else if (encoding == ContentEncoding::Gzip || HttpCompression::brotliSupported()) {
+            body = HttpCompression::compress(content, encoding, compression.staticGzipLevel,
+                                             compression.staticBrotliQuality);
+        }
+        if (body.isEmpty() || body.size() >= content.size())
+            return;
+
+        encoded.etag = HttpCompression::encodedEtag(entry->etag, encoding);
+        QByteArray encodedValidators = validatorHeaders(encoded.etag, entry->lastModified) + varyHeader();
+        encoded.response = makeHead(200, mimeType, body.size(),
+                                    encodedValidators + "Content-Encoding: " + HttpCompression::token(encoding) + "\r\n");
+        encoded.response.setBody(body);
+        encoded.notModified = notModifiedResponse(encodedValidators);
+        entry->cost += encoded.response.size() + encoded.notModified.size();
+    };
+    encode(ContentEncoding::Gzip, entry->gzip);
+    encode(ContentEncoding::Brotli, entry->brotli);
+    return entry;
+}
+
+QString StaticFileCache::precompressedPath(const QFileInfo &info, ContentEncoding encoding)
+{
+    QString path = info.filePath() + (encoding == ContentEncoding::Brotli ? ".br" : ".gz");
+    QFileInfo sibling(path);
+    // Устаревший .gz отдал бы клиенту старую версию файла
+    if (!sibling.isFile() || !sibling.isReadable() || sibling.lastModified() < info.lastModified())
+        return QString();
+    return path;
+}
+
+HttpResponse StaticFileCache::respond(const Entry &entry, const HttpHeaders &headers)
+{
+    // Диапазоны отдаем только из несжатого представления
+    if (entry.varies && !headers.contains(HttpHeaders::Range)) {
+        ContentEncoding encoding = HttpCompression::negotiate(headers.valueView(HttpHeaders::AcceptEncoding),
+                                                              !entry.brotli.response.isNull());
+        const Encoded *encoded = encoding == ContentEncoding::Brotli ? &entry.brotli
+                               : encoding == ContentEncoding::Gzip ? &entry.gzip : nullptr;
+        if (encoded && !encoded->response.isNull()) {
+            if (isNotModified(headers, encoded->etag, entry.lastModified))
+                return encoded->notModified;
+            return encoded->response;
+        }
+    }
+
+    if (isNotModified(headers, entry.etag, entry.lastModified))
+        return entry.notModified;
+
+    qint64 start = 0, end = 0;
+    switch (parseRange(headers, entry.etag, entry.lastModified, entry.fileSize, start, end)) {
+    case RangeResult::Full:
+        return entry.response;
+    case RangeResult::Unsatisfiable:
+        return rangeNotSatisfiableResponse(entry.fileSize);
+    case RangeResult::Partial:
+        break;
+    }
+
+    qint64 length = end - start + 1;
+    QByteArray contentRange = "bytes " + QByteArray::number(start) + "-" + QByteArray::number(end)
+        + "/" + QByteArray::number(entry.fileSize);
+    QByteArray validators = validatorHeaders(entry.etag, entry.lastModified);
+    if (entry.varies)
+        validators.append(varyHeader());
+    HttpResponse response = makeHead(206, entry.mimeType, length, validators, contentRange);
+    response.setBody(entry.response.body().mid(int(start), int(length)));
+    return response;
+}
+
+StaticFileCache::RangeResult StaticFileCache::parseRange(const HttpHeaders &headers,
+                                                         const QByteArray &etag, const QDateTime &lastModified,
+                                                         qint64 size, qint64 &start, qint64 &end)
+{
+    QByteArray range = headers.valueView(HttpHeaders::Range).trimmed();
+    if (range.isEmpty() || !range.startsWith("bytes="))
+        return RangeResult::Full;
+
+    // If-Range: диапазон только если у клиента та же версия файла
+    QByteArray ifRange = headers.valueView(HttpHeaders::IfRange).trimmed();
+    if (!ifRange.isEmpty()) {
+        if (ifRange.startsWith('"') || ifRange.startsWith("W/")) {
+            if (ifRange != etag) return RangeResult::Full;
+        } else {
+            QDateTime date = parseHttpDate(QString::fromLatin1(ifRange));
+            if (!date.isValid() || lastModified.toUTC().toSecsSinceEpoch() != date.toSecsSinceEpoch())
+                return RangeResult::Full;
+        }
+    }
+
+    QByteArray spec = range.mid(6).trimmed();
+    // Несколько диапазонов (multipart/byteranges) не поддерживаем - отдаем файл целиком
+    if (spec.contains(','))
+        return RangeResult::Full;
+
+    int dash = spec.indexOf('-');
+    if (dash == -1)
+        return RangeResult::Full;
+
+    bool okStart = true, okEnd = true;
+    QByteArray first = spec.left(dash).trimmed();
+    QByteArray last = spec.mid(dash + 1).trimmed();
+
+    if (first.isEmpty()) {
+        // bytes=-N: последние N байт
+        qint64 suffix = last.toLongLong(&okEnd);
+        if (!okEnd || suffix < 0) return RangeResult::Full;
+        if (suffix == 0 || size == 0) return RangeResult::Unsatisfiable;
+        start = qMax<qint64>(0, size - suffix);
+        end = size - 1;
+        return RangeResult::Partial;
+    }
+
+    start = first.toLongLong(&okStart);
+    end = last.isEmpty() ? size - 1 : last.toLongLong(&okEnd);
+    if (!okStart || !okEnd || start < 0 || end < start)
+        return RangeResult::Full;
+    if (start >= size)
+        return RangeResult::Unsatisfiable;
+    if (end >= size) end = size - 1;
+    return RangeResult::Partial;
+}
+
+QByteArray StaticFileCache::validatorHeaders(const QByteArray &etag, const QDateTime &lastModified)
+{
+    return "ETag: " + etag + "\r\n"
+           "Last-Modified: " + httpDate(lastModified) + "\r\n";
+}
+
+HttpResponse StaticFileCache::makeHead(int status, const QByteArray &mimeType, qint64 contentLength,
+                                       const QByteArray &validators, const QByteArray &contentRange)
+{
+    HttpResponse response(status);
+    response.addHeader("Content-Type", mimeType);
+    response.addHeader("Content-Length", QByteArray::number(contentLength));
+    if (!contentRange.isEmpty())
+        response.addHeader("Content-Range", contentRange);
+    response.addHeader(QByteArrayLiteral("Accept-Ranges: bytes\r\n"));
+    response.addHeader(validators);
+    return response;
+}
+
+HttpResponse StaticFileCache::notModifiedResponse(const QByteArray &validators)
+{
+    HttpResponse response(304);
+    response.addHeader(validators);
+    return response;
+}
+
+HttpResponse StaticFileCache::rangeNotSatisfiableResponse(qint64 size)
+{
+    HttpResponse response(416);
+    response.addHeader("Content-Range", "bytes */" + QByteArray::number(size));
+    response.addHeader(QByteArrayLiteral("Content-Length: 0\r\n"));
+    return response;
+}
+
+bool StaticFileCache::isNotModified(const HttpHeaders &headers, const QByteArray &etag,
+                                    const QDateTime &lastModified)
+{
+    // If-None-Match важнее If-Modified-Since (RFC 7232, 6)
+    QByteArray ifNoneMatch = headers.valueView(HttpHeaders::IfNoneMatch);
+    if (!ifNoneMatch.isEmpty()) {
+        if (ifNoneMatch.trimmed() == "*") return true;
+        // Частый случай - один ETag, сравниваем без разбиения на список
+        if (ifNoneMatch == etag) return true;
+        for (QByteArray candidate : ifNoneMatch.split(',')) {
+            candidate = candidate.trimmed();
+            if (candidate.startsWith("W/")) candidate = candidate.mid(2); // слабое сравнение
+            if (candidate == etag) return true;
+        }
+        return false;
+    }
+
+    QByteArray ifModifiedSince = headers.valueView(HttpHeaders::IfModifiedSince);
+    if (!ifModifiedSince.isEmpty()) {
+        QDateTime since = parseHttpDate(QString::fromLatin1(ifModifiedSince));
+        if (!since.isValid()) return false;
+        // В HTTP-дате нет миллисекунд
+        return lastModified.toUTC().toSecsSinceEpoch() <= since.toSecsSinceEpoch();
+    }
+    return false;
+}
+
+QByteArray StaticFileCache::makeEtag(const QFileInfo &info)
+{
+    return "\"" + QByteArray::number(info.lastModified().toMSecsSinceEpoch(), 16)
+        + "-" + QByteArray::number(info.size(), 16) + "\"";
+}
+
+QByteArray StaticFileCache::httpDate(const QDateTime &dateTime)
+{
+    return QLocale::c().toString(dateTime.toUTC(), "ddd, dd MMM yyyy hh:mm:ss 'GMT'").toLatin1();
+}
+
+QDateTime StaticFileCache::parseHttpDate(const QString &value)
+{
+    QDateTime date = QLocale::c().toDateTime(value.trimmed(), "ddd, dd MMM yyyy hh:mm:ss 'GMT'");
+    date.setTimeSpec(Qt::UTC);
+    return date;
+}
@@ -0,0 +1,126 @@
+#ifndef STATICFILECACHE_H
+#define STATICFILECACHE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <atomic>
+#include <list>
+#include "httpcompression.h"
+#include "httpheaders.h"
+#include "httpresponse.h"
+
+class QFileSystemWatcher;
+
+// Кеш готовых ответов для статических файлов из document root.
+// Заголовки и MIME-тип считаются один раз при загрузке файла, тело
+// хранится одним буфером и отдается без копирования (и для Range тоже).
+// Запись сбрасывается по QFileSystemWatcher и по проверке mtime.
+class StaticFileCache : public QObject
+{
+    Q_OBJECT
+public:
+    // Сжатое представление файла со своим ETag
+    struct Encoded
+    {
+        HttpResponse response;    // null - представления нет
+        HttpResponse notModified;
+        QByteArray etag;
+    };
+
+    struct Entry
+    {
+        HttpResponse response;    // ответ 200, тело - содержимое файла
+        HttpResponse notModified; // готовый ответ 304
+        Encoded gzip;
+        Encoded brotli;
+        bool varies = false;      // ответ зависит от Accept-Encoding
+        QByteArray etag;
+        QByteArray mimeType;
+        QDateTime lastModified;
+        qint64 fileSize;
+        qint64 cost;
+        std::atomic<qint64> checkedAt; // когда последний раз сверяли mtime
+    };
+    typedef QSharedPointer<Entry> EntryPtr;
+
+    StaticFileCache(qint64 maxBytes, qint64 maxFileSize, int revalidateMs, QObject *parent = nullptr);
+
+    // Готовая запись или null, если файла нет в кеше или он изменился
+    EntryPtr lookup(const QString &path);
+    void insert(const QString &path, const EntryPtr &entry);
+    void invalidate(const QString &path);
+
+    bool isCacheable(qint64 fileSize) const { return m_maxBytes > 0 && fileSize <= m_maxFileSize; }
+
+    quint64 hits() const { return m_hits.load(); }
+    quint64 misses() const { return m_misses.load(); }
+
+    // Собрать запись (с ответами 200 и 304) из содержимого файла.
+    // Для сжимаемых типов сразу готовятся gzip / brotli: из соседних
+    // .gz / .br, если они не старше файла, иначе сжатием содержимого
+    static EntryPtr makeEntry(const QFileInfo &info, const QByteArray &mimeType, const QByteArray &content,
+                              const CompressionSettings &compression);
+    // Готовый сжатый файл рядом с исходным (path.gz / path.br), если он актуален
+    static QString precompressedPath(const QFileInfo &info, ContentEncoding encoding);
+
+    // Ответ на запрос с учетом If-None-Match / If-Modified-Since и Range
+    static HttpResponse respond(const Entry &entry, const HttpHeaders &headers);
+    static bool isNotModified(const HttpHeaders &headers, const QByteArray &etag,
+                              const QDateTime &lastModified);
+
+    enum class RangeResult {
+        Full,           // Range нет или он не применим (If-Range не совпал, несколько диапазонов)
+        Partial,        // отдать [start, end]
+        Unsatisfiable   // 416
+    };
+    static RangeResult parseRange(const HttpHeaders &headers, const QByteArray &etag,
+                                  const QDateTime &lastModified, qint64 size, qint64 &start, qint64 &end);
+
+    static QByteArray validatorHeaders(const QByteArray &etag, const QDateTime &lastModified);
+    static QByteArray varyHeader() { return "Vary: Accept-Encoding\r\n"; }
+    // Заголовки с Content-Length; тело - setBody или файл через sendFile
+    static HttpResponse makeHead(int status, const QByteArray &mimeType, qint64 contentLength,
+                                 const QByteArray &validators, const QByteArray &contentRange = QByteArray());
+    static HttpResponse notModifiedResponse(const QByteArray &validators);
+    static HttpResponse rangeNotSatisfiableResponse(qint64 size);
+
+    static QByteArray makeEtag(const QFileInfo &info);
+    static QByteArray httpDate(const QDateTime &dateTime);
+    static QDateTime parseHttpDate(const QString &value);
+
+private slots:
+    void onFileChanged(const QString &path);
+
+private:
+    void watch(const QString &path);
+    void removeLocked(const QString &path);
+
+    struct Slot
+    {
+        EntryPtr entry;
+        std::list<QString>::iterator lruPos;
+    };
+
+    qint64 m_maxBytes;
+    qint64 m_maxFileSize;
+    int m_revalidateMs;
+
+    QMutex m_mutex;
+    QHash<QString, Slot> m_entries;
+    std::list<QString> m_lru; // в начале - недавно использованные
+    qint64 m_totalCost;
+
+    QElapsedTimer m_clock;
+    QFileSystemWatcher *m_watcher;
+
+    std::atomic<quint64> m_hits;
+    std::atomic<quint64> m_misses;
+};
+
+#endif // STATICFILECACHE_H
@@ -0,0 +1,6 @@
+TARGET = tst_hpack
+
+include(../test.pri)
+
+SOURCES += \
+        tst_hpack.cpp
@@ -0,0 +1,244 @@
+#include <QtTest>
+#include "hpack.h"
+
+// HPACK по примерам RFC 7541, приложение C: запросы без Хаффмана (C.3)
+// и с ним (C.4), ответы с таблицей 256 байт и вытеснением (C.5, C.6).
+// Примеры идут последовательно - каждый следующий опирается на
+// динамическую таблицу, заполненную предыдущими.
+class tst_Hpack : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void decodeRequests_data();
+    void decodeRequests();
+    void decodeResponses_data();
+    void decodeResponses();
+    void encodeRequests();
+    void roundTripWithTableSizeUpdate();
+    void huffman();
+    void decodeErrors_data();
+    void decodeErrors();
+    void headerListTooLarge();
+};
+
+typedef QList<QPair<QByteArray, QByteArray>> HeaderList;
+Q_DECLARE_METATYPE(HeaderList)
+
+static QByteArray block(const char *hex)
+{
+    return QByteArray::fromHex(hex);
+}
+
+static HeaderList toList(const std::vector<HpackHeader> &headers)
+{
+    HeaderList list;
+    for (const HpackHeader &header : headers)
+        list.append(qMakePair(header.name, header.value));
+    return list;
+}
+
+static const HeaderList &requestHeaders(int index)
+{
+    static const HeaderList requests[3] = {
+        { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" } },
+        { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" },
+          { "cache-control", "no-cache" } },
+        { { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" },
+          { ":authority", "www.example.com" }, { "custom-key", "custom-value" } }
+    };
+    return requests[index];
+}
+
+static const HeaderList &responseHeaders(int index)
+{
+    static const HeaderList responses[3] = {
+        { { ":status", "302" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+          { "location", "https://www.example.com" } },
+        { { ":status", "307" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+          { "location", "https://www.example.com" } },
+        { { ":status", "200" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:22 GMT" },
+          { "location", "https://www.example.com" }, { "content-encoding", "gzip" },
+          { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" } }
+    };
+    return responses[index];
+}
+
+void tst_Hpack::decodeRequests_data()
+{
+    QTest::addColumn<QByteArrayList>("blocks");
+
+    QTest::newRow("C.3 literal") << QByteArrayList{
+        block("828684410f7777772e6578616d706c652e636f6d"),
+        block("828684be58086e6f2d6361636865"),
+        block("828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565") };
+    QTest::newRow("C.4 huffman") << QByteArrayList{
+        block("828684418cf1e3c2e5f23a6ba0ab90f4ff"),
+        block("828684be5886a8eb10649cbf"),
+        block("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf") };
+}
+
+void tst_Hpack::decodeRequests()
+{
+    QFETCH(QByteArrayList, blocks);
+
+    HpackDecoder decoder;
+    for (int i = 0; i < blocks.size(); ++i) {
+        std::vector<HpackHeader> headers;
+        QCOMPARE(decoder.decode(blocks.at(i).constData(), blocks.at(i).size(), headers), HpackDecoder::Status::Ok);
+        QCOMPARE(toList(headers), requestHeaders(i));
+    }
+}
+
+void tst_Hpack::decodeResponses_data()
+{
+    QTest::addColumn<QByteArrayList>("blocks");
+
+    QTest::newRow("C.5 literal") << QByteArrayList{
+        block("4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a323120474d54"
+              "6e1768747470733a2f2f7777772e6578616d706c652e636f6d"),
+        block("4803333037c1c0bf"),
+        block("88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220474d54c05a04677a6970773866"
+              "6f6f3d4153444a4b48514b425a584f5157454f50495541585157454f49553b206d61782d6167653d333630"
+              "303b2076657273696f6e3d31") };
+    QTest::newRow("C.6 huffman") << QByteArrayList{
+        block("488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff6e919d29ad171863"
+              "c78f0b97c8e9ae82ae43d3"),
+        block("4883640effc1c0bf"),
+        block("88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7821dd7f2e6c7b3"
+              "35dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587316065c003ed4ee5b1063d5007") };
+}
+
+void tst_Hpack::decodeResponses()
+{
+    QFETCH(QByteArrayList, blocks);
+
+    // SETTINGS_HEADER_TABLE_SIZE = 256: третий ответ вытесняет записи первых двух
+    HpackDecoder decoder(256);
+    for (int i = 0; i < blocks.size(); ++i) {
+        std::vector<HpackHeader> headers;
+        QCOMPARE(decoder.decode(blocks.at(i).constData(), blocks.at(i).size(), headers), HpackDecoder::Status::Ok);
+        QCOMPARE(toList(headers), responseHeaders(i));
+    }
+}
+
+void tst_Hpack::encodeRequests()
+{
+    // Кодер выбирает те же представления, что и примеры C.4
+    const QByteArray expected[3] = {
+        block("828684418cf1e3c2e5f23a6ba0ab90f4ff"),
+        block("828684be5886a8eb10649cbf"),
+        block("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf")
+    };
+    HpackEncoder encoder;
+    for (int i = 0; i < 3; ++i) {
+        QByteArray encoded;
+        encoder.begin(encoded);
+        for (const auto &header : requestHeaders(i))
+            encoder.add(encoded, header.first, header.second);
+        QCOMPARE(encoded.toHex(), expected[i].toHex());
+    }
+}
+
+void tst_Hpack::roundTripWithTableSizeUpdate()
+{
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    for (int round = 0; round < 3; ++round) {
+        // Клиент уменьшил таблицу: кодер начинает следующий блок с обновления размера
+        if (round == 1)
+            encoder.setMaxTableSize(256);
+        if (round == 2)
+            encoder.setMaxTableSize(0);
+
+        for (int i = 0; i < 3; ++i) {
+            QByteArray encoded;
+            encoder.begin(encoded);
+            for (const auto &header : responseHeaders(i))
+                encoder.add(encoded, header.first, header.second,
+                            header.first == "set-cookie" ? HpackEncoder::NeverIndex : HpackEncoder::Index);
+            encoder.add(encoded, "content-length", QByteArray::number(round * 10 + i), HpackEncoder::NoIndex);
+
+            std::vector<HpackHeader> headers;
+            QCOMPARE(decoder.decode(encoded.constData(), encoded.size(), headers), HpackDecoder::Status::Ok);
+            HeaderList expected = responseHeaders(i);
+            expected.append(qMakePair(QByteArray("content-length"), QByteArray::number(round * 10 + i)));
+            QCOMPARE(toList(headers), expected);
+        }
+    }
+}
+
+void tst_Hpack::huffman()
+{
+    QByteArray encoded;
+    HpackEncoder::huffmanEncode("no-cache", encoded);
+    QCOMPARE(encoded.toHex(), QByteArray("a8eb10649cbf"));
+    QCOMPARE(HpackEncoder::huffmanLength("no-cache"), 6);
+
+    QByteArray decoded;
+    QByteArray www = block("f1e3c2e5f23a6ba0ab90f4ff");
+    QVERIFY(HpackEncoder::huffmanDecode(www.constData(), www.size(), decoded));
+    QCOMPARE(decoded, QByteArray("www.example.com"));
+
+    // Все 256 байт туда и обратно
+    QByteArray all;
+    for (int c = 0; c < 256; ++c)
+        all.append(char(c));
+    encoded.clear();
+    HpackEncoder::huffmanEncode(all, encoded);
+    QCOMPARE(encoded.size(), HpackEncoder::huffmanLength(all));
+    decoded.clear();
+    QVERIFY(HpackEncoder::huffmanDecode(encoded.constData(), encoded.size(), decoded));
+    QCOMPARE(decoded, all);
+
+    // Дополнение не из единиц и дополнение длиннее 7 бит (RFC 7541, 5.2)
+    decoded.clear();
+    QVERIFY(!HpackEncoder::huffmanDecode("\x00", 1, decoded));
+    decoded.clear();
+    QVERIFY(!HpackEncoder::huffmanDecode("\xff", 1, decoded));
+    decoded.clear();
+    QVERIFY(!HpackEncoder::huffmanDecode("\xff\xff\xff\xff", 4, decoded));
+}
+
+void tst_Hpack::decodeErrors_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("index 0") << block("80");
+    QTest::newRow("index past table") << block("be");
+    QTest::newRow("size update above limit") << block("3fe21f82");
+    QTest::newRow("size update after header") << block("8220");
+    QTest::newRow("truncated integer") << block("ff");
+    QTest::newRow("truncated string") << block("400a6375");
+    QTest::newRow("bad huffman padding") << block("418100");
+}
+
+void tst_Hpack::decodeErrors()
+{
+    QFETCH(QByteArray, data);
+
+    HpackDecoder decoder;
+    std::vector<HpackHeader> headers;
+    QCOMPARE(decoder.decode(data.constData(), data.size(), headers), HpackDecoder::Status::Error);
+    QVERIFY(!decoder.errorString().isEmpty());
+}
+
+void tst_Hpack::headerListTooLarge()
+{
+    // Блок разбирается до конца, чтобы таблица осталась согласованной с кодером клиента
+    HpackDecoder decoder;
+    decoder.setMaxHeaderListSize(50);
+    QByteArray first = block("828684410f7777772e6578616d706c652e636f6d");
+    std::vector<HpackHeader> headers;
+    QCOMPARE(decoder.decode(first.constData(), first.size(), headers), HpackDecoder::Status::TooLarge);
+
+    decoder.setMaxHeaderListSize(64 * 1024);
+    QByteArray second = block("828684be58086e6f2d6361636865");
+    headers.clear();
+    QCOMPARE(decoder.decode(second.constData(), second.size(), headers), HpackDecoder::Status::Ok);
+    QCOMPARE(toList(headers), requestHeaders(1));
+}
+
+QTEST_APPLESS_MAIN(tst_Hpack)
+
+#include "tst_hpack.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_http2session
+
+include(../test.pri)
+
+SOURCES += \
+        tst_http2session.cpp
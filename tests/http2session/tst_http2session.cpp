@@ -0,0 +1,414 @@
+#include <QtTest>
+#include <QTcpSocket>
+#include <map>
+#include <memory>
+#include "hpack.h"
+#include "http2session.h"
+#include "httpserver.h"
+
+// HTTP/2 на живом сервере в этом же процессе: prior knowledge и
+// Upgrade: h2c, параллельные потоки, HEAD, PING, некорректные запросы
+// и ошибки соединения. Как и в tst_httpconnection, запросы идут на
+// /metrics - ему не нужны ни БД, ни PHP.
+class tst_Http2Session : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void priorKnowledge();
+    void manyStreamsInOneWrite();
+    void headEndsWithHeaders();
+    void ping();
+    void conflictingContentLength();
+    void upgradeFromHttp1();
+    void frameOnClosedConnection();
+    void badPreface();
+
+private:
+    std::unique_ptr<HttpServer> m_server;
+};
+
+static const QByteArray MetricsPath("/metrics");
+
+namespace {
+
+enum : quint8 {
+    FrameData = 0x0,
+    FrameHeaders = 0x1,
+    FrameRstStream = 0x3,
+    FrameSettings = 0x4,
+    FramePing = 0x6,
+    FrameGoAway = 0x7,
+    FrameWindowUpdate = 0x8,
+    FrameContinuation = 0x9
+};
+
+enum : quint8 {
+    FlagEndStream = 0x1,
+    FlagAck = 0x1,
+    FlagEndHeaders = 0x4
+};
+
+QByteArray frame(quint8 type, quint8 flags, quint32 stream, const QByteArray &payload = QByteArray())
+{
+    QByteArray out;
+    out.append(char(payload.size() >> 16));
+    out.append(char(payload.size() >> 8));
+    out.append(char(payload.size()));
+    out.append(char(type));
+    out.append(char(flags));
+    out.append(char(stream >> 24));
+    out.append(char(stream >> 16));
+    out.append(char(stream >> 8));
+    out.append(char(stream));
+    out.append(payload);
+    return out;
+}
+
+quint32 readUInt32(const QByteArray &data, int offset)
+{
+    return quint32(quint8(data.at(offset))) << 24 | quint32(quint8(data.at(offset + 1))) << 16
+        | quint32(quint8(data.at(offset + 2))) << 8 | quint32(quint8(data.at(offset + 3)));
+}
+
+// Клиент HTTP/2 ровно настолько, насколько нужно тестам
+class Client
+{
+public:
+    struct Stream
+    {
+        int status = 0;
+        QList<QPair<QByteArray, QByteArray>> headers;
+        QByteArray body;
+        bool headersEndStream = false;
+        bool ended = false;
+        bool reset = false;
+        quint32 resetCode = 0;
+    };
+
+    bool connect(quint16 port, bool sendPreface = true)
+    {
+        m_socket.connectToHost(QHostAddress::LocalHost, port);
+        if (!m_socket.waitForConnected(5000))
+            return false;
+        if (sendPreface)
+            m_socket.write(Http2Session::preface() + frame(FrameSettings, 0, 0));
+        return true;
+    }
+
+    void write(const QByteArray &data) { m_socket.write(data); }
+
+    QByteArray request(quint32 id, const QByteArray &method, const QByteArray &path,
+                       const QList<QPair<QByteArray, QByteArray>> &extra = {}, bool endStream = true)
+    {
+        QByteArray block;
+        m_encoder.begin(block);
+        m_encoder.add(block, ":method", method);
+        m_encoder.add(block, ":scheme", "http");
+        m_encoder.add(block, ":path", path);
+        m_encoder.add(block, ":authority", "test");
+        for (const auto &header : extra)
+            m_encoder.add(block, header.first, header.second);
+        return frame(FrameHeaders, FlagEndHeaders | (endStream ? FlagEndStream : 0), id, block);
+    }
+
+    // Читать кадры, пока done() не вернет true; false - таймаут или закрытие
+    template <typename Done>
+    bool readUntil(Done done)
+    {
+        while (!done()) {
+            if (!readFrame())
+                return false;
+        }
+        return true;
+    }
+
+    bool allEnded(int count) const
+    {
+        int ended = 0;
+        for (const auto &entry : streams) {
+            if (entry.second.ended || entry.second.reset)
+                ++ended;
+        }
+        return ended >= count;
+    }
+
+    bool waitForRaw(int size)
+    {
+        while (m_buffer.size() < size) {
+            m_buffer += m_socket.readAll();
+            if (m_buffer.size() >= size)
+                break;
+            // Сервер принимает соединения в этом же потоке - ждем с event loop
+            QSignalSpy spy(&m_socket, &QTcpSocket::readyRead);
+            if (!spy.wait(5000))
+                return false;
+        }
+        return true;
+    }
+
+    QByteArray takeRaw(int size)
+    {
+        QByteArray data = m_buffer.left(size);
+        m_buffer.remove(0, size);
+        return data;
+    }
+
+    QByteArray &buffer() { return m_buffer; }
+
+    std::map<quint32, Stream> streams;
+    bool settingsAcked = false;
+    QByteArray pingAck;
+    bool goAway = false;
+    quint32 goAwayCode = 0;
+    bool decodeFailed = false;
+
+private:
+    bool readFrame()
+    {
+        if (!waitForRaw(9))
+            return false;
+        int length = int(quint8(m_buffer.at(0))) << 16 | int(quint8(m_buffer.at(1))) << 8 | int(quint8(m_buffer.at(2)));
+        if (!waitForRaw(9 + length))
+            return false;
+        quint8 type = quint8(m_buffer.at(3));
+        quint8 flags = quint8(m_buffer.at(4));
+        quint32 id = readUInt32(m_buffer, 5) & 0x7fffffff;
+        QByteArray payload = m_buffer.mid(9, length);
+        m_buffer.remove(0, 9 + length);
+
+        switch (type) {
+        case FrameSettings:
+            if (flags & FlagAck)
+                settingsAcked = true;
+            else
+                m_socket.write(frame(FrameSettings, FlagAck, 0));
+            break;
+        case FramePing:
+            if (flags & FlagAck)
+                pingAck = payload;
+            break;
+        case FrameGoAway:
+            goAway = true;
+            goAwayCode = readUInt32(payload, 4);
+            break;
+        case FrameRstStream:
+            streams[id].reset = true;
+            streams[id].resetCode = readUInt32(payload, 0);
+            break;
+        case FrameHeaders:
+        case FrameContinuation:
+            m_headerBlock += payload;
+            if (type == FrameHeaders)
+                m_headerFlags = flags;
+            if (flags & FlagEndHeaders)
+                headerBlockDone(id);
+            break;
+        case FrameData: {
+            Stream &stream = streams[id];
+            stream.body += payload;
+            if (flags & FlagEndStream)
+                stream.ended = true;
+            // Окно возвращаем сразу - тестам не нужно упираться в управление потоком
+            if (!payload.isEmpty()) {
+                QByteArray increment;
+                increment.append(char(payload.size() >> 24)).append(char(payload.size() >> 16))
+                         .append(char(payload.size() >> 8)).append(char(payload.size()));
+                m_socket.write(frame(FrameWindowUpdate, 0, 0, increment) + frame(FrameWindowUpdate, 0, id, increment));
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        return true;
+    }
+
+    void headerBlockDone(quint32 id)
+    {
+        std::vector<HpackHeader> headers;
+        if (m_decoder.decode(m_headerBlock.constData(), m_headerBlock.size(), headers) != HpackDecoder::Status::Ok)
+            decodeFailed = true;
+        m_headerBlock.clear();
+
+        Stream &stream = streams[id];
+        int status = 0;
+        for (const HpackHeader &header : headers) {
+            if (header.name == ":status")
+                status = header.value.toInt();
+            else
+                stream.headers.append(qMakePair(header.name, header.value));
+        }
+        // Промежуточный 100 не заканчивает поток
+        if (status >= 200)
+            stream.status = status;
+        if (m_headerFlags & FlagEndStream) {
+            stream.headersEndStream = true;
+            stream.ended = true;
+        }
+    }
+
+    QTcpSocket m_socket;
+    QByteArray m_buffer;
+    HpackEncoder m_encoder;
+    HpackDecoder m_decoder;
+    QByteArray m_headerBlock;
+    quint8 m_headerFlags = 0;
+};
+
+QByteArray headerValue(const Client::Stream &stream, const QByteArray &name)
+{
+    for (const auto &header : stream.headers) {
+        if (header.first == name)
+            return header.second;
+    }
+    return QByteArray();
+}
+
+}
+
+void tst_Http2Session::initTestCase()
+{
+    m_server.reset(new HttpServer);
+    QVERIFY(m_server->startServer(0));
+}
+
+void tst_Http2Session::cleanupTestCase()
+{
+    m_server->stopServer();
+    m_server.reset();
+}
+
+void tst_Http2Session::priorKnowledge()
+{
+    Client client;
+    QVERIFY(client.connect(m_server->serverPort()));
+    client.write(client.request(1, "GET", MetricsPath));
+
+    QVERIFY(client.readUntil([&]() { return client.allEnded(1); }));
+    QVERIFY(!client.decodeFailed);
+    const Client::Stream &stream = client.streams[1];
+    QCOMPARE(stream.status, 200);
+    QVERIFY(stream.body.contains("# TYPE"));
+    QByteArray length = headerValue(stream, "content-length");
+    if (!length.isEmpty())
+        QCOMPARE(length.toInt(), stream.body.size());
+    // Заголовков соединения в HTTP/2 быть не должно
+    QVERIFY(headerValue(stream, "connection").isEmpty());
+    QVERIFY(headerValue(stream, "keep-alive").isEmpty());
+}
+
+void tst_Http2Session::manyStreamsInOneWrite()
+{
+    // Ответы уходят пачкой кадров в одном write() транспорта - больше, чем
+    // частей влезает в один writev
+    const int count = 40;
+    Client client;
+    QVERIFY(client.connect(m_server->serverPort()));
+    QByteArray requests;
+    for (int i = 0; i < count; ++i)
+        requests += client.request(quint32(2 * i + 1), "GET", MetricsPath);
+    client.write(requests);
+
+    QVERIFY(client.readUntil([&]() { return client.allEnded(count); }));
+    QVERIFY(!client.decodeFailed);
+    QVERIFY(!client.goAway);
+    for (int i = 0; i < count; ++i) {
+        const Client::Stream &stream = client.streams[quint32(2 * i + 1)];
+        QCOMPARE(stream.status, 200);
+        QVERIFY(stream.body.contains("# TYPE"));
+    }
+}
+
+void tst_Http2Session::headEndsWithHeaders()
+{
+    Client client;
+    QVERIFY(client.connect(m_server->serverPort()));
+    client.write(client.request(1, "HEAD", MetricsPath) + client.request(3, "GET", MetricsPath));
+
+    QVERIFY(client.readUntil([&]() { return client.allEnded(2); }));
+    QCOMPARE(client.streams[1].status, 200);
+    QVERIFY(client.streams[1].headersEndStream);
+    QVERIFY(client.streams[1].body.isEmpty());
+    QCOMPARE(client.streams[3].status, 200);
+    QVERIFY(!client.streams[3].body.isEmpty());
+}
+
+void tst_Http2Session::ping()
+{
+    Client client;
+    QVERIFY(client.connect(m_server->serverPort()));
+    client.write(frame(FramePing, 0, 0, "12345678"));
+
+    QVERIFY(client.readUntil([&]() { return !client.pingAck.isEmpty(); }));
+    QCOMPARE(client.pingAck, QByteArray("12345678"));
+    QVERIFY(client.readUntil([&]() { return client.settingsAcked; }));
+}
+
+void tst_Http2Session::conflictingContentLength()
+{
+    // Некорректный запрос сбрасывает только свой поток (RFC 9113, 8.1.1)
+    Client client;
+    QVERIFY(client.connect(m_server->serverPort()));
+    client.write(client.request(1, "POST", MetricsPath, { { "content-length", "1" }, { "content-length", "2" } }, false)
+                 + client.request(3, "GET", MetricsPath));
+
+    QVERIFY(client.readUntil([&]() { return client.allEnded(2); }));
+    QVERIFY(client.streams[1].reset);
+    QCOMPARE(client.streams[1].resetCode, quint32(0x1));
+    QCOMPARE(client.streams[3].status, 200);
+    QVERIFY(!client.goAway);
+}
+
+void tst_Http2Session::upgradeFromHttp1()
+{
+    Client client;
+    QVERIFY(client.connect(m_server->serverPort(), false));
+    // HTTP2-Settings: SETTINGS_MAX_CONCURRENT_STREAMS = 100 в base64url
+    client.write("GET " + MetricsPath + " HTTP/1.1\r\nHost: test\r\nConnection: Upgrade, HTTP2-Settings\r\n"
+                 "Upgrade: h2c\r\nHTTP2-Settings: AAMAAABk\r\n\r\n");
+
+    int headEnd = -1;
+    while ((headEnd = client.buffer().indexOf("\r\n\r\n")) < 0)
+        QVERIFY(client.waitForRaw(client.buffer().size() + 1));
+    QByteArray head = client.takeRaw(headEnd + 4);
+    QVERIFY2(head.startsWith("HTTP/1.1 101"), head.constData());
+
+    // Запрос из HTTP/1.1 - поток 1, ответ на него приходит уже кадрами
+    client.write(Http2Session::preface() + frame(FrameSettings, 0, 0) + client.request(3, "GET", MetricsPath));
+    QVERIFY(client.readUntil([&]() { return client.allEnded(2); }));
+    QCOMPARE(client.streams[1].status, 200);
+    QVERIFY(client.streams[1].body.contains("# TYPE"));
+    QCOMPARE(client.streams[3].status, 200);
+}
+
+void tst_Http2Session::frameOnClosedConnection()
+{
+    // DATA на потоке 0 - ошибка соединения: GOAWAY с PROTOCOL_ERROR
+    Client client;
+    QVERIFY(client.connect(m_server->serverPort()));
+    client.write(frame(FrameData, 0, 0, "x"));
+
+    QVERIFY(client.readUntil([&]() { return client.goAway; }));
+    QCOMPARE(client.goAwayCode, quint32(0x1));
+}
+
+void tst_Http2Session::badPreface()
+{
+    // Начало похоже на преамбулу, но дальше не она - это уже не HTTP/2
+    Client client;
+    QVERIFY(client.connect(m_server->serverPort(), false));
+    client.write("PRI * HTTP/1.1\r\n\r\n");
+
+    int headEnd = -1;
+    while ((headEnd = client.buffer().indexOf("\r\n\r\n")) < 0)
+        QVERIFY(client.waitForRaw(client.buffer().size() + 1));
+    QVERIFY(client.buffer().startsWith("HTTP/1.1 "));
+}
+
+QTEST_GUILESS_MAIN(tst_Http2Session)
+
+#include "tst_http2session.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_httpconnection
+
+include(../test.pri)
+
+SOURCES += \
+        tst_httpconnection.cpp
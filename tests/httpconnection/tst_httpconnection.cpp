@@ -0,0 +1,211 @@
+#include <QtTest>
+#include <QTcpSocket>
+#include <memory>
+#include "httpserver.h"
+
+// HTTP/1.1 на живом сервере в этом же процессе (настройки из http_server.ini,
+// порт выбирает система): порядок ответов при pipelining, HEAD без тела
+// и 100 Continue только после уже начатых ответов. Маршрут /metrics не
+// требует ни БД, ни PHP.
+class tst_HttpConnection : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void pipelinedInOrder();
+    void headHasNoBody();
+    void continueAfterPreviousResponse();
+    void badRequestAfterPipelined();
+
+private:
+    struct Response
+    {
+        int status = 0;
+        QByteArray head;
+        QByteArray body;
+        qint64 contentLength = -1;
+    };
+
+    bool connectClient(QTcpSocket &socket);
+    // Один ответ из потока; headOnly - ответ на HEAD, тело не читается
+    static bool readResponse(QTcpSocket &socket, QByteArray &buffer, Response &response, bool headOnly = false);
+    static bool waitForBytes(QTcpSocket &socket, QByteArray &buffer, int size);
+
+    std::unique_ptr<HttpServer> m_server;
+};
+
+static const QByteArray MetricsPath("/metrics");
+
+void tst_HttpConnection::initTestCase()
+{
+    m_server.reset(new HttpServer);
+    QVERIFY(m_server->startServer(0));
+}
+
+void tst_HttpConnection::cleanupTestCase()
+{
+    m_server->stopServer();
+    m_server.reset();
+}
+
+bool tst_HttpConnection::connectClient(QTcpSocket &socket)
+{
+    socket.connectToHost(QHostAddress::LocalHost, m_server->serverPort());
+    return socket.waitForConnected(5000);
+}
+
+bool tst_HttpConnection::waitForBytes(QTcpSocket &socket, QByteArray &buffer, int size)
+{
+    // Сервер принимает соединения в этом же потоке - ждем с event loop, а не waitForReadyRead
+    while (buffer.size() < size) {
+        buffer += socket.readAll();
+        if (buffer.size() >= size)
+            break;
+        QSignalSpy spy(&socket, &QTcpSocket::readyRead);
+        if (!spy.wait(5000))
+            return false;
+    }
+    return true;
+}
+
+bool tst_HttpConnection::readResponse(QTcpSocket &socket, QByteArray &buffer, Response &response, bool headOnly)
+{
+    int headEnd;
+    while ((headEnd = buffer.indexOf("\r\n\r\n")) < 0) {
+        if (!waitForBytes(socket, buffer, buffer.size() + 1))
+            return false;
+    }
+    response = Response();
+    response.head = buffer.left(headEnd + 4);
+    buffer.remove(0, headEnd + 4);
+    if (!response.head.startsWith("HTTP/1.1 "))
+        return false;
+    response.status = response.head.mid(9, 3).toInt();
+
+    QByteArray lower = response.head.toLower();
+    int lengthPos = lower.indexOf("\r\ncontent-length:");
+    if (lengthPos >= 0) {
+        int valueStart = lengthPos + 17;
+        response.contentLength = response.head.mid(valueStart, lower.indexOf("\r\n", valueStart) - valueStart)
+                                     .trimmed().toLongLong();
+    }
+    if (headOnly || response.status < 200 || response.status == 204 || response.status == 304)
+        return true;
+
+    if (lower.contains("\r\ntransfer-encoding: chunked\r\n")) {
+        for (;;) {
+            int lineEnd;
+            while ((lineEnd = buffer.indexOf("\r\n")) < 0) {
+                if (!waitForBytes(socket, buffer, buffer.size() + 1))
+                    return false;
+            }
+            int size = buffer.left(lineEnd).toInt(nullptr, 16);
+            if (!waitForBytes(socket, buffer, lineEnd + 2 + size + 2))
+                return false;
+            response.body += buffer.mid(lineEnd + 2, size);
+            buffer.remove(0, lineEnd + 2 + size + 2);
+            if (size == 0)
+                return true;
+        }
+    }
+
+    if (response.contentLength < 0)
+        return false;
+    if (!waitForBytes(socket, buffer, int(response.contentLength)))
+        return false;
+    response.body = buffer.left(int(response.contentLength));
+    buffer.remove(0, int(response.contentLength));
+    return true;
+}
+
+void tst_HttpConnection::pipelinedInOrder()
+{
+    QTcpSocket socket;
+    QVERIFY(connectClient(socket));
+    socket.write("GET " + MetricsPath + " HTTP/1.1\r\nHost: test\r\n\r\n"
+                 "GET /no-such-route-for-test HTTP/1.1\r\nHost: test\r\n\r\n"
+                 "GET " + MetricsPath + " HTTP/1.1\r\nHost: test\r\n\r\n");
+
+    QByteArray buffer;
+    Response response;
+    QVERIFY(readResponse(socket, buffer, response));
+    QCOMPARE(response.status, 200);
+    QVERIFY(response.body.contains("# TYPE"));
+    QVERIFY(readResponse(socket, buffer, response));
+    QCOMPARE(response.status, 404);
+    QVERIFY(readResponse(socket, buffer, response));
+    QCOMPARE(response.status, 200);
+    QVERIFY(response.head.toLower().contains("connection: keep-alive"));
+    QVERIFY(buffer.isEmpty());
+}
+
+void tst_HttpConnection::headHasNoBody()
+{
+    // Тело после ответа на HEAD клиент принял бы за следующий ответ
+    QTcpSocket socket;
+    QVERIFY(connectClient(socket));
+    socket.write("HEAD " + MetricsPath + " HTTP/1.1\r\nHost: test\r\n\r\n"
+                 "GET " + MetricsPath + " HTTP/1.1\r\nHost: test\r\n\r\n");
+
+    QByteArray buffer;
+    Response head;
+    QVERIFY(readResponse(socket, buffer, head, true));
+    QCOMPARE(head.status, 200);
+    QVERIFY(head.contentLength > 0);
+
+    Response get;
+    QVERIFY(readResponse(socket, buffer, get));
+    QCOMPARE(get.status, 200);
+    QVERIFY(get.body.contains("# TYPE"));
+    QVERIFY(buffer.isEmpty());
+}
+
+void tst_HttpConnection::continueAfterPreviousResponse()
+{
+    // 100 Continue для второго запроса не должен попасть внутрь первого ответа
+    QTcpSocket socket;
+    QVERIFY(connectClient(socket));
+    socket.write("GET " + MetricsPath + " HTTP/1.1\r\nHost: test\r\n\r\n"
+                 "POST " + MetricsPath + " HTTP/1.1\r\nHost: test\r\nExpect: 100-continue\r\n"
+                 "Content-Length: 5\r\n\r\n");
+
+    QByteArray buffer;
+    Response first;
+    QVERIFY(readResponse(socket, buffer, first));
+    QCOMPARE(first.status, 200);
+    QVERIFY(first.body.endsWith('\n'));
+
+    Response interim;
+    QVERIFY(readResponse(socket, buffer, interim));
+    QCOMPARE(interim.status, 100);
+
+    socket.write("hello");
+    Response last;
+    QVERIFY(readResponse(socket, buffer, last));
+    QVERIFY(last.status >= 200);
+    QVERIFY(buffer.isEmpty());
+}
+
+void tst_HttpConnection::badRequestAfterPipelined()
+{
+    // Ошибка разбора отвечается после уже принятых запросов, потом соединение закрывается
+    QTcpSocket socket;
+    QVERIFY(connectClient(socket));
+    socket.write("GET " + MetricsPath + " HTTP/1.1\r\nHost: test\r\n\r\n"
+                 "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\nab");
+
+    QByteArray buffer;
+    Response response;
+    QVERIFY(readResponse(socket, buffer, response));
+    QCOMPARE(response.status, 200);
+    QVERIFY(readResponse(socket, buffer, response));
+    QCOMPARE(response.status, 400);
+    QVERIFY(response.head.toLower().contains("connection: close"));
+}
+
+QTEST_GUILESS_MAIN(tst_HttpConnection)
+
+#include "tst_httpconnection.moc"
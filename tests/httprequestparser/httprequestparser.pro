@@ -0,0 +1,6 @@
+TARGET = tst_httprequestparser
+
+include(../test.pri)
+
+SOURCES += \
+        tst_httprequestparser.cpp
@@ -0,0 +1,264 @@
+#include <QtTest>
+#include "httprequestparser.h"
+
+// Инкрементальный разбор HTTP/1.1: pipelining, тела, 100-continue и
+// отказы на заголовках, по которым посредник и сервер могли бы
+// по-разному определить границы запроса.
+class tst_HttpRequestParser : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void simpleGet();
+    void pipelined();
+    void splitAcrossReads();
+    void headRequestKeepsNextRequest();
+    void contentLengthBody();
+    void chunkedBody();
+    void chunkedCoding();
+    void chunkedOverflow();
+    void continueExpected();
+    void continueWithoutBody();
+    void rejected_data();
+    void rejected();
+    void repeatedEqualContentLength();
+    void repeatedHeaders();
+    void takeBufferedData();
+};
+
+void tst_HttpRequestParser::simpleGet()
+{
+    HttpRequestParser parser;
+    parser.append("GET /index.html?x=1 HTTP/1.1\r\nHost: example.com\r\nX-Custom: a b \r\n\r\n");
+
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    HttpRequest request = parser.takeRequest();
+    QCOMPARE(request.method, QByteArray("GET"));
+    QCOMPARE(request.target, QByteArray("/index.html?x=1"));
+    QCOMPARE(request.version, QByteArray("HTTP/1.1"));
+    QCOMPARE(request.headers.value(HttpHeaders::Host), QByteArray("example.com"));
+    QCOMPARE(request.headers.value(QByteArray("x-custom")), QByteArray("a b"));
+    QVERIFY(request.body.isEmpty());
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::NeedMore);
+}
+
+void tst_HttpRequestParser::pipelined()
+{
+    HttpRequestParser parser;
+    parser.append("GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                  "POST /b HTTP/1.1\r\nHost: x\r\nContent-Length: 3\r\n\r\nabc"
+                  "GET /c HTTP/1.1\r\nHost: x\r\n\r\n");
+
+    const QByteArray targets[] = { "/a", "/b", "/c" };
+    for (const QByteArray &target : targets) {
+        QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+        HttpRequest request = parser.takeRequest();
+        QCOMPARE(request.target, target);
+        if (target == "/b")
+            QCOMPARE(request.body, QByteArray("abc"));
+    }
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::NeedMore);
+    QVERIFY(!parser.hasBufferedData());
+}
+
+void tst_HttpRequestParser::splitAcrossReads()
+{
+    const QByteArray raw = "POST /upload HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\n\r\nhello"
+                           "GET /next HTTP/1.1\r\n\r\n";
+    HttpRequestParser parser;
+    QList<HttpRequest> requests;
+    for (char c : raw) {
+        parser.append(QByteArray(1, c));
+        while (parser.parse() == HttpRequestParser::Status::Complete)
+            requests.append(parser.takeRequest());
+    }
+
+    QCOMPARE(requests.size(), 2);
+    QCOMPARE(requests.at(0).body, QByteArray("hello"));
+    QCOMPARE(requests.at(0).headers.value(HttpHeaders::ContentLength), QByteArray("5"));
+    QCOMPARE(requests.at(1).target, QByteArray("/next"));
+}
+
+void tst_HttpRequestParser::headRequestKeepsNextRequest()
+{
+    // Ответ на HEAD содержит Content-Length, но у самого запроса тела нет
+    HttpRequestParser parser;
+    parser.append("HEAD /file HTTP/1.1\r\nHost: x\r\n\r\nGET /file HTTP/1.1\r\nHost: x\r\n\r\n");
+
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    HttpRequest head = parser.takeRequest();
+    QCOMPARE(head.method, QByteArray("HEAD"));
+    QVERIFY(head.body.isEmpty());
+
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    QCOMPARE(parser.takeRequest().method, QByteArray("GET"));
+}
+
+void tst_HttpRequestParser::contentLengthBody()
+{
+    HttpRequestParser parser;
+    parser.append("PUT /x HTTP/1.1\r\nContent-Length: 10\r\n\r\n01234");
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::NeedMore);
+    parser.append("56789");
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    QCOMPARE(parser.takeRequest().body, QByteArray("0123456789"));
+}
+
+void tst_HttpRequestParser::chunkedBody()
+{
+    HttpRequestParser parser;
+    parser.append("POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                  "5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nTrailer: t\r\n\r\n");
+
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    HttpRequest request = parser.takeRequest();
+    QCOMPARE(request.body, QByteArray("hello world"));
+    QVERIFY(!request.headers.contains(HttpHeaders::TransferEncoding));
+    QCOMPARE(request.headers.value(HttpHeaders::ContentLength), QByteArray("11"));
+}
+
+void tst_HttpRequestParser::chunkedCoding()
+{
+    // Имя кодировки без учета регистра, пробелы и пустые элементы списка не мешают
+    HttpRequestParser parser;
+    parser.append("POST /x HTTP/1.1\r\nTransfer-Encoding: , Chunked \r\n\r\n3\r\nabc\r\n0\r\n\r\n");
+
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    QCOMPARE(parser.takeRequest().body, QByteArray("abc"));
+}
+
+void tst_HttpRequestParser::chunkedOverflow()
+{
+    // body.size() + chunkSize переполнял qint64 и проходил проверку лимита
+    HttpRequestParser parser;
+    parser.setMaxBodySize(1024);
+    parser.append("POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                  "1\r\na\r\n7fffffffffffffff\r\n");
+
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Error);
+    QCOMPARE(parser.errorCode(), 413);
+}
+
+void tst_HttpRequestParser::continueExpected()
+{
+    HttpRequestParser parser;
+    parser.append("POST /x HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n");
+
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::NeedMore);
+    QVERIFY(parser.takeContinueRequest());
+    QVERIFY(!parser.takeContinueRequest());
+
+    parser.append("hello");
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    QCOMPARE(parser.takeRequest().body, QByteArray("hello"));
+    QVERIFY(!parser.takeContinueRequest());
+}
+
+void tst_HttpRequestParser::continueWithoutBody()
+{
+    HttpRequestParser parser;
+    parser.append("GET /x HTTP/1.1\r\nExpect: 100-continue\r\n\r\n");
+
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    QVERIFY(!parser.takeContinueRequest());
+}
+
+void tst_HttpRequestParser::rejected_data()
+{
+    QTest::addColumn<QByteArray>("raw");
+    QTest::addColumn<int>("code");
+
+    QTest::newRow("no version") << QByteArray("GET /\r\n\r\n") << 400;
+    QTest::newRow("http/2 request line") << QByteArray("GET / HTTP/2.0\r\n\r\n") << 505;
+    QTest::newRow("no colon") << QByteArray("GET / HTTP/1.1\r\nHost x\r\n\r\n") << 400;
+    QTest::newRow("space before colon") << QByteArray("GET / HTTP/1.1\r\nHost : x\r\n\r\n") << 400;
+    QTest::newRow("obs-fold") << QByteArray("GET / HTTP/1.1\r\nX-A: 1\r\n X-B: 2\r\n\r\n") << 400;
+    QTest::newRow("invalid content-length") << QByteArray("POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n") << 400;
+    QTest::newRow("conflicting content-length")
+        << QByteArray("POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd") << 400;
+    QTest::newRow("content-length and chunked")
+        << QByteArray("POST / HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n") << 400;
+    QTest::newRow("repeated host") << QByteArray("GET / HTTP/1.1\r\nHost: a\r\nHost: b\r\n\r\n") << 400;
+    QTest::newRow("repeated transfer-encoding")
+        << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n\r\n") << 400;
+    QTest::newRow("unsupported transfer-encoding")
+        << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n") << 501;
+    QTest::newRow("gzip then chunked")
+        << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n0\r\n\r\n") << 501;
+    QTest::newRow("chunked as a suffix")
+        << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: xchunked\r\n\r\n0\r\n\r\n") << 501;
+    QTest::newRow("chunked twice")
+        << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: chunked, chunked\r\n\r\n0\r\n\r\n") << 501;
+    QTest::newRow("invalid chunk size")
+        << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n") << 400;
+    QTest::newRow("bad chunk terminator")
+        << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\naXX") << 400;
+    QTest::newRow("body too large") << QByteArray("POST / HTTP/1.1\r\nContent-Length: 2048\r\n\r\n") << 413;
+    QTest::newRow("headers too large")
+        << QByteArray("GET / HTTP/1.1\r\nX-Big: " + QByteArray(8192, 'a') + "\r\n\r\n") << 431;
+}
+
+void tst_HttpRequestParser::rejected()
+{
+    QFETCH(QByteArray, raw);
+    QFETCH(int, code);
+
+    HttpRequestParser parser;
+    parser.setMaxHeaderSize(4096);
+    parser.setMaxBodySize(1024);
+    parser.append(raw);
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Error);
+    QCOMPARE(parser.errorCode(), code);
+    // Дальше соединение ничего не разбирает
+    parser.append("GET / HTTP/1.1\r\n\r\n");
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Error);
+}
+
+void tst_HttpRequestParser::repeatedEqualContentLength()
+{
+    // Одинаковые значения границ не меняют (RFC 9112, 6.3)
+    HttpRequestParser parser;
+    parser.append("POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc");
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    QCOMPARE(parser.takeRequest().body, QByteArray("abc"));
+}
+
+void tst_HttpRequestParser::repeatedHeaders()
+{
+    // Повторы полей-списков объединяются (RFC 9110, 5.3), у остальных - первое значение
+    HttpRequestParser parser;
+    parser.append("GET / HTTP/1.1\r\nAccept-Encoding: gzip\r\nCookie: a=1\r\nUser-Agent: first\r\n"
+                  "X-Tag: one\r\nAccept-Encoding: br\r\nCookie: b=2\r\nUser-Agent: second\r\n"
+                  "X-Tag: two\r\n\r\n");
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+
+    QByteArray acceptEncoding, tags;
+    {
+        HttpRequest request = parser.takeRequest();
+        QCOMPARE(request.headers.valueView(HttpHeaders::AcceptEncoding), QByteArray("gzip, br"));
+        QCOMPARE(request.headers.value(HttpHeaders::Cookie), QByteArray("a=1; b=2"));
+        QCOMPARE(request.headers.value(HttpHeaders::UserAgent), QByteArray("first"));
+        acceptEncoding = request.headers.value(HttpHeaders::AcceptEncoding);
+        tags = request.headers.value(QByteArray("x-tag"));
+    }
+    // value() - копия, она переживает запрос и буфер парсера
+    parser.append(QByteArray(64 * 1024, 'x'));
+    QCOMPARE(acceptEncoding, QByteArray("gzip, br"));
+    QCOMPARE(tags, QByteArray("one, two"));
+}
+
+void tst_HttpRequestParser::takeBufferedData()
+{
+    // Upgrade: h2c - все после запроса принадлежит уже HTTP/2
+    HttpRequestParser parser;
+    parser.append("GET / HTTP/1.1\r\nUpgrade: h2c\r\n\r\nPRI * HTTP/2.0\r\n");
+    QCOMPARE(parser.parse(), HttpRequestParser::Status::Complete);
+    parser.takeRequest();
+    QCOMPARE(parser.peekBuffered(3), QByteArray("PRI"));
+    QCOMPARE(parser.takeBufferedData(), QByteArray("PRI * HTTP/2.0\r\n"));
+    QVERIFY(!parser.hasBufferedData());
+}
+
+QTEST_APPLESS_MAIN(tst_HttpRequestParser)
+
+#include "tst_httprequestparser.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_httprouter
+
+include(../test.pri)
+
+SOURCES += \
+        tst_httprouter.cpp
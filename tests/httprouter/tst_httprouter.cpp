@@ -0,0 +1,180 @@
+#include <QtTest>
+#include "httprouter.h"
+
+// Сопоставление путей radix-деревом: точный текст важнее :name, :name
+// важнее *; если ветка с точным текстом дальше не подошла, поиск
+// возвращается и пробует параметр и остаток пути.
+class tst_HttpRouter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void match_data();
+    void match();
+    void methods();
+    void invalidPatterns();
+    void decodedParam();
+    void addAfterCompile();
+
+private:
+    static RouteHandler handler() { return [](const HttpRequest &, const RouteParams &, const HttpResponderPtr &) {}; }
+
+    HttpRouter m_router;
+};
+
+void tst_HttpRouter::initTestCase()
+{
+    const QByteArray patterns[] = {
+        "/",
+        "/users/me",
+        "/users/:id",
+        "/users/:id/posts",
+        "/users/:id/posts/:post",
+        "/files/:name",
+        "/files/*path",
+        "/static/*",
+        "/a/b/d",
+        "/a/b/e",
+        "/a/:x/c",
+        "/api/db/:table",
+        "/api/*path",
+        "/search",
+        "/searchable"
+    };
+    for (const QByteArray &pattern : patterns)
+        QVERIFY2(m_router.add("GET", pattern, handler()), pattern.constData());
+    m_router.compile();
+    QVERIFY(m_router.isCompiled());
+}
+
+void tst_HttpRouter::match_data()
+{
+    QTest::addColumn<QByteArray>("target");
+    QTest::addColumn<QByteArray>("pattern");     // пустой - не найдено
+    QTest::addColumn<QByteArrayList>("values");
+
+    QTest::newRow("root") << QByteArray("/") << QByteArray("/") << QByteArrayList();
+    QTest::newRow("static over param") << QByteArray("/users/me") << QByteArray("/users/me") << QByteArrayList();
+    QTest::newRow("param") << QByteArray("/users/42") << QByteArray("/users/:id") << QByteArrayList{ "42" };
+    QTest::newRow("query dropped") << QByteArray("/users/42?full=1") << QByteArray("/users/:id")
+                                   << QByteArrayList{ "42" };
+    // "me" совпал с точной веткой, но у нее нет /posts - возврат к :id
+    QTest::newRow("backtrack from static") << QByteArray("/users/me/posts") << QByteArray("/users/:id/posts")
+                                           << QByteArrayList{ "me" };
+    QTest::newRow("two params") << QByteArray("/users/7/posts/9") << QByteArray("/users/:id/posts/:post")
+                                << QByteArrayList{ "7", "9" };
+    QTest::newRow("param over wildcard") << QByteArray("/files/a.txt") << QByteArray("/files/:name")
+                                         << QByteArrayList{ "a.txt" };
+    QTest::newRow("wildcard after param fails") << QByteArray("/files/a/b.txt") << QByteArray("/files/*path")
+                                                << QByteArrayList{ "a/b.txt" };
+    QTest::newRow("param needs a segment") << QByteArray("/files/") << QByteArray("/files/*path")
+                                           << QByteArrayList{ "" };
+    QTest::newRow("empty wildcard") << QByteArray("/static/") << QByteArray("/static/*") << QByteArrayList{ "" };
+    // Ветка "b/" точная, но за ней только d и e - возврат к :x
+    QTest::newRow("backtrack deep static") << QByteArray("/a/b/c") << QByteArray("/a/:x/c")
+                                           << QByteArrayList{ "b" };
+    QTest::newRow("deep static") << QByteArray("/a/b/e") << QByteArray("/a/b/e") << QByteArrayList();
+    QTest::newRow("param then wildcard sibling") << QByteArray("/api/db/users") << QByteArray("/api/db/:table")
+                                                 << QByteArrayList{ "users" };
+    QTest::newRow("wildcard sibling") << QByteArray("/api/db/users/1") << QByteArray("/api/*path")
+                                      << QByteArrayList{ "db/users/1" };
+    QTest::newRow("shared prefix short") << QByteArray("/search") << QByteArray("/search") << QByteArrayList();
+    QTest::newRow("shared prefix long") << QByteArray("/searchable") << QByteArray("/searchable")
+                                        << QByteArrayList();
+    QTest::newRow("prefix only") << QByteArray("/searc") << QByteArray() << QByteArrayList();
+    QTest::newRow("trailing slash") << QByteArray("/users/42/") << QByteArray() << QByteArrayList();
+    QTest::newRow("unknown") << QByteArray("/nothing") << QByteArray() << QByteArrayList();
+}
+
+void tst_HttpRouter::match()
+{
+    QFETCH(QByteArray, target);
+    QFETCH(QByteArray, pattern);
+    QFETCH(QByteArrayList, values);
+
+    RouteParams params;
+    const HttpRouter::Route *route = m_router.match("GET", target, params);
+    if (pattern.isEmpty()) {
+        QVERIFY(!route);
+        QCOMPARE(params.size(), 0);
+        return;
+    }
+    QVERIFY(route);
+    QCOMPARE(route->pattern, pattern);
+    QCOMPARE(params.size(), values.size());
+    for (int i = 0; i < values.size(); ++i)
+        QCOMPARE(params.value(i), values.at(i));
+}
+
+void tst_HttpRouter::methods()
+{
+    HttpRouter router;
+    QVERIFY(router.add("GET", "/items/:id", handler()));
+    QVERIFY(router.add("DELETE", "/items/:id", handler()));
+    QVERIFY(router.add("", "/any", handler()));
+    QVERIFY(router.add("", "/mixed", handler()));
+    QVERIFY(router.add("POST", "/mixed", handler()));
+    router.compile();
+
+    RouteParams params;
+    bool methodNotAllowed = false;
+    const HttpRouter::Route *route = router.match("DELETE", "/items/5", params, &methodNotAllowed);
+    QVERIFY(route);
+    QCOMPARE(route->method, QByteArray("DELETE"));
+    QCOMPARE(params.value("id"), QByteArray("5"));
+
+    QVERIFY(!router.match("PUT", "/items/5", params, &methodNotAllowed));
+    QVERIFY(methodNotAllowed);
+
+    QVERIFY(!router.match("PUT", "/missing", params, &methodNotAllowed));
+    QVERIFY(!methodNotAllowed);
+
+    route = router.match("PATCH", "/any", params, &methodNotAllowed);
+    QVERIFY(route);
+    QVERIFY(!methodNotAllowed);
+
+    // Маршрут для конкретного метода важнее маршрута для любого
+    QCOMPARE(router.match("POST", "/mixed", params)->method, QByteArray("POST"));
+    QCOMPARE(router.match("GET", "/mixed", params)->method, QByteArray());
+}
+
+void tst_HttpRouter::invalidPatterns()
+{
+    HttpRouter router;
+    QVERIFY(!router.add("GET", "relative", handler()));
+    QVERIFY(!router.add("GET", "/users/:", handler()));
+    QVERIFY(!router.add("GET", "/files/*path/more", handler()));
+    QVERIFY(!router.add("GET", "/:a/:b/:c/:d/:e/:f/:g/:h/:i", handler()));
+    QVERIFY(router.add("GET", "/users/:id", handler()));
+    QVERIFY(!router.add("GET", "/users/:name", handler()));
+    QVERIFY(router.add("POST", "/users/:name", handler()));
+
+    // Отклоненные шаблоны не оставили узлов в дереве
+    router.compile();
+    RouteParams params;
+    QVERIFY(!router.match("GET", "/files/x/more", params));
+    QVERIFY(!router.match("GET", "/relative", params));
+}
+
+void tst_HttpRouter::decodedParam()
+{
+    RouteParams params;
+    const HttpRouter::Route *route = m_router.match("GET", "/users/%D0%B8%D0%BC%D1%8F%20x", params);
+    QVERIFY(route);
+    QCOMPARE(params.name(0), QByteArray("id"));
+    QCOMPARE(params.value("id"), QByteArray("%D0%B8%D0%BC%D1%8F%20x"));
+    QCOMPARE(params.text("id"), QString::fromUtf8("имя x"));
+}
+
+void tst_HttpRouter::addAfterCompile()
+{
+    QVERIFY(!m_router.add("GET", "/late", handler()));
+    RouteParams params;
+    QVERIFY(!m_router.match("GET", "/late", params));
+}
+
+QTEST_APPLESS_MAIN(tst_HttpRouter)
+
+#include "tst_httprouter.moc"
@@ -0,0 +1,12 @@
+# Общее для тестов: QtTest и код сервера. Запуск всех: make tests в корне
+# (или qmake tests/tests.pro && make check)
+
+QT += core network testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../server.pri)
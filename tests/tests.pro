@@ -0,0 +1,8 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    hpack \
+    http2session \
+    httpconnection \
+    httprequestparser \
+    httprouter
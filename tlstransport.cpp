@@ -0,0 +1,426 @@
+#include "tlstransport.h"
+#include "metrics.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Максимальный открытый текст одной TLS-записи
+static const int TlsRecordSize = 16 * 1024;
+// Частей ответа в одном sendmsg при kTLS
+static const int MaxIov = 64;
+
+static const unsigned char SessionIdContext[] = "simple-http-server";
+
+namespace {
+
+QString sslErrors()
+{
+    QStringList errors;
+    while (unsigned long code = ERR_get_error()) {
+        char buffer[256];
+        ERR_error_string_n(code, buffer, sizeof(buffer));
+        errors << QString::fromLatin1(buffer);
+    }
+    return errors.join("; ");
+}
+
+// ALPN: первый протокол сервера, который предложил клиент
+int selectProtocol(SSL *, const unsigned char **out, unsigned char *outLength,
+                   const unsigned char *in, unsigned int inLength, void *)
+{
+    static const unsigned char protocols[] = "\x02h2\x08http/1.1";
+    unsigned char *selected = nullptr;
+    if (SSL_select_next_proto(&selected, outLength, protocols, sizeof(protocols) - 1, in, inLength)
+        != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+qint64 monotonicUs()
+{
+    static QElapsedTimer clock = []() { QElapsedTimer timer; timer.start(); return timer; }();
+    return clock.nsecsElapsed() / 1000;
+}
+
+}
+
+TlsContext::TlsContext(const Settings &settings) :
+    m_ctx(nullptr),
+    m_full(0),
+    m_resumed(0),
+    m_failures(0),
+    m_ktls(0),
+    m_handshakeUs(0)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        m_error = "SSL_CTX_new failed: " + sslErrors();
+        return;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, settings.minVersion == "1.3" ? TLS1_3_VERSION : TLS1_2_VERSION);
+    long options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE;
+    if (!settings.sessionTickets)
+        options |= SSL_OP_NO_TICKET;
+#ifdef SSL_OP_ENABLE_KTLS
+    if (settings.ktls)
+        options |= SSL_OP_ENABLE_KTLS;
+#endif
+    SSL_CTX_set_options(ctx, options);
+    // Неполная запись - как у обычного сокета; буферы простаивающих соединений освобождаются
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+                     | SSL_MODE_RELEASE_BUFFERS);
+
+    bool ok = true;
+    if (!settings.ciphers.isEmpty() && !SSL_CTX_set_cipher_list(ctx, settings.ciphers.toLatin1().constData())) {
+        m_error = "Invalid tls/ciphers: " + sslErrors();
+        ok = false;
+    }
+    if (ok && !settings.cipherSuites.isEmpty()
+        && !SSL_CTX_set_ciphersuites(ctx, settings.cipherSuites.toLatin1().constData())) {
+        m_error = "Invalid tls/ciphersuites: " + sslErrors();
+        ok = false;
+    }
+    if (ok && SSL_CTX_use_certificate_chain_file(ctx, settings.certificateFile.toLocal8Bit().constData()) != 1) {
+        m_error = "Failed to load certificate " + settings.certificateFile + ": " + sslErrors();
+        ok = false;
+    }
+    if (ok && (SSL_CTX_use_PrivateKey_file(ctx, settings.privateKeyFile.toLocal8Bit().constData(),
+                                           SSL_FILETYPE_PEM) != 1 || SSL_CTX_check_private_key(ctx) != 1)) {
+        m_error = "Failed to load private key " + settings.privateKeyFile + ": " + sslErrors();
+        ok = false;
+    }
+    if (!ok) {
+        SSL_CTX_free(ctx);
+        return;
+    }
+
+    // Возобновление: по id из кеша сервера (TLS 1.2, а в TLS 1.3 без ticket'ов -
+    // stateful ticket) или по session ticket, зашифрованному ключом контекста
+    SSL_CTX_set_session_id_context(ctx, SessionIdContext, sizeof(SessionIdContext) - 1);
+    if (settings.sessionCacheSize > 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, settings.sessionCacheSize);
+    } else {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+    SSL_CTX_set_timeout(ctx, settings.sessionTimeoutSec);
+
+    // Без h2 ALPN не нужен: клиент и так говорит HTTP/1.1
+    if (settings.http2)
+        SSL_CTX_set_alpn_select_cb(ctx, selectProtocol, nullptr);
+
+    m_ctx = ctx;
+}
+
+TlsContext::~TlsContext()
+{
+    if (m_ctx)
+        SSL_CTX_free(m_ctx);
+}
+
+void TlsContext::handshakeFinished(SSL *ssl, bool ktlsSend, qint64 elapsedUs)
+{
+    if (SSL_session_reused(ssl))
+        ++m_resumed;
+    else
+        ++m_full;
+    if (ktlsSend)
+        ++m_ktls;
+    m_handshakeUs += quint64(qMax<qint64>(0, elapsedUs));
+}
+
+TlsTransport::TlsTransport(TlsContext *context, qintptr socketDescriptor) :
+    m_context(context),
+    m_fd(int(socketDescriptor)),
+    m_ssl(nullptr),
+    m_readNotifier(nullptr),
+    m_writeNotifier(nullptr),
+    m_handshakeStarted(monotonicUs()),
+    m_handshakeDone(false),
+    m_ktlsSend(false),
+    m_closeWhenFlushed(false),
+    m_writeRetry(false),
+    m_queued(0)
+{
+    // Весь ввод-вывод - через OpenSSL на неблокирующем сокете
+    ::fcntl(m_fd, F_SETFL, ::fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    int on = 1;
+    ::setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (::getpeername(m_fd, reinterpret_cast<sockaddr *>(&address), &length) == 0)
+        m_peer = QHostAddress(reinterpret_cast<sockaddr *>(&address));
+
+    m_ssl = SSL_new(m_context->handle());
+    if (!m_ssl || SSL_set_fd(m_ssl, m_fd) != 1) {
+        qWarning() << "Failed to create TLS session:" << sslErrors();
+        ::close(m_fd);
+        m_fd = -1;
+        return;
+    }
+    SSL_set_accept_state(m_ssl);
+
+    m_readNotifier = new QSocketNotifier(m_fd, QSocketNotifier::Read);
+    QObject::connect(m_readNotifier, &QSocketNotifier::activated, m_readNotifier, [this]() { onReadable(); });
+    m_writeNotifier = new QSocketNotifier(m_fd, QSocketNotifier::Write);
+    m_writeNotifier->setEnabled(false);
+    QObject::connect(m_writeNotifier, &QSocketNotifier::activated, m_writeNotifier, [this]() { onWritable(); });
+}
+
+TlsTransport::~TlsTransport()
+{
+    delete m_readNotifier;
+    delete m_writeNotifier;
+    if (m_ssl)
+        SSL_free(m_ssl);
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+void TlsTransport::onReadable()
+{
+    if (!m_handshakeDone && !handshake())
+        return;
+    readDecrypted();
+    // SSL_write мог ждать чтения (KeyUpdate в TLS 1.3)
+    if (m_fd >= 0 && m_writeRetry) {
+        qint64 sent = flush();
+        if (sent > 0 && m_handler)
+            m_handler->transportBytesWritten(sent);
+    }
+}
+
+void TlsTransport::onWritable()
+{
+    if (!m_handshakeDone) {
+        // ClientHello мог прийти вместе с запросом - он уже в буфере OpenSSL
+        if (handshake())
+            readDecrypted();
+        return;
+    }
+
+    qint64 sent = flush();
+    if (sent > 0 && m_handler)
+        m_handler->transportBytesWritten(sent);
+}
+
+bool TlsTransport::handshake()
+{
+    ERR_clear_error();
+    int result = SSL_do_handshake(m_ssl);
+    if (result == 1) {
+        m_handshakeDone = true;
+#ifdef BIO_get_ktls_send
+        m_ktlsSend = BIO_get_ktls_send(SSL_get_wbio(m_ssl));
+#endif
+        m_context->handshakeFinished(m_ssl, m_ktlsSend, monotonicUs() - m_handshakeStarted);
+        m_writeNotifier->setEnabled(false);
+        return true;
+    }
+
+    int error = SSL_get_error(m_ssl, result);
+    if (error == SSL_ERROR_WANT_READ) {
+        m_writeNotifier->setEnabled(false);
+        return false;
+    }
+    if (error == SSL_ERROR_WANT_WRITE) {
+        m_writeNotifier->setEnabled(true);
+        return false;
+    }
+
+    // Сканеры, клиенты без общих шифров, чужой протокол на порту
+    m_context->handshakeFailed();
+    qDebug() << "TLS handshake failed with" << m_peer << ":" << sslErrors();
+    closeSocket();
+    return false;
+}
+
+void TlsTransport::readDecrypted()
+{
+    bool closed = false;
+    char buffer[TlsRecordSize];
+    while (true) {
+        ERR_clear_error();
+        int received = SSL_read(m_ssl, buffer, sizeof(buffer));
+        if (received > 0) {
+            m_unread.append(buffer, received);
+            continue;
+        }
+        int error = SSL_get_error(m_ssl, received);
+        if (error == SSL_ERROR_WANT_READ)
+            break;
+        if (error == SSL_ERROR_WANT_WRITE) {
+            m_writeNotifier->setEnabled(true);
+            break;
+        }
+        // close_notify, обрыв или ошибка протокола
+        closed = true;
+        break;
+    }
+
+    if (!m_unread.isEmpty() && m_handler)
+        m_handler->transportReadyRead();
+    if (closed && m_fd >= 0)
+        closeSocket();
+}
+
+QByteArray TlsTransport::readAll()
+{
+    QByteArray data;
+    data.swap(m_unread);
+    return data;
+}
+
+void TlsTransport::write(const HttpBody *parts, int count)
+{
+    if (m_fd < 0 || m_closeWhenFlushed) return;
+
+    for (int i = 0; i < count; ++i) {
+        if (parts[i].isEmpty()) continue;
+        m_queue.push_back(parts[i]);
+        m_queued += parts[i].size();
+    }
+
+    // Отправленное сразу считаем здесь, bytesWritten - только для досланного по готовности
+    qint64 sent = flush();
+    if (sent > 0)
+        Metrics::global().bytesSent(sent);
+}
+
+qint64 TlsTransport::flush()
+{
+    if (!m_handshakeDone) return 0;
+
+    qint64 total = 0;
+    while (m_fd >= 0 && !m_queue.empty()) {
+        qint64 sent;
+        if (m_ktlsSend) {
+            // Записи режет и шифрует ядро - очередь уходит одним вызовом, как у открытого сокета
+            iovec iov[MaxIov];
+            int count = 0;
+            for (auto it = m_queue.begin(); it != m_queue.end() && count < MaxIov; ++it, ++count) {
+                iov[count].iov_base = const_cast<char *>(it->constData());
+                iov[count].iov_len = size_t(it->size());
+            }
+            msghdr message;
+            std::memset(&message, 0, sizeof(message));
+            message.msg_iov = iov;
+            message.msg_iovlen = size_t(count);
+            sent = ::sendmsg(m_fd, &message, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    closeSocket();
+                    return -1;
+                }
+                m_writeNotifier->setEnabled(true);
+                break;
+            }
+        } else {
+            // Заголовки, хвост и короткое тело - одной записью и одним send, а не тремя.
+            // Повтор SSL_write после WANT_* - строго с теми же данными, поэтому без склейки
+            if (!m_writeRetry && m_queue.size() > 1 && m_queue.front().size() < TlsRecordSize) {
+                QByteArray merged;
+                merged.reserve(TlsRecordSize);
+                while (!m_queue.empty() && merged.size() + m_queue.front().size() <= TlsRecordSize) {
+                    merged.append(m_queue.front().constData(), m_queue.front().size());
+                    m_queue.pop_front();
+                }
+                if (!merged.isEmpty())
+                    m_queue.push_front(HttpBody(merged));
+            }
+
+            const HttpBody &front = m_queue.front();
+            ERR_clear_error();
+            int written = SSL_write(m_ssl, front.constData(), front.size());
+            if (written <= 0) {
+                int error = SSL_get_error(m_ssl, written);
+                if (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) {
+                    m_writeRetry = true;
+                    m_writeNotifier->setEnabled(error == SSL_ERROR_WANT_WRITE);
+                    break;
+                }
+                closeSocket();
+                return -1;
+            }
+            m_writeRetry = false;
+            sent = written;
+        }
+
+        total += sent;
+        m_queued -= sent;
+        while (sent > 0) {
+            HttpBody &front = m_queue.front();
+            if (sent >= front.size()) {
+                sent -= front.size();
+                m_queue.pop_front();
+            } else {
+                front = front.mid(int(sent), front.size() - int(sent));
+                sent = 0;
+            }
+        }
+    }
+
+    if (m_fd >= 0 && m_queue.empty()) {
+        m_writeNotifier->setEnabled(false);
+        if (m_closeWhenFlushed)
+            shutdownAndClose();
+    }
+    return total;
+}
+
+void TlsTransport::disconnectFromHost()
+{
+    if (m_fd < 0) return;
+    if (m_queue.empty() || !m_handshakeDone) {
+        shutdownAndClose();
+        return;
+    }
+    // Закроем, когда уйдет очередь
+    m_closeWhenFlushed = true;
+    m_writeNotifier->setEnabled(true);
+}
+
+void TlsTransport::abort()
+{
+    if (m_fd < 0) return;
+    closeSocket();
+}
+
+void TlsTransport::shutdownAndClose()
+{
+    // close_notify без ожидания ответа клиента: соединение все равно закрываем
+    if (m_handshakeDone)
+        SSL_shutdown(m_ssl);
+    closeSocket();
+}
+
+void TlsTransport::closeSocket()
+{
+    // Уведомители удаляются вместе с транспортом: сейчас мы можем быть внутри их сигнала
+    m_readNotifier->setEnabled(false);
+    m_writeNotifier->setEnabled(false);
+    ::close(m_fd);
+    m_fd = -1;
+    m_queue.clear();
+    m_queued = 0;
+    m_unread.clear();
+    ERR_clear_error();
+    if (m_handler)
+        m_handler->transportClosed();
+}
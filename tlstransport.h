@@ -0,0 +1,133 @@
+#ifndef TLSTRANSPORT_H
+#define TLSTRANSPORT_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QString>
+#include <QTcpServer>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include "httptransport.h"
+
+class QSocketNotifier;
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+
+// Общий для всех HTTPS-соединений контекст OpenSSL: сертификат, шифры,
+// кеш сессий и ключи session ticket'ов. Один на сервер, поэтому
+// вернувшийся клиент возобновляет сессию в любом воркере без полного
+// рукопожатия. С kTLS (OpenSSL 3 и модуль tls ядра) после рукопожатия
+// шифрует ядро: запись в сокет и sendfile идут мимо OpenSSL. Протокол
+// выбирается через ALPN: h2, если включен HTTP/2, иначе http/1.1.
+class TlsContext
+{
+public:
+    struct Settings
+    {
+        QString certificateFile;   // PEM, сертификат с цепочкой
+        QString privateKeyFile;    // PEM
+        QString ciphers;           // TLS 1.2, формат OpenSSL; пустой - по умолчанию
+        QString cipherSuites;      // TLS 1.3; пустой - по умолчанию
+        QString minVersion = "1.2";
+        int sessionCacheSize = 20480; // 0 - без кеша сессий на сервере
+        int sessionTimeoutSec = 300;
+        bool sessionTickets = true;
+        bool ktls = true;
+        bool http2 = false;        // предлагать h2 через ALPN
+    };
+
+    explicit TlsContext(const Settings &settings);
+    ~TlsContext();
+
+    bool isValid() const { return m_ctx != nullptr; }
+    QString errorString() const { return m_error; }
+    SSL_CTX *handle() const { return m_ctx; }
+
+    // Учет рукопожатий (из потоков воркеров)
+    void handshakeFinished(SSL *ssl, bool ktlsSend, qint64 elapsedUs);
+    void handshakeFailed() { ++m_failures; }
+
+    quint64 fullHandshakes() const { return m_full.load(); }
+    quint64 resumedHandshakes() const { return m_resumed.load(); }
+    quint64 failedHandshakes() const { return m_failures.load(); }
+    quint64 ktlsConnections() const { return m_ktls.load(); }
+    // Суммарное время рукопожатий, секунды
+    double handshakeSeconds() const { return double(m_handshakeUs.load()) / 1e6; }
+
+private:
+    SSL_CTX *m_ctx;
+    QString m_error;
+    std::atomic<quint64> m_full;
+    std::atomic<quint64> m_resumed;
+    std::atomic<quint64> m_failures;
+    std::atomic<quint64> m_ktls;
+    std::atomic<quint64> m_handshakeUs;
+};
+
+// HTTPS-соединение поверх своего дескриптора: OpenSSL читает и пишет
+// сокет сам, готовность - через QSocketNotifier в потоке воркера.
+// Работает при любом server/io_engine. Мелкие части ответа (заголовки,
+// хвост, короткое тело) склеиваются в одну TLS-запись; с kTLS очередь
+// уходит одним sendmsg, как у EpollTransport, и sendfile тоже разрешен.
+class TlsTransport : public HttpTransport
+{
+public:
+    TlsTransport(TlsContext *context, qintptr socketDescriptor);
+    ~TlsTransport();
+
+    bool isOpen() const override { return m_fd >= 0; }
+    qintptr socketDescriptor() const override { return m_fd; }
+    bool allowsDirectWrite() const override { return m_ktlsSend; }
+    bool isEncrypted() const override { return true; }
+    QHostAddress peerAddress() const override { return m_peer; }
+    QByteArray readAll() override;
+    void write(const HttpBody *parts, int count) override;
+    using HttpTransport::write;
+    qint64 bytesToWrite() const override { return m_queued; }
+    void disconnectFromHost() override;
+    void abort() override;
+
+private:
+    void onReadable();
+    void onWritable();
+    bool handshake();
+    void readDecrypted();
+    // Отправить очередь; сколько байт ушло (-1 - соединение закрыто из-за ошибки)
+    qint64 flush();
+    void shutdownAndClose();
+    void closeSocket();
+
+    TlsContext *m_context;
+    int m_fd;
+    SSL *m_ssl;
+    QHostAddress m_peer;
+    QSocketNotifier *m_readNotifier;
+    QSocketNotifier *m_writeNotifier;
+    qint64 m_handshakeStarted;    // мкс монотонных часов
+    bool m_handshakeDone;
+    bool m_ktlsSend;
+    bool m_closeWhenFlushed;
+    bool m_writeRetry;            // SSL_write вернул WANT_*, первая часть очереди ждет повтора
+    QByteArray m_unread;
+    std::deque<HttpBody> m_queue;
+    qint64 m_queued;
+};
+
+// Слушающий сокет HTTPS: принятые дескрипторы отдает серверу, дальше - как у HTTP
+class TlsListener : public QTcpServer
+{
+public:
+    typedef std::function<void(qintptr socketDescriptor)> ConnectionHandler;
+
+    explicit TlsListener(ConnectionHandler onConnection, QObject *parent = nullptr) :
+        QTcpServer(parent), m_onConnection(std::move(onConnection)) {}
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override { m_onConnection(socketDescriptor); }
+
+private:
+    ConnectionHandler m_onConnection;
+};
+
+#endif // TLSTRANSPORT_H